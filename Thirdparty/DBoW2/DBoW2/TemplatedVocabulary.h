@@ -3,6 +3,8 @@
  * Added functions: Save and Load from text files without using cv::FileStorage.
  * Date: August 2015
  * Raúl Mur-Artal
+ *
+ * Added functions: Save and Load from memory mapped binary files.
  */
 
 /**
@@ -26,6 +28,13 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <cstring>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -246,6 +255,23 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is memory mapped and the node descriptors point directly into
+   * the mapped pages, so the mapping lives as long as the vocabulary.
+   * @param filename
+   * @return false if the file could not be mapped or is not a valid
+   *   binary vocabulary
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file that can be memory mapped
+   * @param filename
+   * @note descriptors must be cv::Mat of F::L bytes, e.g. FORB
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -401,7 +427,50 @@ protected:
    * @param features
    */
   void setNodeWeights(const vector<vector<TDescriptor> > &features);
-  
+
+  /**
+   * Unmaps the file mapped by loadFromBinaryFile, if any. Node descriptors
+   * must not be used after this call until the nodes are rebuilt
+   */
+  void releaseMapping();
+
+protected:
+
+  /// Header of the binary vocabulary file. It is followed by these arrays,
+  /// in this order: weights (double, nodes), parents (uint32_t, nodes),
+  /// word ids (uint32_t, nodes, leaves only), child offsets (uint32_t,
+  /// nodes + 1), child ids (uint32_t, children), word nodes (uint32_t, words),
+  /// and descriptors (desc_bytes each, nodes) starting at a 32 byte boundary
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint32_t desc_bytes;
+    uint32_t nodes;
+    uint32_t words;
+    uint32_t children;
+    uint32_t reserved[2];
+  };
+
+  /// Offsets in bytes of the arrays following the binary header
+  struct BinaryLayout
+  {
+    size_t weights;
+    size_t parents;
+    size_t word_ids;
+    size_t child_offsets;
+    size_t child_ids;
+    size_t word_nodes;
+    size_t descriptors;
+    size_t total;
+  };
+
+  static void getBinaryLayout(const BinaryHeader &h, BinaryLayout &layout);
+
 protected:
 
   /// Branching factor
@@ -425,6 +494,12 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary vocabulary file mapped by loadFromBinaryFile, NULL otherwise
+  unsigned char *m_mapped_data;
+
+  /// Length in bytes of the mapped file
+  size_t m_mapped_size;
   
 };
 
@@ -434,7 +509,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_mapped_data(NULL), m_mapped_size(0)
 {
   createScoringObject();
 }
@@ -443,7 +518,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL),
+  m_mapped_data(NULL), m_mapped_size(0)
 {
   load(filename);
 }
@@ -452,7 +528,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL),
+  m_mapped_data(NULL), m_mapped_size(0)
 {
   load(filename);
 }
@@ -516,7 +593,7 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_mapped_data(NULL), m_mapped_size(0)
 {
   *this = voc;
 }
@@ -527,6 +604,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::~TemplatedVocabulary()
 {
   delete m_scoring_object;
+  releaseMapping();
 }
 
 // --------------------------------------------------------------------------
@@ -548,6 +626,15 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
+
+  // descriptors of a mapped vocabulary do not own their data
+  if(voc.m_mapped_data != NULL)
+  {
+    typename vector<Node>::iterator nit;
+    for(nit = this->m_nodes.begin(); nit != this->m_nodes.end(); ++nit)
+      nit->descriptor = nit->descriptor.clone();
+  }
+  this->releaseMapping();
   
   return *this;
 }
@@ -1345,6 +1432,7 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    releaseMapping();
 
     string s;
     getline(f,s);
@@ -1450,6 +1538,222 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::getBinaryLayout(
+  const BinaryHeader &h, BinaryLayout &layout)
+{
+  layout.weights = sizeof(BinaryHeader);
+  layout.parents = layout.weights + sizeof(double) * h.nodes;
+  layout.word_ids = layout.parents + sizeof(uint32_t) * h.nodes;
+  layout.child_offsets = layout.word_ids + sizeof(uint32_t) * h.nodes;
+  layout.child_ids = layout.child_offsets +
+    sizeof(uint32_t) * ((size_t)h.nodes + 1);
+  layout.word_nodes = layout.child_ids + sizeof(uint32_t) * h.children;
+  layout.descriptors = (layout.word_nodes + sizeof(uint32_t) * h.words + 31)
+    & ~(size_t)31;
+  layout.total = layout.descriptors + (size_t)h.desc_bytes * h.nodes;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::releaseMapping()
+{
+  if(m_mapped_data != NULL)
+  {
+    munmap(m_mapped_data, m_mapped_size);
+    m_mapped_data = NULL;
+    m_mapped_size = 0;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(
+  const std::string &filename) const
+{
+  BinaryHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "DBOW2BIN", 8);
+  h.version = 1;
+  h.k = m_k;
+  h.L = m_L;
+  h.scoring = m_scoring;
+  h.weighting = m_weighting;
+  h.desc_bytes = F::L;
+  h.nodes = m_nodes.size();
+  h.words = m_words.size();
+
+  vector<double> weights(m_nodes.size());
+  vector<uint32_t> parents(m_nodes.size());
+  vector<uint32_t> word_ids(m_nodes.size());
+  vector<uint32_t> child_offsets(m_nodes.size() + 1, 0);
+  vector<uint32_t> child_ids;
+  child_ids.reserve(m_nodes.size());
+
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    const Node &node = m_nodes[i];
+    weights[i] = node.weight;
+    parents[i] = node.parent;
+    word_ids[i] = node.isLeaf() ? node.word_id : 0;
+    child_offsets[i] = child_ids.size();
+    child_ids.insert(child_ids.end(), node.children.begin(),
+      node.children.end());
+  }
+  child_offsets[m_nodes.size()] = child_ids.size();
+  h.children = child_ids.size();
+
+  vector<uint32_t> word_nodes(m_words.size());
+  for(size_t i = 0; i < m_words.size(); ++i)
+    word_nodes[i] = m_words[i]->id;
+
+  BinaryLayout layout;
+  getBinaryLayout(h, layout);
+
+  ofstream f(filename.c_str(), ios_base::out | ios_base::binary);
+  if(!f.is_open()) return false;
+
+  f.write((const char*)&h, sizeof(h));
+  f.write((const char*)&weights[0], sizeof(double) * weights.size());
+  f.write((const char*)&parents[0], sizeof(uint32_t) * parents.size());
+  f.write((const char*)&word_ids[0], sizeof(uint32_t) * word_ids.size());
+  f.write((const char*)&child_offsets[0],
+    sizeof(uint32_t) * child_offsets.size());
+  if(!child_ids.empty())
+    f.write((const char*)&child_ids[0], sizeof(uint32_t) * child_ids.size());
+  if(!word_nodes.empty())
+    f.write((const char*)&word_nodes[0],
+      sizeof(uint32_t) * word_nodes.size());
+
+  const size_t padding = layout.descriptors - (layout.word_nodes +
+    sizeof(uint32_t) * word_nodes.size());
+  const char zeros[32] = {0};
+  f.write(zeros, padding);
+
+  // the root has no descriptor, write zeros in its place
+  vector<char> empty_descriptor(F::L, 0);
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    const TDescriptor &d = m_nodes[i].descriptor;
+    if(d.empty())
+      f.write(&empty_descriptor[0], F::L);
+    else
+      f.write((const char*)d.data, F::L);
+  }
+
+  return f.good();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(
+  const std::string &filename)
+{
+  m_words.clear();
+  m_nodes.clear();
+  releaseMapping();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BinaryHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps its own reference to the file
+  if(addr == MAP_FAILED) return false;
+
+  m_mapped_data = (unsigned char*)addr;
+  m_mapped_size = st.st_size;
+
+  const BinaryHeader &h = *(const BinaryHeader*)m_mapped_data;
+  BinaryLayout layout;
+  getBinaryLayout(h, layout);
+
+  if(memcmp(h.magic, "DBOW2BIN", 8) != 0 || h.version != 1 ||
+    h.desc_bytes != (uint32_t)F::L || h.nodes == 0 ||
+    layout.total > m_mapped_size)
+  {
+    std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+    releaseMapping();
+    return false;
+  }
+
+  // the tree is walked from the root for every feature, ask the kernel to
+  // fault the pages in ahead of the first transform
+  madvise(m_mapped_data, m_mapped_size, MADV_WILLNEED);
+
+  const double *weights = (const double*)(m_mapped_data + layout.weights);
+  const uint32_t *parents = (const uint32_t*)(m_mapped_data + layout.parents);
+  const uint32_t *word_ids = (const uint32_t*)(m_mapped_data + layout.word_ids);
+  const uint32_t *child_offsets =
+    (const uint32_t*)(m_mapped_data + layout.child_offsets);
+  const uint32_t *child_ids =
+    (const uint32_t*)(m_mapped_data + layout.child_ids);
+  const uint32_t *word_nodes =
+    (const uint32_t*)(m_mapped_data + layout.word_nodes);
+  unsigned char *descriptors = m_mapped_data + layout.descriptors;
+
+  // the arrays index each other, check every index before following it.
+  // Children come after their parent, so that the tree has no cycles
+  bool valid = child_offsets[0] == 0 && child_offsets[h.nodes] == h.children;
+  for(uint32_t i = 0; valid && i < h.nodes; ++i)
+  {
+    valid = parents[i] < h.nodes &&
+      child_offsets[i] <= child_offsets[i+1] &&
+      child_offsets[i+1] <= h.children;
+    for(uint32_t j = child_offsets[i]; valid && j < child_offsets[i+1]; ++j)
+      valid = child_ids[j] > i && child_ids[j] < h.nodes;
+    if(valid && i > 0 && child_offsets[i] == child_offsets[i+1])
+      valid = word_ids[i] < h.words; // a leaf
+  }
+  for(uint32_t i = 0; valid && i < h.words; ++i)
+    valid = word_nodes[i] < h.nodes && word_ids[word_nodes[i]] == i &&
+      child_offsets[word_nodes[i]] == child_offsets[word_nodes[i]+1];
+
+  if(!valid)
+  {
+    std::cerr << "Vocabulary loading failure: The binary file is corrupted!" << endl;
+    releaseMapping();
+    return false;
+  }
+
+  m_k = h.k;
+  m_L = h.L;
+  m_scoring = (ScoringType)h.scoring;
+  m_weighting = (WeightingType)h.weighting;
+  createScoringObject();
+
+  m_nodes.resize(h.nodes);
+  for(uint32_t i = 0; i < h.nodes; ++i)
+  {
+    Node &node = m_nodes[i];
+    node.id = i;
+    node.parent = parents[i];
+    node.weight = weights[i];
+    node.word_id = word_ids[i];
+    node.children.assign(child_ids + child_offsets[i],
+      child_ids + child_offsets[i+1]);
+    if(i > 0) // the root has no descriptor
+      node.descriptor = cv::Mat(1, F::L, CV_8U, descriptors + i * F::L);
+  }
+
+  m_words.resize(h.words);
+  for(uint32_t i = 0; i < h.words; ++i)
+    m_words[i] = &m_nodes[word_nodes[i]];
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1575,6 +1879,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  releaseMapping();
   
   cv::FileNode fvoc = fs[name];
   
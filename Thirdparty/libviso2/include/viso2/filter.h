@@ -40,7 +40,8 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #endif
 
 // fast filters: implements 3x3 and 5x5 sobel filters and 
-//               5x5 blob and corner filters based on SSE2/3 instructions
+//               5x5 blob and corner filters based on SSE2/3 instructions,
+//               the 5x5 filters use AVX2 kernels if the CPU supports them (see simd.h)
 namespace filter {
   
   // private namespace, public user functions at the bottom of this file
@@ -75,6 +76,9 @@ namespace filter {
     void convolve_row_p1p1p0m1m1_5x5( const int16_t* in, int16_t* out, int w, int h );
     
     void convolve_cols_3x3( const unsigned char* in, int16_t* out_v, int16_t* out_h, int w, int h );
+    
+    // blob5x5 response computed from the integral image of in
+    void blob5x5_from_integral( const uint8_t* in, const int32_t* integral, int16_t* out, int w, int h );
   }
   
   void sobel3x3( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h );
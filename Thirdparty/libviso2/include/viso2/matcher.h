@@ -30,6 +30,7 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include <emmintrin.h>
 #include <algorithm>
 #include <vector>
+#include <functional>
 #include "p_match.h"
 #include "matrix.h"
 namespace libviso2{
@@ -56,6 +57,9 @@ public:
     int32_t multi_stage;            // 0=disabled,1=multistage matching (denser and faster)
     int32_t half_resolution;        // 0=disabled,1=match at half resolution, refine at full resolution
     int32_t refinement;             // refinement (0=none,1=pixel,2=subpixel)
+    int32_t parallel;               // 0=disabled,1=compute features of left and right images concurrently (see setParallelFor)
+    double  prior_sigma;            // with a motion covariance, flow search windows span prior_sigma standard deviations
+    int32_t prior_min_radius;       // ... plus prior_min_radius pixels around the predicted positions
     double  f,cu,cv,base;           // calibration (only for match prediction)
     
     // default settings
@@ -70,6 +74,9 @@ public:
       multi_stage            = 1;
       half_resolution        = 1;
       refinement             = 1;
+      parallel               = 1;
+      prior_sigma            = 3;
+      prior_min_radius       = 5;
     }    
   };
 
@@ -78,7 +85,24 @@ public:
 
   // deconstructor
   ~Matcher();
+
+  // time spent in the stages of the last pushBack, in milliseconds, index 0 for
+  // the left image and 1 for the right image, which overlap if param.parallel is set
+  struct timing {
+    double copy[2];       // copy to aligned memory
+    double filter[2];     // sobel, blob and checkerboard filters
+    double nms[2];        // non-maximum suppression, sparse and dense
+    double descriptor[2]; // descriptors of sparse and dense maxima
+    double total;
+    timing () { memset(this,0,sizeof(timing)); }
+  };
   
+  // runs task(i) for i in [0,n), possibly concurrently, and returns when all are done,
+  // e.g. ORB_SLAM::ThreadPool::ParallelFor. pushBack computes the features of the left
+  // and right images with it if param.parallel is set, without one they run serially
+  typedef std::function<void (size_t,const std::function<void (size_t)>&)> ParallelFor;
+  void setParallelFor(const ParallelFor &parallel_for) { this->parallel_for = parallel_for; }
+
   // intrinsics
   void setIntrinsics(double f,double cu,double cv,double base) {
     param.f = f;
@@ -99,6 +123,13 @@ public:
   //                         to the previous image (ring buffer functionality, descriptors need
   //                         to be computed only once)    
   void pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace);
+
+  // same as above with the half resolution images I1_half, I2_half computed by the caller as 2x2 means
+  // rounded down, of dims[0]/2 x dims[1]/2 pixels and bpl_half bytes per line. If bpl_half is the width
+  // rounded up to a multiple of 16 and the padding bytes are zero they are filtered in place, otherwise copied.
+  // They are only used if param.half_resolution is set, and only during the call
+  void pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace,
+                 uint8_t *I1_half,uint8_t *I2_half,int32_t bpl_half);
   
   // computes features from a single image and pushes it back to a ringbuffer,
   // which interally stores the features of the current and previous image pair
@@ -110,12 +141,27 @@ public:
   // input: method ... 0 = flow, 1 = stereo, 2 = quad matching
   //        Tr_delta: uses motion from previous frame to better search for
   //                  matches, if specified
-  void matchFeatures(int32_t method, const Matrix *Tr_delta = 0);
+  //        Tr_delta_cov: 6x6 covariance of the error of Tr_delta, as a rotation and translation
+  //                      applied on its left, if specified the quad matching searches the
+  //                      previous to current image only in windows around the predicted positions
+  void matchFeatures(int32_t method, const Matrix *Tr_delta = 0, const Matrix *Tr_delta_cov = 0);
 
   // feature bucketing: keeps only max_features per bucket, where the domain
   // is split into buckets of size (bucket_width,bucket_height)
   void bucketFeatures(int32_t max_features,float bucket_width,float bucket_height);
 
+  // quad matching, bucketing and stereo matching in one call, with the same results as
+  // matchFeatures(2,Tr_delta), getMatches(), bucketFeatures(...), getMatches(), matchFeatures(1), getMatches()
+  // the bin index vectors of the features are built once per matching pass for both methods, and the searches
+  // from the current right to the current left image are shared when they have the same search range (no prior)
+  // output: quad_matched ..... quad matches, empty if there is no previous frame
+  //         bucketed ......... bucketed subset of quad_matched
+  //         stereo_matched ... stereo matches of the current frame
+  // the matches are swapped into the outputs, getMatches() is empty afterwards
+  void matchQuadAndStereo(std::vector<p_match> &quad_matched,std::vector<p_match> &bucketed,std::vector<p_match> &stereo_matched,
+                          int32_t max_features,float bucket_width,float bucket_height,
+                          const Matrix *Tr_delta = 0,const Matrix *Tr_delta_cov = 0);
+
   // return vector with matched feature points and indices
   std::vector<p_match> getMatches() { return p_matched_2; }
 
@@ -141,6 +187,10 @@ public:
       else
           return n2c1;
   }
+  const timing& getTiming() const { return push_back_timing; }
+
+  // number of descriptor comparisons of the last matchFeatures or matchQuadAndStereo
+  int64_t getNumComparisons() const { return num_comparisons; }
 private:
 
   // structure for storing interest points
@@ -162,6 +212,30 @@ private:
     float v_max[4];
   };
   
+  // 16-byte aligned buffers of one image, the features computed from it and the
+  // scratch images used to compute them, they are reused from frame to frame and only
+  // reallocated if the image size grows
+  struct image_buffers {
+    uint8_t *I,*I_du,*I_dv,*I_du_full,*I_dv_full,*I_half;
+    int16_t *I_f1,*I_f2;
+    int32_t *max1,*max2;      // sparse and dense maxima
+    int32_t num1,num2;
+    size_t  size_I,size_du,size_dv,size_du_full,size_dv_full,size_half,size_f1,size_f2,size_max1,size_max2; // allocated bytes
+    image_buffers () { memset(this,0,sizeof(image_buffers)); }
+    void release ();
+  };
+
+  // bin index vectors of the four feature sets of a matching pass, for efficient search, and
+  // the left feature matched to each current right feature (i1c_of_i2c, -1 if not searched yet)
+  // when it is shared by the quad and stereo matching of matchQuadAndStereo()
+  struct match_index {
+    int32_t u_bin_num,v_bin_num;
+    std::vector<int32_t> *k1p,*k2p,*k1c,*k2c;
+    std::vector<int32_t> i1c_of_i2c;
+    match_index () : u_bin_num(0),v_bin_num(0),k1p(0),k2p(0),k1c(0),k2c(0) {}
+    ~match_index () { delete []k1p; delete []k2p; delete []k1c; delete []k2c; }
+  };
+
   struct delta {
     float val[8];
     delta () {}
@@ -178,6 +252,8 @@ private:
 
   // Alexander Neubeck and Luc Van Gool: Efficient Non-Maximum Suppression, ICPR'06, algorithm 4
   void nonMaximumSuppression (int16_t* I_f1,int16_t* I_f2,const int32_t* dims,std::vector<Matcher::maximum> &maxima,int32_t nms_n);
+  // same maxima in the same order, from the block and window extrema of the AVX2 kernels in simd.h
+  void nonMaximumSuppressionAVX2 (int16_t* I_f1,int16_t* I_f2,const int32_t* dims,std::vector<Matcher::maximum> &maxima,int32_t nms_n);
 
   // descriptor functions
   inline uint8_t saturate(int16_t in);
@@ -188,30 +264,45 @@ private:
   void computeDescriptors (uint8_t* I_du,uint8_t* I_dv,const int32_t bpl,std::vector<Matcher::maximum> &maxima);
   
   void getHalfResolutionDimensions(const int32_t *dims,int32_t *dims_half);
-  uint8_t* createHalfResolutionImage(uint8_t *I,const int32_t* dims);
-
-  // compute sparse set of features from image
-  // inputs:  I ........ image
-  //          dims ..... image dimensions [width,height]
-  //          n ........ non-max neighborhood
-  //          tau ...... non-max threshold
-  // outputs: max ...... vector with maxima [u,v,value,class,descriptor (128 bits)]
-  //          I_du ..... gradient in horizontal direction
-  //          I_dv ..... gradient in vertical direction
-  // WARNING: max,I_du,I_dv has to be freed by yourself!
-  // max1 sparse descriptors, max2 dense descriptors, each 16byte aligned memory, descriptor is acctually 4x8x8=256 bits
-  void computeFeatures (uint8_t *I,const int32_t* dims,int32_t* &max1,int32_t &num1,int32_t* &max2,int32_t &num2,uint8_t* &I_du,uint8_t* &I_dv,uint8_t* &I_du_full,uint8_t* &I_dv_full);
+  void createHalfResolutionImage(uint8_t *I,const int32_t* dims,uint8_t* I_half);
+
+  // copies image I with bpl bytes per line into buf.I, of dimensions dims_c, and
+  // computes its sparse set of features
+  // outputs: buf.max1 ..... sparse maxima [u,v,value,class,descriptor]
+  //          buf.max2 ..... dense maxima, descriptor is acctually 4x8x8=256 bits
+  //          buf.I_du ..... gradient in horizontal direction
+  //          buf.I_dv ..... gradient in vertical direction
+  //          buf.I_du_full, buf.I_dv_full ... full resolution gradients if half_resolution
+  // side is 0 for the left image and 1 for the right image, for timing
+  // I_half, if not 0, is the half resolution image with bpl_half bytes per line, see pushBack
+  void computeFeatures (uint8_t *I,const int32_t bpl,image_buffers &buf,const int32_t side,
+                        uint8_t *I_half=0,const int32_t bpl_half=0);
+
+  // grows an aligned buffer to at least bytes, its content is zeroed when it grows
+  template<class T> static void reserve (T* &buf,size_t &size,const size_t bytes);
+
+  // points m1c1, I1c, ... to the current and m1p1, I1p, ... to the previous buffers
+  void updateBufferPointers ();
 
   // matching functions
   void computePriorStatistics (std::vector<p_match> &p_matched,int32_t method);
   void createIndexVector (int32_t* m,int32_t n,std::vector<int32_t> *k,const int32_t &u_bin_num,const int32_t &v_bin_num);
-  // u_, v_ predicted feature position
+  // u_, v_ predicted feature position, r_ radius of the search window around it if positive
   inline void findMatch (int32_t* m1,const int32_t &i1,int32_t* m2,const int32_t &step_size,
                          std::vector<int32_t> *k2,const int32_t &u_bin_num,const int32_t &v_bin_num,const int32_t &stat_bin,
-                         int32_t& min_ind,int32_t stage,bool flow,bool use_prior,double u_=-1,double v_=-1);
+                         int32_t& min_ind,int32_t stage,bool flow,bool use_prior,double u_=-1,double v_=-1,double r_=-1);
+  // builds the bin index vectors used by method (0 = flow, 1 = stereo, 2 = quad matching)
+  void createMatchIndex (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
+                         int32_t n1p,int32_t n2p,int32_t n1c,int32_t n2c,int32_t method,match_index &index);
+  // index: shared bin index vectors, built here if 0
   void matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
                  int32_t n1p,int32_t n2p,int32_t n1c,int32_t n2c,
-                 std::vector<p_match> &p_matched,int32_t method,bool use_prior,const Matrix *Tr_delta = 0);
+                 std::vector<p_match> &p_matched,int32_t method,bool use_prior,const Matrix *Tr_delta = 0,
+                 const Matrix *Tr_delta_cov = 0,match_index *index = 0);
+
+  // keeps up to max_features of p_matched per bucket, in random order
+  void bucketMatches (const std::vector<p_match> &p_matched,std::vector<p_match> &bucketed,
+                      int32_t max_features,float bucket_width,float bucket_height);
 
   // outlier removal
   void removeOutliers (std::vector<p_match> &p_matched,int32_t method);
@@ -248,6 +339,14 @@ private:
   uint8_t *I1p_dv_full,*I2p_dv_full,*I1c_dv_full,*I2c_dv_full; // half-res matching
   int32_t dims_p[3],dims_c[3];
 
+  // ring buffer of the previous and current image pair [left/right][slot],
+  // the pointers above refer to these buffers
+  image_buffers buffers[2][2];
+  int32_t       slot_c;   // slot of the current image pair, the other one is the previous pair
+  timing        push_back_timing;
+  int64_t       num_comparisons;
+  ParallelFor   parallel_for;
+
   std::vector<p_match> p_matched_1;
   std::vector<p_match> p_matched_2;
   std::vector<Matcher::range>   ranges;
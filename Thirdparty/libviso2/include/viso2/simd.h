@@ -0,0 +1,64 @@
+/*
+Copyright 2012. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libviso2.
+Authors: Andreas Geiger
+
+libviso2 is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or any later version.
+
+libviso2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libviso2; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA 
+*/
+
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <stdint.h>
+
+// runtime selection of the instruction set used by the filters and the
+// non-maximum suppression of the matcher: the SSE2/3 kernels always work, the AVX2 kernels
+// (compiled separately with -mavx2) are used if the CPU supports them.
+// all kernels of an instruction set give bit-exact the same results
+namespace simd {
+
+  enum instruction_set { SSE3=0, AVX2=1 };
+
+  // does the CPU support this instruction set, and was it compiled in
+  bool supported (instruction_set set);
+
+  // instruction set in use, the best supported one by default
+  instruction_set get ();
+
+  // force an instruction set, e.g., for tests and benchmarks, returns false if not supported
+  bool set (instruction_set set);
+
+  // AVX2 kernels, same interface and results as their SSE counterparts in filter::detail
+  namespace avx2 {
+    // false if the library was built without AVX2 support, the kernels then fall back to SSE
+    extern const bool available;
+
+    void convolve_14641_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h );
+    void convolve_12021_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h );
+    void convolve_cols_5x5( const unsigned char* in, int16_t* out_v, int16_t* out_h, int w, int h );
+    void convolve_col_p1p1p0m1m1_5x5( const unsigned char* in, int16_t* out, int w, int h );
+    void convolve_row_p1p1p0m1m1_5x5( const int16_t* in, int16_t* out, int w, int h );
+    void blob5x5_from_integral( const uint8_t* in, const int32_t* integral, int16_t* out, int w, int h );
+
+    // extrema of the non-maximum suppression, which has no SSE counterpart: the minimum and
+    // maximum over rows 0..rows-1 of each of the w columns of in, rows bpl values apart
+    void column_extrema_16bit( const int16_t* in, int bpl, int rows, int w, int16_t* out_min, int16_t* out_max );
+    // the minimum of in_min[u-n..u+n] and the maximum of in_max[u-n..u+n] for each u in 0..w-1
+    void window_extrema_16bit( const int16_t* in_min, const int16_t* in_max, int n, int w, int16_t* out_min, int16_t* out_max );
+  }
+}
+
+#endif
@@ -24,6 +24,7 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include <cassert>
 
 #include "filter.h"
+#include "simd.h"
 
 // define fixed-width datatypes for Visual Studio projects
 #ifndef _MSC_VER
@@ -403,6 +404,27 @@ namespace filter {
         *(result_v+1) = _mm_add_epi16( *(result_v+1), ilo );
       }
     }
+    
+    void blob5x5_from_integral( const uint8_t* in, const int32_t* integral, int16_t* out, int w, int h ) {
+      int16_t* out_ptr   = out + 3 + 3*w;
+      int16_t* out_end   = out + w * h - 2 - 2*w;
+      const int32_t* i00 = integral;
+      const int32_t* i50 = integral + 5;
+      const int32_t* i05 = integral + 5*w;
+      const int32_t* i55 = integral + 5 + 5*w;
+      const int32_t* i11 = integral + 1 + 1*w;
+      const int32_t* i41 = integral + 4 + 1*w;
+      const int32_t* i14 = integral + 1 + 4*w;
+      const int32_t* i44 = integral + 4 + 4*w;    
+      const uint8_t* im22 = in + 3 + 3*w;
+      for( ; out_ptr != out_end; out_ptr++, i00++, i50++, i05++, i55++, i11++, i41++, i14++, i44++, im22++ ) {
+        int32_t result = 0;
+        result = -( *i55 - *i50 - *i05 + *i00 );
+        result += 2*( *i44 - *i41 - *i14 + *i11 );
+        result += 7* *im22;
+        *out_ptr = result;
+      }
+    }
   };
   
   void sobel3x3( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h ) {
@@ -416,11 +438,22 @@ namespace filter {
   }
   
   void sobel5x5( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h ) {
-    int16_t* temp_h = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 16 ) );
-    int16_t* temp_v = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 16 ) );
-    detail::convolve_cols_5x5( in, temp_v, temp_h, w, h );
-    detail::convolve_12021_row_5x5_16bit( temp_v, out_v, w, h );
-    detail::convolve_14641_row_5x5_16bit( temp_h, out_h, w, h );
+    // the row filters read a few values past the last pixel, pad the temporaries with zeros
+    // so that the last pixels are the same for the SSE and AVX2 kernels
+    const int padding = 16;
+    int16_t* temp_h = (int16_t*)( _mm_malloc( (w*h+padding)*sizeof( int16_t ), 32 ) );
+    int16_t* temp_v = (int16_t*)( _mm_malloc( (w*h+padding)*sizeof( int16_t ), 32 ) );
+    memset( temp_h + w*h, 0, padding*sizeof( int16_t ) );
+    memset( temp_v + w*h, 0, padding*sizeof( int16_t ) );
+    if( simd::get()==simd::AVX2 ) {
+      simd::avx2::convolve_cols_5x5( in, temp_v, temp_h, w, h );
+      simd::avx2::convolve_12021_row_5x5_16bit( temp_v, out_v, w, h );
+      simd::avx2::convolve_14641_row_5x5_16bit( temp_h, out_h, w, h );
+    } else {
+      detail::convolve_cols_5x5( in, temp_v, temp_h, w, h );
+      detail::convolve_12021_row_5x5_16bit( temp_v, out_v, w, h );
+      detail::convolve_14641_row_5x5_16bit( temp_h, out_h, w, h );
+    }
     _mm_free( temp_h );
     _mm_free( temp_v );
   }
@@ -431,9 +464,14 @@ namespace filter {
   //  1  1  0 -1 -1
   //  1  1  0 -1 -1
   void checkerboard5x5( const uint8_t* in, int16_t* out, int w, int h ) {
-    int16_t* temp = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 16 ) );
-    detail::convolve_col_p1p1p0m1m1_5x5( in, temp, w, h );
-    detail::convolve_row_p1p1p0m1m1_5x5( temp, out, w, h );
+    int16_t* temp = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 32 ) );
+    if( simd::get()==simd::AVX2 ) {
+      simd::avx2::convolve_col_p1p1p0m1m1_5x5( in, temp, w, h );
+      simd::avx2::convolve_row_p1p1p0m1m1_5x5( temp, out, w, h );
+    } else {
+      detail::convolve_col_p1p1p0m1m1_5x5( in, temp, w, h );
+      detail::convolve_row_p1p1p0m1m1_5x5( temp, out, w, h );
+    }
     _mm_free( temp );
   }
   
@@ -443,26 +481,12 @@ namespace filter {
   // -1  1  1  1 -1
   // -1 -1 -1 -1 -1
   void blob5x5( const uint8_t* in, int16_t* out, int w, int h ) {
-    int32_t* integral = (int32_t*)( _mm_malloc( w*h*sizeof( int32_t ), 16 ) );
+    int32_t* integral = (int32_t*)( _mm_malloc( w*h*sizeof( int32_t ), 32 ) );
     detail::integral_image( in, integral, w, h );
-    int16_t* out_ptr   = out + 3 + 3*w;
-    int16_t* out_end   = out + w * h - 2 - 2*w;
-    const int32_t* i00 = integral;
-    const int32_t* i50 = integral + 5;
-    const int32_t* i05 = integral + 5*w;
-    const int32_t* i55 = integral + 5 + 5*w;
-    const int32_t* i11 = integral + 1 + 1*w;
-    const int32_t* i41 = integral + 4 + 1*w;
-    const int32_t* i14 = integral + 1 + 4*w;
-    const int32_t* i44 = integral + 4 + 4*w;    
-    const uint8_t* im22 = in + 3 + 3*w;
-    for( ; out_ptr != out_end; out_ptr++, i00++, i50++, i05++, i55++, i11++, i41++, i14++, i44++, im22++ ) {
-      int32_t result = 0;
-      result = -( *i55 - *i50 - *i05 + *i00 );
-      result += 2*( *i44 - *i41 - *i14 + *i11 );
-      result += 7* *im22;
-      *out_ptr = result;
-    }
+    if( simd::get()==simd::AVX2 )
+      simd::avx2::blob5x5_from_integral( in, integral, out, w, h );
+    else
+      detail::blob5x5_from_integral( in, integral, out, w, h );
     _mm_free( integral );
   }
-};
+};
\ No newline at end of file
@@ -22,7 +22,9 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include "matcher.h"
 #include "triangle.h"
 #include "filter.h"
+#include "simd.h"
 #include <fstream> //for ofstream test
+#include <chrono>
 using namespace std;
 
 //////////////////////
@@ -193,24 +195,11 @@ int cornerScore<16>(const unsigned char* ptr, const int pixel[], int threshold)
 Matcher::Matcher(parameters param) : param(param) {
 
   // init match ring buffer to zero
-  m1p1 = 0; n1p1 = 0;
-  m1p2 = 0; n1p2 = 0;
-  m2p1 = 0; n2p1 = 0;
-  m2p2 = 0; n2p2 = 0;
-  m1c1 = 0; n1c1 = 0;
-  m1c2 = 0; n1c2 = 0;
-  m2c1 = 0; n2c1 = 0;
-  m2c2 = 0; n2c2 = 0;
-  I1p    = 0; I2p    = 0;
-  I1c    = 0; I2c    = 0;
-  I1p_du = 0; I1p_dv = 0;
-  I2p_du = 0; I2p_dv = 0;
-  I1c_du = 0; I1c_dv = 0;
-  I2c_du = 0; I2c_dv = 0;
-  I1p_du_full = 0; I1p_dv_full = 0;
-  I2p_du_full = 0; I2p_dv_full = 0;
-  I1c_du_full = 0; I1c_dv_full = 0;
-  I2c_du_full = 0; I2c_dv_full = 0;
+  slot_c = 0;
+  num_comparisons = 0;
+  dims_p[0] = dims_p[1] = dims_p[2] = 0;
+  dims_c[0] = dims_c[1] = dims_c[2] = 0;
+  updateBufferPointers();
 
   // margin needed to compute descriptor + sobel responses
   margin = 5+1;
@@ -222,37 +211,68 @@ Matcher::Matcher(parameters param) : param(param) {
 
 // deconstructor
 Matcher::~Matcher() {
-  if (I1p)          _mm_free(I1p);
-  if (I2p)          _mm_free(I2p);
-  if (I1c)          _mm_free(I1c);
-  if (I2c)          _mm_free(I2c);
-  if (m1p1)         _mm_free(m1p1);
-  if (m1p2)         _mm_free(m1p2);
-  if (I1p_du)       _mm_free(I1p_du);
-  if (I1p_dv)       _mm_free(I1p_dv);
-  if (I1p_du_full)  _mm_free(I1p_du_full);
-  if (I1p_dv_full)  _mm_free(I1p_dv_full);
-  if (m2p1)         _mm_free(m2p1);
-  if (m2p2)         _mm_free(m2p2);
-  if (I2p_du)       _mm_free(I2p_du);
-  if (I2p_dv)       _mm_free(I2p_dv);
-  if (I2p_du_full)  _mm_free(I2p_du_full);
-  if (I2p_dv_full)  _mm_free(I2p_dv_full);
-  if (m1c1)         _mm_free(m1c1);
-  if (m1c2)         _mm_free(m1c2);
-  if (I1c_du)       _mm_free(I1c_du);
-  if (I1c_dv)       _mm_free(I1c_dv);
-  if (I1c_du_full)  _mm_free(I1c_du_full);
-  if (I1c_dv_full)  _mm_free(I1c_dv_full);
-  if (m2c1)         _mm_free(m2c1);
-  if (m2c2)         _mm_free(m2c2);
-  if (I2c_du)       _mm_free(I2c_du);
-  if (I2c_dv)       _mm_free(I2c_dv);
-  if (I2c_du_full)  _mm_free(I2c_du_full);
-  if (I2c_dv_full)  _mm_free(I2c_dv_full);
+  for (int32_t side=0; side<2; side++)
+    for (int32_t slot=0; slot<2; slot++)
+      buffers[side][slot].release();
+}
+
+void Matcher::image_buffers::release () {
+  if (I)         _mm_free(I);
+  if (I_du)      _mm_free(I_du);
+  if (I_dv)      _mm_free(I_dv);
+  if (I_du_full) _mm_free(I_du_full);
+  if (I_dv_full) _mm_free(I_dv_full);
+  if (I_half)    _mm_free(I_half);
+  if (I_f1)      _mm_free(I_f1);
+  if (I_f2)      _mm_free(I_f2);
+  if (max1)      _mm_free(max1);
+  if (max2)      _mm_free(max2);
+  memset(this,0,sizeof(image_buffers));
+}
+
+template<class T>
+void Matcher::reserve (T* &buf,size_t &size,const size_t bytes) {
+  if (bytes<=size)
+    return;
+  if (buf) _mm_free(buf);
+  // the sobel filters write 2 pixels past the image, keep a few padding bytes
+  const size_t padding = 16;
+  buf  = (T*)_mm_malloc(bytes+padding,16);
+  size = bytes;
+  memset(buf,0,bytes+padding);
+}
+
+void Matcher::updateBufferPointers () {
+  image_buffers &b1c = buffers[0][slot_c];
+  image_buffers &b2c = buffers[1][slot_c];
+  image_buffers &b1p = buffers[0][1-slot_c];
+  image_buffers &b2p = buffers[1][1-slot_c];
+  m1c1 = b1c.max1; n1c1 = b1c.num1;
+  m1c2 = b1c.max2; n1c2 = b1c.num2;
+  m2c1 = b2c.max1; n2c1 = b2c.num1;
+  m2c2 = b2c.max2; n2c2 = b2c.num2;
+  m1p1 = b1p.max1; n1p1 = b1p.num1;
+  m1p2 = b1p.max2; n1p2 = b1p.num2;
+  m2p1 = b2p.max1; n2p1 = b2p.num1;
+  m2p2 = b2p.max2; n2p2 = b2p.num2;
+  I1c = b1c.I; I1c_du = b1c.I_du; I1c_dv = b1c.I_dv; I1c_du_full = b1c.I_du_full; I1c_dv_full = b1c.I_dv_full;
+  I2c = b2c.I; I2c_du = b2c.I_du; I2c_dv = b2c.I_dv; I2c_du_full = b2c.I_du_full; I2c_dv_full = b2c.I_dv_full;
+  I1p = b1p.I; I1p_du = b1p.I_du; I1p_dv = b1p.I_dv; I1p_du_full = b1p.I_du_full; I1p_dv_full = b1p.I_dv_full;
+  I2p = b2p.I; I2p_du = b2p.I_du; I2p_dv = b2p.I_dv; I2p_du_full = b2p.I_du_full; I2p_dv_full = b2p.I_dv_full;
+}
+
+static double millisecondsSince (const std::chrono::steady_clock::time_point &t) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t).count();
 }
 
 void Matcher::pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace) {
+  pushBack(I1,I2,dims,replace,0,0,0);
+}
+
+void Matcher::pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace,
+                        uint8_t *I1_half,uint8_t *I2_half,int32_t bpl_half) {
+
+  std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
 
   // image dimensions
   int32_t width  = dims[0];
@@ -265,53 +285,13 @@ void Matcher::pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace
     return;
   }
 
-  if (replace) {
-    if (I1c)         _mm_free(I1c);
-    if (I2c)         _mm_free(I2c);
-    if (m1c1)        _mm_free(m1c1);
-    if (m1c2)        _mm_free(m1c2);
-    if (I1c_du)      _mm_free(I1c_du);
-    if (I1c_dv)      _mm_free(I1c_dv);
-    if (I1c_du_full) _mm_free(I1c_du_full);
-    if (I1c_dv_full) _mm_free(I1c_dv_full);
-    if (m2c1)        _mm_free(m2c1);
-    if (m2c2)        _mm_free(m2c2);
-    if (I2c_du)      _mm_free(I2c_du);
-    if (I2c_dv)      _mm_free(I2c_dv);
-    if (I2c_du_full) _mm_free(I2c_du_full);
-    if (I2c_dv_full) _mm_free(I2c_dv_full);
-  } else {
-    if (I1p)         _mm_free(I1p);
-    if (I2p)         _mm_free(I2p);
-    if (m1p1)        _mm_free(m1p1);
-    if (m1p2)        _mm_free(m1p2);
-    if (I1p_du)      _mm_free(I1p_du);
-    if (I1p_dv)      _mm_free(I1p_dv);
-    if (I1p_du_full) _mm_free(I1p_du_full);
-    if (I1p_dv_full) _mm_free(I1p_dv_full);
-    if (m2p1)        _mm_free(m2p1);
-    if (m2p2)        _mm_free(m2p2);
-    if (I2p_du)      _mm_free(I2p_du);
-    if (I2p_dv)      _mm_free(I2p_dv);
-    if (I2p_du_full) _mm_free(I2p_du_full);
-    if (I2p_dv_full) _mm_free(I2p_dv_full);
-    m1p1 = m1c1; n1p1 = n1c1;
-    m1p2 = m1c2; n1p2 = n1c2;
-    m2p1 = m2c1; n2p1 = n2c1;
-    m2p2 = m2c2; n2p2 = n2c2;
-    I1p         = I1c;
-    I2p         = I2c;
-    I1p_du      = I1c_du;
-    I1p_dv      = I1c_dv;
-    I1p_du_full = I1c_du_full;
-    I1p_dv_full = I1c_dv_full;
-    I2p_du      = I2c_du;
-    I2p_dv      = I2c_dv;
-    I2p_du_full = I2c_du_full;
-    I2p_dv_full = I2c_dv_full;
-    dims_p[0]   = dims_c[0];
-    dims_p[1]   = dims_c[1];
-    dims_p[2]   = dims_c[2];
+  // the current pair becomes the previous pair, and the buffers of the
+  // previous pair are overwritten with the new images
+  if (!replace) {
+    slot_c = 1-slot_c;
+    dims_p[0] = dims_c[0];
+    dims_p[1] = dims_c[1];
+    dims_p[2] = dims_c[2];
   }
 
   // set new dims (bytes per line must be multiple of 16)
@@ -319,25 +299,25 @@ void Matcher::pushBack (uint8_t *I1,uint8_t* I2,int32_t* dims,const bool replace
   dims_c[1] = height;
   dims_c[2] = width + 15-(width-1)%16;
 
-  // copy images to byte aligned memory
-  I1c = (uint8_t*)_mm_malloc(dims_c[2]*dims_c[1]*sizeof(uint8_t),16);
-  I2c = (uint8_t*)_mm_malloc(dims_c[2]*dims_c[1]*sizeof(uint8_t),16);
-  if (dims_c[2]==bpl) {
-    memcpy(I1c,I1,dims_c[2]*dims_c[1]*sizeof(uint8_t));
-    if (I2!=0)
-      memcpy(I2c,I2,dims_c[2]*dims_c[1]*sizeof(uint8_t));
+  // compute new features for current frame
+  push_back_timing = timing();
+  if (I2!=0 && param.parallel && parallel_for) {
+    uint8_t *I[2]      = {I1,I2};
+    uint8_t *I_half[2] = {I1_half,I2_half};
+    parallel_for(2,[&](size_t side) {
+      computeFeatures(I[side],bpl,buffers[side][slot_c],(int32_t)side,I_half[side],bpl_half);
+    });
   } else {
-    for (int32_t v=0; v<height; v++) {
-      memcpy(I1c+v*dims_c[2],I1+v*bpl,dims_c[0]*sizeof(uint8_t));
-      if (I2!=0)
-        memcpy(I2c+v*dims_c[2],I2+v*bpl,dims_c[0]*sizeof(uint8_t));
+    computeFeatures(I1,bpl,buffers[0][slot_c],0,I1_half,bpl_half);
+    if (I2!=0) {
+      computeFeatures(I2,bpl,buffers[1][slot_c],1,I2_half,bpl_half);
+    } else {
+      buffers[1][slot_c].num1 = 0;
+      buffers[1][slot_c].num2 = 0;
     }
   }
-
-  // compute new features for current frame
-  computeFeatures(I1c,dims_c,m1c1,n1c1,m1c2,n1c2,I1c_du,I1c_dv,I1c_du_full,I1c_dv_full);
-  if (I2!=0)
-    computeFeatures(I2c,dims_c,m2c1,n2c1,m2c2,n2c2,I2c_du,I2c_dv,I2c_du_full,I2c_dv_full);
+  updateBufferPointers();
+  push_back_timing.total = millisecondsSince(t_start);
 }
 // this seems not to improve accuracy
 void Matcher::refineFeatures(std::vector<p_match> & vMatches)
@@ -381,7 +361,7 @@ void Matcher::refineFeatures(std::vector<p_match> & vMatches)
        }
     }
 }
-void Matcher::matchFeatures(int32_t method, const Matrix *Tr_delta) {
+void Matcher::matchFeatures(int32_t method, const Matrix *Tr_delta, const Matrix *Tr_delta_cov) {
   
   //////////////////
   // sanity check //
@@ -415,19 +395,20 @@ void Matcher::matchFeatures(int32_t method, const Matrix *Tr_delta) {
   // clear old matches
   p_matched_1.clear();
   p_matched_2.clear();
+  num_comparisons = 0;
 
   // double pass matching
   if (param.multi_stage) {
 
     // 1st pass (sparse matches)
-    matching(m1p1,m2p1,m1c1,m2c1,n1p1,n2p1,n1c1,n2c1,p_matched_1,method,false,Tr_delta);
+    matching(m1p1,m2p1,m1c1,m2c1,n1p1,n2p1,n1c1,n2c1,p_matched_1,method,false,Tr_delta,Tr_delta_cov);
     removeOutliers(p_matched_1,method);
     
     // compute search range prior statistics (used for speeding up 2nd pass)
     computePriorStatistics(p_matched_1,method);      
 
     // 2nd pass (dense matches)
-    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,p_matched_2,method,true,Tr_delta);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,p_matched_2,method,true,Tr_delta,Tr_delta_cov);
     if (param.refinement>0){
   //      refineFeatures(p_matched_2);//refine u1c v1c
         refinement(p_matched_2,method);// refine others
@@ -436,7 +417,7 @@ void Matcher::matchFeatures(int32_t method, const Matrix *Tr_delta) {
 
   // single pass matching
   } else {
-    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,p_matched_2,method,false,Tr_delta);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,p_matched_2,method,false,Tr_delta,Tr_delta_cov);
     if (param.refinement>0){
     //  refineFeatures(p_matched_2);//refine u1c v1c
       refinement(p_matched_2,method);//refine others
@@ -445,12 +426,95 @@ void Matcher::matchFeatures(int32_t method, const Matrix *Tr_delta) {
   }
 }
 
+void Matcher::matchQuadAndStereo(vector<p_match> &quad_matched,vector<p_match> &bucketed,vector<p_match> &stereo_matched,
+                                 int32_t max_features,float bucket_width,float bucket_height,
+                                 const Matrix *Tr_delta,const Matrix *Tr_delta_cov) {
+
+  quad_matched.clear();
+  bucketed.clear();
+  stereo_matched.clear();
+
+  // without previous features (first frame), only stereo matching is possible
+  bool quad = !(m1p2==0 || n1p2==0 || m2p2==0 || n2p2==0);
+  if (param.multi_stage)
+    quad = quad && !(m1p1==0 || n1p1==0 || m2p1==0 || n2p1==0);
+  if (!quad) {
+    matchFeatures(1);
+    stereo_matched.swap(p_matched_2);
+    return;
+  }
+  if (m1c2==0 || n1c2==0 || m2c2==0 || n2c2==0)
+    return;
+  if (param.multi_stage)
+    if (m1c1==0 || n1c1==0 || m2c1==0 || n2c1==0)
+      return;
+
+  p_matched_1.clear();
+  p_matched_2.clear();
+  num_comparisons = 0;
+
+  // double pass matching
+  if (param.multi_stage) {
+
+    // 1st pass (sparse matches), without prior both methods search the same
+    // ranges from the current right to the current left image
+    vector<p_match> quad_matched_1;
+    {
+      match_index index;
+      createMatchIndex(m1p1,m2p1,m1c1,m2c1,n1p1,n2p1,n1c1,n2c1,2,index);
+      index.i1c_of_i2c.assign(n2c1,-1);
+      matching(m1p1,m2p1,m1c1,m2c1,n1p1,n2p1,n1c1,n2c1,quad_matched_1,2,false,Tr_delta,Tr_delta_cov,&index);
+      matching(m1p1,m2p1,m1c1,m2c1,n1p1,n2p1,n1c1,n2c1,p_matched_1,1,false,0,0,&index);
+    }
+    removeOutliers(quad_matched_1,2);
+    removeOutliers(p_matched_1,1);
+
+    // 2nd pass (dense matches), each method with its own search range prior statistics
+    match_index index;
+    createMatchIndex(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,2,index);
+    computePriorStatistics(quad_matched_1,2);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,quad_matched,2,true,Tr_delta,Tr_delta_cov,&index);
+    if (param.refinement>0)
+      refinement(quad_matched,2);
+    removeOutliers(quad_matched,2);
+
+    computePriorStatistics(p_matched_1,1);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,stereo_matched,1,true,0,0,&index);
+    if (param.refinement>0)
+      refinement(stereo_matched,1);
+    removeOutliers(stereo_matched,1);
+
+  // single pass matching
+  } else {
+    match_index index;
+    createMatchIndex(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,2,index);
+    index.i1c_of_i2c.assign(n2c2,-1);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,quad_matched,2,false,Tr_delta,Tr_delta_cov,&index);
+    if (param.refinement>0)
+      refinement(quad_matched,2);
+    removeOutliers(quad_matched,2);
+    matching(m1p2,m2p2,m1c2,m2c2,n1p2,n2p2,n1c2,n2c2,stereo_matched,1,false,0,0,&index);
+    if (param.refinement>0)
+      refinement(stereo_matched,1);
+    removeOutliers(stereo_matched,1);
+  }
+
+  bucketMatches(quad_matched,bucketed,max_features,bucket_width,bucket_height);
+}
+
 void Matcher::bucketFeatures(int32_t max_features,float bucket_width,float bucket_height) {
+  vector<p_match> bucketed;
+  bucketMatches(p_matched_2,bucketed,max_features,bucket_width,bucket_height);
+  p_matched_2.swap(bucketed);
+}
+
+void Matcher::bucketMatches (const vector<p_match> &p_matched,vector<p_match> &bucketed,
+                             int32_t max_features,float bucket_width,float bucket_height) {
 
   // find max values
   float u_max = 0;
   float v_max = 0;
-  for (vector<p_match>::iterator it = p_matched_2.begin(); it!=p_matched_2.end(); it++) {
+  for (vector<p_match>::const_iterator it = p_matched.begin(); it!=p_matched.end(); it++) {
     if (it->u1c>u_max) u_max=it->u1c;
     if (it->v1c>v_max) v_max=it->v1c;
   }
@@ -461,14 +525,14 @@ void Matcher::bucketFeatures(int32_t max_features,float bucket_width,float bucke
   vector<p_match> *buckets = new vector<p_match>[bucket_cols*bucket_rows];
 
   // assign matches to their buckets
-  for (vector<p_match>::iterator it=p_matched_2.begin(); it!=p_matched_2.end(); it++) {
+  for (vector<p_match>::const_iterator it=p_matched.begin(); it!=p_matched.end(); it++) {
     int32_t u = (int32_t)floor(it->u1c/bucket_width);
     int32_t v = (int32_t)floor(it->v1c/bucket_height);
     buckets[v*bucket_cols+u].push_back(*it);
   }
   
-  // refill p_matched from buckets
-  p_matched_2.clear();
+  // fill bucketed from buckets
+  bucketed.clear();
   for (int32_t i=0; i<bucket_cols*bucket_rows; i++) {
     
     // shuffle bucket indices randomly
@@ -477,7 +541,7 @@ void Matcher::bucketFeatures(int32_t max_features,float bucket_width,float bucke
     // add up to max_features features from this bucket to p_matched
     int32_t k=0;
     for (vector<p_match>::iterator it=buckets[i].begin(); it!=buckets[i].end(); it++) {
-      p_matched_2.push_back(*it);
+      bucketed.push_back(*it);
       k++;
       if (k>=max_features)
         break;
@@ -534,6 +598,11 @@ float Matcher::getGain (vector<int32_t> inliers) {
 
 void Matcher::nonMaximumSuppression (int16_t* I_f1,int16_t* I_f2,const int32_t* dims,vector<Matcher::maximum> &maxima,int32_t nms_n) {
   
+  if (simd::get()==simd::AVX2) {
+    nonMaximumSuppressionAVX2(I_f1,I_f2,dims,maxima,nms_n);
+    return;
+  }
+
   // extract parameters
   int32_t width  = dims[0];
   int32_t height = dims[1];
@@ -635,6 +704,95 @@ void Matcher::nonMaximumSuppression (int16_t* I_f1,int16_t* I_f2,const int32_t*
   }
 }
 
+// extremum of the block at i,j that the scalar search keeps: it visits the block column by
+// column and only replaces its extremum by a more extreme value, so this is the first of the
+// columns whose extremum in col (col[0] for column i) is the block extremum, at the first row
+// of that column holding it
+template<class Compare>
+static inline void blockExtremum (const int16_t* col,const int16_t* I,int32_t bpl,int32_t i,int32_t j,int32_t n,
+                                  Compare more_extreme,int32_t &ei,int32_t &ej,int32_t &val) {
+  val = col[0];
+  ei  = i;
+  for (int32_t k=1; k<=n; k++) {
+    if (more_extreme(col[k],val)) {
+      val = col[k];
+      ei  = i+k;
+    }
+  }
+  ej = j;
+  while (*(I+ej*bpl+ei)!=val)
+    ej++;
+}
+
+// No pixel of a block is more extreme than its extremum, so the verification loops of the
+// scalar version fail exactly if the extremum of the (clipped) window around it differs from
+// it. These window extrema are computed for all pixels up front, as are the column extrema
+// of each band of blocks, leaving a few scalar steps per block
+void Matcher::nonMaximumSuppressionAVX2 (int16_t* I_f1,int16_t* I_f2,const int32_t* dims,vector<Matcher::maximum> &maxima,int32_t nms_n) {
+
+  // extract parameters
+  int32_t width  = dims[0];
+  int32_t height = dims[1];
+  int32_t bpl    = dims[2];
+  int32_t n      = nms_n;
+  int32_t tau    = param.nms_tau;
+  if (n+margin>=width-n-margin || n+margin>=height-n-margin)
+    return;
+
+  // the extrema lie in [u0,u1)x[v0,v1), their windows in [margin,u1)x[margin,v1)
+  int32_t u0 = n+margin, u1 = width-margin, nu = u1-u0;
+  int32_t v0 = n+margin, v1 = height-margin;
+
+  // window extrema, over column extrema that are padded at the right with values that never win
+  vector<int16_t> win_f1min(nu*(v1-v0)),win_f1max(nu*(v1-v0)),win_f2min(nu*(v1-v0)),win_f2max(nu*(v1-v0));
+  vector<int16_t> col_f1min(u1-margin+n,INT16_MAX),col_f1max(u1-margin+n,INT16_MIN);
+  vector<int16_t> col_f2min(u1-margin+n,INT16_MAX),col_f2max(u1-margin+n,INT16_MIN);
+  for (int32_t v=v0; v<v1; v++) {
+    int32_t rows = min(v+n,v1-1)-(v-n)+1;
+    int32_t addr = getAddressOffsetImage(margin,v-n,bpl);
+    int32_t k    = (v-v0)*nu;
+    simd::avx2::column_extrema_16bit(I_f1+addr,bpl,rows,u1-margin,&col_f1min[0],&col_f1max[0]);
+    simd::avx2::column_extrema_16bit(I_f2+addr,bpl,rows,u1-margin,&col_f2min[0],&col_f2max[0]);
+    simd::avx2::window_extrema_16bit(&col_f1min[n],&col_f1max[n],n,nu,&win_f1min[k],&win_f1max[k]);
+    simd::avx2::window_extrema_16bit(&col_f2min[n],&col_f2max[n],n,nu,&win_f2min[k],&win_f2max[k]);
+  }
+
+  // column extrema of each band of blocks
+  int32_t num_bands = (height-n-margin-v0+n)/(n+1);
+  vector<int16_t> band_f1min(nu*num_bands),band_f1max(nu*num_bands),band_f2min(nu*num_bands),band_f2max(nu*num_bands);
+  for (int32_t b=0; b<num_bands; b++) {
+    int32_t addr = getAddressOffsetImage(u0,v0+b*(n+1),bpl);
+    simd::avx2::column_extrema_16bit(I_f1+addr,bpl,n+1,nu,&band_f1min[b*nu],&band_f1max[b*nu]);
+    simd::avx2::column_extrema_16bit(I_f2+addr,bpl,n+1,nu,&band_f2min[b*nu],&band_f2max[b*nu]);
+  }
+
+  // loop variables
+  int32_t f1mini,f1minj,f1maxi,f1maxj,f2mini,f2minj,f2maxi,f2maxj;
+  int32_t f1minval,f1maxval,f2minval,f2maxval;
+  std::less<int32_t> smaller;
+  std::greater<int32_t> larger;
+
+  // same order of the blocks and their maxima as the scalar version
+  for (int32_t i=n+margin; i<width-n-margin;i+=n+1) {
+    for (int32_t j=n+margin, b=0; j<height-n-margin;j+=n+1, b++) {
+      int32_t k = b*nu+i-u0;
+      blockExtremum(&band_f1min[k],I_f1,bpl,i,j,n,smaller,f1mini,f1minj,f1minval);
+      blockExtremum(&band_f1max[k],I_f1,bpl,i,j,n,larger,f1maxi,f1maxj,f1maxval);
+      blockExtremum(&band_f2min[k],I_f2,bpl,i,j,n,smaller,f2mini,f2minj,f2minval);
+      blockExtremum(&band_f2max[k],I_f2,bpl,i,j,n,larger,f2maxi,f2maxj,f2maxval);
+
+      if (f1minval<=-tau && win_f1min[(f1minj-v0)*nu+f1mini-u0]==f1minval)
+        maxima.push_back(Matcher::maximum(f1mini,f1minj,f1minval,0));
+      if (f1maxval>=tau && win_f1max[(f1maxj-v0)*nu+f1maxi-u0]==f1maxval)
+        maxima.push_back(Matcher::maximum(f1maxi,f1maxj,f1maxval,1));
+      if (f2minval<=-tau && win_f2min[(f2minj-v0)*nu+f2mini-u0]==f2minval)
+        maxima.push_back(Matcher::maximum(f2mini,f2minj,f2minval,2));
+      if (f2maxval>=tau && win_f2max[(f2maxj-v0)*nu+f2maxi-u0]==f2maxval)
+        maxima.push_back(Matcher::maximum(f2maxi,f2maxj,f2maxval,3));
+    }
+  }
+}
+
 inline void Matcher::computeDescriptor (const uint8_t* I_du,const uint8_t* I_dv,const int32_t &bpl,const int32_t &u,const int32_t &v,uint8_t *desc_addr) {
   
     // get address indices
@@ -838,84 +996,106 @@ void Matcher::getHalfResolutionDimensions(const int32_t *dims,int32_t *dims_half
   dims_half[2] = dims_half[0]+15-(dims_half[0]-1)%16;
 }
 
-uint8_t* Matcher::createHalfResolutionImage(uint8_t *I,const int32_t* dims) {
+void Matcher::createHalfResolutionImage(uint8_t *I,const int32_t* dims,uint8_t* I_half) {
   int32_t dims_half[3];
   getHalfResolutionDimensions(dims,dims_half);
-  uint8_t* I_half = (uint8_t*)_mm_malloc(dims_half[2]*dims_half[1]*sizeof(uint8_t),16);
   for (int32_t v=0; v<dims_half[1]; v++)
     for (int32_t u=0; u<dims_half[0]; u++)
       I_half[v*dims_half[2]+u] =  (uint8_t)(((int32_t)I[(v*2+0)*dims[2]+u*2+0]+
                                              (int32_t)I[(v*2+0)*dims[2]+u*2+1]+
                                              (int32_t)I[(v*2+1)*dims[2]+u*2+0]+
                                              (int32_t)I[(v*2+1)*dims[2]+u*2+1])/4);
-  return I_half;
 }
 
-void Matcher::computeFeatures (uint8_t *I,const int32_t* dims,int32_t* &max1,int32_t &num1,int32_t* &max2,int32_t &num2,uint8_t* &I_du,uint8_t* &I_dv,uint8_t* &I_du_full,uint8_t* &I_dv_full) {
-  
-  int16_t *I_f1;
-  int16_t *I_f2;
-  
+void Matcher::computeFeatures (uint8_t *I_in,const int32_t bpl,image_buffers &buf,const int32_t side,
+                               uint8_t *I_half_in,const int32_t bpl_half) {
+
+  std::chrono::steady_clock::time_point t_stage = std::chrono::steady_clock::now();
+  const int32_t* dims = dims_c;
+
+  // copy image to byte aligned memory, padding bytes at the end of the lines are zero
+  reserve(buf.I,buf.size_I,dims[2]*dims[1]*sizeof(uint8_t));
+  uint8_t* I = buf.I;
+  if (dims[2]==bpl) {
+    memcpy(I,I_in,dims[2]*dims[1]*sizeof(uint8_t));
+  } else {
+    for (int32_t v=0; v<dims[1]; v++) {
+      memcpy(I+v*dims[2],I_in+v*bpl,dims[0]*sizeof(uint8_t));
+      memset(I+v*dims[2]+dims[0],0,(dims[2]-dims[0])*sizeof(uint8_t));
+    }
+  }
+  push_back_timing.copy[side] = millisecondsSince(t_stage);
+  t_stage = std::chrono::steady_clock::now();
+
   int32_t dims_matching[3];
   memcpy(dims_matching,dims,3*sizeof(int32_t));
   
-  // allocate memory for sobel images and filter images
+  // sobel images and filter images
   if (!param.half_resolution) {
-    I_du = (uint8_t*)_mm_malloc(dims[2]*dims[1]*sizeof(uint8_t*),16);
-    I_dv = (uint8_t*)_mm_malloc(dims[2]*dims[1]*sizeof(uint8_t*),16);
-    I_f1 = (int16_t*)_mm_malloc(dims[2]*dims[1]*sizeof(int16_t),16);
-    I_f2 = (int16_t*)_mm_malloc(dims[2]*dims[1]*sizeof(int16_t),16);
-    filter::sobel5x5(I,I_du,I_dv,dims[2],dims[1]);
-    filter::blob5x5(I,I_f1,dims[2],dims[1]);
-    filter::checkerboard5x5(I,I_f2,dims[2],dims[1]);
+    reserve(buf.I_du,buf.size_du,dims[2]*dims[1]*sizeof(uint8_t));
+    reserve(buf.I_dv,buf.size_dv,dims[2]*dims[1]*sizeof(uint8_t));
+    reserve(buf.I_f1,buf.size_f1,dims[2]*dims[1]*sizeof(int16_t));
+    reserve(buf.I_f2,buf.size_f2,dims[2]*dims[1]*sizeof(int16_t));
+    filter::sobel5x5(I,buf.I_du,buf.I_dv,dims[2],dims[1]);
+    filter::blob5x5(I,buf.I_f1,dims[2],dims[1]);
+    filter::checkerboard5x5(I,buf.I_f2,dims[2],dims[1]);
   } else {
-    uint8_t* I_matching = createHalfResolutionImage(I,dims);
     getHalfResolutionDimensions(dims,dims_matching);
-    I_du      = (uint8_t*)_mm_malloc(dims_matching[2]*dims_matching[1]*sizeof(uint8_t*),16);
-    I_dv      = (uint8_t*)_mm_malloc(dims_matching[2]*dims_matching[1]*sizeof(uint8_t*),16);
-    I_f1      = (int16_t*)_mm_malloc(dims_matching[2]*dims_matching[1]*sizeof(int16_t),16);
-    I_f2      = (int16_t*)_mm_malloc(dims_matching[2]*dims_matching[1]*sizeof(int16_t),16);
-    I_du_full = (uint8_t*)_mm_malloc(dims[2]*dims[1]*sizeof(uint8_t*),16);
-    I_dv_full = (uint8_t*)_mm_malloc(dims[2]*dims[1]*sizeof(uint8_t*),16);
-    filter::sobel5x5(I_matching,I_du,I_dv,dims_matching[2],dims_matching[1]);
-    filter::sobel5x5(I,I_du_full,I_dv_full,dims[2],dims[1]);
-    filter::blob5x5(I_matching,I_f1,dims_matching[2],dims_matching[1]);
-    filter::checkerboard5x5(I_matching,I_f2,dims_matching[2],dims_matching[1]);
-    _mm_free(I_matching);
+    uint8_t* I_half = buf.I_half;
+    if (I_half_in!=0 && bpl_half==dims_matching[2]) {
+      I_half = I_half_in;
+    } else {
+      reserve(buf.I_half,buf.size_half,dims_matching[2]*dims_matching[1]*sizeof(uint8_t));
+      I_half = buf.I_half;
+      if (I_half_in!=0) {
+        for (int32_t v=0; v<dims_matching[1]; v++)
+          memcpy(I_half+v*dims_matching[2],I_half_in+v*bpl_half,dims_matching[0]*sizeof(uint8_t));
+      } else {
+        createHalfResolutionImage(I,dims,I_half);
+      }
+    }
+    reserve(buf.I_du,buf.size_du,dims_matching[2]*dims_matching[1]*sizeof(uint8_t));
+    reserve(buf.I_dv,buf.size_dv,dims_matching[2]*dims_matching[1]*sizeof(uint8_t));
+    reserve(buf.I_f1,buf.size_f1,dims_matching[2]*dims_matching[1]*sizeof(int16_t));
+    reserve(buf.I_f2,buf.size_f2,dims_matching[2]*dims_matching[1]*sizeof(int16_t));
+    reserve(buf.I_du_full,buf.size_du_full,dims[2]*dims[1]*sizeof(uint8_t));
+    reserve(buf.I_dv_full,buf.size_dv_full,dims[2]*dims[1]*sizeof(uint8_t));
+    filter::sobel5x5(I_half,buf.I_du,buf.I_dv,dims_matching[2],dims_matching[1]);
+    filter::sobel5x5(I,buf.I_du_full,buf.I_dv_full,dims[2],dims[1]);
+    filter::blob5x5(I_half,buf.I_f1,dims_matching[2],dims_matching[1]);
+    filter::checkerboard5x5(I_half,buf.I_f2,dims_matching[2],dims_matching[1]);
   }
-  
-  // extract sparse maxima (1st pass) via non-maximum suppression
+  push_back_timing.filter[side] = millisecondsSince(t_stage);
+  t_stage = std::chrono::steady_clock::now();
+
+  // extract sparse maxima (1st pass) and dense maxima (2nd pass) via non-maximum suppression
   vector<Matcher::maximum> maxima1;
   if (param.multi_stage) {
     int32_t nms_n_sparse = param.nms_n*3;
     if (nms_n_sparse>10)
       nms_n_sparse = max(param.nms_n,10);
-    nonMaximumSuppression(I_f1,I_f2,dims_matching,maxima1,nms_n_sparse);
-    computeDescriptors(I_du,I_dv,dims_matching[2],maxima1);
+    nonMaximumSuppression(buf.I_f1,buf.I_f2,dims_matching,maxima1,nms_n_sparse);
   }
-  
-  // extract dense maxima (2nd pass) via non-maximum suppression
   vector<Matcher::maximum> maxima2;
-  nonMaximumSuppression(I_f1,I_f2,dims_matching,maxima2,param.nms_n);
-  computeDescriptors(I_du,I_dv,dims_matching[2],maxima2);
+  nonMaximumSuppression(buf.I_f1,buf.I_f2,dims_matching,maxima2,param.nms_n);
+  push_back_timing.nms[side] = millisecondsSince(t_stage);
+  t_stage = std::chrono::steady_clock::now();
 
-  // release filter images
-  _mm_free(I_f1);
-  _mm_free(I_f2);  
+  computeDescriptors(buf.I_du,buf.I_dv,dims_matching[2],maxima1);
+  computeDescriptors(buf.I_du,buf.I_dv,dims_matching[2],maxima2);
   
-  // get number of interest points and init maxima pointer to NULL
-  num1 = maxima1.size();
-  num2 = maxima2.size();
-  max1 = 0;
-  max2 = 0;
+  // get number of interest points
+  buf.num1 = maxima1.size();
+  buf.num2 = maxima2.size();
   
   int32_t s = 1;
   if (param.half_resolution)
     s = 2;
 
   // return sparse maxima as 16-bytes aligned memory
-  if (num1!=0) {
-    max1 = (int32_t*)_mm_malloc(sizeof(Matcher::maximum)*num1,16);
+  if (buf.num1!=0) {
+    reserve(buf.max1,buf.size_max1,sizeof(Matcher::maximum)*buf.num1);
+    int32_t* max1 = buf.max1;
     int32_t k=0;
     for (vector<Matcher::maximum>::iterator it=maxima1.begin(); it!=maxima1.end(); it++) {
       *(max1+k++) = it->u*s;  *(max1+k++) = it->v*s;  *(max1+k++) = 0;        *(max1+k++) = it->c;
@@ -925,8 +1105,9 @@ void Matcher::computeFeatures (uint8_t *I,const int32_t* dims,int32_t* &max1,int
   }
   
   // return dense maxima as 16-bytes aligned memory
-  if (num2!=0) {
-    max2 = (int32_t*)_mm_malloc(sizeof(Matcher::maximum)*num2,16);
+  if (buf.num2!=0) {
+    reserve(buf.max2,buf.size_max2,sizeof(Matcher::maximum)*buf.num2);
+    int32_t* max2 = buf.max2;
     int32_t k=0;
     for (vector<Matcher::maximum>::iterator it=maxima2.begin(); it!=maxima2.end(); it++) {
       *(max2+k++) = it->u*s;  *(max2+k++) = it->v*s;  *(max2+k++) = 0;        *(max2+k++) = it->c;
@@ -934,6 +1115,7 @@ void Matcher::computeFeatures (uint8_t *I,const int32_t* dims,int32_t* &max1,int
       *(max2+k++) = it->d5;   *(max2+k++) = it->d6;   *(max2+k++) = it->d7;   *(max2+k++) = it->d8;
     }
   }
+  push_back_timing.descriptor[side] = millisecondsSince(t_stage);
 }
 
 void Matcher::computePriorStatistics (vector<p_match> &p_matched,int32_t method) {
@@ -1094,9 +1276,42 @@ void Matcher::createIndexVector (int32_t* m,int32_t n,vector<int32_t> *k,const i
   }
 }
 
+namespace {
+
+  // standard deviation in pixels, along the major axis, of the projection of the point (x,y,z) of
+  // the current right camera, (xl,y,z) in the current left camera, when the motion from the previous
+  // frame has an error [rotation;translation] applied on its left with 6x6 covariance cov
+  double projectionStd (double f,double xl,double x,double y,double z,const Matrix &cov) {
+
+    // jacobian of the point: [-[X]x | I], X = (xl,y,z)
+    const double A[3][6] = {{ 0,  z, -y, 1, 0, 0},
+                            {-z,  0, xl, 0, 1, 0},
+                            { y,-xl,  0, 0, 0, 1}};
+
+    // jacobian of the projection
+    double ju[6],jv[6];
+    for (int32_t i=0; i<6; i++) {
+      ju[i] = f/z*(A[0][i]-x/z*A[2][i]);
+      jv[i] = f/z*(A[1][i]-y/z*A[2][i]);
+    }
+
+    // 2x2 covariance of the projection and its largest eigenvalue
+    double a=0,b=0,c=0;
+    for (int32_t i=0; i<6; i++) {
+      for (int32_t j=0; j<6; j++) {
+        a += ju[i]*cov.val[i][j]*ju[j];
+        b += ju[i]*cov.val[i][j]*jv[j];
+        c += jv[i]*cov.val[i][j]*jv[j];
+      }
+    }
+    double lambda = (a+c)/2+sqrt((a-c)*(a-c)/4+b*b);
+    return sqrt(max(lambda,0.0));
+  }
+}
+
 inline void Matcher::findMatch (int32_t* m1,const int32_t &i1,int32_t* m2,const int32_t &step_size,vector<int32_t> *k2,
                                 const int32_t &u_bin_num,const int32_t &v_bin_num,const int32_t &stat_bin,
-                                int32_t& min_ind,int32_t stage,bool flow,bool use_prior,double u_,double v_) {
+                                int32_t& min_ind,int32_t stage,bool flow,bool use_prior,double u_,double v_,double r_) {
   
   // init and load image coordinates + feature
   min_ind          = 0;
@@ -1129,6 +1344,14 @@ inline void Matcher::findMatch (int32_t* m1,const int32_t &i1,int32_t* m2,const
     v_min = v1-param.match_disp_tolerance;
     v_max = v1+param.match_disp_tolerance;
   }
+
+  // restrict search range to the window around the predicted position
+  if (r_>0 && u_>=0 && v_>=0) {
+    u_min = max(u_min,(float)(u_-r_));
+    u_max = min(u_max,(float)(u_+r_));
+    v_min = max(v_min,(float)(v_-r_));
+    v_max = min(v_max,(float)(v_+r_));
+  }
   
   // bins of interest
   int32_t u_bin_min = min(max((int32_t)floor(u_min/(float)param.match_binsize),0),u_bin_num-1);
@@ -1150,6 +1373,7 @@ inline void Matcher::findMatch (int32_t* m1,const int32_t &i1,int32_t* m2,const
           xmm4 = _mm_sad_epu8 (xmm2,xmm4);
           xmm4 = _mm_add_epi16(xmm3,xmm4);
           double cost = (double)(_mm_extract_epi16(xmm4,0)+_mm_extract_epi16(xmm4,4));
+          num_comparisons++;
           
           if (u_>=0 && v_>=0) {
             double du = (double)u2-u_;
@@ -1168,23 +1392,54 @@ inline void Matcher::findMatch (int32_t* m1,const int32_t &i1,int32_t* m2,const
   }
 }
 
+void Matcher::createMatchIndex (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
+                                int32_t n1p,int32_t n2p,int32_t n1c,int32_t n2c,int32_t method,match_index &index) {
+
+  // compute number of bins
+  index.u_bin_num = (int32_t)ceil((float)dims_c[0]/(float)param.match_binsize);
+  index.v_bin_num = (int32_t)ceil((float)dims_c[1]/(float)param.match_binsize);
+  int32_t bin_num = 4*index.v_bin_num*index.u_bin_num; // 4 classes
+
+  // allocate memory for index vectors (needed for efficient search)
+  index.k1p = new vector<int32_t>[bin_num];
+  index.k2p = new vector<int32_t>[bin_num];
+  index.k1c = new vector<int32_t>[bin_num];
+  index.k2c = new vector<int32_t>[bin_num];
+
+  // create position/class bin index vectors
+  if (method!=1)
+    createIndexVector(m1p,n1p,index.k1p,index.u_bin_num,index.v_bin_num);
+  if (method==2)
+    createIndexVector(m2p,n2p,index.k2p,index.u_bin_num,index.v_bin_num);
+  createIndexVector(m1c,n1c,index.k1c,index.u_bin_num,index.v_bin_num);
+  if (method!=0)
+    createIndexVector(m2c,n2c,index.k2c,index.u_bin_num,index.v_bin_num);
+}
+
 void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
                         int32_t n1p,int32_t n2p,int32_t n1c,int32_t n2c,
-                        vector<p_match> &p_matched,int32_t method,bool use_prior,const Matrix *Tr_delta) {
+                        vector<p_match> &p_matched,int32_t method,bool use_prior,const Matrix *Tr_delta,
+                        const Matrix *Tr_delta_cov,match_index *index) {
 
   // descriptor step size (number of int32_t elements in struct)
   int32_t step_size = sizeof(Matcher::maximum)/sizeof(int32_t);
   
-  // compute number of bins
-  int32_t u_bin_num = (int32_t)ceil((float)dims_c[0]/(float)param.match_binsize);
-  int32_t v_bin_num = (int32_t)ceil((float)dims_c[1]/(float)param.match_binsize);
-  int32_t bin_num   = 4*v_bin_num*u_bin_num; // 4 classes
-  
-  // allocate memory for index vectors (needed for efficient search)
-  vector<int32_t> *k1p = new vector<int32_t>[bin_num];
-  vector<int32_t> *k2p = new vector<int32_t>[bin_num];
-  vector<int32_t> *k1c = new vector<int32_t>[bin_num];
-  vector<int32_t> *k2c = new vector<int32_t>[bin_num];
+  // bin index vectors, unless they are shared
+  match_index local_index;
+  if (!index) {
+    createMatchIndex(m1p,m2p,m1c,m2c,n1p,n2p,n1c,n2c,method,local_index);
+    index = &local_index;
+  }
+  const int32_t u_bin_num = index->u_bin_num;
+  const int32_t v_bin_num = index->v_bin_num;
+  vector<int32_t> *k1p = index->k1p;
+  vector<int32_t> *k2p = index->k2p;
+  vector<int32_t> *k1c = index->k1c;
+  vector<int32_t> *k2c = index->k2c;
+
+  // searches from the current right to the current left image are shared by
+  // matchQuadAndStereo() if they do not depend on the method's prior
+  const bool share_searches = !use_prior && (int32_t)index->i1c_of_i2c.size()==n2c;
   
   // loop variables
   int32_t* M = (int32_t*)calloc(dims_c[0]*dims_c[1],sizeof(int32_t));
@@ -1211,10 +1466,6 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
   // method: flow
   if (method==0) {
     
-    // create position/class bin index vectors
-    createIndexVector(m1p,n1p,k1p,u_bin_num,v_bin_num);
-    createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
-    
     // for all points do
     for (i1c=0; i1c<n1c; i1c++) {
 
@@ -1250,10 +1501,6 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
   // method: stereo
   } else if (method==1) {
     
-    // create position/class bin index vectors
-    createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
-    createIndexVector(m2c,n2c,k2c,u_bin_num,v_bin_num);
-    
     // for all points do
     for (i1c=0; i1c<n1c; i1c++) {
 
@@ -1268,7 +1515,14 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
 
       // match left/right
       findMatch(m1c,i1c,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 0,false,use_prior);
-      findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,false,use_prior);
+      if (share_searches) {
+        int32_t &i1c_shared = index->i1c_of_i2c[i2c];
+        if (i1c_shared<0)
+          findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c_shared,1,false,use_prior);
+        i1c2 = i1c_shared;
+      } else {
+        findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c2,1,false,use_prior);
+      }
 
       // circle closure success?
       if (i1c2==i1c) {
@@ -1293,12 +1547,6 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
   // method: quad matching
   } else {
     
-    // create position/class bin index vectors
-    createIndexVector(m1p,n1p,k1p,u_bin_num,v_bin_num);
-    createIndexVector(m2p,n2p,k2p,u_bin_num,v_bin_num);
-    createIndexVector(m1c,n1c,k1c,u_bin_num,v_bin_num);
-    createIndexVector(m2c,n2c,k2c,u_bin_num,v_bin_num);
-    
  /*   static int mytemp=0;
     char filename[300];
     sprintf(filename, "/media/jianzhuhuai0108/Mag/tempk1pandk1c%d.txt", mytemp);
@@ -1337,6 +1585,7 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
       u2p = *(m2p+step_size*i2p+0);
       v2p = *(m2p+step_size*i2p+1);
 
+      double r_pred = -1;
       if (Tr_delta) {
       
         double d = max((double)u1p-(double)u2p,1.0);
@@ -1351,13 +1600,24 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
         double u2c_ = param.f*x2c/z2c+param.cu;
         double v2c_ = param.f*y2c/z2c+param.cv;
 
-        findMatch(m2p,i2p,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 1,true ,use_prior,u2c_,v2c_);
+        // with the motion covariance, search the current images only around the predicted positions
+        if (Tr_delta_cov && z2c>0)
+          r_pred = param.prior_sigma*projectionStd(param.f,x2c+param.base,x2c,y2c,z2c,*Tr_delta_cov)+param.prior_min_radius;
+
+        findMatch(m2p,i2p,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 1,true ,use_prior,u2c_,v2c_,r_pred);
       } else {
         findMatch(m2p,i2p,m2c,step_size,k2c,u_bin_num,v_bin_num,stat_bin,i2c, 1,true ,use_prior);
       }
-      findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c, 2,false,use_prior);
+      if (share_searches) {
+        int32_t &i1c_shared = index->i1c_of_i2c[i2c];
+        if (i1c_shared<0)
+          findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c_shared,2,false,use_prior);
+        i1c = i1c_shared;
+      } else {
+        findMatch(m2c,i2c,m1c,step_size,k1c,u_bin_num,v_bin_num,stat_bin,i1c, 2,false,use_prior);
+      }
       if (Tr_delta)
-        findMatch(m1c,i1c,m1p,step_size,k1p,u_bin_num,v_bin_num,stat_bin,i1p2,3,true ,use_prior,u1p,v1p);
+        findMatch(m1c,i1c,m1p,step_size,k1p,u_bin_num,v_bin_num,stat_bin,i1p2,3,true ,use_prior,u1p,v1p,r_pred);
       else
         findMatch(m1c,i1c,m1p,step_size,k1p,u_bin_num,v_bin_num,stat_bin,i1p2,3,true ,use_prior);
       
@@ -1424,10 +1684,6 @@ void Matcher::matching (int32_t *m1p,int32_t *m2p,int32_t *m1c,int32_t *m2c,
 
   // free memory
   free(M);
-  delete []k1p;
-  delete []k2p;
-  delete []k1c;
-  delete []k2c;
 }
 
 void Matcher::removeOutliers (vector<p_match> &p_matched,int32_t method) {
@@ -0,0 +1,59 @@
+/*
+Copyright 2012. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libviso2.
+Authors: Andreas Geiger
+
+libviso2 is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or any later version.
+
+libviso2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libviso2; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA 
+*/
+
+#include "simd.h"
+
+namespace simd {
+
+  namespace {
+
+    instruction_set detect () {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      if (avx2::available && __builtin_cpu_supports("avx2"))
+        return AVX2;
+#endif
+      return SSE3;
+    }
+
+    // initialized on first use, thread-safe in C++11
+    instruction_set& current () {
+      static instruction_set set = detect();
+      return set;
+    }
+  }
+
+  bool supported (instruction_set set) {
+    if (set==SSE3)
+      return true;
+    return detect()>=set;
+  }
+
+  instruction_set get () {
+    return current();
+  }
+
+  bool set (instruction_set set) {
+    if (!supported(set))
+      return false;
+    current() = set;
+    return true;
+  }
+}
@@ -0,0 +1,338 @@
+/*
+Copyright 2012. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libviso2.
+Authors: Andreas Geiger
+
+libviso2 is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or any later version.
+
+libviso2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libviso2; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA 
+*/
+
+// AVX2 versions of the 5x5 filters of filter.cpp, and the extrema kernels of the
+// non-maximum suppression of matcher.cpp.
+// This file alone is compiled with -mavx2, its kernels are only called if simd::get()
+// returns AVX2. The filters process twice the pixels per instruction and write exactly the
+// same output as the SSE kernels, including the pixels the SSE kernels write beyond the image
+// borders, and fall back to the SSE tail where a full AVX2 block does not fit
+
+#include <string.h>
+#include <cassert>
+#include <algorithm>
+
+#include "simd.h"
+#include "filter.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace simd {
+namespace avx2 {
+
+#ifdef __AVX2__
+
+  const bool available = true;
+
+  namespace {
+
+    // 16 unsigned bytes starting at p, widened to 16bit
+    inline __m256i load_8bit_to_16bit( const unsigned char* p ) {
+      return _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)( p ) ) );
+    }
+
+    inline __m256i load_16bit( const int16_t* p ) {
+      return _mm256_loadu_si256( (const __m256i*)( p ) );
+    }
+
+    // (1,4,6,4,1) row filter of 16 pixels, scaled by 1/128 and shifted to [0,255] (before saturation)
+    inline __m256i row_14641( const int16_t* in, const __m256i& offs ) {
+      __m256i i0 = load_16bit( in );
+      __m256i i1 = load_16bit( in+1 );
+      __m256i i2 = load_16bit( in+2 );
+      __m256i i3 = load_16bit( in+3 );
+      __m256i i4 = load_16bit( in+4 );
+      __m256i r  = _mm256_add_epi16( i0, i4 );
+      r = _mm256_add_epi16( r, _mm256_slli_epi16( _mm256_add_epi16( i1, i3 ), 2 ) );
+      r = _mm256_add_epi16( r, _mm256_slli_epi16( i2, 1 ) );
+      r = _mm256_add_epi16( r, _mm256_slli_epi16( i2, 2 ) );
+      r = _mm256_srai_epi16( r, 7 );
+      return _mm256_add_epi16( r, offs );
+    }
+
+    // (1,2,0,-2,-1) row filter of 16 pixels, scaled by 1/128 and shifted to [0,255] (before saturation)
+    inline __m256i row_12021( const int16_t* in, const __m256i& offs ) {
+      __m256i i0 = load_16bit( in );
+      __m256i i1 = load_16bit( in+1 );
+      __m256i i3 = load_16bit( in+3 );
+      __m256i i4 = load_16bit( in+4 );
+      __m256i r  = _mm256_add_epi16( i0, _mm256_slli_epi16( i1, 1 ) );
+      r = _mm256_sub_epi16( r, _mm256_slli_epi16( i3, 1 ) );
+      r = _mm256_sub_epi16( r, i4 );
+      r = _mm256_srai_epi16( r, 7 );
+      return _mm256_add_epi16( r, offs );
+    }
+
+    // saturate 2x16 values to 8bit and store them in order
+    inline void store_16bit_to_8bit_saturate( uint8_t* out, const __m256i& a0, const __m256i& a1 ) {
+      __m256i b = _mm256_permute4x64_epi64( _mm256_packus_epi16( a0, a1 ), 0xD8 );
+      _mm256_storeu_si256( (__m256i*)( out ), b );
+    }
+
+    // saturate 16 values to 8bit and store them in order
+    inline void store_16bit_to_8bit_saturate( uint8_t* out, const __m256i& a ) {
+      __m128i b = _mm_packus_epi16( _mm256_castsi256_si128( a ), _mm256_extracti128_si256( a, 1 ) );
+      _mm_storeu_si128( (__m128i*)( out ), b );
+    }
+  }
+
+  // the SSE kernel writes 16 pixels per iteration while i4 < end_input,
+  // here two of its iterations are done at once while both are in range
+  void convolve_14641_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h ) {
+    assert( w % 16 == 0 && "width must be multiple of 16!" );
+    const int16_t* i0 = in;
+    uint8_t* result   = out + 2;
+    const int16_t* const end_input = in + w*h;
+    const __m256i offs = _mm256_set1_epi16( 128 );
+    for( ; i0+4+16 < end_input; i0 += 32, result += 32 )
+      store_16bit_to_8bit_saturate( result, row_14641( i0, offs ), row_14641( i0+16, offs ) );
+    for( ; i0+4 < end_input; i0 += 16, result += 16 )
+      store_16bit_to_8bit_saturate( result, row_14641( i0, offs ) );
+  }
+
+  void convolve_12021_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h ) {
+    assert( w % 16 == 0 && "width must be multiple of 16!" );
+    const int16_t* i0 = in;
+    uint8_t* result   = out + 2;
+    const int16_t* const end_input = in + w*h;
+    const __m256i offs = _mm256_set1_epi16( 128 );
+    for( ; i0+4+16 < end_input; i0 += 32, result += 32 )
+      store_16bit_to_8bit_saturate( result, row_12021( i0, offs ), row_12021( i0+16, offs ) );
+    for( ; i0+4 < end_input; i0 += 16, result += 16 )
+      store_16bit_to_8bit_saturate( result, row_12021( i0, offs ) );
+  }
+
+  // (1,4,6,4,1) and (1,2,0,-2,-1) column filters, one 16 pixel chunk per iteration
+  // instead of two 8 pixel halves. Rows 0, 1, h-2 and h-1 of the output are zero
+  void convolve_cols_5x5( const unsigned char* in, int16_t* out_v, int16_t* out_h, int w, int h ) {
+    assert( w % 16 == 0 && "width must be multiple of 16!" );
+    memset( out_h, 0, 2*w*sizeof(int16_t) );
+    memset( out_v, 0, 2*w*sizeof(int16_t) );
+    memset( out_h + w*(h-2), 0, 2*w*sizeof(int16_t) );
+    memset( out_v + w*(h-2), 0, 2*w*sizeof(int16_t) );
+    const unsigned char* i0        = in;
+    const unsigned char* end_input = in + w*(h-4);
+    int16_t* result_h = out_h + 2*w;
+    int16_t* result_v = out_v + 2*w;
+    for( ; i0 != end_input; i0 += 16, result_h += 16, result_v += 16 ) {
+      __m256i r0 = load_8bit_to_16bit( i0 );
+      __m256i r1 = load_8bit_to_16bit( i0 + w );
+      __m256i r2 = load_8bit_to_16bit( i0 + 2*w );
+      __m256i r3 = load_8bit_to_16bit( i0 + 3*w );
+      __m256i r4 = load_8bit_to_16bit( i0 + 4*w );
+      __m256i rh = _mm256_sub_epi16( r0, r4 );
+      rh = _mm256_add_epi16( rh, _mm256_slli_epi16( _mm256_sub_epi16( r1, r3 ), 1 ) );
+      __m256i rv = _mm256_add_epi16( r0, r4 );
+      rv = _mm256_add_epi16( rv, _mm256_slli_epi16( _mm256_add_epi16( r1, r3 ), 2 ) );
+      rv = _mm256_add_epi16( rv, _mm256_mullo_epi16( r2, _mm256_set1_epi16( 6 ) ) );
+      _mm256_storeu_si256( (__m256i*)( result_h ), rh );
+      _mm256_storeu_si256( (__m256i*)( result_v ), rv );
+    }
+  }
+
+  // (1,1,0,-1,-1) column filter. Rows 0, 1, h-2 and h-1 of the output are zero
+  void convolve_col_p1p1p0m1m1_5x5( const unsigned char* in, int16_t* out, int w, int h ) {
+    assert( w % 16 == 0 && "width must be multiple of 16!" );
+    memset( out, 0, 2*w*sizeof(int16_t) );
+    memset( out + w*(h-2), 0, 2*w*sizeof(int16_t) );
+    const unsigned char* i0        = in;
+    const unsigned char* end_input = in + w*(h-4);
+    int16_t* result = out + 2*w;
+    for( ; i0 != end_input; i0 += 16, result += 16 ) {
+      __m256i r = _mm256_add_epi16( load_8bit_to_16bit( i0 ), load_8bit_to_16bit( i0 + w ) );
+      r = _mm256_sub_epi16( r, load_8bit_to_16bit( i0 + 3*w ) );
+      r = _mm256_sub_epi16( r, load_8bit_to_16bit( i0 + 4*w ) );
+      _mm256_storeu_si256( (__m256i*)( result ), r );
+    }
+  }
+
+  // (1,1,0,-1,-1) row filter, the SSE kernel writes 8 pixels per iteration while i4+8 < end_input
+  void convolve_row_p1p1p0m1m1_5x5( const int16_t* in, int16_t* out, int w, int h ) {
+    assert( w % 16 == 0 && "width must be multiple of 16!" );
+    const int16_t* i0 = in;
+    int16_t* result   = out + 2;
+    const int16_t* const end_input = in + w*h;
+    for( ; i0+4+16 < end_input; i0 += 16, result += 16 ) {
+      __m256i r = _mm256_add_epi16( load_16bit( i0 ), load_16bit( i0+1 ) );
+      r = _mm256_sub_epi16( r, load_16bit( i0+3 ) );
+      r = _mm256_sub_epi16( r, load_16bit( i0+4 ) );
+      _mm256_storeu_si256( (__m256i*)( result ), r );
+    }
+    for( ; i0+4+8 < end_input; i0 += 8, result += 8 ) {
+      __m128i r = _mm_add_epi16( _mm_loadu_si128( (const __m128i*)( i0 ) ), _mm_loadu_si128( (const __m128i*)( i0+1 ) ) );
+      r = _mm_sub_epi16( r, _mm_loadu_si128( (const __m128i*)( i0+3 ) ) );
+      r = _mm_sub_epi16( r, _mm_loadu_si128( (const __m128i*)( i0+4 ) ) );
+      _mm_storeu_si128( (__m128i*)( result ), r );
+    }
+  }
+
+  // 8 blob responses, not yet truncated to 16bit
+  namespace {
+    inline __m256i blob_8( const int32_t* i00, const uint8_t* im22, int w ) {
+      __m256i r = _mm256_loadu_si256( (const __m256i*)( i00 ) );
+      r = _mm256_sub_epi32( r, _mm256_loadu_si256( (const __m256i*)( i00 + 5 ) ) );
+      r = _mm256_sub_epi32( r, _mm256_loadu_si256( (const __m256i*)( i00 + 5*w ) ) );
+      r = _mm256_add_epi32( r, _mm256_loadu_si256( (const __m256i*)( i00 + 5 + 5*w ) ) );
+      __m256i c = _mm256_loadu_si256( (const __m256i*)( i00 + 4 + 4*w ) );
+      c = _mm256_sub_epi32( c, _mm256_loadu_si256( (const __m256i*)( i00 + 4 + 1*w ) ) );
+      c = _mm256_sub_epi32( c, _mm256_loadu_si256( (const __m256i*)( i00 + 1 + 4*w ) ) );
+      c = _mm256_add_epi32( c, _mm256_loadu_si256( (const __m256i*)( i00 + 1 + 1*w ) ) );
+      __m256i m = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( im22 ) ) );
+      r = _mm256_sub_epi32( _mm256_slli_epi32( c, 1 ), r );
+      r = _mm256_add_epi32( r, _mm256_sub_epi32( _mm256_slli_epi32( m, 3 ), m ) );
+      return r;
+    }
+  }
+
+  // blob5x5 as in filter::detail, 16 responses per iteration. The low 16bit of the 32bit
+  // responses are packed with unsigned saturation, which keeps them unchanged, to store
+  // the same truncated values as the scalar loop
+  void blob5x5_from_integral( const uint8_t* in, const int32_t* integral, int16_t* out, int w, int h ) {
+    int16_t* out_ptr   = out + 3 + 3*w;
+    int16_t* out_end   = out + w * h - 2 - 2*w;
+    const int32_t* i00 = integral;
+    const uint8_t* im22 = in + 3 + 3*w;
+    const __m256i low = _mm256_set1_epi32( 0xFFFF );
+    for( ; out_end-out_ptr >= 16; out_ptr += 16, i00 += 16, im22 += 16 ) {
+      __m256i r0 = _mm256_and_si256( blob_8( i00, im22, w ), low );
+      __m256i r1 = _mm256_and_si256( blob_8( i00+8, im22+8, w ), low );
+      __m256i r  = _mm256_permute4x64_epi64( _mm256_packus_epi32( r0, r1 ), 0xD8 );
+      _mm256_storeu_si256( (__m256i*)( out_ptr ), r );
+    }
+    for( ; out_ptr != out_end; out_ptr++, i00++, im22++ ) {
+      int32_t result = 0;
+      result = -( *(i00+5+5*w) - *(i00+5) - *(i00+5*w) + *i00 );
+      result += 2*( *(i00+4+4*w) - *(i00+4+1*w) - *(i00+1+4*w) + *(i00+1+1*w) );
+      result += 7* *im22;
+      *out_ptr = result;
+    }
+  }
+
+  // vertical extrema of 16 columns per iteration, the columns past the last full block
+  // are done one at a time
+  void column_extrema_16bit( const int16_t* in, int bpl, int rows, int w, int16_t* out_min, int16_t* out_max ) {
+    int u = 0;
+    for( ; u+16 <= w; u += 16 ) {
+      __m256i mn = load_16bit( in+u );
+      __m256i mx = mn;
+      for( int v=1; v<rows; v++ ) {
+        __m256i r = load_16bit( in+v*bpl+u );
+        mn = _mm256_min_epi16( mn, r );
+        mx = _mm256_max_epi16( mx, r );
+      }
+      _mm256_storeu_si256( (__m256i*)( out_min+u ), mn );
+      _mm256_storeu_si256( (__m256i*)( out_max+u ), mx );
+    }
+    for( ; u < w; u++ ) {
+      int16_t mn = in[u], mx = in[u];
+      for( int v=1; v<rows; v++ ) {
+        mn = std::min( mn, in[v*bpl+u] );
+        mx = std::max( mx, in[v*bpl+u] );
+      }
+      out_min[u] = mn;
+      out_max[u] = mx;
+    }
+  }
+
+  // horizontal extrema of 16 windows per iteration, reading only in[-n..w-1+n]
+  void window_extrema_16bit( const int16_t* in_min, const int16_t* in_max, int n, int w, int16_t* out_min, int16_t* out_max ) {
+    int u = 0;
+    for( ; u+16 <= w; u += 16 ) {
+      __m256i mn = load_16bit( in_min+u-n );
+      __m256i mx = load_16bit( in_max+u-n );
+      for( int k=-n+1; k<=n; k++ ) {
+        mn = _mm256_min_epi16( mn, load_16bit( in_min+u+k ) );
+        mx = _mm256_max_epi16( mx, load_16bit( in_max+u+k ) );
+      }
+      _mm256_storeu_si256( (__m256i*)( out_min+u ), mn );
+      _mm256_storeu_si256( (__m256i*)( out_max+u ), mx );
+    }
+    for( ; u < w; u++ ) {
+      int16_t mn = in_min[u-n], mx = in_max[u-n];
+      for( int k=-n+1; k<=n; k++ ) {
+        mn = std::min( mn, in_min[u+k] );
+        mx = std::max( mx, in_max[u+k] );
+      }
+      out_min[u] = mn;
+      out_max[u] = mx;
+    }
+  }
+
+#else
+
+  // built without -mavx2: never selected by simd::get(), forward to the SSE kernels
+  const bool available = false;
+
+  void convolve_14641_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h ) {
+    filter::detail::convolve_14641_row_5x5_16bit( in, out, w, h );
+  }
+
+  void convolve_12021_row_5x5_16bit( const int16_t* in, uint8_t* out, int w, int h ) {
+    filter::detail::convolve_12021_row_5x5_16bit( in, out, w, h );
+  }
+
+  void convolve_cols_5x5( const unsigned char* in, int16_t* out_v, int16_t* out_h, int w, int h ) {
+    filter::detail::convolve_cols_5x5( in, out_v, out_h, w, h );
+  }
+
+  void convolve_col_p1p1p0m1m1_5x5( const unsigned char* in, int16_t* out, int w, int h ) {
+    filter::detail::convolve_col_p1p1p0m1m1_5x5( in, out, w, h );
+  }
+
+  void convolve_row_p1p1p0m1m1_5x5( const int16_t* in, int16_t* out, int w, int h ) {
+    filter::detail::convolve_row_p1p1p0m1m1_5x5( in, out, w, h );
+  }
+
+  void blob5x5_from_integral( const uint8_t* in, const int32_t* integral, int16_t* out, int w, int h ) {
+    filter::detail::blob5x5_from_integral( in, integral, out, w, h );
+  }
+
+  // the matcher uses its scalar search if AVX2 is not selected, these are for completeness
+  void column_extrema_16bit( const int16_t* in, int bpl, int rows, int w, int16_t* out_min, int16_t* out_max ) {
+    for( int u=0; u<w; u++ ) {
+      int16_t mn = in[u], mx = in[u];
+      for( int v=1; v<rows; v++ ) {
+        mn = std::min( mn, in[v*bpl+u] );
+        mx = std::max( mx, in[v*bpl+u] );
+      }
+      out_min[u] = mn;
+      out_max[u] = mx;
+    }
+  }
+
+  void window_extrema_16bit( const int16_t* in_min, const int16_t* in_max, int n, int w, int16_t* out_min, int16_t* out_max ) {
+    for( int u=0; u<w; u++ ) {
+      int16_t mn = in_min[u-n], mx = in_max[u-n];
+      for( int k=-n+1; k<=n; k++ ) {
+        mn = std::min( mn, in_min[u+k] );
+        mx = std::max( mx, in_max[u+k] );
+      }
+      out_min[u] = mn;
+      out_max[u] = mx;
+    }
+  }
+
+#endif
+
+}
+}
@@ -0,0 +1,134 @@
+/*
+Copyright 2012. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libviso2.
+Authors: Andreas Geiger
+
+libviso2 is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or any later version.
+
+libviso2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libviso2; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+/*
+  Checks that Matcher::pushBack gives the same quad matches when the left and right
+  features are computed concurrently through setParallelFor as when they are computed
+  serially, at half and full resolution, on a synthetic stereo sequence of KITTI sized
+  images. Build with -DLIBVISO2_SANITIZER=address or thread to run it under ASan or TSan.
+  Usage: test_matcher [number of frames]
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+#include <stdint.h>
+
+#include "matcher.h"
+
+using namespace std;
+using namespace libviso2;
+
+// a smooth random texture, wider than the images so that they can be cut out with offsets
+static vector<uint8_t> make_texture (int w,int h) {
+  vector<int> noise(w*h);
+  srand(0);
+  for (int i=0; i<w*h; i++)
+    noise[i] = rand()%256;
+  vector<uint8_t> texture(w*h,0);
+  const int r = 2;
+  for (int v=r; v<h-r; v++) {
+    for (int u=r; u<w-r; u++) {
+      int sum = 0;
+      for (int dv=-r; dv<=r; dv++)
+        for (int du=-r; du<=r; du++)
+          sum += noise[(v+dv)*w+u+du];
+      texture[v*w+u] = (uint8_t)(sum/((2*r+1)*(2*r+1)));
+    }
+  }
+  return texture;
+}
+
+static vector<uint8_t> crop (const vector<uint8_t> &texture,int tw,int u0,int v0,int w,int h) {
+  vector<uint8_t> I(w*h);
+  for (int v=0; v<h; v++)
+    for (int u=0; u<w; u++)
+      I[v*w+u] = texture[(v+v0)*tw+u+u0];
+  return I;
+}
+
+// runs task(1) in a second thread, as a two worker thread pool would
+static void two_threads (size_t n,const function<void (size_t)> &task) {
+  vector<thread> workers;
+  for (size_t i=1; i<n; i++)
+    workers.push_back(thread(task,i));
+  task(0);
+  for (size_t i=0; i<workers.size(); i++)
+    workers[i].join();
+}
+
+static vector<vector<p_match> > run_matcher (const vector<uint8_t> &texture,int tw,int w,int h,
+                                             int num_frames,int32_t half_resolution,bool parallel) {
+  Matcher::parameters param;
+  param.half_resolution = half_resolution;
+  Matcher matcher(param);
+  if (parallel)
+    matcher.setParallelFor(two_threads);
+
+  // the camera moves 3 pixels to the left per frame, the right image sees the scene 10 pixels shifted
+  vector<vector<p_match> > matches;
+  int32_t dims[] = {w,h,w};
+  for (int f=0; f<num_frames; f++) {
+    vector<uint8_t> I1 = crop(texture,tw,40+3*f,8,w,h);
+    vector<uint8_t> I2 = crop(texture,tw,50+3*f,8,w,h);
+    matcher.pushBack(&I1[0],&I2[0],dims,false);
+    if (f>0) {
+      matcher.matchFeatures(2);
+      matches.push_back(matcher.getMatches());
+    }
+  }
+  return matches;
+}
+
+static bool same_matches (const vector<vector<p_match> > &a,const vector<vector<p_match> > &b) {
+  if (a.size()!=b.size())
+    return false;
+  for (size_t f=0; f<a.size(); f++) {
+    if (a[f].size()!=b[f].size() || a[f].empty())
+      return false;
+    for (size_t i=0; i<a[f].size(); i++) {
+      const p_match &p = a[f][i], &q = b[f][i];
+      if (p.u1p!=q.u1p || p.v1p!=q.v1p || p.i1p!=q.i1p || p.u2p!=q.u2p || p.v2p!=q.v2p || p.i2p!=q.i2p ||
+          p.u1c!=q.u1c || p.v1c!=q.v1c || p.i1c!=q.i1c || p.u2c!=q.u2c || p.v2c!=q.v2c || p.i2c!=q.i2c)
+        return false;
+    }
+  }
+  return true;
+}
+
+int main (int argc,char **argv) {
+  const int num_frames = argc>1 ? atoi(argv[1]) : 5;
+  const int w = 1241, h = 376;
+  const int tw = w+100+3*num_frames, th = h+16;
+  vector<uint8_t> texture = make_texture(tw,th);
+
+  bool passed = true;
+  for (int32_t half_resolution=0; half_resolution<=1; half_resolution++) {
+    vector<vector<p_match> > serial   = run_matcher(texture,tw,w,h,num_frames,half_resolution,false);
+    vector<vector<p_match> > parallel = run_matcher(texture,tw,w,h,num_frames,half_resolution,true);
+    const bool same = same_matches(serial,parallel);
+    cout << (half_resolution ? "half" : "full") << " resolution, " << (serial.empty() ? 0 : serial.back().size())
+         << " matches in the last frame: " << (same ? "passed" : "FAILED") << endl;
+    passed = passed && same;
+  }
+  return passed ? 0 : 1;
+}
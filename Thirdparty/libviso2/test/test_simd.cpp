@@ -0,0 +1,218 @@
+/*
+Copyright 2012. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libviso2.
+Authors: Andreas Geiger
+
+libviso2 is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or any later version.
+
+libviso2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libviso2; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA 
+*/
+
+/*
+  Checks that the AVX2 filters and non-maximum suppression give bit-exact the same
+  results as the SSE ones, also in the features and quad matches built on them, and
+  compares their run times, on synthetic KITTI sized images.
+  Usage: test_simd [number of repetitions]
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <stdint.h>
+
+#include "filter.h"
+#include "matcher.h"
+#include "simd.h"
+
+using namespace std;
+using namespace libviso2;
+
+// output of the filters on one image
+struct filter_output {
+  vector<uint8_t> sobel_v, sobel_h;
+  vector<int16_t> checkerboard, blob;
+  double t_sobel, t_checkerboard, t_blob;
+};
+
+static double seconds_since (const chrono::steady_clock::time_point &start) {
+  return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+// the kernels write a few pixels past the image, hence the padding
+static filter_output run_filters (const vector<uint8_t> &I,int w,int h,int repetitions) {
+  const int padding = 64;
+  filter_output out;
+  out.sobel_v.assign(w*h+padding,0);
+  out.sobel_h.assign(w*h+padding,0);
+  out.checkerboard.assign(w*h+padding,0);
+  out.blob.assign(w*h+padding,0);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int r=0; r<repetitions; r++)
+    filter::sobel5x5(&I[0],&out.sobel_v[0],&out.sobel_h[0],w,h);
+  out.t_sobel = seconds_since(start)/repetitions;
+
+  start = chrono::steady_clock::now();
+  for (int r=0; r<repetitions; r++)
+    filter::checkerboard5x5(&I[0],&out.checkerboard[0],w,h);
+  out.t_checkerboard = seconds_since(start)/repetitions;
+
+  start = chrono::steady_clock::now();
+  for (int r=0; r<repetitions; r++)
+    filter::blob5x5(&I[0],&out.blob[0],w,h);
+  out.t_blob = seconds_since(start)/repetitions;
+
+  out.sobel_v.resize(w*h);
+  out.sobel_h.resize(w*h);
+  out.checkerboard.resize(w*h);
+  out.blob.resize(w*h);
+  return out;
+}
+
+// the extrema kernels of the non-maximum suppression against a scalar reference, on
+// random values including the 16bit limits, for widths with and without a tail
+static bool check_extrema_kernels () {
+  const int bpl = 80, rows = 7, n = 5;
+  vector<int16_t> in(bpl*rows),out_min(bpl),out_max(bpl),win_min(bpl),win_max(bpl);
+  srand(2);
+  for (size_t i=0; i<in.size(); i++)
+    in[i] = rand()%8==0 ? (rand()%2 ? INT16_MAX : INT16_MIN) : (int16_t)(rand()%65536-32768);
+  for (int w=1; w<=bpl-2*n; w++) {
+    simd::avx2::column_extrema_16bit(&in[0],bpl,rows,w,&out_min[0],&out_max[0]);
+    simd::avx2::window_extrema_16bit(&in[n],&in[bpl+n],n,w,&win_min[0],&win_max[0]);
+    for (int u=0; u<w; u++) {
+      int16_t mn = in[u], mx = in[u], wmn = in[u], wmx = in[bpl+u];
+      for (int v=1; v<rows; v++) {
+        mn = min(mn,in[v*bpl+u]);
+        mx = max(mx,in[v*bpl+u]);
+      }
+      for (int k=1; k<=2*n; k++) {
+        wmn = min(wmn,in[u+k]);
+        wmx = max(wmx,in[bpl+u+k]);
+      }
+      if (out_min[u]!=mn || out_max[u]!=mx || win_min[u]!=wmn || win_max[u]!=wmx)
+        return false;
+    }
+  }
+  return true;
+}
+
+// quad matches of a sequence of shifted stereo images, with the number of sparse and dense
+// features of each image and the total time of the non-maximum suppression
+static vector<p_match> run_matcher (const vector<uint8_t> &base,int base_width,int w,int h,int frames,
+                                    vector<int32_t> &num_features,double &t_nms) {
+  Matcher::parameters param;
+  param.f = 700; param.cu = w/2; param.cv = h/2; param.base = 0.5;
+  Matcher matcher(param);
+  int32_t dims[3] = {w,h,w};
+  vector<uint8_t> I1(w*h),I2(w*h);
+  vector<p_match> matches;
+  t_nms = 0;
+  for (int f=0; f<frames; f++) {
+    for (int v=0; v<h; v++)
+      for (int u=0; u<w; u++) {
+        I1[v*w+u] = base[(v+f)*base_width+u+2*f];
+        I2[v*w+u] = base[(v+f)*base_width+u+2*f+7];
+      }
+    matcher.pushBack(&I1[0],&I2[0],dims,false);
+    for (int left=0; left<2; left++) {
+      num_features.push_back(matcher.getNumSparseFeatures(left));
+      num_features.push_back(matcher.getNumDenseFeatures(left));
+      t_nms += matcher.getTiming().nms[left];
+    }
+    if (f==0)
+      continue;
+    matcher.matchFeatures(2);
+    vector<p_match> m = matcher.getMatches();
+    matches.insert(matches.end(),m.begin(),m.end());
+  }
+  return matches;
+}
+
+static bool same_matches (const vector<p_match> &a,const vector<p_match> &b) {
+  if (a.size()!=b.size())
+    return false;
+  for (size_t i=0; i<a.size(); i++)
+    if (a[i].u1p!=b[i].u1p || a[i].v1p!=b[i].v1p || a[i].i1p!=b[i].i1p ||
+        a[i].u2p!=b[i].u2p || a[i].v2p!=b[i].v2p || a[i].i2p!=b[i].i2p ||
+        a[i].u1c!=b[i].u1c || a[i].v1c!=b[i].v1c || a[i].i1c!=b[i].i1c ||
+        a[i].u2c!=b[i].u2c || a[i].v2c!=b[i].v2c || a[i].i2c!=b[i].i2c)
+      return false;
+  return true;
+}
+
+int main (int argc,char** argv) {
+  const int repetitions = argc>1 ? atoi(argv[1]) : 100;
+  const int w = 1248, h = 376, frames = 6;
+
+  if (!simd::supported(simd::AVX2)) {
+    cout << "AVX2 is not supported by this CPU or build, nothing to compare" << endl;
+    return 0;
+  }
+
+  // smoothed noise, so that the matcher finds features
+  const int base_width = w+64, base_height = h+16;
+  vector<uint8_t> base(base_width*base_height);
+  srand(1);
+  for (size_t i=0; i<base.size(); i++)
+    base[i] = rand()%256;
+  for (int it=0; it<2; it++)
+    for (size_t i=1; i+base_width+1<base.size(); i++)
+      base[i] = (base[i-1]+base[i]+base[i+1]+base[i+base_width])/4;
+  vector<uint8_t> I(w*h);
+  for (int v=0; v<h; v++)
+    memcpy(&I[v*w],&base[v*base_width],w);
+
+  simd::set(simd::SSE3);
+  filter_output out_sse = run_filters(I,w,h,repetitions);
+  vector<int32_t> features_sse,features_avx2;
+  double t_nms_sse,t_nms_avx2;
+  vector<p_match> matches_sse = run_matcher(base,base_width,w,h,frames,features_sse,t_nms_sse);
+
+  simd::set(simd::AVX2);
+  filter_output out_avx2 = run_filters(I,w,h,repetitions);
+  vector<p_match> matches_avx2 = run_matcher(base,base_width,w,h,frames,features_avx2,t_nms_avx2);
+
+  bool ok = true;
+  if (out_sse.sobel_v!=out_avx2.sobel_v || out_sse.sobel_h!=out_avx2.sobel_h) {
+    cout << "sobel5x5 differs" << endl; ok = false;
+  }
+  if (out_sse.checkerboard!=out_avx2.checkerboard) {
+    cout << "checkerboard5x5 differs" << endl; ok = false;
+  }
+  if (out_sse.blob!=out_avx2.blob) {
+    cout << "blob5x5 differs" << endl; ok = false;
+  }
+  if (!check_extrema_kernels()) {
+    cout << "extrema kernels differ from the scalar reference" << endl; ok = false;
+  }
+  if (features_sse!=features_avx2) {
+    cout << "number of features differs" << endl; ok = false;
+  }
+  if (!same_matches(matches_sse,matches_avx2)) {
+    cout << "matches differ: " << matches_sse.size() << " with SSE, " << matches_avx2.size() << " with AVX2" << endl; ok = false;
+  }
+  cout << "AVX2 results are " << (ok ? "bit-exact the same as" : "DIFFERENT from") << " SSE, "
+       << matches_sse.size() << " matches" << endl;
+
+  cout << "             SSE (ms)  AVX2 (ms)" << endl;
+  cout << "sobel5x5        " << out_sse.t_sobel*1e3 << "  " << out_avx2.t_sobel*1e3 << endl;
+  cout << "checkerboard5x5 " << out_sse.t_checkerboard*1e3 << "  " << out_avx2.t_checkerboard*1e3 << endl;
+  cout << "blob5x5         " << out_sse.t_blob*1e3 << "  " << out_avx2.t_blob*1e3 << endl;
+  cout << "nms per image   " << t_nms_sse/(2*frames) << "  " << t_nms_avx2/(2*frames) << endl;
+  return ok ? 0 : 1;
+}
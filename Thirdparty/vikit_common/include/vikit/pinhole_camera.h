@@ -10,6 +10,7 @@
 
 #include <stdlib.h>
 #include <string>
+#include <vector>
 #include <Eigen/Eigen>
 #include <vikit/abstract_camera.h>
 #include <opencv2/opencv.hpp>
@@ -28,6 +29,7 @@ private:
   double d_[5];                 //!< distortion parameters, see http://docs.opencv.org/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html
   cv::Mat cvK_, cvD_;
   cv::Mat undist_map1_, undist_map2_;
+  cv::Mat undist_lut_;          //!< undistorted position of every pixel, CV_32FC2 of (height+1)x(width+1), shared by copies
   bool use_optimization_;
   Matrix3d K_;
   Matrix3d K_inv_;
@@ -44,6 +46,15 @@ public:
   void
   initUnistortionMap();
 
+  //! build the lookup table of undistorted pixel positions, done once by the constructor if there is distortion
+  void
+  initUndistortionLut();
+
+  //! undistort keypoints by bilinear interpolation in the lookup table instead of the iterative
+  //! cv::undistortPoints, which is only used for the keypoints out of the image
+  void
+  undistortKeyPoints(const std::vector<cv::KeyPoint>& kps, std::vector<cv::KeyPoint>& kps_un) const;
+
   virtual Vector3d
   cam2world(const double& x, const double& y) const;
 
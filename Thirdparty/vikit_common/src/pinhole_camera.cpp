@@ -35,6 +35,8 @@ PinholeCamera(double width, double height,
                               cv::Size(width_, height_), CV_16SC2, undist_map1_, undist_map2_);
   K_ << fx_, 0.0, cx_, 0.0, fy_, cy_, 0.0, 0.0, 1.0;
   K_inv_ = K_.inverse();
+  if(distortion_)
+    initUndistortionLut();
 }
 
 PinholeCamera::
@@ -105,6 +107,53 @@ world2cam(const Vector2d& uv) const
   return px;
 }
 
+void PinholeCamera::
+initUndistortionLut()
+{
+  // one entry per pixel corner, so that every position in the image has 4 neighbours
+  const int cols = width_+1, rows = height_+1;
+  cv::Mat grid(rows*cols, 1, CV_32FC2);
+  for(int v=0; v<rows; ++v)
+    for(int u=0; u<cols; ++u)
+      grid.at<cv::Point2f>(v*cols+u) = cv::Point2f(u, v);
+  cv::undistortPoints(grid, grid, cvK_, cvD_, cv::Mat(), cvK_);
+  undist_lut_ = grid.reshape(2, rows);
+}
+
+void PinholeCamera::
+undistortKeyPoints(const std::vector<cv::KeyPoint>& kps, std::vector<cv::KeyPoint>& kps_un) const
+{
+  kps_un = kps;
+  if(!distortion_)
+    return;
+
+  const float max_u = undist_lut_.cols-1, max_v = undist_lut_.rows-1;
+  std::vector<size_t> outside;
+  for(size_t i=0; i<kps.size(); ++i)
+  {
+    const float u = kps[i].pt.x, v = kps[i].pt.y;
+    if(!(u>=0 && v>=0 && u<max_u && v<max_v))
+    {
+      outside.push_back(i);
+      continue;
+    }
+    const int u0 = u, v0 = v;
+    const float a = u-u0, b = v-v0;
+    const cv::Point2f* row0 = undist_lut_.ptr<cv::Point2f>(v0)+u0;
+    const cv::Point2f* row1 = undist_lut_.ptr<cv::Point2f>(v0+1)+u0;
+    kps_un[i].pt = (1-b)*((1-a)*row0[0] + a*row0[1]) + b*((1-a)*row1[0] + a*row1[1]);
+  }
+
+  if(outside.empty())
+    return;
+  cv::Mat pts(outside.size(), 1, CV_32FC2);
+  for(size_t i=0; i<outside.size(); ++i)
+    pts.at<cv::Point2f>(i) = kps[outside[i]].pt;
+  cv::undistortPoints(pts, pts, cvK_, cvD_, cv::Mat(), cvK_);
+  for(size_t i=0; i<outside.size(); ++i)
+    kps_un[outside[i]].pt = pts.at<cv::Point2f>(i);
+}
+
 void PinholeCamera::
 undistortImage(const cv::Mat& raw, cv::Mat& rectified)
 {
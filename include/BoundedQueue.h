@@ -0,0 +1,72 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <deque>
+#include <boost/thread.hpp>
+
+namespace ORB_SLAM
+{
+// A FIFO shared by a producer and a consumer thread. Push blocks while the queue is full,
+// Pop blocks while it is empty, and both return false once the queue is closed
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t nCapacity): mnCapacity(nCapacity>0? nCapacity: 1), mbClosed(false) {}
+
+    bool Push(const T& item)
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        while(mQueue.size()>=mnCapacity && !mbClosed)
+            mCondNotFull.wait(lock);
+        if(mbClosed)
+            return false;
+        mQueue.push_back(item);
+        mCondNotEmpty.notify_one();
+        return true;
+    }
+
+    // items pushed before Close are still popped
+    bool Pop(T& item)
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        while(mQueue.empty() && !mbClosed)
+            mCondNotEmpty.wait(lock);
+        if(mQueue.empty())
+            return false;
+        item = mQueue.front();
+        mQueue.pop_front();
+        mCondNotFull.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mbClosed = true;
+        mCondNotFull.notify_all();
+        mCondNotEmpty.notify_all();
+    }
+
+    // remove the items that will never be popped, e.g., to release them when the consumer quits
+    std::deque<T> Drain()
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        std::deque<T> remaining;
+        remaining.swap(mQueue);
+        mCondNotFull.notify_all();
+        return remaining;
+    }
+
+protected:
+    const size_t mnCapacity;
+    bool mbClosed;
+    std::deque<T> mQueue;
+    boost::mutex mMutex;
+    boost::condition_variable mCondNotFull;
+    boost::condition_variable mCondNotEmpty;
+};
+
+} //namespace ORB_SLAM
+
+#endif // BOUNDEDQUEUE_H
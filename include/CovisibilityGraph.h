@@ -0,0 +1,63 @@
+#ifndef COVISIBILITYGRAPH_H
+#define COVISIBILITYGRAPH_H
+
+#include <vector>
+#include <utility>
+#include <boost/thread.hpp>
+
+namespace ORB_SLAM
+{
+
+class KeyFrame;
+
+// Number of map points shared by every pair of keyframes, kept up to date by MapPoint as left observations
+// are added and erased, so that KeyFrame::UpdateConnections() reads the weights of a keyframe instead of
+// counting the observers of all its map points. Bad map points share nothing.
+// The adjacency is indexed by KeyFrame::mnFrameId, each row holds the keyframes with a nonzero count and
+// records which of them changed since its keyframe last took the changes, so that a keyframe updates its
+// connections in the time of the changes.
+// All functions are thread safe, the mutex is taken last, after those of map points and keyframes
+class CovisibilityGraph
+{
+public:
+    // add nDelta to the count of pKF with each of the n keyframes in vpKFs, except pKF itself
+    void AddWeights(KeyFrame* pKF, KeyFrame* const* vpKFs, size_t n, int nDelta);
+
+    // the keyframes sharing map points with pKF and their counts
+    void GetWeights(KeyFrame* pKF, std::vector<std::pair<KeyFrame*,int> > &vWeights);
+
+    // the keyframes whose count with pKF changed since the last call for pKF, with their counts, 0 for those
+    // sharing nothing any more. On the first call, all keyframes sharing map points with pKF
+    void TakeChanges(KeyFrame* pKF, std::vector<std::pair<KeyFrame*,int> > &vChanges);
+
+    // drop pKF from the graph, when it is set bad or deleted
+    void EraseKeyFrame(KeyFrame* pKF);
+
+    void Clear();
+
+protected:
+    struct Edge
+    {
+        KeyFrame* pKF;
+        int nWeight; // 0 only until the change is taken
+        bool bChanged;
+    };
+    // ids start again from 0 after a reset, so a row also records its keyframe
+    struct Row
+    {
+        Row(): pKF(NULL) {}
+        KeyFrame* pKF;
+        std::vector<Edge> vEdges;
+        std::vector<size_t> vnChanged; // indices in vEdges of the changed edges
+    };
+    // the row of pKF, created if needed. The caller holds mMutex
+    Row& GetRow(KeyFrame* pKF);
+    void AddWeight(KeyFrame* pKF1, KeyFrame* pKF2, int nDelta);
+
+    std::vector<Row> mvRows;
+    boost::mutex mMutex;
+};
+
+} //namespace ORB_SLAM
+
+#endif // COVISIBILITYGRAPH_H
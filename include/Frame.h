@@ -31,6 +31,9 @@
 #include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
 #include "ORBVocabulary.h"
 #include "ORBextractor.h"
+#include "ImagePyramid.h"
+#include "FrameGrid.h"
+#include "FrustumCulling.h"
 #include "sophus/se3.hpp"
 #include "boost/shared_ptr.hpp"
 #include "g2o/types/sba/types_six_dof_expmap.h"
@@ -55,14 +58,18 @@ class Frame
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW 
     Frame(const Frame &frame);
+    // takes over the keypoints, descriptors, grid and other buffers of frame without copying them,
+    // frame is left without features and should only be deleted
+    Frame(Frame &&frame);
 
     //monocular
     Frame(cv::Mat &im, const double &timeStamp, ORBextractor* extractor, ORBVocabulary* voc,
           vk::PinholeCamera* cam,  const Eigen::Vector3d ginc=Eigen::Vector3d::Zero(),
           const Eigen::Matrix<double, 9,1> sb=Eigen::Matrix<double, 9,1>::Zero());
-    // stereo and viso2 stereo matches
-    Frame(cv::Mat &im , const double &timeStamp, const int num_features_left,
-          cv::Mat &right_img, const int num_features_right,
+    // stereo and viso2 stereo matches, the ORB descriptors are computed on the pyramids shared with libviso2.
+    // It may be built ahead on another thread, so mnId is left to AssignNextId() by the tracking thread
+    Frame(ImagePyramid &left_pyr, const double &timeStamp, const int num_features_left,
+          ImagePyramid &right_pyr, const int num_features_right,
           const std::vector<p_match> & vStereoMatches, ORBextractor* extractor, ORBVocabulary* voc,
           vk::PinholeCamera* cam, vk::PinholeCamera* right_cam,
           const Sophus::SE3d& Tl2r, const Eigen::Vector3d &ginc, const Eigen::Matrix<double, 9,1> sb);
@@ -198,6 +205,10 @@ inline void updatePointStatistics(PointStatistics* stats){
     // Check if a MapPoint is in the frustum of the camera and also fills variables of the MapPoint to be used by the tracking
     bool isInFrustum(MapPoint* pMP, float viewingCosLimit);
     bool isInFrustumStereo(MapPoint* pMP, float viewingCosLimit);
+    // The same on all the points of a batch filled by Batch::Assign, in single precision.
+    // Return the number of points in view
+    int isInFrustum(FrustumCulling::Batch &batch, float viewingCosLimit);
+    int isInFrustumStereo(FrustumCulling::Batch &batch, float viewingCosLimit);
     // Compute the cell of a keypoint (return false if outside the grid)
     bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY);
 
@@ -256,11 +267,13 @@ inline void updatePointStatistics(PointStatistics* stats){
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints
     static float mfGridElementWidthInv;
     static float mfGridElementHeightInv;
-    std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS]; //used by GetFeaturesInArea()
+    FrameGrid mGrid; //used by GetFeaturesInArea()
 
     // Current and Next Frame id
     static long unsigned int nNextId;
     long unsigned int mnId; //mnId has the same meaning in derived KeyFrame class and in base Frame class, it is supposed to be continuous for frames
+    // numbers the frame in tracking order, called by the tracking thread only, so that ids restart after a reset
+    void AssignNextId(){ mnId = nNextId++; }
 
     // Scale pyramid info.
     int mnScaleLevels;
@@ -293,6 +306,8 @@ inline void updatePointStatistics(PointStatistics* stats){
     vio::G2oVertexSpeedBias*        v_sb_; //!< temporary pointer to g2o speed bias vertex
 private:
     void ComputeImageBounds();
+    void AssignFeaturesToGrid();
+    int CullBatch(FrustumCulling::Batch &batch, float viewingCosLimit, bool bStereo);
     Frame& operator= (const Frame&);
 };
 // given matched features between F1 and F2, put them into p_match structure
@@ -0,0 +1,53 @@
+#ifndef FRAMEGRID_H
+#define FRAMEGRID_H
+
+#include <vector>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace ORB_SLAM
+{
+// Index of the undistorted keypoints of a frame by grid cell, used by GetFeaturesInArea().
+// The keypoints are stored cell after cell in contiguous arrays (compressed sparse row layout),
+// with cell c covering entries [mvCellStarts[c], mvCellStarts[c+1]), so that building the index
+// takes a few allocations instead of one per cell and an area search scans memory linearly.
+// Within a cell, keypoints keep their order in the frame, so that the search returns the same indices
+// as the former vector-per-cell grid
+class FrameGrid
+{
+public:
+    FrameGrid(int nCols, int nRows);
+
+    // assign keypoints to cells of 1/fCellWidthInv x 1/fCellHeightInv pixels starting at (fMinX, fMinY),
+    // keypoints outside the grid are left out
+    void Build(const std::vector<cv::KeyPoint> &vKeysUn, float fMinX, float fMinY,
+               float fCellWidthInv, float fCellHeightInv);
+    void Clear();
+
+    // Compute the cell of a keypoint (return false if outside the grid)
+    bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) const;
+
+    // indices of keypoints within the square of half size r centred at (x, y),
+    // with octave in [minLevel, maxLevel] unless both are -1
+    std::vector<std::size_t> GetFeaturesInArea(const float &x, const float &y, const float &r,
+                                               const int minLevel=-1, const int maxLevel=-1) const;
+
+    std::size_t size() const { return mvIndices.size(); }
+
+protected:
+    int mnCols;
+    int mnRows;
+    float mfMinX;
+    float mfMinY;
+    float mfCellWidthInv;
+    float mfCellHeightInv;
+
+    std::vector<unsigned int> mvCellStarts; // mnCols*mnRows+1 offsets, cell (ix, iy) is ix*mnRows+iy
+    std::vector<unsigned int> mvIndices; // index of the keypoint in the frame
+    std::vector<float> mvX;
+    std::vector<float> mvY;
+    std::vector<int> mvOctaves;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FRAMEGRID_H
@@ -0,0 +1,68 @@
+#ifndef FRUSTUMCULLING_H
+#define FRUSTUMCULLING_H
+
+#include <cstddef>
+#include <vector>
+
+namespace ORB_SLAM
+{
+class MapPoint;
+
+// Visibility of many MapPoints in a frame at once, as Frame::isInFrustum and Frame::isInFrustumStereo
+// point by point. The points are copied in structure of arrays and projected in single precision,
+// the kernel is chosen at startup from what the CPU supports, all kernels give the same projections
+namespace FrustumCulling
+{
+enum Kernel {SCALAR=0, SSE2=1, AVX=2};
+
+// Geometry of MapPoints copied by Assign with one lock per point, and the results of Cull for them
+struct Batch
+{
+    std::vector<MapPoint*> vpMapPoints;
+    // world position, unit normal and scale invariance distances
+    std::vector<float> vX, vY, vZ;
+    std::vector<float> vNx, vNy, vNz;
+    std::vector<float> vMinDistance, vMaxDistance;
+
+    // set by Cull, the others are only meaningful for the points in view
+    std::vector<unsigned char> vbInView;
+    std::vector<float> vProjX, vProjY;
+    std::vector<int> vnScaleLevel;
+    std::vector<float> vViewCos;
+
+    size_t size() const { return vpMapPoints.size(); }
+    // snapshot of the points, the buffers are kept across calls
+    void Assign(const std::vector<MapPoint*> &vpPoints);
+};
+
+// Pose and cameras of the frame, the right camera is only checked if bStereo
+struct View
+{
+    float Rcw[9]; // row major
+    float Ow[3]; // camera center in world
+    float fx, fy, cx, cy;
+    bool bStereo;
+    float Rlr[9]; // row major, left to right camera
+    float tlr[3];
+    float fxr, fyr, cxr, cyr;
+    float minX, maxX, minY, maxY; // image bounds, of both images
+    float viewingCosLimit;
+    const float* vScaleFactors; // increasing
+    int nScaleLevels;
+};
+
+// Projects every point of batch and checks it as isInFrustumStereo (isInFrustum if !view.bStereo) does,
+// returns the number of points in view
+size_t Cull(const View &view, Batch &batch);
+
+bool IsSupported(Kernel kernel);
+// Switch to another kernel, e.g. for benchmarking. Returns false if the CPU lacks it.
+// Not thread safe, call it before the tracking starts
+bool SetKernel(Kernel kernel);
+Kernel GetKernel();
+const char* GetKernelName(Kernel kernel);
+}
+
+} //namespace ORB_SLAM
+
+#endif // FRUSTUMCULLING_H
@@ -0,0 +1,33 @@
+#ifndef HAMMINGDISTANCE_H
+#define HAMMINGDISTANCE_H
+
+#include <cstddef>
+
+namespace ORB_SLAM
+{
+// Hamming distance between 256 bit (32 byte) ORB descriptors.
+// The kernel is chosen at startup from what the CPU supports, all kernels give the same distances
+namespace HammingDistance
+{
+enum Kernel {SCALAR=0, SSSE3=1, POPCNT=2, AVX2=3};
+
+// Distance between two descriptors
+int Distance(const unsigned char* a, const unsigned char* b);
+
+// Distances between a and the descriptors pointed to by vpB[0..n)
+void Distances(const unsigned char* a, const unsigned char* const* vpB, size_t n, int* vDists);
+
+// Distances between a and n descriptors stored contiguously in B, stride bytes apart
+void Distances(const unsigned char* a, const unsigned char* B, size_t stride, size_t n, int* vDists);
+
+bool IsSupported(Kernel kernel);
+// Switch to another kernel, e.g. for benchmarking. Returns false if the CPU lacks it.
+// Not thread safe, call it before the matching threads start
+bool SetKernel(Kernel kernel);
+Kernel GetKernel();
+const char* GetKernelName(Kernel kernel);
+}
+
+} //namespace ORB_SLAM
+
+#endif // HAMMINGDISTANCE_H
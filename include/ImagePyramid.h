@@ -0,0 +1,57 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM
+{
+// The pyramids of one 8 bit image, built once per image and shared by its consumers:
+// - the ORB scale levels, each with a reflected border, and their Gaussian blurred copies,
+//   for ORBextractor
+// - the halving levels, 2x2 means rounded down, where level 1 is the half resolution image of
+//   libviso2 and the levels are those of createImgPyramid for direct alignment.
+// Every level is computed on first use and kept, so a consumer of level 0 does not pay for the others.
+// The accessors are not thread safe, except GetBlurredLevel() for distinct levels once
+// GetLevel(GetLevels()-1) has been called. Copies share the levels like cv::Mat
+class ImagePyramid
+{
+public:
+    ImagePyramid();
+    // vInvScaleFactors[l] is the scale of ORB level l, nBorder the border in pixels around every level.
+    // The image is referenced, not copied
+    ImagePyramid(const cv::Mat& image, const std::vector<float>& vInvScaleFactors, int nBorder);
+
+    bool empty() const { return mImage.empty(); }
+    const cv::Mat& GetImage() const { return mImage; }
+    int GetLevels() const { return (int)mvInvScaleFactors.size(); }
+
+    // ORB level, a view into an image with nBorder pixels on each side. Computes the lower levels
+    const cv::Mat& GetLevel(int level);
+    // ORB level blurred by a 7x7 Gaussian of sigma 2, without border. Level 0 is blurred from
+    // the image, so it does not need the bordered copy of level 0
+    const cv::Mat& GetBlurredLevel(int level);
+
+    // image halved n times, n=0 is the image. The rows are zero padded to a multiple of 16 bytes
+    // and aligned as cv::Mat allocations are, so libviso2 filters them in place
+    const cv::Mat& GetHalfLevel(int n);
+
+    // bytes of the levels computed so far, not counting the image
+    size_t GetMemoryBytes() const;
+
+    // drop all the levels and the image
+    void Release();
+
+protected:
+    cv::Mat mImage;
+    std::vector<float> mvInvScaleFactors;
+    int mnBorder;
+
+    std::vector<cv::Mat> mvLevels;
+    std::vector<cv::Mat> mvBlurredLevels;
+    std::vector<cv::Mat> mvHalfLevels;
+};
+
+} //namespace ORB_SLAM
+
+#endif // IMAGEPYRAMID_H
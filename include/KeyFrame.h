@@ -30,6 +30,7 @@
 #include "KeyFrameDatabase.h"
 #include "FeatureGrid.h"
 #include<boost/thread.hpp>
+#include<atomic>
 
 
 namespace ORB_SLAM
@@ -38,6 +39,7 @@ namespace ORB_SLAM
 class Map;
 class KeyFrameDatabase;
 class DatabaseResult;
+class KeyFrameStore;
 const uchar DoubleWindowKF= 0x01;// if a keyframe is in double window, then its mbNotErase & DoubleWindowKF ==DoubleWindowKF
 const uchar LoopCandidateKF= 0x02;// if a keyframe is a loop candidate, then its mbNotErase & LoopCandidateKF ==LoopCandidateKF
 class KeyFrame: public Frame
@@ -45,7 +47,9 @@ class KeyFrame: public Frame
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW 
     KeyFrame(Frame &F, Map* pMap, KeyFrameDatabase* pKFDB);
-    ~KeyFrame(){Release();}
+    // takes over the buffers of F, which is deleted by the caller afterwards
+    KeyFrame(Frame &&F, Map* pMap, KeyFrameDatabase* pKFDB);
+    ~KeyFrame();
     bool isKeyFrame() const {return true;}
 
     void Release();
@@ -75,10 +79,14 @@ public:
     void AddConnection(KeyFrame* pKF, const int &weight);
     void EraseConnection(KeyFrame* pKF);
     void UpdateConnections();
+    // the weights counted from scratch, for each map point of this keyframe the other keyframes observing it in
+    // the left image. UpdateConnections() reads the same counts from the covisibility graph of the map
+    void CountConnections(std::map<KeyFrame*,int> &KFcounter);
     void UpdateBestCovisibles();
     std::set<KeyFrame *> GetConnectedKeyFrames();
     std::vector<KeyFrame* > GetVectorCovisibleKeyFrames();
-    std::vector<KeyFrame*> GetBestCovisibilityKeyFrames(const int &N);
+    // bMakeResident=false for callers that do not use the features of the covisibles, e.g., to accumulate scores
+    std::vector<KeyFrame*> GetBestCovisibilityKeyFrames(const int &N, bool bMakeResident=true);
     std::vector<KeyFrame*> GetCovisiblesByWeight(const int &w);
     int GetWeight(KeyFrame* pKF);
 
@@ -94,20 +102,25 @@ public:
     void AddLoopEdge(KeyFrame* pKF);
     std::set<KeyFrame*> GetLoopEdges();
 
-    // MapPoint observation functions
-    void EraseMapPointMatch(MapPoint* pMP);
+    // MapPoint observation functions, called by MapPoint as it gains and loses left observations.
+    // Put pMP at idx unless another good point is there, returns whether pMP is at idx
+    bool SetMapPointMatch(const size_t &idx, MapPoint* pMP);
+    // take pMP out of idx, if it is still there
+    void EraseMapPointMatch(const size_t &idx, MapPoint* pMP);
 
     std::set<MapPoint*> GetMapPoints();
     int TrackedMapPoints();
     Map * GetMap(){ return mpMap;}
     MapPoint* GetMapPoint(const size_t &idx);   
     MapPoint* GetFeaturePoint(const size_t &idx);
-    // KeyPoint functions
-    int GetKeyPointScaleLevel(const size_t &idx) const;
+    // KeyPoint functions, they make the keyframe resident
+    int GetKeyPointScaleLevel(const size_t &idx);
+    cv::KeyPoint GetKeyPointUn(const size_t &idx, bool left=true);
+    cv::Mat GetDescriptor(const size_t &idx, bool left=true);
 
-    std::vector<cv::KeyPoint> GetKeyPointsUn() const;
+    std::vector<cv::KeyPoint> GetKeyPointsUn();
     cv::Mat GetDescriptors(bool left=true);
-    std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
+    std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r);
 
     // Image
     bool IsInImage(const float &x, const float &y) const;
@@ -124,6 +137,29 @@ public:
     float ComputeSceneMedianDepth(int q = 2);
     void setExistingFeatures(FeatureGrid &fg);
 
+    // Offloading, see Map::EnforceMemoryBudget(). The keypoints, descriptors, feature vector and grid of
+    // an offloaded keyframe live in a KeyFrameStore on disk, its pose, bag of words, map points and
+    // connections stay in memory. The features are hidden from code outside KeyFrame and read through the
+    // accessors above, which call MakeResident(). Reaching a keyframe through the covisibility graph, map point
+    // observations or the keyframe database also makes it resident and counts as a use. Local mapping offloads
+    // keyframes, so threads other than local mapping must hold Map::mMutexResidency shared from MakeResident()
+    // until they are done with the features. Throws std::runtime_error if the store cannot be read
+    void MakeResident()
+    {
+        if(mbOffloaded.load(std::memory_order_acquire))
+            Reload();
+        const unsigned long nEpoch = snAccessEpoch.load(std::memory_order_relaxed);
+        if(mnLastAccessEpoch.load(std::memory_order_relaxed)!=nEpoch)
+            mnLastAccessEpoch.store(nEpoch, std::memory_order_relaxed);
+    }
+    static void MakeResident(const std::vector<KeyFrame*> &vpKFs);
+    bool IsOffloaded() const {return mbOffloaded.load(std::memory_order_acquire);}
+    // has MakeResident() not been called in the last nEpochs epochs
+    bool IsIdle(unsigned long nEpochs) const;
+    void Offload(KeyFrameStore* pStore);
+    // an epoch passes every time local mapping checks the memory budget
+    static void AdvanceAccessEpoch();
+
   
 public:
     static long unsigned int nNextKeyId;
@@ -143,14 +179,6 @@ public:
     long unsigned int mnBALocalForKF;
     long unsigned int mnBAFixedForKF;
 
-    // Variables used by the keyframe database
-    long unsigned int mnLoopQuery;
-    int mnLoopWords;
-    float mLoopScore;
-    long unsigned int mnRelocQuery;
-    int mnRelocWords;
-    float mRelocScore;
-
     FeatureGrid * mpFG; //feature grid to control distribution of newly created features
     // Calibration parameters
 //    float fx, fy, cx, cy;//inherit from Frame
@@ -181,27 +209,31 @@ protected:
 //    cv::Mat mK;//inherit from Frame
 
     // KeyPoints, Descriptors, MapPoints vectors (all associated by an index)
-//    std::vector<cv::KeyPoint> mvKeys;//inherit from Frame
-//    std::vector<cv::KeyPoint> mvKeysUn;
-//    cv::Mat mDescriptors;
+    // The features inherited from Frame may be offloaded, other classes read them through the accessors
+    using Frame::mvKeys;
+    using Frame::mvKeysUn;
+    using Frame::mDescriptors;
 //    std::vector<MapPoint*> mvpMapPoints;
 
-//    std::vector<cv::KeyPoint> mvRightKeys;
-//    std::vector<cv::KeyPoint> mvRightKeysUn;
-//    cv::Mat mRightDescriptors;
+    using Frame::mvRightKeys;
+    using Frame::mvRightKeysUn;
+    using Frame::mRightDescriptors;
 
     // BoW
     KeyFrameDatabase* mpKeyFrameDB;
 //    ORBVocabulary* mpORBvocabulary;//inherit from Frame
-//    DBoW2::FeatureVector mFeatVec;//inherit from Frame
+    using Frame::mFeatVec;
 
 
     // Grid over the image to speed up feature matching
-//    std::vector< std::vector <std::vector<size_t> > > mGrid; //inherit from Frame
+    using Frame::mGrid;
 
     std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
     std::vector<int> mvOrderedWeights;
+    // keep the ordered lists sorted by decreasing weight, the caller holds mMutexConnections
+    void EraseOrderedConnection(KeyFrame* pKF);
+    void InsertOrderedConnection(KeyFrame* pKF, int weight);
 
     // Spanning Tree and Loop Edges
     bool mbFirstConnection;
@@ -218,6 +250,14 @@ protected:
     boost::mutex mMutexConnections;
     boost::mutex mMutexFeatures; // exclusive access to mvpMapPoints and fts_->point
 
+    void Reload();
+    std::atomic<bool> mbOffloaded;
+    std::atomic<unsigned long> mnLastAccessEpoch;
+    static std::atomic<unsigned long> snAccessEpoch;
+    KeyFrameStore* mpStore;
+    long mnStoreRecord; // -1 until the features are written to mpStore
+    boost::mutex mMutexOffload;
+
 private:
     KeyFrame();
     KeyFrame(const KeyFrame&);
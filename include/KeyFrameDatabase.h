@@ -37,6 +37,7 @@ namespace ORB_SLAM
 
 class Frame;
 class KeyFrame;
+class ThreadPool;
 
 class KeyFrameDatabase
 {
@@ -56,13 +57,55 @@ public:
    // Relocalisation
    std::vector<KeyFrame*> DetectRelocalisationCandidates(Frame* F);
 
+   // Score the candidates of a query on the pool, NULL scores them serially
+   void SetThreadPool(ThreadPool* pThreadPool) { mpThreadPool = pThreadPool; }
+
 protected:
 
+  // A keyframe in the posting list of a word, with its id so that a query counts shared words without
+  // reading the keyframe. An erased keyframe leaves a tombstone, pKF==NULL, until the list is compacted
+  struct Posting
+  {
+      KeyFrame* pKF;
+      long unsigned int nId;
+  };
+  struct PostingList
+  {
+      PostingList(): nTombstones(0) {}
+      std::vector<Posting> vPostings;
+      size_t nTombstones;
+  };
+
+  // Scratch state of one query, indexed by keyframe id, so that loop and relocalisation queries
+  // may run concurrently and keyframes carry no query fields. It is kept across queries, which
+  // reset only the entries they have set, so that a query costs the keyframes it reaches rather than mnMaxId
+  struct Query
+  {
+      std::vector<int> vnWords; // words shared with the query, -1 for excluded keyframes, 0 between queries
+      std::vector<float> vScores; // similarity score, -1 if not scored
+      std::vector<KeyFrame*> vpSharingWords;
+  };
+
+  // The keyframes sharing words with bowVec, except those in spExcluded, scored if they share more than
+  // 80% of the largest number of shared words. Those scoring at least minScore, or their best covisible
+  // keyframe, are returned if their score accumulated over their covisible keyframes is within 75% of the best
+  std::vector<KeyFrame*> DetectCandidates(const DBoW2::BowVector &bowVec, const std::set<KeyFrame*> &spExcluded,
+                                          float minScore);
+  std::vector<KeyFrame*> DetectCandidates(Query &query, const DBoW2::BowVector &bowVec,
+                                          const std::set<KeyFrame*> &spExcluded, float minScore);
+
   // Associated vocabulary
   const ORBVocabulary* mpVoc;
 
   // Inverted file
-  std::vector<list<KeyFrame*> > mvInvertedFile;
+  std::vector<PostingList> mvInvertedFile;
+  long unsigned int mnMaxId; // largest id added, sizes the scratch arrays of a query
+
+  // Scratch of the queries, one per query running at a time. A list so that they do not move
+  std::list<Query> mlQueries;
+  std::vector<Query*> mvpIdleQueries;
+
+  ThreadPool* mpThreadPool;
 
   // Mutex
   boost::mutex mMutex;
@@ -0,0 +1,51 @@
+#ifndef KEYFRAMEQUEUE_H
+#define KEYFRAMEQUEUE_H
+
+#include <list>
+#include <boost/thread.hpp>
+
+namespace ORB_SLAM
+{
+class KeyFrame;
+
+// FIFO of keyframes handed from one thread to another, e.g., from tracking to local mapping.
+// The consumer blocks in Wait() until a keyframe is pushed or another event calls WakeUp(),
+// instead of polling, and the time each keyframe spends in the queue is recorded
+class KeyFrameQueue
+{
+public:
+    KeyFrameQueue();
+
+    void Push(KeyFrame* pKF);
+    bool Empty() const;
+
+    // the oldest keyframe, NULL if the queue is empty
+    KeyFrame* Pop();
+
+    // remove all the keyframes without popping them, e.g., to delete them on reset
+    std::list<KeyFrame*> Drain();
+
+    // block until the queue is not empty or WakeUp() is called, at most nTimeoutMs milliseconds
+    void Wait(int nTimeoutMs);
+
+    // make the current or next Wait() return, to handle stop and reset requests
+    void WakeUp();
+
+    // average and maximum seconds a popped keyframe spent in the queue
+    void GetWaitTimes(double &average, double &maximum) const;
+
+protected:
+    mutable boost::mutex mMutex;
+    boost::condition_variable mCondNotEmpty;
+    std::list<KeyFrame*> mlKeyFrames;
+    std::list<double> mlPushTimes;
+    bool mbWakeUp;
+
+    double mdWaitTotal;
+    double mdWaitMax;
+    size_t mnPopped;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMEQUEUE_H
@@ -0,0 +1,44 @@
+#ifndef KEYFRAMESTORE_H
+#define KEYFRAMESTORE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/thread.hpp>
+
+namespace ORB_SLAM
+{
+// Append-only file holding the features of keyframes offloaded from memory, see Map::EnforceMemoryBudget().
+// Each record is an opaque block of bytes produced by KeyFrame, a record is written once since the features
+// of a keyframe do not change after its creation, and the file is removed when the store is destroyed
+class KeyFrameStore
+{
+public:
+    // creates a new file named strFilePrefix followed by six unique characters
+    KeyFrameStore(const std::string &strFilePrefix);
+    ~KeyFrameStore();
+
+    bool IsOpen() const;
+    const std::string &GetFilename() const {return mstrFilename;}
+
+    // append a record and return its id, -1 on failure
+    long Write(const std::vector<char> &vBlock);
+    bool Read(long nRecord, std::vector<char> &vBlock);
+
+    // drop all records, e.g., when the map is reset
+    void Clear();
+
+    // bytes written to the file
+    size_t size() const;
+
+protected:
+    std::string mstrFilename;
+    std::fstream mFile;
+    std::vector<std::pair<std::streamoff, size_t> > mvRecords; // offset and length of every record
+    std::streamoff mnEnd;
+    mutable boost::mutex mMutex;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMESTORE_H
@@ -27,6 +27,7 @@
 #include "Tracking.h"
 #include <boost/thread.hpp>
 #include "KeyFrameDatabase.h"
+#include "KeyFrameQueue.h"
 
 
 namespace ORB_SLAM
@@ -35,11 +36,30 @@ namespace ORB_SLAM
 class Tracking;
 class LoopClosing;
 class Map;
+class ThreadPool;
+
+// stages of the local mapping accumulated over keyframes
+struct LocalMappingStats
+{
+    size_t nKeyFrames; // keyframes processed
+    double dProcessTime; // seconds in ProcessNewKeyFrame
+    double dCullingTime; // seconds in MapPointCulling
+    double dTriangulationTime; // seconds in CreateNewMapPoints
+    double dFusionTime; // seconds in SearchInNeighbors
+    double dKeyFrameCullingTime; // seconds in KeyFrameCulling
+    size_t nNewMapPoints;
+    size_t nFusions;
+    LocalMappingStats(): nKeyFrames(0), dProcessTime(0), dCullingTime(0), dTriangulationTime(0), dFusionTime(0),
+        dKeyFrameCullingTime(0), nNewMapPoints(0), nFusions(0)
+    {}
+};
 
 class LocalMapping
 {
 public:
-    LocalMapping(Map* pMap);
+    // nThreads workers search the neighbor keyframes in triangulation and fusion besides the local mapping thread
+    LocalMapping(Map* pMap, int nThreads=0);
+    ~LocalMapping();
 
     void SetLoopCloser(LoopClosing* pLoopCloser);
 
@@ -58,6 +78,8 @@ public:
     void Release();
 
     bool isStopped();
+    // block the caller until the local mapping thread has stopped after RequestStop()
+    void WaitUntilStopped();
 
     bool stopRequested();
 
@@ -66,43 +88,64 @@ public:
 
     void InterruptBA();
     void ProcessNewKeyFrame();
+
+    // average and maximum seconds a keyframe waited before local mapping processed it
+    void GetQueueWaitTimes(double &average, double &maximum) const;
+
+    LocalMappingStats GetStats() const;
 protected:
 
     bool CheckNewKeyFrames();
 
-    void CreateNewMapPoints();
-    void CreateNewMapPointsStereo();
+    // matches of a neighbor keyframe triangulated with the current keyframe, before the MapPoint is created
+    struct TriangulatedPoint
+    {
+        size_t idx1; // keypoint in the current keyframe
+        size_t idx2; // keypoint in the neighbor keyframe
+        Eigen::Vector3d x3D;
+    };
+
+    // these return the number of MapPoints created or fused
+    int CreateNewMapPoints();
+    int CreateNewMapPointsStereo();
+    void TriangulateStereo(KeyFrame* pKF2, std::vector<TriangulatedPoint> &vPoints);
 
     void MapPointCulling();
-    void SearchInNeighbors();
+    int SearchInNeighbors();
 
     void KeyFrameCulling();
 
     void ResetIfRequested();
+    void WaitUntilReleased();
     bool mbResetRequested;
     boost::mutex mMutexReset;
+    boost::condition_variable mCondReset;
 
     Map* mpMap;
 
     LoopClosing* mpLoopCloser;
     Tracking* mpTracker;
 
-    std::list<KeyFrame*> mlNewKeyFrames;
+    KeyFrameQueue mNewKeyFrames;
 
     KeyFrame* mpCurrentKeyFrame;
 
     std::list<MapPoint*> mlpRecentAddedMapPoints;
 
-    boost::mutex mMutexNewKFs;    
-
     bool mbAbortBA;
 
     bool mbStopped;
     bool mbStopRequested;
     boost::mutex mMutexStop;
+    boost::condition_variable mCondStop; // signalled when mbStopped changes
 
     bool mbAcceptKeyFrames;
     boost::mutex mMutexAccept;
+
+    ThreadPool* mpThreadPool;
+
+    LocalMappingStats mStats;
+    mutable boost::mutex mMutexStats;
 };
 
 } //namespace ORB_SLAM
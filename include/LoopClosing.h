@@ -30,6 +30,7 @@
 #include <boost/thread.hpp>
 
 #include "KeyFrameDatabase.h"
+#include "KeyFrameQueue.h"
 
 //#include "Thirdparty/g2o/g2o/types/sim3/types_seven_dof_expmap.h"
 #include <g2o/types/sim3/types_seven_dof_expmap.h>
@@ -65,6 +66,9 @@ public:
 
     void RequestReset();
 
+    // average and maximum seconds a keyframe waited before loop detection processed it
+    void GetQueueWaitTimes(double &average, double &maximum) const;
+
     Sophus::Sim3d GetSnew2old();
     Sophus::SE3d GetTnew2old();
 
@@ -84,6 +88,7 @@ public:
     void ResetIfRequested();
     bool mbResetRequested;
     boost::mutex mMutexReset;
+    boost::condition_variable mCondReset;
 
     Map* mpMap;
     Tracking* mpTracker;
@@ -93,9 +98,7 @@ public:
 
     LocalMapping *mpLocalMapper;
 
-    std::list<KeyFrame*> mlpLoopKeyFrameQueue;
-
-    boost::mutex mMutexLoopQueue;
+    KeyFrameQueue mLoopKeyFrameQueue;
 
     std::vector<float> mvfLevelSigmaSquare;
 
@@ -23,6 +23,7 @@
 
 #include "MapPoint.h"
 #include "KeyFrame.h"
+#include "CovisibilityGraph.h"
 #include<set>
 
 #include<boost/thread.hpp>
@@ -34,6 +35,7 @@ namespace ORB_SLAM
 
 class MapPoint;
 class KeyFrame;
+class KeyFrameStore;
 
 class Map
 {
@@ -65,6 +67,21 @@ public:
 
     void clear();
 
+    // Memory budget: keep the features of at most nMaxResidentKFs keyframes in memory, offloading the keyframes
+    // farthest from the current one to a KeyFrameStore in a new file named strStorePrefix and a unique suffix.
+    // A keyframe is only offloaded after nIdleEpochs epochs without use, and never while it is in the temporal
+    // window or a loop candidate. Only keyframe features are offloaded, the map points and the bag of words,
+    // map point matches and connections of the keyframes stay in memory.
+    // Offloaded keyframes are faulted back in when they are reached again, see KeyFrame::MakeResident()
+    void SetMemoryBudget(int nMaxResidentKFs, const std::string &strStorePrefix, int nIdleEpochs);
+    // called by local mapping after it has processed pCurrentKF, returns the number of offloaded keyframes.
+    // Offloads nothing if it cannot take mMutexResidency exclusively within a few milliseconds
+    int EnforceMemoryBudget(KeyFrame* pCurrentKF);
+    int ResidentKeyFramesInMap();
+
+    // shared map point counts of the keyframes, see KeyFrame::UpdateConnections()
+    CovisibilityGraph& GetCovisibilityGraph() { return mCovisibilityGraph; }
+
 protected:
     std::set<MapPoint*> mspMapPoints;
     std::set<KeyFrame*> mspKeyFrames;
@@ -75,6 +92,12 @@ protected:
 
     boost::mutex mMutexMap;
     bool mbMapUpdated;
+
+    CovisibilityGraph mCovisibilityGraph;
+
+    KeyFrameStore* mpKeyFrameStore; // NULL if the memory is not bounded
+    int mnMaxResidentKFs;
+    int mnIdleEpochs;
 public:
     // external lock, make sure that the points' positions and keyframe poses are consistent
     // during this lock period, used in reading and writing data between the map and an optimizer of the map
@@ -83,6 +106,11 @@ public:
     // does loop closing optimization just finished? This boolean prevent other optimization functions
     // from restoring their results if loop closing is just finished. It is also pretected by mPointPoseConsistencyMutex
     bool mbFinishedLoopClosing;
+    // held shared by tracking while it processes a frame and by loop closing while it processes a keyframe,
+    // the threads that read keyframe features besides local mapping, so that no keyframe is offloaded while
+    // they may be reading it. EnforceMemoryBudget() holds it exclusively while it frees features. The idle
+    // epochs only choose which keyframes to offload, they do not make reading features safe
+    boost::shared_mutex mMutexResidency;
 };
 
 } //namespace ORB_SLAM
@@ -23,11 +23,13 @@
 
 #include"Frame.h"
 #include"Map.h"
+#include"SmallVector.h"
 
 #include "vio_g2o/anchored_points.h"
 #include "g2o/types/sba/types_sba.h"
 #include<opencv2/core/core.hpp>
 #include<boost/thread.hpp>
+#include<atomic>
 
 namespace ORB_SLAM
 {
@@ -37,6 +39,17 @@ class KeyFrame;
 class Map;
 typedef Eigen::Matrix<double, 2, 3> Matrix23d;
 
+// A keyframe observing a map point, with the index of the point in the left and in the right keypoints
+// of the keyframe, -1 if the point is not observed on that side
+struct MapPointObservation
+{
+    KeyFrame* pKF;
+    int nLeft;
+    int nRight;
+};
+// most points are observed by a few keyframes, so a copy of their observations stays on the stack
+typedef SmallVector<MapPointObservation, 8> MapPointObservations;
+
 class MapPoint
 {
 
@@ -49,12 +62,27 @@ public:
     Eigen::Vector3d GetNormal();
     KeyFrame* GetReferenceKeyFrame();
 
-    std::map<KeyFrame*,size_t> GetObservations(bool left=true);
+    // copy of the observations without heap allocation for up to 8 keyframes, which are made resident
+    void GetObservations(MapPointObservations& observations);
+    // calls visit(const MapPointObservation&) for every observation while holding mMutexFeatures,
+    // so visit must not lock keyframes or map points. Keyframes are not made resident
+    template<typename Visitor>
+    void VisitObservations(Visitor visit)
+    {
+        boost::mutex::scoped_lock lock(mMutexFeatures);
+        for(MapPointObservations::const_iterator it=mObservations.begin(), itend=mObservations.end(); it!=itend; ++it)
+            visit(*it);
+    }
+    // number of keyframes observing the point in the left image
     int Observations();
 
     /// Add a reference to a frame.
-    void AddObservation(KeyFrame* pKF,size_t idx, bool left=true);
-    void EraseObservation(KeyFrame* pKF);
+    // A keyframe holds a map point exactly when it is a left observer of the point, which the covisibility
+    // graph relies on. So a left observation puts this point at idx of pKF, and returns false without
+    // observing if pKF holds another good point there or this point is bad. Erasing a left observation
+    // takes the point out of pKF, unless pKF is being set bad (bKeyFrameBad), which keeps its map points
+    bool AddObservation(KeyFrame* pKF,size_t idx, bool left=true);
+    void EraseObservation(KeyFrame* pKF, bool bKeyFrameBad=false);
 
     int GetIndexInKeyFrame(KeyFrame* pKF, bool left=true);
     bool IsInKeyFrame(KeyFrame* pF);
@@ -77,6 +105,8 @@ public:
 
     float GetMinDistanceInvariance();
     float GetMaxDistanceInvariance();
+    // position, normal and scale invariance distances under one lock, as used to check visibility
+    void GetGeometry(Eigen::Vector3d &pos, Eigen::Vector3d &normal, float &minDistance, float &maxDistance);
     void SetFirstEstimate();
     void Release();
 
@@ -86,7 +116,7 @@ public:
 
 
 
-    /// Get number of observations.
+    /// Get number of observing keyframes.
     inline size_t nRefs() const { return mObservations.size(); }
 
     /// Jacobian of point projection on unit plane (focal length = 1) in frame (f).
@@ -138,22 +168,25 @@ public:
     // Reference KeyFrame
     KeyFrame* mpRefKF;  
     int                         last_structure_optim_;    //!< Timestamp of last point optimization
-    // Keyframes observing the point and associated index in keyframe
-    std::map<KeyFrame*,size_t> mObservations;
-    std::map<KeyFrame*,size_t> mRightObservations;
+    // Keyframes observing the point and associated indices in keyframe, in the order they were added
+    MapPointObservations mObservations;
 
-    // Tracking counters
-    int mnVisible;
-    int mnFound;
+    // Tracking counters, updated by the tracking thread for every map point in view, without locks
+    std::atomic<int> mnVisible;
+    std::atomic<int> mnFound;
     vio::G2oVertexPointXYZ *                   v_pt_;                    //!< Temporary pointer to the point-vertex in g2o during bundle adjustment.
     Map* mpMap;
 
 protected:    
      // Position in absolute coordinates
      Eigen::Vector3d mWorldPos;
+     // Copy of mWorldPos for GetWorldPos() without locks. Writers hold mMutexPos and make mnPosVersion odd
+     // while they update the copy, readers retry until they see the same even version before and after reading
+     std::atomic<double> mWorldPosSnapshot[3];
+     std::atomic<unsigned int> mnPosVersion;
 
      //because we match a map point to left frame, to right frame, and match left frame to right frame,
-     // mObservations.size()==mRightObservations.size()
+     // an observation has both indices except with MONO
 
      // Mean viewing direction
      Eigen::Vector3d mNormalVector;
@@ -161,8 +194,9 @@ protected:
      // Best descriptor to fast matching
      cv::Mat mDescriptor;
 
-     // Bad flag (we do not currently erase MapPoint from memory)
-     bool mbBad;
+     // Bad flag (we do not currently erase MapPoint from memory),
+     // set while holding mMutexFeatures and mMutexPos, read without locks by isBad()
+     std::atomic<bool> mbBad;
 
      // Scale invariance distances
      float mfMinDistance;
@@ -173,6 +207,15 @@ protected:
      boost::mutex mMutexFeatures;
 
 private:
+     void StoreWorldPosSnapshot(const Eigen::Vector3d &Pos);
+     // the observation of pKF or NULL, the caller holds mMutexFeatures
+     MapPointObservation* FindObservation(KeyFrame* pKF);
+     // add nDelta to the covisibility of pKF with the other keyframes observing the point in the left image,
+     // the caller holds mMutexFeatures
+     void UpdateCovisibility(KeyFrame* pKF, int nDelta);
+     // remove the covisibility of every pair of keyframes in observations, those of a point set bad
+     void EraseCovisibility(const MapPointObservations& observations);
+
      MapPoint & operator=(const MapPoint&);
      MapPoint(const MapPoint&);
 
@@ -0,0 +1,31 @@
+#ifndef ORBKERNELS_H
+#define ORBKERNELS_H
+
+namespace ORB_SLAM
+{
+// Intensity centroid orientation and rotated BRIEF sampling of ORB keypoints on 8 bit images.
+// The kernel is chosen at startup from what the CPU supports, all kernels give the same moments
+// and the same descriptors as the scalar code
+namespace ORBKernels
+{
+enum Kernel {SCALAR=0, SSE2=1};
+
+// Moments m_01 and m_10 of the circular patch of radius 15 around center,
+// the half width of row v of the patch is u_max[v]
+void ICMoments(const unsigned char* center, int step, const int* u_max, int &m_01, int &m_10);
+
+// 32 byte rotated BRIEF descriptor, the 512 points of pattern (x, y interleaved) are rotated by
+// the angle of cosine a and sine b and compared in pairs
+void Descriptor(const unsigned char* center, int step, float a, float b, const int* pattern, unsigned char* desc);
+
+bool IsSupported(Kernel kernel);
+// Switch to another kernel, e.g. for benchmarking. Returns false if the CPU lacks it.
+// Not thread safe, call it before the extraction threads start
+bool SetKernel(Kernel kernel);
+Kernel GetKernel();
+const char* GetKernelName(Kernel kernel);
+}
+
+} //namespace ORB_SLAM
+
+#endif // ORBKERNELS_H
@@ -25,11 +25,68 @@
 #include"Thirdparty/DBoW2/DBoW2/FORB.h"
 #include"Thirdparty/DBoW2/DBoW2/TemplatedVocabulary.h"
 
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+
 namespace ORB_SLAM
 {
 
-typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
-  ORBVocabulary;
+class ThreadPool;
+
+// The DBoW2 vocabulary of ORB descriptors, with a flattened copy of its tree for transforming the descriptors
+// of a frame: the descriptors of the children of a node are packed 32 bytes each in one cache line aligned
+// block, so that a descriptor descends a level with one batched SIMD Hamming distance to all the children.
+// The loaders and create() build the flattened tree, the result of transform is the same as DBoW2's
+class ORBVocabulary: public DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
+{
+public:
+    typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB> Base;
+
+    ORBVocabulary(int k = 10, int L = 5, DBoW2::WeightingType weighting = DBoW2::TF_IDF,
+                  DBoW2::ScoringType scoring = DBoW2::L1_NORM);
+
+    using Base::create;
+    virtual void create(const std::vector<std::vector<DBoW2::FORB::TDescriptor> > &training_features);
+
+    using Base::load;
+    virtual void load(const cv::FileStorage &fs, const std::string &name = "vocabulary");
+    bool loadFromTextFile(const std::string &filename);
+    bool loadFromBinaryFile(const std::string &filename);
+
+    // Bow vector and feature vector of the descriptors, one 32 byte row per feature, as
+    // Base::transform(features, v, fv, levelsup). The features are distributed over the pool, if not NULL
+    using Base::transform;
+    void transform(const cv::Mat &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup,
+                   ThreadPool* pThreadPool = NULL) const;
+
+protected:
+    // Builds the flattened tree from m_nodes, left empty if the descriptors are not 32 bytes
+    void Flatten();
+
+    // Word, weight and node at levelsup levels from the leaves of one descriptor, vDists holds a distance per child
+    void TransformFeature(const unsigned char* pDescriptor, DBoW2::WordId &wordId, DBoW2::WordValue &weight,
+                          DBoW2::NodeId &nodeId, int levelsup, int* vDists) const;
+
+    struct FlatNode
+    {
+        uint32_t nFirstChild; // index of the first child in mvFlatChildren and of its descriptor
+        uint32_t nChildren;
+    };
+    struct FlatChild
+    {
+        DBoW2::NodeId nodeId;
+        int32_t nFlatNode; // index in mvFlatNodes, -1 for a leaf
+    };
+
+    static const size_t DESCRIPTOR_BYTES = 32;
+
+    // internal nodes in breadth first order, the root first
+    std::vector<FlatNode> mvFlatNodes;
+    std::vector<FlatChild> mvFlatChildren;
+    // descriptors of mvFlatChildren, shared by copies of the vocabulary as they are never modified
+    boost::shared_ptr<unsigned char> mpChildDescriptors;
+    size_t mnMaxChildren;
+};
 
 } //namespace ORB_SLAM
 
@@ -25,11 +25,19 @@
 #include <list>
 #include <opencv/cv.h>
 #include <Eigen/Dense>
+#include <boost/function.hpp>
+
+namespace vk
+{
+class PinholeCamera;
+}
 
 namespace ORB_SLAM
 {
 class ORBmatcher;
 class Frame;
+class ThreadPool;
+class ImagePyramid;
 class ORBextractor
 {
     friend class ORBmatcher;
@@ -54,12 +62,15 @@ public:
     void operator()(cv::InputArray image, cv::InputArray mask,
                     std::vector<cv::KeyPoint>& keypoints,  cv::OutputArray descriptors,
                     std::vector<cv::KeyPoint>& _keypointsUn,
-                    const cv::Mat & K, const cv::Mat & distCoef, const Eigen::Vector3d& ginc);
+                    const vk::PinholeCamera& cam, const Eigen::Vector3d& ginc);
     // comptue ORB features on level 0 given keypoints,
     // bGAFD true means keypoints' angle is already determined by gravity direction
     void operator()( cv::InputArray image,
       std::vector<cv::KeyPoint>& keypoints,
       cv::OutputArray descriptors, bool bGAFD=false);
+    // as above on a pyramid shared with other consumers of the image, only its blurred level 0 is computed
+    void operator()(ImagePyramid& pyramid, std::vector<cv::KeyPoint>& keypoints,
+                    cv::OutputArray descriptors, bool bGAFD=false);
     void operator()(std::vector<cv::KeyPoint>& keypoints,cv::OutputArray _descriptors,
                     const float detection_threshold);
     int inline GetLevels(){
@@ -85,8 +96,27 @@ public:
     std::vector<float> inline GetInverseScaleSigmaSquares(){
         return mvInvLevelSigma2;
     }
+
+    // Extract the pyramid levels, grid cells and descriptor chunks on the pool,
+    // the output is identical to the serial extraction. NULL extracts serially
+    void inline SetThreadPool(ThreadPool* pThreadPool){
+        mpThreadPool = pThreadPool;
+    }
+    inline ThreadPool* GetThreadPool() const{
+        return mpThreadPool;
+    }
+
+    // Seconds spent on each pyramid level by the last call to operator(),
+    // including blurring, keypoint detection, orientation and descriptors
+    std::vector<double> inline GetLevelTimes() const{
+        return mvLevelTimes;
+    }
    
     void ComputePyramid(cv::Mat image);
+    // point mvImagePyramid and mvBlurredImagePyramid to the levels of pyramid, computing them if needed
+    void ComputePyramid(ImagePyramid& pyramid);
+    // a pyramid of image with the scale factors and border of this extractor, computed on demand
+    ImagePyramid CreatePyramid(const cv::Mat& image) const;
     void ClonePyramid(std::vector<cv::Mat> & vImagePyramid);
     void ComputePyramid(const cv::Mat & image,   std::vector<cv::Mat>& vImagePyramid );
     void ComputeBlurredPyramid(const std::vector<cv::Mat> & vImagePyramid,
@@ -110,6 +140,10 @@ protected:
     void ComputeKeyPointsBF(std::vector<std::vector<cv::KeyPoint> >& allKeypoints,
                             const std::vector<cv::Mat>& vImagePyramid);
     void ComputeKeyPoints(std::vector<std::vector<cv::KeyPoint> >& allKeypoints, bool bGAFD=false);
+    void ComputeKeyPointsLevel(const int level, std::vector<cv::KeyPoint>& keypoints, bool bGAFD);
+    void ComputeDescriptors(const cv::Mat& image, const std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors);
+    // run task(i) for i in [0,n) on the thread pool if available
+    void ParallelFor(size_t n, const boost::function<void (size_t)>& task);
 
     std::vector<cv::Point> pattern;
 
@@ -127,6 +161,9 @@ protected:
 
     std::vector<cv::Mat> mvImagePyramid;
     std::vector<cv::Mat> mvBlurredImagePyramid;
+
+    ThreadPool* mpThreadPool;
+    std::vector<double> mvLevelTimes;
 };
 
 void computeOrbDescriptor(const cv::KeyPoint& kpt,
@@ -135,11 +172,8 @@ void computeOrbDescriptor(const cv::KeyPoint& kpt,
 void computeOrientation(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, const std::vector<int>& umax);
 void computeDescriptors(const cv::Mat& image, const std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors,
 const std::vector<cv::Point>& pattern);
-void UndistortKeyPoints(const std::vector<cv::KeyPoint>& vKeys, std::vector<cv::KeyPoint>& vKeysUn,
-                         const cv::Mat & K, const cv::Mat & distCoef);
-
 void computeKeyPointGAO(std::vector< cv::KeyPoint>& vKeys, std::vector< cv::KeyPoint>& vKeysUn,
-                        const cv::Mat& K, const cv::Mat& distCoef, Eigen::Vector3d ginc);
+                        const vk::PinholeCamera& cam, Eigen::Vector3d ginc);
 void nonMaximaSuppression(const cv::Mat& src, const int sz, cv::Mat& dst, const cv::Mat mask= cv::Mat());
 } //namespace ORB_SLAM
 
@@ -29,6 +29,7 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"HammingDistance.h"
 
 
 namespace ORB_SLAM
@@ -42,6 +43,13 @@ public:
 
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+    // Computes the Hamming distances between one descriptor and the rows vIndices of B in one batch.
+    // vpRows is scratch for the row pointers, kept by the caller to reuse it across calls
+    template<typename Index>
+    static void DescriptorDistances(const cv::Mat &a, const cv::Mat &B, const std::vector<Index> &vIndices,
+                                    std::vector<int> &vDists, std::vector<const unsigned char*> &vpRows);
+    // Computes the Hamming distances between one descriptor and all rows of B
+    static void DescriptorDistances(const cv::Mat &a, const cv::Mat &B, std::vector<int> &vDists);
     bool findMatchDirect(const cv::KeyPoint & pt, const cv::Mat &descriptor,
             const ORBextractor* pORBextractor, cv::KeyPoint & pt_cur, cv::Mat& output_descrip);
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
@@ -91,6 +99,15 @@ public:
     // Project MapPoints into KeyFrame and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, std::vector<MapPoint *> &vpMapPoints, float th=2.5);
 
+    // The search of Fuse without modifying the map: the keypoint of pKF each MapPoint is to be fused with,
+    // so that several keyframes, or chunks of MapPoints, can be searched concurrently before ApplyFusions
+    int SearchForFusion(KeyFrame* pKF, const std::vector<MapPoint*> &vpMapPoints,
+                        std::vector<std::pair<MapPoint*, size_t> > &vFusions, float th=2.5) const;
+
+    // Fuse the MapPoints found by SearchForFusion in pKF, in their order. A MapPoint that became bad or was
+    // added to pKF since the search is skipped, a keypoint that got a MapPoint since is fused with that MapPoint
+    static int ApplyFusions(KeyFrame* pKF, const std::vector<std::pair<MapPoint*, size_t> > &vFusions);
+
     // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, g2o::Sim3 Scw, const std::vector<MapPoint*> &vpPoints, float th=2.5);
 
@@ -111,6 +128,18 @@ protected:
     float mfNNratio; // maximum allowed bestDist/secondBestDist
     bool mbCheckOrientation;
 };
+template<typename Index>
+void ORBmatcher::DescriptorDistances(const cv::Mat &a, const cv::Mat &B, const std::vector<Index> &vIndices,
+                                     std::vector<int> &vDists, std::vector<const unsigned char*> &vpRows)
+{
+    vpRows.resize(vIndices.size());
+    for(size_t i=0; i<vIndices.size(); ++i)
+        vpRows[i] = B.ptr<unsigned char>((int)vIndices[i]);
+    vDists.resize(vIndices.size());
+    if(!vDists.empty())
+        HammingDistance::Distances(a.ptr<unsigned char>(), &vpRows[0], vpRows.size(), &vDists[0]);
+}
+
 bool CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2,
                            const Eigen::Matrix3d &F12, const Frame *pKF);
 
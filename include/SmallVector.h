@@ -0,0 +1,89 @@
+#ifndef SMALLVECTOR_H
+#define SMALLVECTOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace ORB_SLAM
+{
+// Vector of trivially copyable elements whose first N elements are stored inside the object, so that a
+// short vector, and its copy on the stack, take no heap allocation. Elements move to the heap beyond N
+template<typename T, size_t N>
+class SmallVector
+{
+public:
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector(): mpData(mInline), mnSize(0), mnCapacity(N) {}
+    SmallVector(const SmallVector& other): mpData(mInline), mnSize(0), mnCapacity(N) { *this = other; }
+    ~SmallVector()
+    {
+        if(mpData != mInline)
+            free(mpData);
+    }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if(this != &other)
+        {
+            Reserve(other.mnSize);
+            memcpy(mpData, other.mpData, other.mnSize*sizeof(T));
+            mnSize = other.mnSize;
+        }
+        return *this;
+    }
+
+    size_t size() const { return mnSize; }
+    bool empty() const { return mnSize == 0; }
+    void clear() { mnSize = 0; }
+
+    iterator begin() { return mpData; }
+    iterator end() { return mpData + mnSize; }
+    const_iterator begin() const { return mpData; }
+    const_iterator end() const { return mpData + mnSize; }
+    T& operator[](size_t i) { return mpData[i]; }
+    const T& operator[](size_t i) const { return mpData[i]; }
+
+    void push_back(const T& value)
+    {
+        const T copy = value; // value may be an element
+        if(mnSize == mnCapacity)
+            Reserve(2*mnCapacity);
+        mpData[mnSize++] = copy;
+    }
+
+    // keeps the order of the other elements, returns the iterator to the element after the erased one
+    iterator erase(iterator it)
+    {
+        memmove(it, it+1, (end()-(it+1))*sizeof(T));
+        --mnSize;
+        return it;
+    }
+
+protected:
+    void Reserve(size_t nCapacity)
+    {
+        if(nCapacity <= mnCapacity)
+            return;
+        T* pData = static_cast<T*>(malloc(nCapacity*sizeof(T)));
+        if(!pData)
+            throw std::bad_alloc();
+        memcpy(pData, mpData, mnSize*sizeof(T));
+        if(mpData != mInline)
+            free(mpData);
+        mpData = pData;
+        mnCapacity = nCapacity;
+    }
+
+    T* mpData;
+    size_t mnSize;
+    size_t mnCapacity;
+    T mInline[N];
+};
+
+} //namespace ORB_SLAM
+
+#endif // SMALLVECTOR_H
@@ -0,0 +1,75 @@
+#ifndef STEREOPIPELINE_H
+#define STEREOPIPELINE_H
+
+#include <vector>
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "BoundedQueue.h"
+#include "Tracking.h"
+
+class StereoImageLoader;
+
+namespace ORB_SLAM
+{
+// A stereo pair travelling through the front-end stages
+struct StereoPipelineFrame
+{
+    int nImageIndex;
+    double time_frame; // -1 if the images could not be loaded
+    cv::Mat left_img;
+    cv::Mat right_img;
+    StereoFeatures features;
+    StereoPipelineFrame(): nImageIndex(-1), time_frame(-1) {}
+    ~StereoPipelineFrame() { delete features.pFrame; }
+private:
+    StereoPipelineFrame(const StereoPipelineFrame&);
+    StereoPipelineFrame& operator=(const StereoPipelineFrame&);
+};
+
+// Runs the stereo front-end as a pipeline of threads connected by bounded queues:
+// load and rectify -> libviso2 feature matching -> Frame and ORB descriptors,
+// so that frames come out of Next() ready for Tracking::ProcessAStereoFrame at the pace of the slowest stage.
+// Each stage processes the frames in order, so the tracking result is the same as without the pipeline
+class StereoPipeline
+{
+public:
+    StereoPipeline(StereoImageLoader* pLoader, Tracking* pTracker, int nStartIndex, int nFinishIndex,
+                   size_t nQueueSize=2);
+    ~StereoPipeline();
+
+    // the next frame in order, NULL when the sequence is exhausted. The caller deletes the frame
+    StereoPipelineFrame* Next();
+
+    // stop all stages, e.g., when the consumer quits early
+    void Stop();
+
+    // average seconds per frame spent in each stage: load, viso2 matching, frame creation
+    std::vector<double> GetStageTimes() const;
+
+protected:
+    void Load();
+    void ExtractFeatures();
+    void CreateFrames();
+    void AddStageTime(size_t stage, double seconds);
+
+    StereoImageLoader* mpLoader;
+    Tracking* mpTracker;
+    const int mnStartIndex;
+    const int mnFinishIndex;
+    const bool mbCreateFrames; // frame creation depends on gravity if not
+
+    BoundedQueue<StereoPipelineFrame*> mLoaded;
+    BoundedQueue<StereoPipelineFrame*> mMatched;
+    BoundedQueue<StereoPipelineFrame*> mReady;
+
+    std::vector<boost::thread*> mvThreads;
+
+    mutable boost::mutex mMutexTimes;
+    std::vector<double> mvStageTimes;
+    std::vector<int> mvStageCounts;
+};
+
+} //namespace ORB_SLAM
+
+#endif // STEREOPIPELINE_H
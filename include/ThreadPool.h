@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace ORB_SLAM
+{
+// A fixed set of boost threads that run the iterations of parallel loops.
+// The thread calling ParallelFor also runs iterations, so a pool of 0 workers
+// runs the loop serially, and nested ParallelFor calls from a task cannot deadlock.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t nWorkers);
+    ~ThreadPool();
+
+    // Run task(i) for i in [0, n), returns when all iterations are done.
+    // Iterations may run in any order, so each must write its own output slot
+    void ParallelFor(size_t n, const boost::function<void (size_t)>& task);
+
+    // Number of worker threads, not counting the caller of ParallelFor
+    size_t GetNumWorkers() const { return mvWorkers.size(); }
+
+protected:
+    struct Job;
+
+    void WorkerLoop();
+    static void RunJob(Job* pJob);
+
+    std::vector<boost::thread*> mvWorkers;
+    std::deque<boost::shared_ptr<Job> > mlJobs;
+    boost::mutex mMutexJobs;
+    boost::condition_variable mCondJobs;
+    bool mbStop;
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+} //namespace ORB_SLAM
+
+#endif // THREADPOOL_H
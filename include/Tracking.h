@@ -32,6 +32,7 @@
 #include "ORBVocabulary.h"
 #include"KeyFrameDatabase.h"
 #include"ORBextractor.h"
+#include "ImagePyramid.h"
 #include "Initializer.h"
 #include "MapPublisher.h"
 #include "StereoImageLoader.h" //dataset_type
@@ -63,6 +64,7 @@ class FramePublisher;
 class Map;
 class LocalMapping;
 class LoopClosing;
+class ThreadPool;
 
 
 enum TrackingState{
@@ -89,6 +91,35 @@ private:
     TrackingResult& operator= (const TrackingResult&);
 };
 
+// libviso2 matches of one stereo pair and optionally the Frame with ORB descriptors,
+// produced ahead of tracking when the stereo front-end is pipelined, see StereoPipeline
+struct StereoFeatures
+{
+    std::vector<p_match> vQuadMatches; // previous to current frame, cropped
+    std::vector<p_match> vBucketedMatches; // bucketed quad matches for motion estimation
+    std::vector<p_match> vStereoMatches; // left to right image of the current frame
+    int nLeftFeatures; // dense features detected by libviso2 in the left image
+    int nRightFeatures;
+    // pyramids of the images, shared by libviso2 and the ORB descriptors of the frame, released once it is created
+    ImagePyramid leftPyramid;
+    ImagePyramid rightPyramid;
+    Frame* pFrame; // created ahead if not NULL, ownership passes to Tracking
+    StereoFeatures(): nLeftFeatures(0), nRightFeatures(0), pFrame(NULL)
+    {}
+};
+
+// libviso2 matching accumulated over frames, to compare matching with and without the motion prior
+struct MatchingStats
+{
+    size_t nFrames; // frames with a previous frame to match against
+    double dMatchingTime; // seconds in quad and stereo matching
+    size_t nQuadMatches;
+    size_t nInliers; // RANSAC inliers of the motion estimation
+    int64_t nComparisons; // descriptor comparisons
+    MatchingStats(): nFrames(0), dMatchingTime(0), nQuadMatches(0), nInliers(0), nComparisons(0)
+    {}
+};
+
 typedef Eigen::Matrix<double, 7, 1> RawImuMeasurement; //double timestamp, accel xyz m/s^2, gyro xyz rad/sec
 typedef std::vector<RawImuMeasurement, Eigen::aligned_allocator<RawImuMeasurement> > RawImuMeasurementVector;
 
@@ -131,14 +162,26 @@ public:
     void GetViso2PoseEstimate(TrackingResult & rhs) const;
     bool ProcessAMonocularFrame(cv::Mat &left_img, double time_frame,
                                 const RawImuMeasurementVector & imuMeas);
+    // pFeatures, if not NULL, holds the output of ExtractStereoFeatures and possibly CreateStereoFrame
     bool ProcessAStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double time_frame,
-                             const RawImuMeasurementVector & imuMeas);
+                             const RawImuMeasurementVector & imuMeas, StereoFeatures* pFeatures=NULL);
+
+    // The stages of ProcessAStereoFrame that do not depend on the tracking result. They can run ahead
+    // of tracking in other threads, but each of them has to be called in frame order from one thread
+    // pred_Tr_delta and pred_cov, if not NULL, are the predicted motion from the previous frame and its covariance,
+    // which restrict the quad matching to windows around the predicted positions
+    void ExtractStereoFeatures(cv::Mat &left_img, cv::Mat &right_img, StereoFeatures& features,
+                               const Sophus::SE3d *pred_Tr_delta=NULL, const Eigen::Matrix<double, 6, 6> *pred_cov=NULL);
+    void CreateStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double timeStampSec, StereoFeatures& features);
+    // Frames can only be created ahead if the keypoint orientation does not depend on the gravity direction
+    bool CanCreateStereoFrameAhead() const {return ginw.norm()<1e-6;}
 
     /**
      * @brief PrepareImuProcessor construct the ImuProcessor, and reads the initial values for IMU pose in the world frame at start time,
      *  and the its velocity and acc bias and gyro bias. The start time is tied to the first frame that is covered by inertial data
      */
     void PrepareImuProcessor();
+    const MatchingStats& GetMatchingStats() const {return mMatchingStats;}
     void ResizeCameraModel(const int downscale);
 
     TrackingState mState;
@@ -168,7 +211,8 @@ protected:
     //in the following two versions, the original implementation ProcessFrame gives the best result
     void ProcessFrame(cv::Mat &left_img, cv::Mat &right_img, double timeStampSec,
                       const RawImuMeasurementVector& imu_measurements = RawImuMeasurementVector(),
-                      const Sophus::SE3d * pTcp=NULL, Eigen::Matrix<double, 9, 1> sb=Eigen::Matrix<double, 9, 1>::Zero());
+                      const Sophus::SE3d * pTcp=NULL, Eigen::Matrix<double, 9, 1> sb=Eigen::Matrix<double, 9, 1>::Zero(),
+                      StereoFeatures* pFeatures=NULL);
 
     void ProcessFrameQCV(cv::Mat &left_img, cv::Mat &right_img, double timeStampSec,
                       const RawImuMeasurementVector& imu_measurements = RawImuMeasurementVector(),
@@ -193,6 +237,8 @@ protected:
 
     bool RelocalisationRequested();
     bool Relocalisation();
+    int RefineRelocalisationPose(Frame &F, KeyFrame* pKF, const std::vector<bool> &vbInliers,
+                                 const std::vector<MapPoint*> &vpMapPointMatches);
 
     void UpdateReference();
     void UpdateReferencePoints();
@@ -216,6 +262,7 @@ protected:
     //ORB
     ORBextractor* mpORBextractor;
     ORBextractor* mpIniORBextractor; //not used in stereo case
+    ThreadPool* mpThreadPool; //shared by the extractors and relocalisation, owned by Tracking
  
     //BoW
     ORBVocabulary* mpORBVocabulary;
@@ -228,6 +275,8 @@ protected:
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+    // snapshot of the local MapPoints not yet matched in the current frame, checked at once for visibility
+    FrustumCulling::Batch mLocalPointsBatch;
 
     std::vector<KeyFrame*> mvpOldLocalKeyFrames;
     std::deque <Frame*> mvpTemporalFrames;
@@ -307,9 +356,17 @@ protected:
     ///the following parameters determines necessary conditions to create a new keyframe
     float mfTrackedFeatureRatio; /// if the current frame tracks less than this ratio of features in the reference keyframe
     int mnMinTrackedFeatures; /// if the current frame tracks less than this number of features in the reference keyframe
+
+    ///motion prior guided matching, the IMU or decay motion model prediction restricts the libviso2 quad matching
+    bool mbMotionPriorMatching;
+    double mdPriorRotationStd; /// radian, uncertainty of a prediction without IMU covariance
+    double mdPriorTranslationStd; /// meter
+    Eigen::Matrix<double, 6, 6> mPredTcpCov; /// covariance of the last prediction, [rotation; translation] on the left of Tcp
+    MatchingStats mMatchingStats;
 };
 
-std::vector<p_match> cropMatches(const std::vector<p_match> &pMatches, float xl, float xr);
+// remove in place the matches whose u1c falls outside of [xl, xr)
+void cropMatches(std::vector<p_match> &pMatches, float xl, float xr);
 
 
 } //namespace ORB_SLAM
@@ -0,0 +1,119 @@
+#include "CovisibilityGraph.h"
+#include "KeyFrame.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace ORB_SLAM
+{
+
+CovisibilityGraph::Row& CovisibilityGraph::GetRow(KeyFrame* pKF)
+{
+    if(pKF->mnFrameId >= mvRows.size())
+        mvRows.resize(pKF->mnFrameId+1);
+    Row& row = mvRows[pKF->mnFrameId];
+    if(row.pKF!=pKF)
+    {
+        row.pKF = pKF;
+        row.vEdges.clear();
+        row.vnChanged.clear();
+    }
+    return row;
+}
+
+void CovisibilityGraph::AddWeight(KeyFrame* pKF1, KeyFrame* pKF2, int nDelta)
+{
+    Row& row = GetRow(pKF1);
+    size_t i=0;
+    for(; i<row.vEdges.size(); ++i)
+        if(row.vEdges[i].pKF==pKF2)
+            break;
+    if(i==row.vEdges.size())
+    {
+        if(nDelta<=0)
+            return;
+        Edge edge;
+        edge.pKF = pKF2;
+        edge.nWeight = 0;
+        edge.bChanged = false;
+        row.vEdges.push_back(edge);
+    }
+    Edge& edge = row.vEdges[i];
+    edge.nWeight = std::max(edge.nWeight+nDelta, 0);
+    if(!edge.bChanged)
+    {
+        edge.bChanged = true;
+        row.vnChanged.push_back(i);
+    }
+}
+
+void CovisibilityGraph::AddWeights(KeyFrame* pKF, KeyFrame* const* vpKFs, size_t n, int nDelta)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    for(size_t i=0; i<n; ++i)
+    {
+        if(vpKFs[i]==pKF)
+            continue;
+        AddWeight(pKF, vpKFs[i], nDelta);
+        AddWeight(vpKFs[i], pKF, nDelta);
+    }
+}
+
+void CovisibilityGraph::GetWeights(KeyFrame* pKF, std::vector<std::pair<KeyFrame*,int> > &vWeights)
+{
+    vWeights.clear();
+    boost::mutex::scoped_lock lock(mMutex);
+    if(pKF->mnFrameId >= mvRows.size() || mvRows[pKF->mnFrameId].pKF!=pKF)
+        return;
+    const std::vector<Edge>& vEdges = mvRows[pKF->mnFrameId].vEdges;
+    for(size_t i=0; i<vEdges.size(); ++i)
+        if(vEdges[i].nWeight>0)
+            vWeights.push_back(std::make_pair(vEdges[i].pKF, vEdges[i].nWeight));
+}
+
+void CovisibilityGraph::TakeChanges(KeyFrame* pKF, std::vector<std::pair<KeyFrame*,int> > &vChanges)
+{
+    vChanges.clear();
+    boost::mutex::scoped_lock lock(mMutex);
+    if(pKF->mnFrameId >= mvRows.size() || mvRows[pKF->mnFrameId].pKF!=pKF)
+        return;
+    Row& row = mvRows[pKF->mnFrameId];
+    vChanges.reserve(row.vnChanged.size());
+    // from the last edge, so that moving the last edge into the place of a dropped one moves an edge already seen
+    std::sort(row.vnChanged.begin(), row.vnChanged.end(), std::greater<size_t>());
+    for(size_t j=0; j<row.vnChanged.size(); ++j)
+    {
+        const size_t i = row.vnChanged[j];
+        Edge& edge = row.vEdges[i];
+        vChanges.push_back(std::make_pair(edge.pKF, edge.nWeight));
+        edge.bChanged = false;
+        if(edge.nWeight==0)
+        {
+            edge = row.vEdges.back();
+            row.vEdges.pop_back();
+        }
+    }
+    row.vnChanged.clear();
+}
+
+void CovisibilityGraph::EraseKeyFrame(KeyFrame* pKF)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(pKF->mnFrameId >= mvRows.size() || mvRows[pKF->mnFrameId].pKF!=pKF)
+        return;
+    Row& row = mvRows[pKF->mnFrameId];
+    for(size_t i=0; i<row.vEdges.size(); ++i)
+        if(row.vEdges[i].nWeight>0)
+            AddWeight(row.vEdges[i].pKF, pKF, -row.vEdges[i].nWeight);
+    row.pKF = NULL;
+    std::vector<Edge>().swap(row.vEdges);
+    std::vector<size_t>().swap(row.vnChanged);
+}
+
+void CovisibilityGraph::Clear()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    mvRows.clear();
+}
+
+} //namespace ORB_SLAM
@@ -63,7 +63,7 @@ Frame::Frame(const Frame &frame)
      mvRightKeys(frame.mvRightKeys), mvRightKeysUn(frame.mvRightKeysUn),
      mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec), mDescriptors(frame.mDescriptors.clone()),
      mRightDescriptors(frame.mRightDescriptors.clone()),
-     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier),
+     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mGrid(frame.mGrid),
      mnId(frame.mnId), mnScaleLevels(frame.mnScaleLevels), mfScaleFactor(frame.mfScaleFactor),
      mfLogScaleFactor(frame.mfLogScaleFactor), mvScaleFactors(frame.mvScaleFactors),
      mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2),
@@ -71,9 +71,34 @@ Frame::Frame(const Frame &frame)
      viso2LeftId2StereoId(frame.viso2LeftId2StereoId),viso2RightId2StereoId(frame.viso2RightId2StereoId),
      mbBad(frame.mbBad), v_kf_(NULL), v_sb_(NULL)
 { 
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++)
-            mGrid[i][j]=frame.mGrid[i][j];
+}
+
+// the descriptors share their data as cv::Mat headers do, the BoW maps are swapped as they have no move constructor
+Frame::Frame(Frame &&frame)
+    :mpORBvocabulary(frame.mpORBvocabulary), mpORBextractor(frame.mpORBextractor),
+     mTimeStamp(frame.mTimeStamp),mTcw(frame.mTcw),mOw(frame.mOw),
+     prev_frame(frame.prev_frame), next_frame(frame.next_frame), speed_bias(frame.speed_bias),
+     imu_observ(std::move(frame.imu_observ)),
+     mbFixedLinearizationPoint(frame.mbFixedLinearizationPoint), speed_bias_first_estimate(frame.speed_bias_first_estimate),
+     mTcw_first_estimate(frame.mTcw_first_estimate),
+     cam_(frame.cam_), right_cam_(frame.right_cam_),mTl2r(frame.mTl2r),
+     N(frame.N), mvKeys(std::move(frame.mvKeys)), mvKeysUn(std::move(frame.mvKeysUn)),
+     mvRightKeys(std::move(frame.mvRightKeys)), mvRightKeysUn(std::move(frame.mvRightKeysUn)),
+     mDescriptors(frame.mDescriptors), mRightDescriptors(frame.mRightDescriptors),
+     mvpMapPoints(std::move(frame.mvpMapPoints)), mvbOutlier(std::move(frame.mvbOutlier)), mGrid(std::move(frame.mGrid)),
+     mnId(frame.mnId), mnScaleLevels(frame.mnScaleLevels), mfScaleFactor(frame.mfScaleFactor),
+     mfLogScaleFactor(frame.mfLogScaleFactor), mvScaleFactors(std::move(frame.mvScaleFactors)),
+     mvLevelSigma2(std::move(frame.mvLevelSigma2)), mvInvLevelSigma2(std::move(frame.mvInvLevelSigma2)),
+     mnMinX(frame.mnMinX),mnMaxX(frame.mnMaxX),mnMinY(frame.mnMinY), mnMaxY(frame.mnMaxY),
+     viso2LeftId2StereoId(std::move(frame.viso2LeftId2StereoId)),
+     viso2RightId2StereoId(std::move(frame.viso2RightId2StereoId)),
+     mbBad(frame.mbBad), v_kf_(NULL), v_sb_(NULL)
+{
+    mBowVec.swap(frame.mBowVec);
+    mFeatVec.swap(frame.mFeatVec);
+    frame.mDescriptors.release();
+    frame.mRightDescriptors.release();
+    frame.N = 0;
 }
 
 
@@ -82,7 +107,7 @@ Frame::Frame(cv::Mat &im_, const double &timeStamp, ORBextractor* extractor,
              const Eigen::Vector3d ginc, const Eigen::Matrix<double, 9,1> sb)
     :mpORBvocabulary(voc),mpORBextractor(extractor), mTimeStamp(timeStamp),
       prev_frame(NULL), next_frame(NULL), speed_bias(sb), mbFixedLinearizationPoint(false), cam_(*cam),
-      right_cam_(*cam), mnId(nNextId++), mbBad(false),v_kf_(NULL), v_sb_(NULL)
+      right_cam_(*cam), mGrid(FRAME_GRID_COLS, FRAME_GRID_ROWS), mnId(nNextId++), mbBad(false),v_kf_(NULL), v_sb_(NULL)
 {
 
     // Scale Level Info
@@ -94,17 +119,14 @@ Frame::Frame(cv::Mat &im_, const double &timeStamp, ORBextractor* extractor,
     mvLevelSigma2 = mpORBextractor->GetScaleSigmaSquares();
     mvInvLevelSigma2 = mpORBextractor->GetInverseScaleSigmaSquares();
 
-    cv::Mat fK=Converter::toCvMat(cam_.K());
-    cv::Mat fDistCoef=(cv::Mat_<float>(4,1)<< cam_.d0(),cam_.d1(), cam_.d2(), cam_.d3());
-
     //compute orientation either with gravity or illumination
     if(ginc.norm()<1e-6) //assigned proper value
     {
         (*mpORBextractor)(im_, cv::Mat(), mvKeys, mDescriptors);
-        UndistortKeyPoints( mvKeys, mvKeysUn, fK, fDistCoef);
+        cam_.undistortKeyPoints(mvKeys, mvKeysUn);
     }else{
         (*mpORBextractor)( im_, cv::Mat(), mvKeys, mDescriptors,
-          mvKeysUn, fK, fDistCoef, ginc);
+          mvKeysUn, cam_, ginc);
     }
     N = mvKeys.size();
 
@@ -135,32 +157,19 @@ Frame::Frame(cv::Mat &im_, const double &timeStamp, ORBextractor* extractor,
         mnMaxY = snMaxY;
     }
 
-    // Assign Features to Grid Cells
-    int nReserve = 0.5*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);
-
-
-    for(size_t i=0;i<mvKeysUn.size();i++)
-    {
-        cv::KeyPoint &kp = mvKeysUn[i];
-
-        int nGridPosX, nGridPosY;
-        if(PosInGrid(kp,nGridPosX,nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
-    }
+    AssignFeaturesToGrid();
     mvbOutlier = vector<bool>(N,false);    
 }
 
-Frame::Frame(cv::Mat &im_ , const double & timeStamp, const int num_features_left, cv::Mat &right_img, const int num_features_right,
+Frame::Frame(ImagePyramid &left_pyr, const double & timeStamp, const int num_features_left,
+             ImagePyramid &right_pyr, const int num_features_right,
                       const std::vector<p_match> & vStereoMatches, ORBextractor* extractor, ORBVocabulary* voc,
             vk::PinholeCamera * cam, vk::PinholeCamera * right_cam, const Sophus::SE3d& Tl2r,
              const Eigen::Vector3d & ginc, const Eigen::Matrix<double, 9,1> sb)
     :mpORBvocabulary(voc),mpORBextractor(extractor), mTimeStamp(timeStamp),
       prev_frame(NULL), next_frame(NULL), speed_bias(sb), mbFixedLinearizationPoint(false),
       cam_(*cam), right_cam_(*right_cam),
-        mTl2r(Tl2r), mnId(nNextId++), mbBad(false),v_kf_(NULL), v_sb_(NULL)
+        mTl2r(Tl2r), mGrid(FRAME_GRID_COLS, FRAME_GRID_ROWS), mnId(0), mbBad(false),v_kf_(NULL), v_sb_(NULL)
 {
     // Scale Level Info
     mnScaleLevels = mpORBextractor->GetLevels();
@@ -189,28 +198,23 @@ Frame::Frame(cv::Mat &im_ , const double & timeStamp, const int num_features_lef
         mvKeys[jack]=cv::KeyPoint(pMatch.u1c, pMatch.v1c, 11);//11 according to stereoscan article
         mvRightKeys[jack]=cv::KeyPoint(pMatch.u2c, pMatch.v2c, 11);
     }
-    cv::Mat fK=Converter::toCvMat(cam_.K());
-    cv::Mat fDistCoef=(cv::Mat_<float>(4,1)<< cam_.d0(),cam_.d1(), cam_.d2(), cam_.d3());
-
-    cv::Mat fRightK=Converter::toCvMat(right_cam_.K());
-    cv::Mat fRightDistCoef=(cv::Mat_<float>(4,1)<< right_cam_.d0(),right_cam_.d1(), right_cam_.d2(), right_cam_.d3());
-
-    UndistortKeyPoints( mvKeys, mvKeysUn, fK, fDistCoef);
-    UndistortKeyPoints( mvRightKeys, mvRightKeysUn, fRightK, fRightDistCoef);
+    // the cameras undistort by their lookup tables, built once
+    cam_.undistortKeyPoints(mvKeys, mvKeysUn);
+    right_cam_.undistortKeyPoints(mvRightKeys, mvRightKeysUn);
     //compute orientation either with gravity or illumination
     if(ginc.norm()<1e-6) //assigned proper value
     {
-        (*mpORBextractor)(im_, mvKeys, mDescriptors);
-        (*mpORBextractor)(right_img, mvRightKeys, mRightDescriptors);
+        (*mpORBextractor)(left_pyr, mvKeys, mDescriptors);
+        (*mpORBextractor)(right_pyr, mvRightKeys, mRightDescriptors);
     }else
     {
-        computeKeyPointGAO(mvKeys, mvKeysUn, fK, fDistCoef, ginc);
-        (*mpORBextractor)(im_, mvKeys, mDescriptors, true);
+        computeKeyPointGAO(mvKeys, mvKeysUn, cam_, ginc);
+        (*mpORBextractor)(left_pyr, mvKeys, mDescriptors, true);
 
         Eigen::Vector3d ginr=mTl2r*ginc;
 
-        computeKeyPointGAO(mvRightKeys, mvRightKeysUn, fRightK, fRightDistCoef, ginr);
-        (*mpORBextractor)(right_img, mvRightKeys, mRightDescriptors, true);
+        computeKeyPointGAO(mvRightKeys, mvRightKeysUn, right_cam_, ginr);
+        (*mpORBextractor)(right_pyr, mvRightKeys, mRightDescriptors, true);
     }       
 
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
@@ -236,20 +240,7 @@ Frame::Frame(cv::Mat &im_ , const double & timeStamp, const int num_features_lef
         mnMaxY = snMaxY;
     }
 
-    // Assign Features to Grid Cells
-    int nReserve = 0.5*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);//N.B. mGrid[i][j] can grow over nReserve
-
-    for(size_t i=0;i<mvKeysUn.size();i++)
-    {
-        cv::KeyPoint &kp = mvKeysUn[i];
-
-        int nGridPosX, nGridPosY;
-        if(PosInGrid(kp,nGridPosX,nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
-    }
+    AssignFeaturesToGrid();
     mvbOutlier = vector<bool>(N,false);
 
 }
@@ -269,9 +260,7 @@ void Frame::Release()
     mvpMapPoints.clear();
    
     mvbOutlier.clear();
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++)
-            mGrid[i][j].clear();
+    mGrid.Clear();
     viso2LeftId2StereoId.clear();
     viso2RightId2StereoId.clear();
 
@@ -286,9 +275,7 @@ void Frame::PartialRelease()
     mvbOutlier.clear();
 
 // mGrid is used for detecting matches between keyframes
-//    for(int i=0;i<FRAME_GRID_COLS;i++)
-//        for(int j=0; j<FRAME_GRID_ROWS; j++)
-//            mGrid[i][j].clear();
+//    mGrid.Clear();
 
     viso2LeftId2StereoId.clear();
     viso2RightId2StereoId.clear();
@@ -435,95 +422,81 @@ bool Frame::isInFrustumStereo(MapPoint *pMP, float viewingCosLimit)
 
     return true;
 }
-vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, int minLevel, int maxLevel) const
-{   
-    vector<size_t> vIndices;
-    vIndices.reserve(mvKeysUn.size());
-
-    int nMinCellX = floor((x-mnMinX-r)*mfGridElementWidthInv);
-    nMinCellX = max(0,nMinCellX);
-    if(nMinCellX>=FRAME_GRID_COLS)
-        return vIndices;
-
-    int nMaxCellX = ceil((x-mnMinX+r)*mfGridElementWidthInv);
-    nMaxCellX = min(FRAME_GRID_COLS-1,nMaxCellX);
-    if(nMaxCellX<0)
-        return vIndices;
-
-    int nMinCellY = floor((y-mnMinY-r)*mfGridElementHeightInv);
-    nMinCellY = max(0,nMinCellY);
-    if(nMinCellY>=FRAME_GRID_ROWS)
-        return vIndices;
-
-    int nMaxCellY = ceil((y-mnMinY+r)*mfGridElementHeightInv);
-    nMaxCellY = min(FRAME_GRID_ROWS-1,nMaxCellY);
-    if(nMaxCellY<0)
-        return vIndices;
-
-    bool bCheckLevels=true;
-    bool bSameLevel=false;
-    if(minLevel==-1 && maxLevel==-1)
-        bCheckLevels=false;
-    else
-        if(minLevel==maxLevel)
-            bSameLevel=true;
 
-    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
+int Frame::isInFrustum(FrustumCulling::Batch &batch, float viewingCosLimit)
+{
+    return CullBatch(batch, viewingCosLimit, false);
+}
+
+int Frame::isInFrustumStereo(FrustumCulling::Batch &batch, float viewingCosLimit)
+{
+    return CullBatch(batch, viewingCosLimit, true);
+}
+
+int Frame::CullBatch(FrustumCulling::Batch &batch, float viewingCosLimit, bool bStereo)
+{
+    FrustumCulling::View view;
+    const Eigen::Matrix3d Rlr = mTl2r.rotationMatrix();
+    for(int r=0; r<3; ++r)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
+        for(int c=0; c<3; ++c)
         {
-            const vector<size_t> & vCell = mGrid[ix][iy];
-            if(vCell.empty())
-                continue;
-
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                if(bCheckLevels && !bSameLevel)
-                {
-                    if(kpUn.octave<minLevel || kpUn.octave>maxLevel)
-                        continue;
-                }
-                else if(bSameLevel)
-                {
-                    if(kpUn.octave!=minLevel)
-                        continue;
-                }
-
-                if(abs(kpUn.pt.x-x)>r || abs(kpUn.pt.y-y)>r)
-                    continue;
-
-                vIndices.push_back(vCell[j]);
-            }
+            view.Rcw[3*r+c] = mRcw(r,c);
+            view.Rlr[3*r+c] = Rlr(r,c);
         }
+        view.Ow[r] = mOw[r];
+        view.tlr[r] = mTl2r.translation()[r];
     }
-    return vIndices;
+    view.fx = cam_.fx(); view.fy = cam_.fy(); view.cx = cam_.cx(); view.cy = cam_.cy();
+    view.bStereo = bStereo;
+    view.fxr = right_cam_.fx(); view.fyr = right_cam_.fy(); view.cxr = right_cam_.cx(); view.cyr = right_cam_.cy();
+    view.minX = mnMinX; view.maxX = mnMaxX; view.minY = mnMinY; view.maxY = mnMaxY;
+    view.viewingCosLimit = viewingCosLimit;
+    view.vScaleFactors = &mpORBextractor->mvScaleFactor[0];
+    view.nScaleLevels = GetScaleLevels();
+
+    const int nInView = FrustumCulling::Cull(view, batch);
+
+    // Data used by the tracking
+    for(size_t i=0, iend=batch.size(); i<iend; ++i)
+    {
+        MapPoint* pMP = batch.vpMapPoints[i];
+        pMP->mbTrackInView = batch.vbInView[i];
+        if(!batch.vbInView[i])
+            continue;
+        pMP->mTrackProjX = batch.vProjX[i];
+        pMP->mTrackProjY = batch.vProjY[i];
+        pMP->mnTrackScaleLevel = batch.vnScaleLevel[i];
+        pMP->mTrackViewCos = batch.vViewCos[i];
+    }
+    return nInView;
+}
+
+vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, int minLevel, int maxLevel) const
+{   
+    return mGrid.GetFeaturesInArea(x, y, r, minLevel, maxLevel);
 }
 
 bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
 {
-    posX = round((kp.pt.x-mnMinX)*mfGridElementWidthInv);
-    posY = round((kp.pt.y-mnMinY)*mfGridElementHeightInv);
-
-    //Keypoint's coordinates are undistorted, which could cause to go out of the image
-    if(posX<0 || posX>=FRAME_GRID_COLS || posY<0 || posY>=FRAME_GRID_ROWS)
-        return false;
+    return mGrid.PosInGrid(kp, posX, posY);
+}
 
-    return true;
+// Assign Features to Grid Cells
+void Frame::AssignFeaturesToGrid()
+{
+    mGrid.Build(mvKeysUn, mnMinX, mnMinY, mfGridElementWidthInv, mfGridElementHeightInv);
 }
 
 void Frame::ComputeBoW()
 {
     if(mBowVec.empty() || mFeatVec.empty())
     {
-        std::vector<cv::Mat> vDesc;
-        vDesc.reserve(mDescriptors.rows);
-        for (int j=0;j<mDescriptors.rows;j++){       
-            vDesc.push_back(mDescriptors.row(j));
-        }
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vDesc,mBowVec,mFeatVec,4);
+        // The descriptor rows descend the flattened tree directly, on the extractor threads if any
+        mpORBvocabulary->transform(mDescriptors,mBowVec,mFeatVec,4,
+                                   mpORBextractor? mpORBextractor->GetThreadPool(): NULL);
     }
 }
 //void CreatePMatch(const Frame &F1, const Frame &F2, const vector<int>& vMatches, vector<p_match>& p_matched)
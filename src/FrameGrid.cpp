@@ -0,0 +1,132 @@
+#include "FrameGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace ORB_SLAM
+{
+
+FrameGrid::FrameGrid(int nCols, int nRows):
+    mnCols(nCols), mnRows(nRows), mfMinX(0), mfMinY(0), mfCellWidthInv(0), mfCellHeightInv(0)
+{
+}
+
+void FrameGrid::Build(const std::vector<cv::KeyPoint> &vKeysUn, float fMinX, float fMinY,
+                      float fCellWidthInv, float fCellHeightInv)
+{
+    mfMinX = fMinX;
+    mfMinY = fMinY;
+    mfCellWidthInv = fCellWidthInv;
+    mfCellHeightInv = fCellHeightInv;
+
+    const int nCells = mnCols*mnRows;
+    const size_t N = vKeysUn.size();
+
+    // count keypoints per cell, then turn the counts into offsets
+    std::vector<int> vCells(N);
+    mvCellStarts.assign(nCells+1, 0);
+    for(size_t i=0; i<N; i++)
+    {
+        int nGridPosX, nGridPosY;
+        if(PosInGrid(vKeysUn[i], nGridPosX, nGridPosY))
+        {
+            vCells[i] = nGridPosX*mnRows+nGridPosY;
+            ++mvCellStarts[vCells[i]+1];
+        }
+        else
+            vCells[i] = -1;
+    }
+    for(int c=0; c<nCells; c++)
+        mvCellStarts[c+1] += mvCellStarts[c];
+
+    const size_t nInGrid = mvCellStarts[nCells];
+    mvIndices.resize(nInGrid);
+    mvX.resize(nInGrid);
+    mvY.resize(nInGrid);
+    mvOctaves.resize(nInGrid);
+
+    std::vector<unsigned int> vNext(mvCellStarts.begin(), mvCellStarts.end()-1);
+    for(size_t i=0; i<N; i++)
+    {
+        if(vCells[i]<0)
+            continue;
+        const unsigned int k = vNext[vCells[i]]++;
+        const cv::KeyPoint &kp = vKeysUn[i];
+        mvIndices[k] = i;
+        mvX[k] = kp.pt.x;
+        mvY[k] = kp.pt.y;
+        mvOctaves[k] = kp.octave;
+    }
+}
+
+void FrameGrid::Clear()
+{
+    mvCellStarts.clear();
+    mvIndices.clear();
+    mvX.clear();
+    mvY.clear();
+    mvOctaves.clear();
+}
+
+bool FrameGrid::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) const
+{
+    posX = round((kp.pt.x-mfMinX)*mfCellWidthInv);
+    posY = round((kp.pt.y-mfMinY)*mfCellHeightInv);
+
+    //Keypoint's coordinates are undistorted, which could cause to go out of the image
+    if(posX<0 || posX>=mnCols || posY<0 || posY>=mnRows)
+        return false;
+
+    return true;
+}
+
+std::vector<std::size_t> FrameGrid::GetFeaturesInArea(const float &x, const float &y, const float &r,
+                                                      const int minLevel, const int maxLevel) const
+{
+    std::vector<std::size_t> vIndices;
+    if(mvCellStarts.empty())
+        return vIndices;
+
+    int nMinCellX = floor((x-mfMinX-r)*mfCellWidthInv);
+    nMinCellX = std::max(0,nMinCellX);
+    if(nMinCellX>=mnCols)
+        return vIndices;
+
+    int nMaxCellX = ceil((x-mfMinX+r)*mfCellWidthInv);
+    nMaxCellX = std::min(mnCols-1,nMaxCellX);
+    if(nMaxCellX<0)
+        return vIndices;
+
+    int nMinCellY = floor((y-mfMinY-r)*mfCellHeightInv);
+    nMinCellY = std::max(0,nMinCellY);
+    if(nMinCellY>=mnRows)
+        return vIndices;
+
+    int nMaxCellY = ceil((y-mfMinY+r)*mfCellHeightInv);
+    nMaxCellY = std::min(mnRows-1,nMaxCellY);
+    if(nMaxCellY<0)
+        return vIndices;
+
+    // a single level is the range [minLevel, minLevel]
+    const bool bCheckLevels = !(minLevel==-1 && maxLevel==-1);
+
+    // the cells of a column are contiguous, so each column of the area is one run of entries
+    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
+    {
+        const unsigned int kBegin = mvCellStarts[ix*mnRows+nMinCellY];
+        const unsigned int kEnd = mvCellStarts[ix*mnRows+nMaxCellY+1];
+        for(unsigned int k=kBegin; k<kEnd; k++)
+        {
+            if(bCheckLevels && (mvOctaves[k]<minLevel || mvOctaves[k]>maxLevel))
+                continue;
+
+            if(std::fabs(mvX[k]-x)>r || std::fabs(mvY[k]-y)>r)
+                continue;
+
+            vIndices.push_back(mvIndices[k]);
+        }
+    }
+    return vIndices;
+}
+
+} //namespace ORB_SLAM
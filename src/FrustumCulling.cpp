@@ -0,0 +1,320 @@
+#include "FrustumCulling.h"
+#include "MapPoint.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUMCULLING_X86
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM
+{
+namespace FrustumCulling
+{
+
+void Batch::Assign(const std::vector<MapPoint*> &vpPoints)
+{
+    const size_t N = vpPoints.size();
+    vpMapPoints = vpPoints;
+    vX.resize(N); vY.resize(N); vZ.resize(N);
+    vNx.resize(N); vNy.resize(N); vNz.resize(N);
+    vMinDistance.resize(N); vMaxDistance.resize(N);
+    vbInView.resize(N);
+    vProjX.resize(N); vProjY.resize(N);
+    vnScaleLevel.resize(N);
+    vViewCos.resize(N);
+
+    Eigen::Vector3d pos, normal;
+    for(size_t i=0; i<N; ++i)
+    {
+        vpPoints[i]->GetGeometry(pos, normal, vMinDistance[i], vMaxDistance[i]);
+        vX[i] = pos[0]; vY[i] = pos[1]; vZ[i] = pos[2];
+        vNx[i] = normal[0]; vNy[i] = normal[1]; vNz[i] = normal[2];
+    }
+}
+
+// Points [begin, end) one by one. The vector kernels do the same operations in the same order on several
+// points, so that they give the same results as this one. This file is built with -ffp-contract=off to keep it so
+static size_t CullScalar(const View &view, Batch &batch, size_t begin, size_t end)
+{
+    const float* R = view.Rcw;
+    const float* Rr = view.Rlr;
+    size_t nInView = 0;
+    for(size_t i=begin; i<end; ++i)
+    {
+        // camera center to point in world, rotated into the camera
+        const float dx = batch.vX[i]-view.Ow[0];
+        const float dy = batch.vY[i]-view.Ow[1];
+        const float dz = batch.vZ[i]-view.Ow[2];
+        const float PcX = R[0]*dx + R[1]*dy + R[2]*dz;
+        const float PcY = R[3]*dx + R[4]*dy + R[5]*dz;
+        const float PcZ = R[6]*dx + R[7]*dy + R[8]*dz;
+
+        const float invz = 1.0f/PcZ;
+        const float u = view.fx*PcX*invz + view.cx;
+        const float v = view.fy*PcY*invz + view.cy;
+        bool bIn = PcZ>0.0f && u>=view.minX && u<=view.maxX && v>=view.minY && v<=view.maxY;
+
+        if(view.bStereo)
+        {
+            const float PrX = Rr[0]*PcX + Rr[1]*PcY + Rr[2]*PcZ + view.tlr[0];
+            const float PrY = Rr[3]*PcX + Rr[4]*PcY + Rr[5]*PcZ + view.tlr[1];
+            const float PrZ = Rr[6]*PcX + Rr[7]*PcY + Rr[8]*PcZ + view.tlr[2];
+            const float invzr = 1.0f/PrZ;
+            const float ur = view.fxr*PrX*invzr + view.cxr;
+            const float vr = view.fyr*PrY*invzr + view.cyr;
+            bIn = bIn && PrZ>0.0f && ur>=view.minX && ur<=view.maxX && vr>=view.minY && vr<=view.maxY;
+        }
+
+        // scale invariance region and viewing angle
+        const float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+        const float viewCos = (dx*batch.vNx[i] + dy*batch.vNy[i] + dz*batch.vNz[i])/dist;
+        bIn = bIn && dist>=batch.vMinDistance[i] && dist<=batch.vMaxDistance[i] && viewCos>=view.viewingCosLimit;
+
+        // predicted level, the first scale factor not below the ratio as lower_bound
+        const float ratio = dist/batch.vMinDistance[i];
+        int nLevel = 0;
+        for(int l=0; l<view.nScaleLevels; ++l)
+            nLevel += view.vScaleFactors[l]<ratio;
+        if(nLevel >= view.nScaleLevels)
+            nLevel = view.nScaleLevels-1;
+
+        batch.vbInView[i] = bIn;
+        batch.vProjX[i] = u;
+        batch.vProjY[i] = v;
+        batch.vnScaleLevel[i] = nLevel;
+        batch.vViewCos[i] = viewCos;
+        nInView += bIn;
+    }
+    return nInView;
+}
+
+#ifdef FRUSTUMCULLING_X86
+
+// four points per iteration, the remainder by CullScalar
+__attribute__((target("sse2")))
+static size_t CullSSE2(const View &view, Batch &batch)
+{
+    const size_t N = batch.size();
+    const float* R = view.Rcw;
+    const float* Rr = view.Rlr;
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 minX = _mm_set1_ps(view.minX), maxX = _mm_set1_ps(view.maxX);
+    const __m128 minY = _mm_set1_ps(view.minY), maxY = _mm_set1_ps(view.maxY);
+    const __m128 maxLevel = _mm_set1_ps((float)(view.nScaleLevels-1));
+    size_t nInView = 0;
+    size_t i = 0;
+    for(; i+4<=N; i+=4)
+    {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&batch.vX[i]), _mm_set1_ps(view.Ow[0]));
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&batch.vY[i]), _mm_set1_ps(view.Ow[1]));
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&batch.vZ[i]), _mm_set1_ps(view.Ow[2]));
+        __m128 Pc[3];
+        for(int r=0; r<3; ++r)
+            Pc[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(R[3*r]), dx), _mm_mul_ps(_mm_set1_ps(R[3*r+1]), dy)),
+                               _mm_mul_ps(_mm_set1_ps(R[3*r+2]), dz));
+
+        const __m128 invz = _mm_div_ps(one, Pc[2]);
+        const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(view.fx), Pc[0]), invz), _mm_set1_ps(view.cx));
+        const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(view.fy), Pc[1]), invz), _mm_set1_ps(view.cy));
+        __m128 in = _mm_and_ps(_mm_cmpgt_ps(Pc[2], zero),
+                               _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, minX), _mm_cmple_ps(u, maxX)),
+                                          _mm_and_ps(_mm_cmpge_ps(v, minY), _mm_cmple_ps(v, maxY))));
+
+        if(view.bStereo)
+        {
+            __m128 Pr[3];
+            for(int r=0; r<3; ++r)
+                Pr[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(Rr[3*r]), Pc[0]),
+                                                         _mm_mul_ps(_mm_set1_ps(Rr[3*r+1]), Pc[1])),
+                                              _mm_mul_ps(_mm_set1_ps(Rr[3*r+2]), Pc[2])), _mm_set1_ps(view.tlr[r]));
+            const __m128 invzr = _mm_div_ps(one, Pr[2]);
+            const __m128 ur = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(view.fxr), Pr[0]), invzr), _mm_set1_ps(view.cxr));
+            const __m128 vr = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(view.fyr), Pr[1]), invzr), _mm_set1_ps(view.cyr));
+            in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(Pr[2], zero),
+                                           _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(ur, minX), _mm_cmple_ps(ur, maxX)),
+                                                      _mm_and_ps(_mm_cmpge_ps(vr, minY), _mm_cmple_ps(vr, maxY)))));
+        }
+
+        const __m128 minDistance = _mm_loadu_ps(&batch.vMinDistance[i]);
+        const __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        const __m128 viewCos = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&batch.vNx[i])),
+                                                                _mm_mul_ps(dy, _mm_loadu_ps(&batch.vNy[i]))),
+                                                     _mm_mul_ps(dz, _mm_loadu_ps(&batch.vNz[i]))), dist);
+        in = _mm_and_ps(in, _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(dist, minDistance),
+                                                  _mm_cmple_ps(dist, _mm_loadu_ps(&batch.vMaxDistance[i]))),
+                                       _mm_cmpge_ps(viewCos, _mm_set1_ps(view.viewingCosLimit))));
+
+        const __m128 ratio = _mm_div_ps(dist, minDistance);
+        __m128 level = zero;
+        for(int l=0; l<view.nScaleLevels; ++l)
+            level = _mm_add_ps(level, _mm_and_ps(_mm_cmplt_ps(_mm_set1_ps(view.vScaleFactors[l]), ratio), one));
+        level = _mm_min_ps(level, maxLevel);
+
+        const int mask = _mm_movemask_ps(in);
+        for(int k=0; k<4; ++k)
+            batch.vbInView[i+k] = (mask>>k)&1;
+        nInView += __builtin_popcount(mask);
+        _mm_storeu_ps(&batch.vProjX[i], u);
+        _mm_storeu_ps(&batch.vProjY[i], v);
+        _mm_storeu_si128((__m128i*)&batch.vnScaleLevel[i], _mm_cvttps_epi32(level));
+        _mm_storeu_ps(&batch.vViewCos[i], viewCos);
+    }
+    return nInView + CullScalar(view, batch, i, N);
+}
+
+// the same on eight points per iteration
+__attribute__((target("avx")))
+static size_t CullAVX(const View &view, Batch &batch)
+{
+    const size_t N = batch.size();
+    const float* R = view.Rcw;
+    const float* Rr = view.Rlr;
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 minX = _mm256_set1_ps(view.minX), maxX = _mm256_set1_ps(view.maxX);
+    const __m256 minY = _mm256_set1_ps(view.minY), maxY = _mm256_set1_ps(view.maxY);
+    const __m256 maxLevel = _mm256_set1_ps((float)(view.nScaleLevels-1));
+    size_t nInView = 0;
+    size_t i = 0;
+    for(; i+8<=N; i+=8)
+    {
+        const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&batch.vX[i]), _mm256_set1_ps(view.Ow[0]));
+        const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&batch.vY[i]), _mm256_set1_ps(view.Ow[1]));
+        const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&batch.vZ[i]), _mm256_set1_ps(view.Ow[2]));
+        __m256 Pc[3];
+        for(int r=0; r<3; ++r)
+            Pc[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(R[3*r]), dx),
+                                                _mm256_mul_ps(_mm256_set1_ps(R[3*r+1]), dy)),
+                                  _mm256_mul_ps(_mm256_set1_ps(R[3*r+2]), dz));
+
+        const __m256 invz = _mm256_div_ps(one, Pc[2]);
+        const __m256 u = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(view.fx), Pc[0]), invz),
+                                       _mm256_set1_ps(view.cx));
+        const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(view.fy), Pc[1]), invz),
+                                       _mm256_set1_ps(view.cy));
+        __m256 in = _mm256_and_ps(_mm256_cmp_ps(Pc[2], zero, _CMP_GT_OQ),
+                                  _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, minX, _CMP_GE_OQ),
+                                                              _mm256_cmp_ps(u, maxX, _CMP_LE_OQ)),
+                                                _mm256_and_ps(_mm256_cmp_ps(v, minY, _CMP_GE_OQ),
+                                                              _mm256_cmp_ps(v, maxY, _CMP_LE_OQ))));
+
+        if(view.bStereo)
+        {
+            __m256 Pr[3];
+            for(int r=0; r<3; ++r)
+                Pr[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Rr[3*r]), Pc[0]),
+                                                                  _mm256_mul_ps(_mm256_set1_ps(Rr[3*r+1]), Pc[1])),
+                                                    _mm256_mul_ps(_mm256_set1_ps(Rr[3*r+2]), Pc[2])),
+                                      _mm256_set1_ps(view.tlr[r]));
+            const __m256 invzr = _mm256_div_ps(one, Pr[2]);
+            const __m256 ur = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(view.fxr), Pr[0]), invzr),
+                                            _mm256_set1_ps(view.cxr));
+            const __m256 vr = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(view.fyr), Pr[1]), invzr),
+                                            _mm256_set1_ps(view.cyr));
+            in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(Pr[2], zero, _CMP_GT_OQ),
+                                                 _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(ur, minX, _CMP_GE_OQ),
+                                                                             _mm256_cmp_ps(ur, maxX, _CMP_LE_OQ)),
+                                                               _mm256_and_ps(_mm256_cmp_ps(vr, minY, _CMP_GE_OQ),
+                                                                             _mm256_cmp_ps(vr, maxY, _CMP_LE_OQ)))));
+        }
+
+        const __m256 minDistance = _mm256_loadu_ps(&batch.vMinDistance[i]);
+        const __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                         _mm256_mul_ps(dz, dz)));
+        const __m256 viewCos = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, _mm256_loadu_ps(&batch.vNx[i])),
+                                                                         _mm256_mul_ps(dy, _mm256_loadu_ps(&batch.vNy[i]))),
+                                                           _mm256_mul_ps(dz, _mm256_loadu_ps(&batch.vNz[i]))), dist);
+        in = _mm256_and_ps(in, _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(dist, minDistance, _CMP_GE_OQ),
+                                                           _mm256_cmp_ps(dist, _mm256_loadu_ps(&batch.vMaxDistance[i]), _CMP_LE_OQ)),
+                                             _mm256_cmp_ps(viewCos, _mm256_set1_ps(view.viewingCosLimit), _CMP_GE_OQ)));
+
+        const __m256 ratio = _mm256_div_ps(dist, minDistance);
+        __m256 level = zero;
+        for(int l=0; l<view.nScaleLevels; ++l)
+            level = _mm256_add_ps(level, _mm256_and_ps(_mm256_cmp_ps(_mm256_set1_ps(view.vScaleFactors[l]), ratio, _CMP_LT_OQ), one));
+        level = _mm256_min_ps(level, maxLevel);
+
+        const int mask = _mm256_movemask_ps(in);
+        for(int k=0; k<8; ++k)
+            batch.vbInView[i+k] = (mask>>k)&1;
+        nInView += __builtin_popcount(mask);
+        _mm256_storeu_ps(&batch.vProjX[i], u);
+        _mm256_storeu_ps(&batch.vProjY[i], v);
+        _mm256_storeu_si256((__m256i*)&batch.vnScaleLevel[i], _mm256_cvttps_epi32(level));
+        _mm256_storeu_ps(&batch.vViewCos[i], viewCos);
+    }
+    return nInView + CullScalar(view, batch, i, N);
+}
+
+#endif
+
+static size_t CullAllScalar(const View &view, Batch &batch)
+{
+    return CullScalar(view, batch, 0, batch.size());
+}
+
+static size_t (*const gKernels[])(const View&, Batch&) = {
+    CullAllScalar,
+#ifdef FRUSTUMCULLING_X86
+    CullSSE2,
+    CullAVX,
+#endif
+};
+
+bool IsSupported(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case SCALAR:
+        return true;
+#ifdef FRUSTUMCULLING_X86
+    case SSE2:
+        return __builtin_cpu_supports("sse2");
+    case AVX:
+        return __builtin_cpu_supports("avx");
+#endif
+    default:
+        return false;
+    }
+}
+
+static Kernel SelectBestKernel()
+{
+#ifdef FRUSTUMCULLING_X86
+    // this runs during static initialization, possibly before libgcc has probed the cpu
+    __builtin_cpu_init();
+#endif
+    if(IsSupported(AVX))
+        return AVX;
+    return IsSupported(SSE2)? SSE2: SCALAR;
+}
+
+static Kernel gKernel = SelectBestKernel();
+
+size_t Cull(const View &view, Batch &batch)
+{
+    return gKernels[gKernel](view, batch);
+}
+
+bool SetKernel(Kernel kernel)
+{
+    if(!IsSupported(kernel))
+        return false;
+    gKernel = kernel;
+    return true;
+}
+
+Kernel GetKernel()
+{
+    return gKernel;
+}
+
+const char* GetKernelName(Kernel kernel)
+{
+    static const char* names[] = {"scalar", "sse2", "avx"};
+    return names[kernel];
+}
+
+}
+} //namespace ORB_SLAM
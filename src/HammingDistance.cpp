@@ -0,0 +1,194 @@
+#include "HammingDistance.h"
+
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAMMING_X86
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM
+{
+namespace HammingDistance
+{
+
+// Bit set count operation from
+// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+static int DistanceScalar(const unsigned char* a, const unsigned char* b)
+{
+    int dist=0;
+    for(int i=0; i<32; i+=4)
+    {
+        uint32_t va, vb;
+        memcpy(&va, a+i, 4);
+        memcpy(&vb, b+i, 4);
+        uint32_t v = va ^ vb;
+        v = v - ((v >> 1) & 0x55555555);
+        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+    }
+    return dist;
+}
+
+// batch loops instantiated per kernel, so that the kernel is inlined with its target options
+#define HAMMING_BATCH(NAME, ATTR, SINGLE) \
+ATTR static void NAME##Ptrs(const unsigned char* a, const unsigned char* const* vpB, size_t n, int* vDists) \
+{ \
+    for(size_t i=0; i<n; ++i) \
+        vDists[i] = SINGLE(a, vpB[i]); \
+} \
+ATTR static void NAME##Strided(const unsigned char* a, const unsigned char* B, size_t stride, size_t n, int* vDists) \
+{ \
+    for(size_t i=0; i<n; ++i, B+=stride) \
+        vDists[i] = SINGLE(a, B); \
+}
+
+HAMMING_BATCH(Scalar, , DistanceScalar)
+
+#ifdef HAMMING_X86
+
+// 64 bit hardware popcount on 4 words
+__attribute__((target("popcnt")))
+static inline int DistancePopcnt(const unsigned char* a, const unsigned char* b)
+{
+    uint64_t va[4], vb[4];
+    memcpy(va, a, 32);
+    memcpy(vb, b, 32);
+    return __builtin_popcountll(va[0]^vb[0]) + __builtin_popcountll(va[1]^vb[1]) +
+           __builtin_popcountll(va[2]^vb[2]) + __builtin_popcountll(va[3]^vb[3]);
+}
+HAMMING_BATCH(Popcnt, __attribute__((target("popcnt"))), DistancePopcnt)
+
+// nibble lookup table with pshufb, bytes are summed up with psadbw
+__attribute__((target("ssse3")))
+static inline int DistanceSSSE3(const unsigned char* a, const unsigned char* b)
+{
+    const __m128i lut = _mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m128i low = _mm_set1_epi8(0x0f);
+    const __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)a),
+                                     _mm_loadu_si128((const __m128i*)b));
+    const __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a+16)),
+                                     _mm_loadu_si128((const __m128i*)(b+16)));
+    __m128i cnt = _mm_add_epi8(
+                _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(x0, low)),
+                             _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(x0, 4), low))),
+                _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(x1, low)),
+                             _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(x1, 4), low))));
+    const __m128i sum = _mm_sad_epu8(cnt, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+}
+HAMMING_BATCH(SSSE3, __attribute__((target("ssse3"))), DistanceSSSE3)
+
+// the same lookup on a whole descriptor in one 256 bit register
+__attribute__((target("avx2")))
+static inline int DistanceAVX2(const unsigned char* a, const unsigned char* b)
+{
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)a),
+                                       _mm256_loadu_si256((const __m256i*)b));
+    const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+                                        _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+    const __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    const __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return _mm_cvtsi128_si32(sum128) + _mm_extract_epi16(sum128, 4);
+}
+HAMMING_BATCH(AVX2, __attribute__((target("avx2"))), DistanceAVX2)
+
+#endif
+
+#undef HAMMING_BATCH
+
+struct KernelTable
+{
+    int (*single)(const unsigned char*, const unsigned char*);
+    void (*ptrs)(const unsigned char*, const unsigned char* const*, size_t, int*);
+    void (*strided)(const unsigned char*, const unsigned char*, size_t, size_t, int*);
+};
+
+static const KernelTable gKernels[] = {
+    {DistanceScalar, ScalarPtrs, ScalarStrided},
+#ifdef HAMMING_X86
+    {DistanceSSSE3, SSSE3Ptrs, SSSE3Strided},
+    {DistancePopcnt, PopcntPtrs, PopcntStrided},
+    {DistanceAVX2, AVX2Ptrs, AVX2Strided},
+#endif
+};
+
+bool IsSupported(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case SCALAR:
+        return true;
+#ifdef HAMMING_X86
+    case SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case POPCNT:
+        return __builtin_cpu_supports("popcnt");
+    case AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+// one descriptor fits in a 256 bit register, so avx2 comes before the 4 popcnt
+static Kernel SelectBestKernel()
+{
+#ifdef HAMMING_X86
+    // this runs during static initialization, possibly before libgcc has probed the cpu
+    __builtin_cpu_init();
+#endif
+    const Kernel vPreferred[] = {AVX2, POPCNT, SSSE3};
+    for(size_t i=0; i<sizeof(vPreferred)/sizeof(vPreferred[0]); ++i)
+    {
+        if(IsSupported(vPreferred[i]))
+            return vPreferred[i];
+    }
+    return SCALAR;
+}
+
+static Kernel gKernel = SelectBestKernel();
+static KernelTable gActive = gKernels[gKernel];
+
+int Distance(const unsigned char* a, const unsigned char* b)
+{
+    return gActive.single(a, b);
+}
+
+void Distances(const unsigned char* a, const unsigned char* const* vpB, size_t n, int* vDists)
+{
+    gActive.ptrs(a, vpB, n, vDists);
+}
+
+void Distances(const unsigned char* a, const unsigned char* B, size_t stride, size_t n, int* vDists)
+{
+    gActive.strided(a, B, stride, n, vDists);
+}
+
+bool SetKernel(Kernel kernel)
+{
+    if(!IsSupported(kernel))
+        return false;
+    gKernel = kernel;
+    gActive = gKernels[kernel];
+    return true;
+}
+
+Kernel GetKernel()
+{
+    return gKernel;
+}
+
+const char* GetKernelName(Kernel kernel)
+{
+    static const char* names[] = {"scalar", "ssse3", "popcnt", "avx2"};
+    return names[kernel];
+}
+
+}
+} //namespace ORB_SLAM
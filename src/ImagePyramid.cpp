@@ -0,0 +1,105 @@
+#include "ImagePyramid.h"
+
+#include <cassert>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace ORB_SLAM
+{
+
+ImagePyramid::ImagePyramid(): mnBorder(0)
+{
+}
+
+ImagePyramid::ImagePyramid(const cv::Mat& image, const std::vector<float>& vInvScaleFactors, int nBorder):
+    mImage(image), mvInvScaleFactors(vInvScaleFactors), mnBorder(nBorder),
+    mvLevels(vInvScaleFactors.size()), mvBlurredLevels(vInvScaleFactors.size()), mvHalfLevels(1, image)
+{
+    assert(image.type() == CV_8UC1);
+}
+
+const cv::Mat& ImagePyramid::GetLevel(int level)
+{
+    assert(level >= 0 && level < GetLevels());
+    if(!mvLevels[level].empty())
+        return mvLevels[level];
+    if(level > 0)
+        GetLevel(level-1);
+
+    // same as ORBextractor::ComputePyramid: every level is resized from the previous one
+    const float scale = mvInvScaleFactors[level];
+    cv::Size sz(cvRound((float)mImage.cols*scale), cvRound((float)mImage.rows*scale));
+    cv::Size wholeSize(sz.width + mnBorder*2, sz.height + mnBorder*2);
+    cv::Mat temp(wholeSize, mImage.type());
+    mvLevels[level] = temp(cv::Rect(mnBorder, mnBorder, sz.width, sz.height));
+    if(level != 0)
+    {
+        cv::resize(mvLevels[level-1], mvLevels[level], sz, 0, 0, cv::INTER_LINEAR);
+        cv::copyMakeBorder(mvLevels[level], temp, mnBorder, mnBorder, mnBorder, mnBorder,
+                           cv::BORDER_REFLECT_101+cv::BORDER_ISOLATED);
+    }
+    else
+    {
+        cv::copyMakeBorder(mImage, temp, mnBorder, mnBorder, mnBorder, mnBorder, cv::BORDER_REFLECT_101);
+    }
+    return mvLevels[level];
+}
+
+const cv::Mat& ImagePyramid::GetBlurredLevel(int level)
+{
+    assert(level >= 0 && level < GetLevels());
+    if(!mvBlurredLevels[level].empty())
+        return mvBlurredLevels[level];
+
+    // blurring a copy reflects at the level boundary, not into the border
+    cv::Mat blurred = level==0? mImage.clone(): GetLevel(level).clone();
+    cv::GaussianBlur(blurred, blurred, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
+    mvBlurredLevels[level] = blurred;
+    return mvBlurredLevels[level];
+}
+
+const cv::Mat& ImagePyramid::GetHalfLevel(int n)
+{
+    assert(n >= 0 && !mImage.empty());
+    if(n < (int)mvHalfLevels.size())
+        return mvHalfLevels[n];
+    const cv::Mat& in = GetHalfLevel(n-1);
+
+    // same rounding as libviso2 and the scalar vk::halfSample
+    const int width = in.cols/2, height = in.rows/2;
+    const int bpl = width + 15-(width-1)%16;
+    cv::Mat padded = cv::Mat::zeros(height, bpl, CV_8U);
+    for(int v=0; v<height; ++v)
+    {
+        const uchar* top = in.ptr<uchar>(2*v);
+        const uchar* bottom = in.ptr<uchar>(2*v+1);
+        uchar* out = padded.ptr<uchar>(v);
+        for(int u=0; u<width; ++u)
+            out[u] = (uchar)(((int)top[2*u] + top[2*u+1] + bottom[2*u] + bottom[2*u+1])/4);
+    }
+    mvHalfLevels.push_back(padded.colRange(0, width));
+    return mvHalfLevels[n];
+}
+
+size_t ImagePyramid::GetMemoryBytes() const
+{
+    size_t nBytes = 0;
+    for(size_t i=0; i<mvLevels.size(); ++i)
+        if(!mvLevels[i].empty())
+            nBytes += (mvLevels[i].rows + 2*mnBorder)*mvLevels[i].step[0];
+    for(size_t i=0; i<mvBlurredLevels.size(); ++i)
+        nBytes += mvBlurredLevels[i].rows*mvBlurredLevels[i].step[0];
+    for(size_t i=1; i<mvHalfLevels.size(); ++i)
+        nBytes += mvHalfLevels[i].rows*mvHalfLevels[i].step[0];
+    return nBytes;
+}
+
+void ImagePyramid::Release()
+{
+    mImage.release();
+    mvInvScaleFactors.clear();
+    mvLevels.clear();
+    mvBlurredLevels.clear();
+    mvHalfLevels.clear();
+}
+
+} //namespace ORB_SLAM
@@ -20,6 +20,9 @@
 
 #include "KeyFrame.h"
 #include "Converter.h"
+#include "KeyFrameStore.h"
+#include <sstream>
+#include <stdexcept>
 #include "vio/eigen_utils.h"
 #include "global.h" //for debugging output
 //#include <vikit/math_utils.h>
@@ -29,23 +32,27 @@ namespace ORB_SLAM
 {
 
 long unsigned int KeyFrame::nNextKeyId=0;
+std::atomic<unsigned long> KeyFrame::snAccessEpoch(0);
 
-KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):Frame(F),  mnFrameId(nNextKeyId++),
+// copies F, then moves the copy into the base, so that the members are initialized in one place
+KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):KeyFrame(Frame(F), pMap, pKFDB)
+{
+}
+
+KeyFrame::KeyFrame(Frame &&F, Map *pMap, KeyFrameDatabase *pKFDB):Frame(std::move(F)),  mnFrameId(nNextKeyId++),
     mnTrackReferenceForFrame(0),mnBALocalForKF(0), mnBAFixedForKF(0),
-    mnLoopQuery(0), mnRelocQuery(0),mpFG(NULL),    mpKeyFrameDB(pKFDB),
+    mpFG(NULL),    mpKeyFrameDB(pKFDB),
     mbFirstConnection(true), mpParent(NULL), mbNotErase(0), mbToBeErased(false),
-    mpMap(pMap)
+    mpMap(pMap), mbOffloaded(false), mnLastAccessEpoch(snAccessEpoch.load()), mpStore(NULL), mnStoreRecord(-1)
 {
-    // mGrids is taken care in copying base Frame
-    /*mGrid.resize(mnGridCols);
-    for(int i=0; i<mnGridCols;i++)
-    {
-        mGrid[i].resize(mnGridRows);
-        for(int j=0; j<mnGridRows; j++)
-            mGrid[i][j] = F.mGrid[i][j];
-    }*/
-//    SetPose(F.mTcw);
 }
+KeyFrame::~KeyFrame()
+{
+    if(mpMap)
+        mpMap->GetCovisibilityGraph().EraseKeyFrame(this);
+    Release();
+}
+
 void KeyFrame::Release()
 {    
     // the following commented member variables may be referred to by another thread when this keyframe is setbad
@@ -64,9 +71,7 @@ void KeyFrame::Release()
 
 //    mvpMapPoints.clear();
     mvbOutlier.clear();
-//    for(int i=0;i<FRAME_GRID_COLS;i++)
-//        for(int j=0; j<FRAME_GRID_ROWS; j++)
-//            mGrid[i][j].clear();
+//    mGrid.Clear();
 
     viso2LeftId2StereoId.clear();
     viso2RightId2StereoId.clear();
@@ -133,17 +138,33 @@ Eigen::Vector3d KeyFrame::GetTranslation()
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 {
-    {
-        boost::mutex::scoped_lock lock(mMutexConnections);
-        if(!mConnectedKeyFrameWeights.count(pKF))
-            mConnectedKeyFrameWeights[pKF]=weight;
-        else if(mConnectedKeyFrameWeights[pKF]!=weight)
-            mConnectedKeyFrameWeights[pKF]=weight;
-        else
-            return;
-    }
+    boost::mutex::scoped_lock lock(mMutexConnections);
+    map<KeyFrame*,int>::iterator mit = mConnectedKeyFrameWeights.find(pKF);
+    if(mit==mConnectedKeyFrameWeights.end())
+        mConnectedKeyFrameWeights[pKF]=weight;
+    else if(mit->second!=weight)
+        mit->second=weight;
+    else
+        return;
+
+    EraseOrderedConnection(pKF);
+    InsertOrderedConnection(pKF, weight);
+}
 
-    UpdateBestCovisibles();
+void KeyFrame::EraseOrderedConnection(KeyFrame *pKF)
+{
+    vector<KeyFrame*>::iterator vit = find(mvpOrderedConnectedKeyFrames.begin(), mvpOrderedConnectedKeyFrames.end(), pKF);
+    if(vit==mvpOrderedConnectedKeyFrames.end())
+        return;
+    mvOrderedWeights.erase(mvOrderedWeights.begin()+(vit-mvpOrderedConnectedKeyFrames.begin()));
+    mvpOrderedConnectedKeyFrames.erase(vit);
+}
+
+void KeyFrame::InsertOrderedConnection(KeyFrame *pKF, int weight)
+{
+    vector<int>::iterator it = upper_bound(mvOrderedWeights.begin(),mvOrderedWeights.end(),weight,KeyFrame::weightComp);
+    mvpOrderedConnectedKeyFrames.insert(mvpOrderedConnectedKeyFrames.begin()+(it-mvOrderedWeights.begin()), pKF);
+    mvOrderedWeights.insert(it, weight);
 }
 
 void KeyFrame::UpdateBestCovisibles()
@@ -167,46 +188,63 @@ void KeyFrame::UpdateBestCovisibles()
     mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());    
 }
 
+// the covisible keyframes are about to be matched against, so they are made resident
 set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 {
-    boost::mutex::scoped_lock lock(mMutexConnections);
     set<KeyFrame*> s;
-    for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
-        s.insert(mit->first);
+    {
+        boost::mutex::scoped_lock lock(mMutexConnections);
+        for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
+            s.insert(mit->first);
+    }
+    for(set<KeyFrame*>::iterator sit=s.begin(); sit!=s.end(); sit++)
+        (*sit)->MakeResident();
     return s;
 }
 
 vector<KeyFrame*> KeyFrame::GetVectorCovisibleKeyFrames()
 {
-    boost::mutex::scoped_lock lock(mMutexConnections);
-    return mvpOrderedConnectedKeyFrames;
+    vector<KeyFrame*> vpKFs;
+    {
+        boost::mutex::scoped_lock lock(mMutexConnections);
+        vpKFs = mvpOrderedConnectedKeyFrames;
+    }
+    MakeResident(vpKFs);
+    return vpKFs;
 }
 
-vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
+vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N, bool bMakeResident)
 {
-    boost::mutex::scoped_lock lock(mMutexConnections);
-    if((int)mvpOrderedConnectedKeyFrames.size()<N)
-        return mvpOrderedConnectedKeyFrames;
-    else
-        return vector<KeyFrame*>(mvpOrderedConnectedKeyFrames.begin(),mvpOrderedConnectedKeyFrames.begin()+N);
-
+    vector<KeyFrame*> vpKFs;
+    {
+        boost::mutex::scoped_lock lock(mMutexConnections);
+        if((int)mvpOrderedConnectedKeyFrames.size()<N)
+            vpKFs = mvpOrderedConnectedKeyFrames;
+        else
+            vpKFs = vector<KeyFrame*>(mvpOrderedConnectedKeyFrames.begin(),mvpOrderedConnectedKeyFrames.begin()+N);
+    }
+    if(bMakeResident)
+        MakeResident(vpKFs);
+    return vpKFs;
 }
 
 vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 {
-    boost::mutex::scoped_lock lock(mMutexConnections);
+    vector<KeyFrame*> vpKFs;
+    {
+        boost::mutex::scoped_lock lock(mMutexConnections);
 
-    if(mvpOrderedConnectedKeyFrames.empty())
-        return vector<KeyFrame*>();
+        if(mvpOrderedConnectedKeyFrames.empty())
+            return vector<KeyFrame*>();
 
-    vector<int>::iterator it = upper_bound(mvOrderedWeights.begin(),mvOrderedWeights.end(),w,KeyFrame::weightComp);
-    if(it==mvOrderedWeights.end())
-        return vector<KeyFrame*>();
-    else
-    {
+        vector<int>::iterator it = upper_bound(mvOrderedWeights.begin(),mvOrderedWeights.end(),w,KeyFrame::weightComp);
+        if(it==mvOrderedWeights.end())
+            return vector<KeyFrame*>();
         int n = it-mvOrderedWeights.begin();
-        return vector<KeyFrame*>(mvpOrderedConnectedKeyFrames.begin(), mvpOrderedConnectedKeyFrames.begin()+n);
+        vpKFs = vector<KeyFrame*>(mvpOrderedConnectedKeyFrames.begin(), mvpOrderedConnectedKeyFrames.begin()+n);
     }
+    MakeResident(vpKFs);
+    return vpKFs;
 }
 
 int KeyFrame::GetWeight(KeyFrame *pKF)
@@ -234,12 +272,20 @@ void KeyFrame::EraseMapPointMatch(const size_t &idx)
  
 }
 
-void KeyFrame::EraseMapPointMatch(MapPoint* pMP)
+bool KeyFrame::SetMapPointMatch(const size_t &idx, MapPoint* pMP)
 {
-    int idx = pMP->GetIndexInKeyFrame(this);
-   	assert(idx>=0 && mvpMapPoints[idx]);
-    mvpMapPoints[idx]=NULL;
+    boost::mutex::scoped_lock lock(mMutexFeatures);
+    if(mvpMapPoints[idx] && mvpMapPoints[idx]!=pMP && !mvpMapPoints[idx]->isBad())
+        return false;
+    mvpMapPoints[idx]=pMP;
+    return true;
+}
 
+void KeyFrame::EraseMapPointMatch(const size_t &idx, MapPoint* pMP)
+{
+    boost::mutex::scoped_lock lock(mMutexFeatures);
+    if(mvpMapPoints[idx]==pMP)
+        mvpMapPoints[idx]=NULL;
 }
 
 set<MapPoint*> KeyFrame::GetMapPoints()
@@ -285,23 +331,38 @@ MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 }
 
 
-int KeyFrame::GetKeyPointScaleLevel(const size_t &idx) const
+int KeyFrame::GetKeyPointScaleLevel(const size_t &idx)
 {
+    MakeResident();
     assert(idx< mvKeysUn.size());
     return mvKeysUn[idx].octave;
 
 }
 
+cv::KeyPoint KeyFrame::GetKeyPointUn(const size_t &idx, bool left)
+{
+    MakeResident();
+    return Frame::GetKeyPointUn(idx, left);
+}
+
+cv::Mat KeyFrame::GetDescriptor(const size_t &idx, bool left)
+{
+    MakeResident();
+    return Frame::GetDescriptor(idx, left);
+}
+
 cv::Mat KeyFrame::GetDescriptors(bool left)
 {
+    MakeResident();
     if(left)
     return mDescriptors.clone();
     else
         return mRightDescriptors.clone();
 }
 
-vector<cv::KeyPoint> KeyFrame::GetKeyPointsUn() const
+vector<cv::KeyPoint> KeyFrame::GetKeyPointsUn()
 {
+    MakeResident();
     return mvKeysUn;
 }
 
@@ -312,6 +373,7 @@ Eigen::Matrix3d KeyFrame::GetCalibrationMatrix() const
 
 DBoW2::FeatureVector KeyFrame::GetFeatureVector()
 {
+    MakeResident();
     boost::mutex::scoped_lock lock(mMutexFeatures);
     return mFeatVec;
 }
@@ -323,10 +385,9 @@ DBoW2::BowVector KeyFrame::GetBowVector()
 }
 
 
-void KeyFrame::UpdateConnections()
+void KeyFrame::CountConnections(map<KeyFrame*,int> &KFcounter)
 {
-    map<KeyFrame*,int> KFcounter;
-
+    KFcounter.clear();
     vector<MapPoint*> vpMP;
 
     {
@@ -335,7 +396,7 @@ void KeyFrame::UpdateConnections()
     }
 
     //For all map points in keyframe check in which other keyframes are they seen
-    //Increase counter for those keyframes
+    //Increase counter for those keyframes, without making them resident
     for(vector<MapPoint*>::iterator vit=vpMP.begin(), vend=vpMP.end(); vit!=vend; vit++)
     {
         MapPoint* pMP = *vit;
@@ -346,71 +407,86 @@ void KeyFrame::UpdateConnections()
         if(pMP->isBad())
             continue;
 
-        map<KeyFrame*,size_t> observations = pMP->GetObservations();
-
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        pMP->VisitObservations([&](const MapPointObservation& obs)
         {
-            if((mit->first)->mnFrameId==mnFrameId)
-                continue;
-            KFcounter[mit->first]++;
-        }
+            if(obs.nLeft>=0 && obs.pKF->mnFrameId!=mnFrameId)
+                KFcounter[obs.pKF]++;
+        });
     }
+}
 
-    if(KFcounter.empty())
-        return;
+void KeyFrame::UpdateConnections()
+{
+    //The number of map points seen in this keyframe and in each other keyframe is kept by the covisibility graph,
+    //updated as map points gain and lose observations. A keyframe holds a map point exactly when it is a left
+    //observer of the point, so these are the counts of CountConnections(). Only the weights changed since the
+    //last update are applied to the connections and to the ordered lists
+    const int th = 15;
+    vector<pair<KeyFrame*,int> > vChanges;
+    vector<pair<KeyFrame*,int> > vConnected; // keyframes to which this one connects with its weight
+    {
+        boost::mutex::scoped_lock lockCon(mMutexConnections);
+        mpMap->GetCovisibilityGraph().TakeChanges(this, vChanges);
+        if(vChanges.empty())
+            return;
 
-    //If the counter is greater than threshold add connection
-    //In case no keyframe counter is over threshold add the one with maximum counter
-    int nmax=0;
-    KeyFrame* pKFmax=NULL;
-    int th = 15;
+        for(vector<pair<KeyFrame*,int> >::const_iterator vit=vChanges.begin(), vend=vChanges.end(); vit!=vend; vit++)
+        {
+            if(vit->second>0)
+                mConnectedKeyFrameWeights[vit->first]=vit->second;
+            else
+                mConnectedKeyFrameWeights.erase(vit->first);
+            EraseOrderedConnection(vit->first);
+            //If the counter is greater than threshold add connection
+            if(vit->second>=th)
+            {
+                InsertOrderedConnection(vit->first, vit->second);
+                vConnected.push_back(*vit);
+            }
+        }
 
-    vector<pair<int,KeyFrame*> > vPairs;
-    vPairs.reserve(KFcounter.size());
-    for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
-    {
-        if(mit->second>nmax)
+        //Connections below the threshold, added by other keyframes, are dropped if one is over it.
+        //In case no keyframe counter is over threshold add the one with maximum counter
+        if(!mvOrderedWeights.empty() && mvOrderedWeights.front()>=th)
         {
-            nmax=mit->second;
-            pKFmax=mit->first;
+            while(mvOrderedWeights.back()<th)
+            {
+                mvOrderedWeights.pop_back();
+                mvpOrderedConnectedKeyFrames.pop_back();
+            }
         }
-        if(mit->second>=th)
+        else if(!mConnectedKeyFrameWeights.empty())
         {
-            vPairs.push_back(make_pair(mit->second,mit->first));
-            (mit->first)->AddConnection(this,mit->second);
+            int nmax=0;
+            KeyFrame* pKFmax=NULL;
+            for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+            {
+                if(mit->second>nmax)
+                {
+                    nmax=mit->second;
+                    pKFmax=mit->first;
+                }
+            }
+            mvpOrderedConnectedKeyFrames.assign(1, pKFmax);
+            mvOrderedWeights.assign(1, nmax);
+            vConnected.push_back(make_pair(pKFmax,nmax));
+        }
+        else
+        {
+            mvpOrderedConnectedKeyFrames.clear();
+            mvOrderedWeights.clear();
         }
-    }
-
-    if(vPairs.empty())
-    {
-        vPairs.push_back(make_pair(nmax,pKFmax));
-        pKFmax->AddConnection(this,nmax);
-    }
-
-    sort(vPairs.begin(),vPairs.end());
-    list<KeyFrame*> lKFs;
-    list<int> lWs;
-    for(size_t i=0; i<vPairs.size();i++)
-    {
-        lKFs.push_front(vPairs[i].second);
-        lWs.push_front(vPairs[i].first);
-    }
-
-    {
-        boost::mutex::scoped_lock lockCon(mMutexConnections);
-
-        // mspConnectedKeyFrames = spConnectedKeyFrames;
-        mConnectedKeyFrameWeights = KFcounter;
-        mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
-        mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
 //huai: FAQ: do we need to update mvpOrderedConnectedKeyFrames of connected keyframes?
-        if(mbFirstConnection && mnFrameId!=0)
+        if(mbFirstConnection && mnFrameId!=0 && !mvpOrderedConnectedKeyFrames.empty())
         {
             mpParent = mvpOrderedConnectedKeyFrames.front();
             mpParent->AddChild(this);
             mbFirstConnection = false;
         }
     }
+
+    for(vector<pair<KeyFrame*,int> >::const_iterator vit=vConnected.begin(), vend=vConnected.end(); vit!=vend; vit++)
+        (vit->first)->AddConnection(this,vit->second);
 }
 
 void KeyFrame::AddChild(KeyFrame *pKF)
@@ -514,9 +590,10 @@ void KeyFrame::SetBadFlag()
         boost::mutex::scoped_lock lock1(mMutexFeatures);
         for(vector<MapPoint*>::const_iterator it=mvpMapPoints.begin(); it!=mvpMapPoints.end(); ++it){
             if((*it) && (!(*it)->isBad()))
-                (*it)->EraseObservation(this);
+                (*it)->EraseObservation(this, true);
         }
     }
+    mpMap->GetCovisibilityGraph().EraseKeyFrame(this);
 
     {
         boost::mutex::scoped_lock lock(mMutexConnections);
@@ -601,60 +678,15 @@ bool KeyFrame::isBad()
 
 void KeyFrame::EraseConnection(KeyFrame* pKF)
 {
-    bool bUpdate = false;
-    {
-        boost::mutex::scoped_lock lock(mMutexConnections);
-        if(mConnectedKeyFrameWeights.count(pKF))
-        {
-            mConnectedKeyFrameWeights.erase(pKF);
-            bUpdate=true;
-        }
-    }
-
-    if(bUpdate)
-        UpdateBestCovisibles();
+    boost::mutex::scoped_lock lock(mMutexConnections);
+    if(mConnectedKeyFrameWeights.erase(pKF))
+        EraseOrderedConnection(pKF);
 }
 
-vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r) const
+vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r)
 {
-    vector<size_t> vIndices;
-    vIndices.reserve(mvKeysUn.size());
-
-    int nMinCellX = floor((x-mnMinX-r)*mfGridElementWidthInv);
-    nMinCellX = max(0,nMinCellX);
-    if(nMinCellX>=FRAME_GRID_COLS)
-        return vIndices;
-
-    int nMaxCellX = ceil((x-mnMinX+r)*mfGridElementWidthInv);
-    nMaxCellX = min(FRAME_GRID_COLS-1,nMaxCellX);
-    if(nMaxCellX<0)
-        return vIndices;
-
-    int nMinCellY = floor((y-mnMinY-r)*mfGridElementHeightInv);
-    nMinCellY = max(0,nMinCellY);
-    if(nMinCellY>=FRAME_GRID_ROWS)
-        return vIndices;
-
-    int nMaxCellY = ceil((y-mnMinY+r)*mfGridElementHeightInv);
-    nMaxCellY = min(FRAME_GRID_ROWS-1,nMaxCellY);
-    if(nMaxCellY<0)
-        return vIndices;
-
-    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
-    {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t>& vCell = mGrid[ix][iy];
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                if(abs(kpUn.pt.x-x)<=r && abs(kpUn.pt.y-y)<=r)
-                    vIndices.push_back(vCell[j]);
-            }
-        }
-    }
-
-    return vIndices;
+    MakeResident();
+    return mGrid.GetFeaturesInArea(x, y, r);
 }
 
 bool KeyFrame::IsInImage(const float &x, const float &y) const
@@ -719,6 +751,162 @@ void KeyFrame::setExistingFeatures(FeatureGrid &fg) // this frame is not process
         }
     }
 }
+namespace
+{
+// raw copies of plain data, the records are only read back by the same process
+template<class T>
+void AppendRaw(std::vector<char> &vBlock, const T* pData, size_t n)
+{
+    const char* pBytes = reinterpret_cast<const char*>(pData);
+    vBlock.insert(vBlock.end(), pBytes, pBytes+n*sizeof(T));
+}
+
+template<class T>
+const char* ReadRaw(const char* pBlock, T* pData, size_t n)
+{
+    std::copy(pBlock, pBlock+n*sizeof(T), reinterpret_cast<char*>(pData));
+    return pBlock+n*sizeof(T);
+}
+
+void AppendKeyPoints(std::vector<char> &vBlock, const std::vector<cv::KeyPoint> &vKeys)
+{
+    const size_t n = vKeys.size();
+    AppendRaw(vBlock, &n, 1);
+    AppendRaw(vBlock, vKeys.data(), n);
+}
+
+const char* ReadKeyPoints(const char* pBlock, std::vector<cv::KeyPoint> &vKeys)
+{
+    size_t n;
+    pBlock = ReadRaw(pBlock, &n, 1);
+    vKeys.resize(n);
+    return ReadRaw(pBlock, vKeys.data(), n);
+}
+
+void AppendDescriptors(std::vector<char> &vBlock, const cv::Mat &descriptors)
+{
+    const int header[3] = {descriptors.rows, descriptors.cols, descriptors.type()};
+    AppendRaw(vBlock, header, 3);
+    for(int i=0; i<descriptors.rows; ++i)
+        AppendRaw(vBlock, descriptors.ptr<char>(i), descriptors.cols*descriptors.elemSize());
+}
+
+const char* ReadDescriptors(const char* pBlock, cv::Mat &descriptors)
+{
+    int header[3];
+    pBlock = ReadRaw(pBlock, header, 3);
+    descriptors.create(header[0], header[1], header[2]);
+    for(int i=0; i<descriptors.rows; ++i)
+        pBlock = ReadRaw(pBlock, descriptors.ptr<char>(i), descriptors.cols*descriptors.elemSize());
+    return pBlock;
+}
+}
+
+void KeyFrame::MakeResident(const std::vector<KeyFrame*> &vpKFs)
+{
+    for(size_t i=0; i<vpKFs.size(); ++i)
+        vpKFs[i]->MakeResident();
+}
+
+bool KeyFrame::IsIdle(unsigned long nEpochs) const
+{
+    return mnLastAccessEpoch.load(std::memory_order_relaxed)+nEpochs < snAccessEpoch.load(std::memory_order_relaxed);
+}
+
+void KeyFrame::AdvanceAccessEpoch()
+{
+    snAccessEpoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+// the features of a keyframe do not change once it is created, so they are written to the store only once,
+// and offloading a keyframe again only frees the memory
+void KeyFrame::Offload(KeyFrameStore* pStore)
+{
+    boost::mutex::scoped_lock lock(mMutexOffload);
+    if(mbOffloaded.load(std::memory_order_relaxed))
+        return;
+    if(mnStoreRecord<0)
+    {
+        std::vector<char> vBlock;
+        vBlock.reserve(N*(4*sizeof(cv::KeyPoint)+2*mDescriptors.cols)+256);
+        AppendKeyPoints(vBlock, mvKeys);
+        AppendKeyPoints(vBlock, mvKeysUn);
+        AppendKeyPoints(vBlock, mvRightKeys);
+        AppendKeyPoints(vBlock, mvRightKeysUn);
+        AppendDescriptors(vBlock, mDescriptors);
+        AppendDescriptors(vBlock, mRightDescriptors);
+        {
+            boost::mutex::scoped_lock lock2(mMutexFeatures);
+            const size_t nNodes = mFeatVec.size();
+            AppendRaw(vBlock, &nNodes, 1);
+            for(DBoW2::FeatureVector::const_iterator fit=mFeatVec.begin(); fit!=mFeatVec.end(); ++fit)
+            {
+                const size_t nFeatures = fit->second.size();
+                AppendRaw(vBlock, &fit->first, 1);
+                AppendRaw(vBlock, &nFeatures, 1);
+                AppendRaw(vBlock, fit->second.data(), nFeatures);
+            }
+        }
+        mnStoreRecord = pStore->Write(vBlock);
+        if(mnStoreRecord<0)
+            return;
+        mpStore = pStore;
+    }
+
+    mbOffloaded.store(true, std::memory_order_release);
+    std::vector<cv::KeyPoint>().swap(mvKeys);
+    std::vector<cv::KeyPoint>().swap(mvKeysUn);
+    std::vector<cv::KeyPoint>().swap(mvRightKeys);
+    std::vector<cv::KeyPoint>().swap(mvRightKeysUn);
+    mDescriptors.release();
+    mRightDescriptors.release();
+    {
+        boost::mutex::scoped_lock lock2(mMutexFeatures);
+        DBoW2::FeatureVector().swap(mFeatVec);
+    }
+    mGrid.Clear();
+}
+
+void KeyFrame::Reload()
+{
+    boost::mutex::scoped_lock lock(mMutexOffload);
+    if(!mbOffloaded.load(std::memory_order_relaxed))
+        return;
+    std::vector<char> vBlock;
+    // the features exist nowhere else, so the keyframe cannot be used any more
+    if(!mpStore->Read(mnStoreRecord, vBlock))
+    {
+        std::ostringstream message;
+        message<<"Failed to reload keyframe "<<mnFrameId<<" from the keyframe store "<<mpStore->GetFilename();
+        throw std::runtime_error(message.str());
+    }
+
+    const char* pBlock = vBlock.data();
+    pBlock = ReadKeyPoints(pBlock, mvKeys);
+    pBlock = ReadKeyPoints(pBlock, mvKeysUn);
+    pBlock = ReadKeyPoints(pBlock, mvRightKeys);
+    pBlock = ReadKeyPoints(pBlock, mvRightKeysUn);
+    pBlock = ReadDescriptors(pBlock, mDescriptors);
+    pBlock = ReadDescriptors(pBlock, mRightDescriptors);
+    {
+        boost::mutex::scoped_lock lock2(mMutexFeatures);
+        size_t nNodes;
+        pBlock = ReadRaw(pBlock, &nNodes, 1);
+        for(size_t i=0; i<nNodes; ++i)
+        {
+            DBoW2::NodeId nodeId;
+            size_t nFeatures;
+            pBlock = ReadRaw(pBlock, &nodeId, 1);
+            pBlock = ReadRaw(pBlock, &nFeatures, 1);
+            std::vector<unsigned int> &vFeatures = mFeatVec[nodeId];
+            vFeatures.resize(nFeatures);
+            pBlock = ReadRaw(pBlock, vFeatures.data(), nFeatures);
+        }
+    }
+    mGrid.Build(mvKeysUn, mnMinX, mnMinY, mfGridElementWidthInv, mfGridElementHeightInv);
+    mbOffloaded.store(false, std::memory_order_release);
+}
+
 Eigen::Matrix3d ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2)
 {
     Sophus::SE3d T12= pKF1->GetPose()*(pKF2->GetPose().inverse());
@@ -21,6 +21,7 @@
 #include "KeyFrameDatabase.h"
 
 #include "KeyFrame.h"
+#include "ThreadPool.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 //#include <ros/ros.h>
 
@@ -30,7 +31,7 @@ namespace ORB_SLAM
 {
 
 KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+    mpVoc(&voc), mnMaxId(0), mpThreadPool(NULL)
 {
     mvInvertedFile.resize(voc.size());
 }
@@ -40,8 +41,10 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
 {
     boost::mutex::scoped_lock lock(mMutex);
 
+    Posting posting = {pKF, pKF->mnFrameId};
     for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-        mvInvertedFile[vit->first].push_back(pKF);
+        mvInvertedFile[vit->first].vPostings.push_back(posting);
+    mnMaxId = max(mnMaxId, pKF->mnFrameId);
 }
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
@@ -52,260 +55,244 @@ void KeyFrameDatabase::erase(KeyFrame* pKF)
     for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
     {
         // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+        PostingList &postingList = mvInvertedFile[vit->first];
+        vector<Posting> &vPostings = postingList.vPostings;
 
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+        for(size_t i=0; i<vPostings.size(); i++)
         {
-            if(pKF==*lit)
+            if(vPostings[i].pKF==pKF)
             {
-                lKFs.erase(lit);
+                vPostings[i].pKF = NULL;
+                postingList.nTombstones++;
                 break;
             }
         }
+
+        // Compact the list once half of it are tombstones, keeping the order of insertion
+        if(2*postingList.nTombstones > vPostings.size())
+        {
+            size_t nKept = 0;
+            for(size_t i=0; i<vPostings.size(); i++)
+                if(vPostings[i].pKF)
+                    vPostings[nKept++] = vPostings[i];
+            vPostings.resize(nKept);
+            postingList.nTombstones = 0;
+        }
     }
 }
 
 void KeyFrameDatabase::clear()
 {
+    boost::mutex::scoped_lock lock(mMutex);
+
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+    mnMaxId = 0;
 }
 
 
 vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
 {
-    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<KeyFrame*> lKFsSharingWords;
-
-    // Search all keyframes that share a word with current keyframes
     // Discard keyframes connected to the query keyframe
-    {
-        boost::mutex::scoped_lock lock(mMutex);
-
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnLoopQuery!=pKF->mnFrameId)
-                {
-                    pKFi->mnLoopWords=0;
-                    if(!spConnectedKeyFrames.count(pKFi))
-                    {
-                        pKFi->mnLoopQuery=pKF->mnFrameId;
-                        lKFsSharingWords.push_back(pKFi);
-                    }
-                }
-                pKFi->mnLoopWords++;
-            }
-        }
-    }
-
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
+    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
+    vector<KeyFrame*> vpLoopCandidates = DetectCandidates(pKF->mBowVec, spConnectedKeyFrames, minScore);
 
-    // Only compare against those keyframes that share enough words
-    int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        if((*lit)->mnLoopWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnLoopWords;
-    }
+    // the candidates are matched against next
+    KeyFrame::MakeResident(vpLoopCandidates);
+    return vpLoopCandidates;
+}
 
-    int minCommonWords = maxCommonWords*0.8f;
+vector<KeyFrame*> KeyFrameDatabase::DetectRelocalisationCandidates(Frame *F)
+{
+    vector<KeyFrame*> vpRelocCandidates = DetectCandidates(F->mBowVec, set<KeyFrame*>(), 0);
 
-    int nscores=0;
+    KeyFrame::MakeResident(vpRelocCandidates);
+    return vpRelocCandidates;
+}
 
-    // Compute similarity score. Retain the matches whose score is higher than minScore
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+vector<KeyFrame*> KeyFrameDatabase::DetectCandidates(const DBoW2::BowVector &bowVec, const set<KeyFrame*> &spExcluded,
+                                                     float minScore)
+{
+    Query* pQuery = NULL;
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnLoopWords>minCommonWords)
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mvpIdleQueries.empty())
         {
-            nscores++;
-
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
-
-            pKFi->mLoopScore = si;
-            if(si>=minScore)
-                lScoreAndMatch.push_back(make_pair(si,pKFi));
+            mlQueries.push_back(Query());
+            pQuery = &mlQueries.back();
         }
-    }
-
-    if(lScoreAndMatch.empty())
-        return vector<KeyFrame*>();
-
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
-    float bestAccScore = minScore;
-
-    // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-    {
-        KeyFrame* pKFi = it->second;
-        vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = it->first;
-        KeyFrame* pBestKF = pKFi;
-        for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
+        else
         {
-            KeyFrame* pKF2 = *vit;
-            if(pKF2->mnLoopQuery==pKF->mnFrameId && pKF2->mnLoopWords>minCommonWords)
-            {
-                accScore+=pKF2->mLoopScore;
-                if(pKF2->mLoopScore>bestScore)
-                {
-                    pBestKF=pKF2;
-                    bestScore = pKF2->mLoopScore;
-                }
-            }
+            pQuery = mvpIdleQueries.back();
+            mvpIdleQueries.pop_back();
         }
-
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
     }
 
-    // Return all those keyframes with a score higher than 0.75*bestScore
-    const float scoreRatio =0.75f;
-    float minScoreToRetain = scoreRatio*bestAccScore;
-
-    set<KeyFrame*> spAlreadyAddedKF;
-    vector<KeyFrame*> vpLoopCandidates;
-    vpLoopCandidates.reserve(lAccScoreAndMatch.size());
+    vector<KeyFrame*> vpCandidates = DetectCandidates(*pQuery, bowVec, spExcluded, minScore);
 
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    // Reset the entries set by the query, the keyframes scored are among those sharing words
+    for(set<KeyFrame*>::const_iterator sit=spExcluded.begin(), send=spExcluded.end(); sit!=send; sit++)
+        if((*sit)->mnFrameId < pQuery->vnWords.size())
+            pQuery->vnWords[(*sit)->mnFrameId] = 0;
+    for(size_t i=0; i<pQuery->vpSharingWords.size(); i++)
     {
-        if(it->first>minScoreToRetain)
-        {
-            KeyFrame* pKFi = it->second;
-            if(!spAlreadyAddedKF.count(pKFi))
-            {
-                vpLoopCandidates.push_back(pKFi);
-                spAlreadyAddedKF.insert(pKFi);
-            }
-        }
+        pQuery->vnWords[pQuery->vpSharingWords[i]->mnFrameId] = 0;
+        pQuery->vScores[pQuery->vpSharingWords[i]->mnFrameId] = -1.f;
     }
+    pQuery->vpSharingWords.clear();
 
-
-    return vpLoopCandidates;
+    boost::mutex::scoped_lock lock(mMutex);
+    mvpIdleQueries.push_back(pQuery);
+    return vpCandidates;
 }
 
-vector<KeyFrame*> KeyFrameDatabase::DetectRelocalisationCandidates(Frame *F)
+vector<KeyFrame*> KeyFrameDatabase::DetectCandidates(Query &query, const DBoW2::BowVector &bowVec,
+                                                     const set<KeyFrame*> &spExcluded, float minScore)
 {
-    list<KeyFrame*> lKFsSharingWords;
-
-    // Search all keyframes that share a word with current frame
+    // Search all keyframes that share a word with the query, counting the shared words by keyframe id
     {
         boost::mutex::scoped_lock lock(mMutex);
 
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
+        if(query.vnWords.size() < mnMaxId+1)
+        {
+            query.vnWords.resize(mnMaxId+1, 0);
+            query.vScores.resize(mnMaxId+1, -1.f);
+        }
+        for(set<KeyFrame*>::const_iterator sit=spExcluded.begin(), send=spExcluded.end(); sit!=send; sit++)
+            if((*sit)->mnFrameId <= mnMaxId)
+                query.vnWords[(*sit)->mnFrameId] = -1;
+
+        for(DBoW2::BowVector::const_iterator vit=bowVec.begin(), vend=bowVec.end(); vit != vend; vit++)
         {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+            const vector<Posting> &vPostings = mvInvertedFile[vit->first].vPostings;
 
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+            for(vector<Posting>::const_iterator pit=vPostings.begin(), pend=vPostings.end(); pit!=pend; pit++)
             {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
-                {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-                pKFi->mnRelocWords++;
+                if(!pit->pKF)
+                    continue;
+                int &nWords = query.vnWords[pit->nId];
+                if(nWords<0)
+                    continue;
+                if(nWords==0)
+                    query.vpSharingWords.push_back(pit->pKF);
+                nWords++;
             }
         }
     }
-    if(lKFsSharingWords.empty())
+
+    if(query.vpSharingWords.empty())
         return vector<KeyFrame*>();
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<KeyFrame*>::iterator vit=query.vpSharingWords.begin(), vend=query.vpSharingWords.end(); vit!=vend; vit++)
     {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
+        if(query.vnWords[(*vit)->mnFrameId]>maxCommonWords)
+            maxCommonWords=query.vnWords[(*vit)->mnFrameId];
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
-
-    int nscores=0;
-
-    // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    vector<KeyFrame*> vpToScore;
+    vpToScore.reserve(query.vpSharingWords.size());
+    for(vector<KeyFrame*>::iterator vit=query.vpSharingWords.begin(), vend=query.vpSharingWords.end(); vit!=vend; vit++)
     {
-        KeyFrame* pKFi = *lit;
+        if(query.vnWords[(*vit)->mnFrameId]>minCommonWords)
+            vpToScore.push_back(*vit);
+    }
 
-        if(pKFi->mnRelocWords>minCommonWords)
+    // Compute similarity score, each candidate writes its own slot
+    const size_t nScores = vpToScore.size();
+    const size_t nMinParallelScores = 64;
+    if(mpThreadPool && nScores>=nMinParallelScores)
+    {
+        mpThreadPool->ParallelFor(nScores, [&](size_t i)
+        {
+            KeyFrame* pKFi = vpToScore[i];
+            query.vScores[pKFi->mnFrameId] = mpVoc->score(bowVec,pKFi->mBowVec);
+        });
+    }
+    else
+    {
+        for(size_t i=0; i<nScores; i++)
         {
-            nscores++;
-            float si = mpVoc->score(F->mBowVec,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            KeyFrame* pKFi = vpToScore[i];
+            query.vScores[pKFi->mnFrameId] = mpVoc->score(bowVec,pKFi->mBowVec);
         }
     }
 
-    if(lScoreAndMatch.empty())
+    // Retain the matches whose score is higher than minScore
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
+    vScoreAndMatch.reserve(nScores);
+    for(size_t i=0; i<nScores; i++)
+    {
+        const float si = query.vScores[vpToScore[i]->mnFrameId];
+        if(si>=minScore)
+            vScoreAndMatch.push_back(make_pair(si,vpToScore[i]));
+    }
+
+    if(vScoreAndMatch.empty())
         return vector<KeyFrame*>();
 
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
-    float bestAccScore = 0;
+    vector<pair<float,KeyFrame*> > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
+    float bestAccScore = minScore;
 
-    // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+    // Lets now accumulate score by covisibility, over the scored covisible keyframes
+    for(vector<pair<float,KeyFrame*> >::iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
         KeyFrame* pKFi = it->second;
-        vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
+        vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10, false);
 
         float bestScore = it->first;
-        float accScore = bestScore;
+        float accScore = it->first;
         KeyFrame* pBestKF = pKFi;
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
+            // a covisible keyframe may be newer than the query
+            if(pKF2->mnFrameId>=query.vScores.size())
+                continue;
+            const float s2 = query.vScores[pKF2->mnFrameId];
+            if(s2<0)
                 continue;
 
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
+            accScore+=s2;
+            if(s2>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
+                bestScore = s2;
             }
-
         }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
         if(accScore>bestAccScore)
             bestAccScore=accScore;
     }
 
     // Return all those keyframes with a score higher than 0.75*bestScore
-    float minScoreToRetain = 0.75f*bestAccScore;
+    const float scoreRatio =0.75f;
+    float minScoreToRetain = scoreRatio*bestAccScore;
+
     set<KeyFrame*> spAlreadyAddedKF;
-    vector<KeyFrame*> vpRelocCandidates;
-    vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    vector<KeyFrame*> vpCandidates;
+    vpCandidates.reserve(vAccScoreAndMatch.size());
+
+    for(vector<pair<float,KeyFrame*> >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
-        const float &si = it->first;
-        if(si>minScoreToRetain)
+        if(it->first>minScoreToRetain)
         {
             KeyFrame* pKFi = it->second;
             if(!spAlreadyAddedKF.count(pKFi))
             {
-                vpRelocCandidates.push_back(pKFi);
+                vpCandidates.push_back(pKFi);
                 spAlreadyAddedKF.insert(pKFi);
             }
         }
     }
 
-    return vpRelocCandidates;
+    return vpCandidates;
 }
 
 } //namespace ORB_SLAM
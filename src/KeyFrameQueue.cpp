@@ -0,0 +1,78 @@
+#include "KeyFrameQueue.h"
+
+#include <vikit/timer.h>
+
+namespace ORB_SLAM
+{
+
+KeyFrameQueue::KeyFrameQueue(): mbWakeUp(false), mdWaitTotal(0), mdWaitMax(0), mnPopped(0)
+{
+}
+
+void KeyFrameQueue::Push(KeyFrame* pKF)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    mlKeyFrames.push_back(pKF);
+    mlPushTimes.push_back(vk::Timer::getCurrentTime());
+    mCondNotEmpty.notify_one();
+}
+
+bool KeyFrameQueue::Empty() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mlKeyFrames.empty();
+}
+
+KeyFrame* KeyFrameQueue::Pop()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(mlKeyFrames.empty())
+        return NULL;
+    KeyFrame* pKF = mlKeyFrames.front();
+    const double dWait = vk::Timer::getCurrentTime() - mlPushTimes.front();
+    mlKeyFrames.pop_front();
+    mlPushTimes.pop_front();
+
+    mdWaitTotal += dWait;
+    if(dWait>mdWaitMax)
+        mdWaitMax = dWait;
+    ++mnPopped;
+    return pKF;
+}
+
+std::list<KeyFrame*> KeyFrameQueue::Drain()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    std::list<KeyFrame*> lKeyFrames;
+    lKeyFrames.swap(mlKeyFrames);
+    mlPushTimes.clear();
+    return lKeyFrames;
+}
+
+void KeyFrameQueue::Wait(int nTimeoutMs)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    const boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nTimeoutMs);
+    while(mlKeyFrames.empty() && !mbWakeUp)
+    {
+        if(!mCondNotEmpty.timed_wait(lock, timeout))
+            break;
+    }
+    mbWakeUp = false;
+}
+
+void KeyFrameQueue::WakeUp()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    mbWakeUp = true;
+    mCondNotEmpty.notify_all();
+}
+
+void KeyFrameQueue::GetWaitTimes(double &average, double &maximum) const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    average = mnPopped? mdWaitTotal/mnPopped: 0;
+    maximum = mdWaitMax;
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,97 @@
+#include "KeyFrameStore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+namespace ORB_SLAM
+{
+
+KeyFrameStore::KeyFrameStore(const std::string &strFilePrefix): mnEnd(0)
+{
+    // mkstemp creates a new file of a unique name, so runs sharing a prefix never truncate each other's store
+    std::vector<char> vTemplate(strFilePrefix.begin(), strFilePrefix.end());
+    const char suffix[] = "XXXXXX";
+    vTemplate.insert(vTemplate.end(), suffix, suffix+sizeof(suffix));
+    const int fd = mkstemp(vTemplate.data());
+    if(fd<0)
+    {
+        std::cerr<<"Failed to create a keyframe store with prefix "<<strFilePrefix<<std::endl;
+        return;
+    }
+    close(fd);
+    mstrFilename = vTemplate.data();
+    mFile.open(mstrFilename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if(!mFile.is_open())
+    {
+        std::cerr<<"Failed to open the keyframe store "<<mstrFilename<<std::endl;
+        std::remove(mstrFilename.c_str());
+    }
+}
+
+KeyFrameStore::~KeyFrameStore()
+{
+    if(mFile.is_open())
+    {
+        mFile.close();
+        std::remove(mstrFilename.c_str());
+    }
+}
+
+bool KeyFrameStore::IsOpen() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mFile.is_open();
+}
+
+long KeyFrameStore::Write(const std::vector<char> &vBlock)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(!mFile.is_open())
+        return -1;
+    mFile.clear();
+    mFile.seekp(mnEnd);
+    mFile.write(vBlock.data(), vBlock.size());
+    if(!mFile.good())
+    {
+        std::cerr<<"Failed to write to the keyframe store "<<mstrFilename<<std::endl;
+        return -1;
+    }
+    mvRecords.push_back(std::make_pair(mnEnd, vBlock.size()));
+    mnEnd += vBlock.size();
+    return mvRecords.size()-1;
+}
+
+bool KeyFrameStore::Read(long nRecord, std::vector<char> &vBlock)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(nRecord<0 || nRecord>=(long)mvRecords.size())
+        return false;
+    const std::pair<std::streamoff, size_t> &record = mvRecords[nRecord];
+    vBlock.resize(record.second);
+    mFile.clear();
+    mFile.seekg(record.first);
+    mFile.read(vBlock.data(), record.second);
+    return mFile.good();
+}
+
+void KeyFrameStore::Clear()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    mvRecords.clear();
+    mnEnd = 0;
+    if(mFile.is_open())
+    {
+        mFile.close();
+        mFile.open(mstrFilename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    }
+}
+
+size_t KeyFrameStore::size() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mnEnd;
+}
+
+} //namespace ORB_SLAM
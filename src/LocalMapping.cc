@@ -25,17 +25,25 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "ThreadPool.h"
 
 #include <opencv2/core/eigen.hpp>
+#include <vikit/timer.h>
 #ifdef SLAM_USE_ROS
 #include <ros/ros.h>
 #endif
 
 namespace ORB_SLAM
 {
-LocalMapping::LocalMapping(Map *pMap):
+LocalMapping::LocalMapping(Map *pMap, int nThreads):
     mbResetRequested(false), mpMap(pMap),  mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbAcceptKeyFrames(true)
 {
+    mpThreadPool = new ThreadPool(std::max(nThreads, 0));
+}
+
+LocalMapping::~LocalMapping()
+{
+    delete mpThreadPool;
 }
 
 void LocalMapping::SetLoopCloser(LoopClosing* pLoopCloser)
@@ -50,11 +58,10 @@ void LocalMapping::SetTracker(Tracking *pTracker)
 
 // if loop closing is requesting local mapping to stop or the local mapping is suspended
 // the trackiing thread will not insert new keyframes, but there may still be keyframes in
-// the waitlist, i.e., mlNewKeyFrames, they will be deleted once loop closing release the hold on local mapping
+// the waitlist, i.e., mNewKeyFrames, they will be deleted once loop closing release the hold on local mapping
 void LocalMapping::Run()
 {
 #ifdef SLAM_USE_ROS
-    ros::Rate r(300);
     while(ros::ok())
 #else
     while(1)
@@ -66,23 +73,33 @@ void LocalMapping::Run()
             SLAM_START_TIMER("local_mapper");
             // Tracking will see that Local Mapping is busy
             SetAcceptKeyFrames(false);
+            LocalMappingStats stats;
+            stats.nKeyFrames = 1;
+            vk::Timer timer;
 
             // BoW conversion and insertion in Map
             ProcessNewKeyFrame();
+            stats.dProcessTime = timer.stop();
 
             // Check recent MapPoints
+            timer.start();
             MapPointCulling();
+            stats.dCullingTime = timer.stop();
 
             // Triangulate new MapPoints between neighboring keyframes and this new keyframe
+            timer.start();
             if(mpCurrentKeyFrame->mnFrameId>1){
 #ifdef MONO
-            CreateNewMapPoints();
+            stats.nNewMapPoints = CreateNewMapPoints();
 #else
-            CreateNewMapPointsStereo();            
+            stats.nNewMapPoints = CreateNewMapPointsStereo();
 #endif
             }
+            stats.dTriangulationTime = timer.stop();
             // Find more matches in neighbor keyframes and fuse point duplications
-            SearchInNeighbors();
+            timer.start();
+            stats.nFusions = SearchInNeighbors();
+            stats.dFusionTime = timer.stop();
 
             mbAbortBA = false;
 
@@ -93,7 +110,12 @@ void LocalMapping::Run()
                 // huai: local BA not necessary when double window optimization is done in the tracking thread
 
                 // Check redundant local Keyframes
+                timer.start();
                 KeyFrameCulling();
+                stats.dKeyFrameCullingTime = timer.stop();
+
+                // Offload keyframes far away if the map is over its memory budget
+                mpMap->EnforceMemoryBudget(mpCurrentKeyFrame);
 
                 mpMap->SetFlagAfterBA();
 
@@ -102,6 +124,18 @@ void LocalMapping::Run()
                     SetAcceptKeyFrames(true);
             }          
 
+            {
+                boost::mutex::scoped_lock lock(mMutexStats);
+                mStats.nKeyFrames += stats.nKeyFrames;
+                mStats.dProcessTime += stats.dProcessTime;
+                mStats.dCullingTime += stats.dCullingTime;
+                mStats.dTriangulationTime += stats.dTriangulationTime;
+                mStats.dFusionTime += stats.dFusionTime;
+                mStats.dKeyFrameCullingTime += stats.dKeyFrameCullingTime;
+                mStats.nNewMapPoints += stats.nNewMapPoints;
+                mStats.nFusions += stats.nFusions;
+            }
+
             mpLoopCloser->InsertKeyFrame(mpCurrentKeyFrame);
             SLAM_STOP_TIMER("local_mapper");
         }
@@ -110,34 +144,21 @@ void LocalMapping::Run()
         if(stopRequested())
         {
             Stop();
-#ifdef SLAM_USE_ROS
-            ros::Rate r2(1000);
-            while(isStopped() && ros::ok())
-            {                
-                r2.sleep();
-            }
-#else
-            while(isStopped())
-            {
-                boost::this_thread::sleep(boost::posix_time::milliseconds(5));
-            }
-#endif
+            WaitUntilReleased();
             SetAcceptKeyFrames(true);
         }
 
         ResetIfRequested();
-#ifdef SLAM_USE_ROS
-        r.sleep();
-#else
-        boost::this_thread::sleep(boost::posix_time::milliseconds(2));
-#endif
+
+        // sleep until tracking inserts a keyframe or loop closing requests a stop or reset,
+        // the timeout only bounds how late a ROS shutdown is noticed
+        mNewKeyFrames.Wait(100);
     }
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
-    boost::mutex::scoped_lock lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
+    mNewKeyFrames.Push(pKF);
     mbAbortBA=true;
     SetAcceptKeyFrames(false);
 }
@@ -145,17 +166,23 @@ void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 
 bool LocalMapping::CheckNewKeyFrames()
 {
-    boost::mutex::scoped_lock lock(mMutexNewKFs);
-    return(!mlNewKeyFrames.empty());
+    return !mNewKeyFrames.Empty();
+}
+
+void LocalMapping::GetQueueWaitTimes(double &average, double &maximum) const
+{
+    mNewKeyFrames.GetWaitTimes(average, maximum);
+}
+
+LocalMappingStats LocalMapping::GetStats() const
+{
+    boost::mutex::scoped_lock lock(mMutexStats);
+    return mStats;
 }
 
 void LocalMapping::ProcessNewKeyFrame()
 {
-    {
-        boost::mutex::scoped_lock lock(mMutexNewKFs);
-        mpCurrentKeyFrame = mlNewKeyFrames.front();
-        mlNewKeyFrames.pop_front();
-    }
+    mpCurrentKeyFrame = mNewKeyFrames.Pop();
 
     if(mpCurrentKeyFrame->mnFrameId==0)
         return;
@@ -228,7 +255,7 @@ void LocalMapping::MapPointCulling()
     }
 }
 
-void LocalMapping::CreateNewMapPoints()
+int LocalMapping::CreateNewMapPoints()
 {
     // Take neighbor keyframes in covisibility graph
     vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(20);
@@ -252,6 +279,8 @@ void LocalMapping::CreateNewMapPoints()
 
     const float ratioFactor = 1.5f*mpCurrentKeyFrame->GetScaleFactor();
 
+    int nCreated = 0;
+
     // Search matches with epipolar restriction and triangulate
     for(size_t i=0; i<vpNeighKFs.size(); i++)
     {
@@ -384,11 +413,9 @@ void LocalMapping::CreateNewMapPoints()
             // Triangulation is succesfull
             MapPoint* pMP = new MapPoint(x3Dt,mpCurrentKeyFrame, idx1, mpMap);
 
-            pMP->AddObservation(pKF2,idx2);
-         
             mpCurrentKeyFrame->AddMapPoint(pMP,idx1);
             mpCurrentKeyFrame->mpFG->AddMapPoint(posX, posY, idx1);
-            pKF2->AddMapPoint(pMP,idx2);
+            pMP->AddObservation(pKF2,idx2);
 
             pMP->ComputeDistinctiveDescriptors();
 
@@ -396,18 +423,19 @@ void LocalMapping::CreateNewMapPoints()
 
             mpMap->AddMapPoint(pMP);
             mlpRecentAddedMapPoints.push_back(pMP);
+            nCreated++;
         }
     }
     delete mpCurrentKeyFrame->mpFG;
     mpCurrentKeyFrame->mpFG=NULL;
+    return nCreated;
 }
-// for now, we only check left image to get matches
-// a grid is used to control distribution of map points in current keyframe
-void LocalMapping::CreateNewMapPointsStereo()
-{
-    // Take neighbor keyframes in covisibility graph
-    vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(20);
 
+// Triangulate the matches between the current keyframe and pKF2 without modifying either of them or the map,
+// so that the neighbors can be triangulated concurrently. The feature grid is only read, the points are created
+// in CreateNewMapPointsStereo
+void LocalMapping::TriangulateStereo(KeyFrame* pKF2, vector<TriangulatedPoint> &vPoints)
+{
     ORBmatcher matcher(0.6,false);
     Sophus::SE3d proxy= mpCurrentKeyFrame->GetPose();
     Eigen::Matrix<double,3,4> Tw2c1= proxy.matrix3x4();
@@ -426,189 +454,230 @@ void LocalMapping::CreateNewMapPointsStereo()
     const float invfy1 = 1.0f/fy1;
     const float ratioFactor = 1.5f*mpCurrentKeyFrame->GetScaleFactor();
 
-    // Search matches with epipolar restriction and triangulate
-    for(size_t i=0; i<vpNeighKFs.size(); i++)
-    {
-        KeyFrame* pKF2 = vpNeighKFs[i];
-        if(pKF2->mnId+1==mpCurrentKeyFrame->mnId)//because we triangulated mappoints between
-            //the current keyframe and its previous frame in Tracking thread
-            continue;
-        // Check first that baseline is not too short
-        // Small translation errors for short baseline keyframes make scale to diverge
-        Eigen::Vector3d Ow2 = pKF2->GetCameraCenter();
-        Eigen::Vector3d vBaseline = Ow2-Ow1;
-        const float baseline = vBaseline.norm();
-        const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
-        const float ratioBaselineDepth = baseline/medianDepthKF2;
+    // Check first that baseline is not too short
+    // Small translation errors for short baseline keyframes make scale to diverge
+    Eigen::Vector3d Ow2 = pKF2->GetCameraCenter();
+    Eigen::Vector3d vBaseline = Ow2-Ow1;
+    const float baseline = vBaseline.norm();
+    const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+    const float ratioBaselineDepth = baseline/medianDepthKF2;
 
-        if(ratioBaselineDepth<0.01)
-            continue;
+    if(ratioBaselineDepth<0.01)
+        return;
 
-        // Compute Fundamental Matrix
-        Eigen::Matrix3d F12 = ComputeF12(mpCurrentKeyFrame,pKF2);
+    // Compute Fundamental Matrix
+    Eigen::Matrix3d F12 = ComputeF12(mpCurrentKeyFrame,pKF2);
 
-        // Search matches that fulfil epipolar constraint
-        vector<cv::KeyPoint> vMatchedKeysUn1;
-        vector<cv::KeyPoint> vMatchedKeysUn2;
-        vector<pair<size_t,size_t> > vMatchedIndices;
-        matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,F12,vMatchedKeysUn1,vMatchedKeysUn2,vMatchedIndices);
+    // Search matches that fulfil epipolar constraint
+    vector<cv::KeyPoint> vMatchedKeysUn1;
+    vector<cv::KeyPoint> vMatchedKeysUn2;
+    vector<pair<size_t,size_t> > vMatchedIndices;
+    matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,F12,vMatchedKeysUn1,vMatchedKeysUn2,vMatchedIndices);
 
-        proxy= pKF2->GetPose();
-        Eigen::Matrix<double,3,4> Tw2c2= proxy.matrix3x4();
-        Eigen::Matrix3d Rw2c2= Tw2c2.topLeftCorner<3,3>();
-        Eigen::Vector3d twinc2= Tw2c2.col(3);
-        Eigen::Matrix<double,3,4> Tw2c2r= pKF2->GetPose(false).matrix3x4();
+    proxy= pKF2->GetPose();
+    Eigen::Matrix<double,3,4> Tw2c2= proxy.matrix3x4();
+    Eigen::Matrix3d Rw2c2= Tw2c2.topLeftCorner<3,3>();
+    Eigen::Vector3d twinc2= Tw2c2.col(3);
+    Eigen::Matrix<double,3,4> Tw2c2r= pKF2->GetPose(false).matrix3x4();
 
 
-        const float fx2 = pKF2->cam_.fx();
-        const float fy2 = pKF2->cam_.fy();
-        const float cx2 = pKF2->cam_.cx();
-        const float cy2 = pKF2->cam_.cy();
-        const float invfx2 = 1.0f/fx2;
-        const float invfy2 = 1.0f/fy2;
+    const float fx2 = pKF2->cam_.fx();
+    const float fy2 = pKF2->cam_.fy();
+    const float cx2 = pKF2->cam_.cx();
+    const float cy2 = pKF2->cam_.cy();
+    const float invfx2 = 1.0f/fx2;
+    const float invfy2 = 1.0f/fy2;
 
-        // Triangulate each match based on stereo observations
-        for(size_t ikp=0, iendkp=vMatchedKeysUn1.size(); ikp<iendkp; ikp++)
-        {
-            const int idx1 = vMatchedIndices[ikp].first; // indices of features in current keyframe
-            const int idx2 = vMatchedIndices[ikp].second;// indices of features in the other keyframe
-            const cv::KeyPoint &kp1 = vMatchedKeysUn1[ikp];//current keyframe
-            const cv::KeyPoint &kp2 = mpCurrentKeyFrame->mvRightKeysUn[idx1];
-            int posX, posY;
-            if(!mpCurrentKeyFrame->mpFG->IsPointEligible(kp1, posX, posY)) continue;
-            const cv::KeyPoint &kp3 = vMatchedKeysUn2[ikp];
-            const cv::KeyPoint &kp4 = pKF2->mvRightKeysUn[idx2];
+    // Triangulate each match based on stereo observations
+    for(size_t ikp=0, iendkp=vMatchedKeysUn1.size(); ikp<iendkp; ikp++)
+    {
+        const int idx1 = vMatchedIndices[ikp].first; // indices of features in current keyframe
+        const int idx2 = vMatchedIndices[ikp].second;// indices of features in the other keyframe
+        const cv::KeyPoint &kp1 = vMatchedKeysUn1[ikp];//current keyframe
+        const cv::KeyPoint kp2 = mpCurrentKeyFrame->GetKeyPointUn(idx1, false);
+        // a cell full before the points are created stays full
+        int posX, posY;
+        if(!mpCurrentKeyFrame->mpFG->IsPointEligible(kp1, posX, posY)) continue;
+        const cv::KeyPoint &kp3 = vMatchedKeysUn2[ikp];
+        const cv::KeyPoint kp4 = pKF2->GetKeyPointUn(idx2, false);
 #if 1
-            // Check parallax between left and right rays
-            Eigen::Vector3d xn1((kp1.pt.x-cx1)*invfx1,
-                                (kp1.pt.y-cy1)*invfy1, 1.0 ),
-                    ray1(xn1);
-            Eigen::Vector3d xn3((kp3.pt.x-cx2)*invfx2,
-                                (kp3.pt.y-cy2)*invfy2, 1.0 );
-
-            Eigen::Vector3d ray3 = Rw2c1*Rw2c2.transpose()*xn3;
-            const float cosParallaxRays = ray1.dot(ray3)/(ray1.norm()*ray3.norm());
-
-            if((cosParallaxRays<0 || cosParallaxRays>Config::triangMaxCosRays())
-                    && (kp1.pt.x -kp2.pt.x< Config::triangMinDisp()))
-                continue;
-            // Linear Triangulation Method
-            Eigen::Vector3d xn2((kp2.pt.x-mpCurrentKeyFrame->right_cam_.cx())/mpCurrentKeyFrame->right_cam_.fx(),
-                                (kp2.pt.y-mpCurrentKeyFrame->right_cam_.cy())/mpCurrentKeyFrame->right_cam_.fy(), 1.0 );
-
-            Eigen::Vector3d xn4((kp4.pt.x-pKF2->right_cam_.cx())/pKF2->right_cam_.fx(),
-                                (kp4.pt.y-pKF2->right_cam_.cy())/pKF2->right_cam_.fy(), 1.0 );
-
-            Eigen::Matrix<double, 8,4> A;
-            A.row(0) = xn1(0)*Tw2c1.row(2)-Tw2c1.row(0);
-            A.row(1) = xn1(1)*Tw2c1.row(2)-Tw2c1.row(1);
-            A.row(2) = xn2(0)*Tw2c1r.row(2)-Tw2c1r.row(0);
-            A.row(3) = xn2(1)*Tw2c1r.row(2)-Tw2c1r.row(1);
-            A.row(4) = xn3(0)*Tw2c2.row(2)-Tw2c2.row(0);
-            A.row(5) = xn3(1)*Tw2c2.row(2)-Tw2c2.row(1);
-            A.row(6) = xn4(0)*Tw2c2r.row(2)-Tw2c2r.row(0);
-            A.row(7) = xn4(1)*Tw2c2r.row(2)-Tw2c2r.row(1);
-            cv::Mat Aprime, w,u,vt;
-            cv::eigen2cv(A, Aprime);
-            cv::SVD::compute(Aprime,w,u,vt,cv::SVD::MODIFY_A| cv::SVD::FULL_UV);
+        // Check parallax between left and right rays
+        Eigen::Vector3d xn1((kp1.pt.x-cx1)*invfx1,
+                            (kp1.pt.y-cy1)*invfy1, 1.0 ),
+                ray1(xn1);
+        Eigen::Vector3d xn3((kp3.pt.x-cx2)*invfx2,
+                            (kp3.pt.y-cy2)*invfy2, 1.0 );
+
+        Eigen::Vector3d ray3 = Rw2c1*Rw2c2.transpose()*xn3;
+        const float cosParallaxRays = ray1.dot(ray3)/(ray1.norm()*ray3.norm());
+
+        if((cosParallaxRays<0 || cosParallaxRays>Config::triangMaxCosRays())
+                && (kp1.pt.x -kp2.pt.x< Config::triangMinDisp()))
+            continue;
+        // Linear Triangulation Method
+        Eigen::Vector3d xn2((kp2.pt.x-mpCurrentKeyFrame->right_cam_.cx())/mpCurrentKeyFrame->right_cam_.fx(),
+                            (kp2.pt.y-mpCurrentKeyFrame->right_cam_.cy())/mpCurrentKeyFrame->right_cam_.fy(), 1.0 );
+
+        Eigen::Vector3d xn4((kp4.pt.x-pKF2->right_cam_.cx())/pKF2->right_cam_.fx(),
+                            (kp4.pt.y-pKF2->right_cam_.cy())/pKF2->right_cam_.fy(), 1.0 );
+
+        Eigen::Matrix<double, 8,4> A;
+        A.row(0) = xn1(0)*Tw2c1.row(2)-Tw2c1.row(0);
+        A.row(1) = xn1(1)*Tw2c1.row(2)-Tw2c1.row(1);
+        A.row(2) = xn2(0)*Tw2c1r.row(2)-Tw2c1r.row(0);
+        A.row(3) = xn2(1)*Tw2c1r.row(2)-Tw2c1r.row(1);
+        A.row(4) = xn3(0)*Tw2c2.row(2)-Tw2c2.row(0);
+        A.row(5) = xn3(1)*Tw2c2.row(2)-Tw2c2.row(1);
+        A.row(6) = xn4(0)*Tw2c2r.row(2)-Tw2c2r.row(0);
+        A.row(7) = xn4(1)*Tw2c2r.row(2)-Tw2c2r.row(1);
+        cv::Mat Aprime, w,u,vt;
+        cv::eigen2cv(A, Aprime);
+        cv::SVD::compute(Aprime,w,u,vt,cv::SVD::MODIFY_A| cv::SVD::FULL_UV);
+
+        cv::Mat x3D = vt.row(3).t();
+        if(x3D.at<double>(3)==0)
+            continue;
 
-            cv::Mat x3D = vt.row(3).t();
-            if(x3D.at<double>(3)==0)
-                continue;
+        // Euclidean coordinates
+        x3D = x3D.rowRange(0,3)/x3D.at<double>(3);
+        Eigen::Vector3d x3Dt;
+        cv::cv2eigen(x3D, x3Dt);
 
-            // Euclidean coordinates
-            x3D = x3D.rowRange(0,3)/x3D.at<double>(3);
-            Eigen::Vector3d x3Dt;
-            cv::cv2eigen(x3D, x3Dt);
-
-            //Check triangulation in front of cameras
-            float z1 = Rw2c1.row(2)*x3Dt+ twinc1(2);
-            if(z1<=0)
-                continue;
-            float z2 = Rw2c2.row(2)*x3Dt+twinc2(2);
-            if(z2<=0)
-                continue;
+        //Check triangulation in front of cameras
+        float z1 = Rw2c1.row(2)*x3Dt+ twinc1(2);
+        if(z1<=0)
+            continue;
+        float z2 = Rw2c2.row(2)*x3Dt+twinc2(2);
+        if(z2<=0)
+            continue;
 
-            //Check reprojection error in first keyframe
-            float sigmaSquare1 = mpCurrentKeyFrame->GetSigma2(kp1.octave);
-            float x1 = Rw2c1.row(0)*x3Dt+twinc1(0);
-            float y1 = Rw2c1.row(1)*x3Dt+twinc1(1);
-            float invz1 = 1.0/z1;
-            float u1 = fx1*x1*invz1 + cx1;
-            float v1 = fy1*y1*invz1 + cy1;
-            float errX1 = u1 - kp1.pt.x;
-            float errY1 = v1 - kp1.pt.y;
-            if((errX1*errX1+errY1*errY1)>Config::reprojThresh2()*sigmaSquare1)
-                continue;
+        //Check reprojection error in first keyframe
+        float sigmaSquare1 = mpCurrentKeyFrame->GetSigma2(kp1.octave);
+        float x1 = Rw2c1.row(0)*x3Dt+twinc1(0);
+        float y1 = Rw2c1.row(1)*x3Dt+twinc1(1);
+        float invz1 = 1.0/z1;
+        float u1 = fx1*x1*invz1 + cx1;
+        float v1 = fy1*y1*invz1 + cy1;
+        float errX1 = u1 - kp1.pt.x;
+        float errY1 = v1 - kp1.pt.y;
+        if((errX1*errX1+errY1*errY1)>Config::reprojThresh2()*sigmaSquare1)
+            continue;
 
-            //Check reprojection error in second frame
-            float sigmaSquare2 = pKF2->GetSigma2(kp3.octave);
-            float x2 = Rw2c2.row(0)*x3Dt+twinc2(0);
-            float y2 = Rw2c2.row(1)*x3Dt+twinc2(1);
-            float invz2 = 1.0/z2;
-            float u2 = fx2*x2*invz2 + cx2;
-            float v2 = fy2*y2*invz2 + cy2;
-            float errX2 = u2 - kp3.pt.x;
-            float errY2 = v2 - kp3.pt.y;
-            if((errX2*errX2+errY2*errY2)>Config::reprojThresh2()*sigmaSquare2)
-                continue;
+        //Check reprojection error in second frame
+        float sigmaSquare2 = pKF2->GetSigma2(kp3.octave);
+        float x2 = Rw2c2.row(0)*x3Dt+twinc2(0);
+        float y2 = Rw2c2.row(1)*x3Dt+twinc2(1);
+        float invz2 = 1.0/z2;
+        float u2 = fx2*x2*invz2 + cx2;
+        float v2 = fy2*y2*invz2 + cy2;
+        float errX2 = u2 - kp3.pt.x;
+        float errY2 = v2 - kp3.pt.y;
+        if((errX2*errX2+errY2*errY2)>Config::reprojThresh2()*sigmaSquare2)
+            continue;
 
-            //Check scale consistency
-            Eigen::Vector3d normal1 = x3Dt-Ow1;
-            float dist1 = normal1.norm();
+        //Check scale consistency
+        Eigen::Vector3d normal1 = x3Dt-Ow1;
+        float dist1 = normal1.norm();
 
-            Eigen::Vector3d normal2 = x3Dt-Ow2;
-            float dist2 = normal2.norm();
+        Eigen::Vector3d normal2 = x3Dt-Ow2;
+        float dist2 = normal2.norm();
 
-            if(dist1==0 || dist2==0)
-                continue;
+        if(dist1==0 || dist2==0)
+            continue;
 
-            float ratioDist = dist1/dist2;
-            if(ratioDist*ratioFactor<1.f || ratioDist>ratioFactor)
-                continue;
+        float ratioDist = dist1/dist2;
+        if(ratioDist*ratioFactor<1.f || ratioDist>ratioFactor)
+            continue;
 #else
-            //Assume left right image rectified and no distortion
-            if(kp1.pt.x -kp2.pt.x< 3 || kp3.pt.x- kp4.pt.x<3)//parallax
-                continue;
+        //Assume left right image rectified and no distortion
+        if(kp1.pt.x -kp2.pt.x< 3 || kp3.pt.x- kp4.pt.x<3)//parallax
+            continue;
 
-            float base= -mpCurrentKeyFrame->mTl2r.translation()[0];
-            float base_disp = base/(kp1.pt.x -kp2.pt.x);
-            Eigen::Vector3d x3D1;
-            x3D1(0) = (kp1.pt.x- cx1)*base_disp;
-            x3D1(1) = ((kp1.pt.y+ kp2.pt.y)/2 - cy1)*base_disp;
-            x3D1(2) = fx1*base_disp;
-            x3D1= Rw2c1.transpose()*(x3D1- twinc1);
-            base_disp = base/(kp3.pt.x -kp4.pt.x);
-            Eigen::Vector3d x3D2;
-            x3D2(0) = (kp3.pt.x- cx2)*base_disp;
-            x3D2(1) = ((kp3.pt.y+ kp4.pt.y)/2 - cy2)*base_disp;
-            x3D2(2) = fx2*base_disp;
-            x3D2= Rw2c2.transpose()*(x3D2 - twinc2);
-            if(abs(x3D1(2)- x3D2(2))>0.2)
-                continue;
-            Eigen::Vector3d x3Dt= (x3D1+ x3D2)/2;
+        float base= -mpCurrentKeyFrame->mTl2r.translation()[0];
+        float base_disp = base/(kp1.pt.x -kp2.pt.x);
+        Eigen::Vector3d x3D1;
+        x3D1(0) = (kp1.pt.x- cx1)*base_disp;
+        x3D1(1) = ((kp1.pt.y+ kp2.pt.y)/2 - cy1)*base_disp;
+        x3D1(2) = fx1*base_disp;
+        x3D1= Rw2c1.transpose()*(x3D1- twinc1);
+        base_disp = base/(kp3.pt.x -kp4.pt.x);
+        Eigen::Vector3d x3D2;
+        x3D2(0) = (kp3.pt.x- cx2)*base_disp;
+        x3D2(1) = ((kp3.pt.y+ kp4.pt.y)/2 - cy2)*base_disp;
+        x3D2(2) = fx2*base_disp;
+        x3D2= Rw2c2.transpose()*(x3D2 - twinc2);
+        if(abs(x3D1(2)- x3D2(2))>0.2)
+            continue;
+        Eigen::Vector3d x3Dt= (x3D1+ x3D2)/2;
 #endif
-            // Triangulation is succesful
-            MapPoint* pMP = new MapPoint(x3Dt,mpCurrentKeyFrame, idx1, mpMap);
+        // Triangulation is succesful
+        TriangulatedPoint point = {(size_t)idx1, (size_t)idx2, x3Dt};
+        vPoints.push_back(point);
+    }
+}
 
-            pMP->AddObservation(pKF2, idx2);       
-            pMP->AddObservation(pKF2,idx2, false);
+// for now, we only check left image to get matches
+// a grid is used to control distribution of map points in current keyframe
+int LocalMapping::CreateNewMapPointsStereo()
+{
+    // Take neighbor keyframes in covisibility graph
+    vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(20);
+    vector<KeyFrame*> vpTriangulationKFs;
+    vpTriangulationKFs.reserve(vpNeighKFs.size());
+    for(size_t i=0; i<vpNeighKFs.size(); i++)
+    {
+        KeyFrame* pKF2 = vpNeighKFs[i];
+        if(pKF2->mnId+1==mpCurrentKeyFrame->mnId)//because we triangulated mappoints between
+            //the current keyframe and its previous frame in Tracking thread
+            continue;
+        vpTriangulationKFs.push_back(pKF2);
+    }
+
+    // Search matches with epipolar restriction and triangulate, each neighbor on its own
+    vector<vector<TriangulatedPoint> > vvPoints(vpTriangulationKFs.size());
+    mpThreadPool->ParallelFor(vpTriangulationKFs.size(), [&](size_t i)
+    {
+        TriangulateStereo(vpTriangulationKFs[i], vvPoints[i]);
+    });
+
+    // Create the points in the order of the neighbors. A feature triangulated with several neighbors gets the
+    // point of the first one, and the grid bounds the new points per cell as when triangulating one by one
+    int nCreated = 0;
+    for(size_t i=0; i<vpTriangulationKFs.size(); i++)
+    {
+        KeyFrame* pKF2 = vpTriangulationKFs[i];
+        for(size_t j=0; j<vvPoints[i].size(); j++)
+        {
+            const TriangulatedPoint &point = vvPoints[i][j];
+            const size_t idx1 = point.idx1;
+            const size_t idx2 = point.idx2;
+            if(mpCurrentKeyFrame->GetMapPoint(idx1) || pKF2->GetMapPoint(idx2))
+                continue;
+            int posX, posY;
+            if(!mpCurrentKeyFrame->mpFG->IsPointEligible(mpCurrentKeyFrame->GetKeyPointUn(idx1), posX, posY))
+                continue;
+
+            MapPoint* pMP = new MapPoint(point.x3D,mpCurrentKeyFrame, idx1, mpMap);
 
             mpCurrentKeyFrame->AddMapPoint(pMP,idx1);
             mpCurrentKeyFrame->mpFG->AddMapPoint(posX, posY, idx1);
-            pKF2->AddMapPoint(pMP,idx2);
+            pMP->AddObservation(pKF2, idx2);
+            pMP->AddObservation(pKF2,idx2, false);
 
             pMP->ComputeDistinctiveDescriptors();
             pMP->UpdateNormalAndDepth();
             mpMap->AddMapPoint(pMP);
             mlpRecentAddedMapPoints.push_back(pMP);
+            nCreated++;
         }
     }
     delete mpCurrentKeyFrame->mpFG;
     mpCurrentKeyFrame->mpFG=NULL;
+    return nCreated;
 }
+
 // detect and fuse duplicate map points
-void LocalMapping::SearchInNeighbors()
+int LocalMapping::SearchInNeighbors()
 {
     // Retrieve neighbor keyframes
     vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(20);
@@ -633,15 +702,18 @@ void LocalMapping::SearchInNeighbors()
     }
 
 
-    // Search matches by projection from current KF in target KFs
+    // Search matches by projection from current KF in target KFs, each target on its own, then fuse in the
+    // order of the targets as Fuse one target after the other
     ORBmatcher matcher(0.6);
     vector<MapPoint*> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-    for(vector<KeyFrame*>::iterator vit=vpTargetKFs.begin(), vend=vpTargetKFs.end(); vit!=vend; vit++)
+    vector<vector<pair<MapPoint*, size_t> > > vvFusions(vpTargetKFs.size());
+    mpThreadPool->ParallelFor(vpTargetKFs.size(), [&](size_t i)
     {
-        KeyFrame* pKFi = *vit;
-
-        matcher.Fuse(pKFi,vpMapPointMatches);
-    }
+        matcher.SearchForFusion(vpTargetKFs[i], vpMapPointMatches, vvFusions[i]);
+    });
+    int nFused = 0;
+    for(size_t i=0; i<vpTargetKFs.size(); i++)
+        nFused += ORBmatcher::ApplyFusions(vpTargetKFs[i], vvFusions[i]);
 
     // Search matches by projection from target KFs in current KF
     vector<MapPoint*> vpFuseCandidates;
@@ -665,7 +737,18 @@ void LocalMapping::SearchInNeighbors()
         }
     }
 
-    matcher.Fuse(mpCurrentKeyFrame,vpFuseCandidates);
+    // the candidates are searched in chunks and fused in their order
+    const size_t nChunkSize = 256;
+    const size_t nChunks = (vpFuseCandidates.size()+nChunkSize-1)/nChunkSize;
+    vector<vector<pair<MapPoint*, size_t> > > vvChunkFusions(nChunks);
+    mpThreadPool->ParallelFor(nChunks, [&](size_t c)
+    {
+        vector<MapPoint*> vpChunk(vpFuseCandidates.begin()+c*nChunkSize,
+                                  vpFuseCandidates.begin()+std::min(vpFuseCandidates.size(), (c+1)*nChunkSize));
+        matcher.SearchForFusion(mpCurrentKeyFrame, vpChunk, vvChunkFusions[c]);
+    });
+    for(size_t c=0; c<nChunks; c++)
+        nFused += ORBmatcher::ApplyFusions(mpCurrentKeyFrame, vvChunkFusions[c]);
 
 
     // Update points
@@ -685,21 +768,25 @@ void LocalMapping::SearchInNeighbors()
 
     // Update connections in covisibility graph
     mpCurrentKeyFrame->UpdateConnections();
+    return nFused;
 }
 
 // stop is only requested by loop closing thread
 void LocalMapping::RequestStop()
 {
-    boost::mutex::scoped_lock lock(mMutexStop);
-    mbStopRequested = true;
-    boost::mutex::scoped_lock lock2(mMutexNewKFs);
+    {
+        boost::mutex::scoped_lock lock(mMutexStop);
+        mbStopRequested = true;
+    }
     mbAbortBA = true;
+    mNewKeyFrames.WakeUp();
 }
 
 void LocalMapping::Stop()
 {
     boost::mutex::scoped_lock lock(mMutexStop);
     mbStopped = true;
+    mCondStop.notify_all();
 }
 
 bool LocalMapping::isStopped()
@@ -707,6 +794,38 @@ bool LocalMapping::isStopped()
     boost::mutex::scoped_lock lock(mMutexStop);
     return mbStopped;
 }
+
+void LocalMapping::WaitUntilStopped()
+{
+    boost::mutex::scoped_lock lock(mMutexStop);
+    while(!mbStopped)
+    {
+#ifdef SLAM_USE_ROS
+        if(!ros::ok())
+            break;
+        mCondStop.timed_wait(lock, boost::posix_time::milliseconds(100));
+#else
+        mCondStop.wait(lock);
+#endif
+    }
+}
+
+// called by the local mapping thread after Stop(), returns once loop closing calls Release()
+void LocalMapping::WaitUntilReleased()
+{
+    boost::mutex::scoped_lock lock(mMutexStop);
+    while(mbStopped)
+    {
+#ifdef SLAM_USE_ROS
+        if(!ros::ok())
+            break;
+        mCondStop.timed_wait(lock, boost::posix_time::milliseconds(100));
+#else
+        mCondStop.wait(lock);
+#endif
+    }
+}
+
 // stop is only requested by loop closing thread
 bool LocalMapping::stopRequested()
 {
@@ -719,9 +838,10 @@ void LocalMapping::Release()
     boost::mutex::scoped_lock lock(mMutexStop);
     mbStopped = false;
     mbStopRequested = false;
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+    list<KeyFrame*> lNewKeyFrames = mNewKeyFrames.Drain();
+    for(list<KeyFrame*>::iterator lit = lNewKeyFrames.begin(), lend=lNewKeyFrames.end(); lit!=lend; lit++)
         delete *lit;
-    mlNewKeyFrames.clear();
+    mCondStop.notify_all();
 }
 
 bool LocalMapping::AcceptKeyFrames()
@@ -768,14 +888,15 @@ void LocalMapping::KeyFrameCulling()
                     if(pMP->Observations()>3)
                     {
                         int scaleLevel = pKF->GetKeyPointUn(i).octave;
-                        map<KeyFrame*, size_t> observations = pMP->GetObservations();
+                        MapPointObservations observations;
+                        pMP->GetObservations(observations);
                         int nObs=0;
-                        for(map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+                        for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
                         {                            
-                            KeyFrame* pKFi = mit->first;
-                            if(pKFi==pKF)
+                            KeyFrame* pKFi = it->pKF;
+                            if(pKFi==pKF || it->nLeft<0)
                                 continue;
-                            int scaleLeveli = pKFi->GetKeyPointUn(mit->second).octave;
+                            int scaleLeveli = pKFi->GetKeyPointUn(it->nLeft).octave;
                             if(scaleLeveli<=scaleLevel+1)
                             {
                                 nObs++;
@@ -809,22 +930,17 @@ void LocalMapping::RequestReset()
         boost::mutex::scoped_lock lock(mMutexReset);
         mbResetRequested = true;
     }
-#ifdef SLAM_USE_ROS
-    ros::Rate r(500);
-    while(ros::ok())
-#else
-    while(1)
-#endif
+    mNewKeyFrames.WakeUp();
+
+    boost::mutex::scoped_lock lock(mMutexReset);
+    while(mbResetRequested)
     {
-        {
-        boost::mutex::scoped_lock lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
 #ifdef SLAM_USE_ROS
-        r.sleep();
+        if(!ros::ok())
+            break;
+        mCondReset.timed_wait(lock, boost::posix_time::milliseconds(100));
 #else
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        mCondReset.wait(lock);
 #endif
     }
 }
@@ -834,9 +950,10 @@ void LocalMapping::ResetIfRequested()
     boost::mutex::scoped_lock lock(mMutexReset);
     if(mbResetRequested)
     {
-        mlNewKeyFrames.clear();
+        mNewKeyFrames.Drain();
         mlpRecentAddedMapPoints.clear();
         mbResetRequested=false;
+        mCondReset.notify_all();
     }
 }
 
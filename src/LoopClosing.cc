@@ -56,7 +56,6 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
 void LoopClosing::Run()
 {
 #ifdef SLAM_USE_ROS
-    ros::Rate r(120);
     while(ros::ok())
 #else
     while(1)
@@ -65,6 +64,8 @@ void LoopClosing::Run()
         // Check if there are keyframes in the queue
         if(CheckNewKeyFrames())
         {
+            // the keyframes read while closing a loop must not be offloaded, see Map::EnforceMemoryBudget()
+            boost::shared_lock<boost::shared_mutex> residencyLock(mpMap->mMutexResidency);
             SLAM_START_TIMER("loop_closer");
             // Detect loop candidates and check covisibility consistency
             if(DetectLoop())
@@ -92,36 +93,34 @@ void LoopClosing::Run()
         }
 
         ResetIfRequested();
-#ifdef SLAM_USE_ROS
-        r.sleep();
-#else
-        boost::this_thread::sleep(boost::posix_time::milliseconds(4));
-#endif
+
+        // sleep until local mapping inserts a keyframe or a reset is requested,
+        // the timeout only bounds how late a ROS shutdown is noticed
+        mLoopKeyFrameQueue.Wait(100);
     }
 }
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
-    boost::mutex::scoped_lock lock(mMutexLoopQueue);
     if(pKF->mnFrameId!=0)
-        mlpLoopKeyFrameQueue.push_back(pKF);
+        mLoopKeyFrameQueue.Push(pKF);
 }
 
 bool LoopClosing::CheckNewKeyFrames()
 {
-    boost::mutex::scoped_lock lock(mMutexLoopQueue);
-    return(!mlpLoopKeyFrameQueue.empty());
+    return !mLoopKeyFrameQueue.Empty();
+}
+
+void LoopClosing::GetQueueWaitTimes(double &average, double &maximum) const
+{
+    mLoopKeyFrameQueue.GetWaitTimes(average, maximum);
 }
 
 bool LoopClosing::DetectLoop()
 {
-    {
-        boost::mutex::scoped_lock lock(mMutexLoopQueue);
-        mpCurrentKF = mlpLoopKeyFrameQueue.front();
-        mlpLoopKeyFrameQueue.pop_front();
-        // Avoid that a keyframe can be erased while it is being process by this thread
-        mpCurrentKF->SetNotErase(LoopCandidateKF);
-    }
+    mpCurrentKF = mLoopKeyFrameQueue.Pop();
+    // Avoid that a keyframe can be erased while it is being process by this thread
+    mpCurrentKF->SetNotErase(LoopCandidateKF);
 
     //If the map contains less than 10 KF or less than 10KF have passed from last loop detection
     if(mpCurrentKF->mnFrameId<mLastLoopKFid+10)
@@ -419,19 +418,8 @@ void LoopClosing::CorrectLoop()
     // Send a stop signal to Local Mapping
     // Avoid new keyframes are inserted while correcting the loop
     mpLocalMapper->RequestStop();
-#ifdef SLAM_USE_ROS
     // Wait until Local Mapping has effectively stopped
-    ros::Rate r(1e4);
-    while(ros::ok() && !mpLocalMapper->isStopped())
-    {
-        r.sleep();
-    }
-#else
-    while( !mpLocalMapper->isStopped())
-    {
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
-    }
-#endif
+    mpLocalMapper->WaitUntilStopped();
     cout<<("Loop closure starts!");
     // Ensure current keyframe is updated
     mpCurrentKF->UpdateConnections();
@@ -518,7 +506,6 @@ void LoopClosing::CorrectLoop()
             else
             {
            
-                mpCurrentKF->AddMapPoint(pLoopMP,i);
                 pLoopMP->AddObservation(mpCurrentKF,i);
 #ifndef MONO
                 pLoopMP->AddObservation(mpCurrentKF,i, false);
@@ -579,19 +566,8 @@ void LoopClosing::CorrectLoopSE3()
     // Avoid new keyframes are inserted while correcting the loop
     mpLocalMapper->RequestStop();
 
-#ifdef SLAM_USE_ROS
     // Wait until Local Mapping has effectively stopped
-    ros::Rate r(1e4);
-    while(ros::ok() && !mpLocalMapper->isStopped())
-    {
-        r.sleep();
-    }
-#else
-    while( !mpLocalMapper->isStopped())
-    {
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
-    }
-#endif
+    mpLocalMapper->WaitUntilStopped();
     cout<<("Loop closure starts!");
     // Ensure current keyframe is updated
     mpCurrentKF->UpdateConnections();
@@ -677,7 +653,6 @@ void LoopClosing::CorrectLoopSE3()
                 pCurMP->Replace(pLoopMP);
             else
             {
-                mpCurrentKF->AddMapPoint(pLoopMP,i);
                 pLoopMP->AddObservation(mpCurrentKF,i);
 #ifndef MONO
                 pLoopMP->AddObservation(mpCurrentKF,i, false);
@@ -765,22 +740,17 @@ void LoopClosing::RequestReset()
         boost::mutex::scoped_lock lock(mMutexReset);
         mbResetRequested = true;
     }
-#ifdef SLAM_USE_ROS
-    ros::Rate r(500);
-    while(ros::ok())
-#else
-    while(1)
-#endif
+    mLoopKeyFrameQueue.WakeUp();
+
+    boost::mutex::scoped_lock lock(mMutexReset);
+    while(mbResetRequested)
     {
-        {
-        boost::mutex::scoped_lock lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
 #ifdef SLAM_USE_ROS
-        r.sleep();
+        if(!ros::ok())
+            break;
+        mCondReset.timed_wait(lock, boost::posix_time::milliseconds(100));
 #else
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        mCondReset.wait(lock);
 #endif
     }
 }
@@ -790,9 +760,10 @@ void LoopClosing::ResetIfRequested()
     boost::mutex::scoped_lock lock(mMutexReset);
     if(mbResetRequested)
     {
-        mlpLoopKeyFrameQueue.clear();
+        mLoopKeyFrameQueue.Drain();
         mLastLoopKFid=0;
         mbResetRequested=false;
+        mCondReset.notify_all();
     }
 }
 
@@ -19,11 +19,15 @@
 */
 
 #include "Map.h"
+#include "KeyFrameStore.h"
+
+#include <algorithm>
+#include <iostream>
 
 namespace ORB_SLAM
 {
 
-Map::Map():mbFinishedLoopClosing(false)
+Map::Map():mpKeyFrameStore(NULL), mnMaxResidentKFs(0), mnIdleEpochs(0), mbFinishedLoopClosing(false)
 {
     mbMapUpdated= false;
     mnMaxKFid = 0;
@@ -31,6 +35,7 @@ Map::Map():mbFinishedLoopClosing(false)
 Map::~Map()
 {
     clear();
+    delete mpKeyFrameStore;
 }
 
 void Map::AddKeyFrame(KeyFrame *pKF)
@@ -135,8 +140,86 @@ void Map::clear()
 
     mspMapPoints.clear();
     mspKeyFrames.clear();
+    mCovisibilityGraph.Clear();
     mnMaxKFid = 0;
     mvpReferenceMapPoints.clear();
+    if(mpKeyFrameStore)
+        mpKeyFrameStore->Clear();
+}
+
+void Map::SetMemoryBudget(int nMaxResidentKFs, const string &strStorePrefix, int nIdleEpochs)
+{
+    boost::mutex::scoped_lock lock(mMutexMap);
+    delete mpKeyFrameStore;
+    mpKeyFrameStore = NULL;
+    mnMaxResidentKFs = nMaxResidentKFs;
+    mnIdleEpochs = nIdleEpochs;
+    if(nMaxResidentKFs<=0)
+        return;
+    mpKeyFrameStore = new KeyFrameStore(strStorePrefix);
+    if(!mpKeyFrameStore->IsOpen())
+    {
+        delete mpKeyFrameStore;
+        mpKeyFrameStore = NULL;
+        return;
+    }
+    std::cout<<"- Keyframe store: "<<mpKeyFrameStore->GetFilename()<<std::endl;
+}
+
+int Map::EnforceMemoryBudget(KeyFrame *pCurrentKF)
+{
+    if(!mpKeyFrameStore)
+        return 0;
+    KeyFrame::AdvanceAccessEpoch();
+
+    // readers hold the lock for a whole frame or keyframe, and loop closing may hold it while it waits for
+    // local mapping to stop, so give up after a short wait and try again with the next keyframe
+    boost::unique_lock<boost::shared_mutex> lock(mMutexResidency, boost::posix_time::milliseconds(20));
+    if(!lock.owns_lock())
+        return 0;
+
+    vector<KeyFrame*> vpKFs = GetAllKeyFrames();
+    const Eigen::Vector3d Ow = pCurrentKF->GetCameraCenter();
+    vector<pair<double, KeyFrame*> > vDistAndKF;
+    vDistAndKF.reserve(vpKFs.size());
+    int nResident = 0;
+    for(vector<KeyFrame*>::iterator vit=vpKFs.begin(), vend=vpKFs.end(); vit!=vend; ++vit)
+    {
+        KeyFrame* pKF = *vit;
+        if(pKF->IsOffloaded())
+            continue;
+        ++nResident;
+        if(pKF==pCurrentKF || pKF->isBad() || pKF->GetNotErase() || !pKF->IsIdle(mnIdleEpochs))
+            continue;
+        vDistAndKF.push_back(make_pair((pKF->GetCameraCenter()-Ow).squaredNorm(), pKF));
+    }
+    if(nResident<=mnMaxResidentKFs)
+        return 0;
+
+    // farthest first
+    sort(vDistAndKF.begin(), vDistAndKF.end());
+    int nOffloaded = 0;
+    for(vector<pair<double, KeyFrame*> >::reverse_iterator rit=vDistAndKF.rbegin(), rend=vDistAndKF.rend();
+        rit!=rend && nResident>mnMaxResidentKFs; ++rit)
+    {
+        rit->second->Offload(mpKeyFrameStore);
+        if(rit->second->IsOffloaded())
+        {
+            --nResident;
+            ++nOffloaded;
+        }
+    }
+    return nOffloaded;
+}
+
+int Map::ResidentKeyFramesInMap()
+{
+    boost::mutex::scoped_lock lock(mMutexMap);
+    int nResident = 0;
+    for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+        if(!(*sit)->IsOffloaded())
+            ++nResident;
+    return nResident;
 }
 
 } //namespace ORB_SLAM
@@ -35,13 +35,19 @@ MapPoint::MapPoint(const Eigen::Vector3d &Pos, KeyFrame *pRefKF,const int nIDInK
     mnId(nNextId++),mnFirstKFid(pRefKF->mnFrameId), mnTrackReferenceForFrame(0), mnLastFrameSeen(0), mnBALocalForKF(0),
     mnLoopPointForKF(0), mnCorrectedByKF(0),mnCorrectedReference(0),mbFixedLinearizationPoint(false),
     mpRefKF(pRefKF), mnVisible(1), mnFound(1),v_pt_(NULL),mpMap(pMap),
-    mWorldPos(Pos), mNormalVector(0,0,0),mDescriptor(pRefKF->GetDescriptor(nIDInKF)),
+    mWorldPos(Pos), mnPosVersion(0), mNormalVector(0,0,0),mDescriptor(pRefKF->GetDescriptor(nIDInKF)),
     mbBad(false), mfMinDistance(0), mfMaxDistance(0)
 {
-    mObservations[pRefKF]= nIDInKF;
+    StoreWorldPosSnapshot(Pos);
+    MapPointObservation observation;
+    observation.pKF = pRefKF;
+    observation.nLeft = nIDInKF;
 #ifndef MONO
-    mRightObservations[pRefKF]= nIDInKF;
+    observation.nRight = nIDInKF;
+#else
+    observation.nRight = -1;
 #endif
+    mObservations.push_back(observation);
 }
 
 
@@ -49,12 +55,33 @@ void MapPoint::SetWorldPos(const Eigen::Vector3d &Pos)
 {
     boost::mutex::scoped_lock lock(mMutexPos);
     mWorldPos=Pos;
+    StoreWorldPosSnapshot(Pos);
+}
+
+// the caller holds mMutexPos or is the constructor, so there is a single writer
+void MapPoint::StoreWorldPosSnapshot(const Eigen::Vector3d &Pos)
+{
+    const unsigned int nVersion = mnPosVersion.load(std::memory_order_relaxed);
+    mnPosVersion.store(nVersion+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int i=0; i<3; ++i)
+        mWorldPosSnapshot[i].store(Pos[i], std::memory_order_relaxed);
+    mnPosVersion.store(nVersion+2, std::memory_order_release);
 }
 
 Eigen::Vector3d MapPoint::GetWorldPos()
 {
-    boost::mutex::scoped_lock lock(mMutexPos);
-    return mWorldPos;
+    Eigen::Vector3d Pos;
+    unsigned int nVersion;
+    do
+    {
+        nVersion = mnPosVersion.load(std::memory_order_acquire);
+        for(int i=0; i<3; ++i)
+            Pos[i] = mWorldPosSnapshot[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    while((nVersion&1) || nVersion!=mnPosVersion.load(std::memory_order_relaxed));
+    return Pos;
 }
 
 Eigen::Vector3d MapPoint::GetNormal()
@@ -69,74 +96,164 @@ KeyFrame* MapPoint::GetReferenceKeyFrame()
      return mpRefKF;
 }
 
-void MapPoint::AddObservation(KeyFrame* pF, size_t idx, bool left)
+MapPointObservation* MapPoint::FindObservation(KeyFrame* pKF)
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    if(left)
-        mObservations[pF]=idx;
-    else
-        mRightObservations[pF]=idx;
+    for(MapPointObservations::iterator it=mObservations.begin(), itend=mObservations.end(); it!=itend; ++it)
+        if(it->pKF==pKF)
+            return &(*it);
+    return NULL;
+}
+
+void MapPoint::UpdateCovisibility(KeyFrame* pKF, int nDelta)
+{
+    SmallVector<KeyFrame*, 8> vpKFs;
+    for(MapPointObservations::const_iterator it=mObservations.begin(), itend=mObservations.end(); it!=itend; ++it)
+        if(it->nLeft>=0)
+            vpKFs.push_back(it->pKF);
+    mpMap->GetCovisibilityGraph().AddWeights(pKF, vpKFs.begin(), vpKFs.size(), nDelta);
+}
+
+void MapPoint::EraseCovisibility(const MapPointObservations& observations)
+{
+    SmallVector<KeyFrame*, 8> vpKFs;
+    for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
+        if(it->nLeft>=0)
+            vpKFs.push_back(it->pKF);
+    for(size_t i=0; i+1<vpKFs.size(); ++i)
+        mpMap->GetCovisibilityGraph().AddWeights(vpKFs[i], vpKFs.begin()+i+1, vpKFs.size()-i-1, -1);
+}
+
+bool MapPoint::AddObservation(KeyFrame* pF, size_t idx, bool left)
+{
+    // the keyframe takes the point before it is observed, outside mMutexFeatures since keyframes are locked first
+    if(left && (isBad() || !pF->SetMapPointMatch(idx, this)))
+        return false;
+    bool bAdded = true;
+    int nOldLeft = -1;
+    {
+        boost::mutex::scoped_lock lock(mMutexFeatures);
+        // a bad point is observed by nothing, it may have been set bad since the check above
+        if(mbBad)
+            bAdded = false;
+        else
+        {
+            MapPointObservation* pObservation = FindObservation(pF);
+            if(!pObservation)
+            {
+                MapPointObservation observation;
+                observation.pKF = pF;
+                observation.nLeft = -1;
+                observation.nRight = -1;
+                mObservations.push_back(observation);
+                pObservation = &mObservations[mObservations.size()-1];
+            }
+            if(!left)
+            {
+                pObservation->nRight=idx;
+                return true;
+            }
+            nOldLeft = pObservation->nLeft;
+            pObservation->nLeft=idx;
+            if(nOldLeft<0)
+                UpdateCovisibility(pF, 1);
+        }
+    }
+    if(!bAdded && left)
+        pF->EraseMapPointMatch(idx, this);
+    else if(nOldLeft>=0 && nOldLeft!=(int)idx) // the keyframe held the point at another feature
+        pF->EraseMapPointMatch(nOldLeft, this);
+    return bAdded;
 }
 // local mapping and loop closing do not call this function directly
-void MapPoint::EraseObservation(KeyFrame* pKF)
+void MapPoint::EraseObservation(KeyFrame* pKF, bool bKeyFrameBad)
 {
     bool bBad=false;
+    int nLeft=-1;
     {
         boost::mutex::scoped_lock lock(mMutexFeatures);
-        if(mObservations.count(pKF))
+        MapPointObservation* pObservation = FindObservation(pKF);
+        if(pObservation)
         {
-            mObservations.erase(pKF);
-            if(mpRefKF==pKF)            
-    			mpRefKF=mObservations.begin()->first;
+            nLeft = pObservation->nLeft;
+            const bool bLeft = nLeft>=0;
+            mObservations.erase(pObservation);
+            if(bLeft && !mbBad)
+                UpdateCovisibility(pKF, -1);
+            if(bLeft)
+            {
+                // the new reference keyframe must see the point in its left image
+                int nObs = 0;
+                KeyFrame* pFirstLeftKF = NULL;
+                for(MapPointObservations::const_iterator it=mObservations.begin(), itend=mObservations.end(); it!=itend; ++it)
+                {
+                    if(it->nLeft>=0)
+                    {
+                        if(!nObs)
+                            pFirstLeftKF = it->pKF;
+                        ++nObs;
+                    }
+                }
+                if(mpRefKF==pKF && nObs)
+                    mpRefKF=pFirstLeftKF;
 #ifdef MONO
-            // If only 1 or 2 observations or less, discard point
-            if(mObservations.size()<=2)
-                bBad=true;
+                // If only 1 or 2 observations or less, discard point
+                if(nObs<=2)
+                    bBad=true;
 #else
-            if(mObservations.size()<=1) //set 1 to avoid that points used in tracking thread are marked bad,
-                // because if a point is used in tracking, it must be observed by at least two KEYframes in the double window
-                // and these frames are not allowed to be culled and cannot be this keyframe
-                bBad=true;
+                if(nObs<=1) //set 1 to avoid that points used in tracking thread are marked bad,
+                    // because if a point is used in tracking, it must be observed by at least two KEYframes in the double window
+                    // and these frames are not allowed to be culled and cannot be this keyframe
+                    bBad=true;
 #endif
+            }
         }
-        mRightObservations.erase(pKF);
     }
+    // a keyframe being set bad calls this with its features locked, and keeps its map points
+    if(nLeft>=0 && !bKeyFrameBad)
+        pKF->EraseMapPointMatch(nLeft, this);
 
     if(bBad)
         SetBadFlag();
 }
 
-map<KeyFrame*, size_t> MapPoint::GetObservations(bool left)
+// the observing keyframes are about to be used with the indices of their features, so they are made resident
+void MapPoint::GetObservations(MapPointObservations& observations)
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    if(left)
-        return mObservations;
-    else
-        return mRightObservations;
+    {
+        boost::mutex::scoped_lock lock(mMutexFeatures);
+        observations = mObservations;
+    }
+    for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
+        it->pKF->MakeResident();
 }
 
 int MapPoint::Observations()
 {
     boost::mutex::scoped_lock lock(mMutexFeatures);
-    return mObservations.size();
+    int nObs = 0;
+    for(MapPointObservations::const_iterator it=mObservations.begin(), itend=mObservations.end(); it!=itend; ++it)
+        if(it->nLeft>=0)
+            ++nObs;
+    return nObs;
 }
 
 void MapPoint::SetBadFlag()
 {
-    map<KeyFrame*,size_t> obs;
+    MapPointObservations obs;
     {
         boost::mutex::scoped_lock lock1(mMutexFeatures);
         boost::mutex::scoped_lock lock2(mMutexPos);
+        if(!mbBad)
+            EraseCovisibility(mObservations);
         mbBad=true;
     
         obs = mObservations;
         mObservations.clear();
-        mRightObservations.clear();
     }
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(MapPointObservations::const_iterator it=obs.begin(), itend=obs.end(); it!=itend; ++it)
     {
-        KeyFrame* pKF = mit->first;
-        pKF->EraseMapPointMatch(mit->second);
+        if(it->nLeft>=0)
+            it->pKF->EraseMapPointMatch(it->nLeft, this);
     }
     mpMap->EraseMapPoint(this);
 	Release();
@@ -148,36 +265,43 @@ void MapPoint::Replace(MapPoint* pMP)
         return;
     assert(pMP->mpRefKF->isBad()==false);
 
-    map<KeyFrame*,size_t> obs;
+    MapPointObservations obs;
     {
         boost::mutex::scoped_lock lock1(mMutexFeatures);
         boost::mutex::scoped_lock lock2(mMutexPos);
 		obs=mObservations;
+        if(!mbBad)
+            EraseCovisibility(mObservations);
         mbBad=true;
        //note this point may be observed in current frame and used in localoptimize,
         // but we still delete its observations, so some isolated point may exist in localoptimize
         mObservations.clear();
-        mRightObservations.clear();
     }
 
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(MapPointObservations::const_iterator it=obs.begin(), itend=obs.end(); it!=itend; ++it)
     {
+        if(it->nLeft<0)
+            continue;
         // Replace measurement in frame
-        KeyFrame* pKF = mit->first;
+        KeyFrame* pKF = it->pKF;
    
         int nMPId=pMP->IdInKeyFrame(pKF);
+        // this point is bad, so pMP takes its place in the keyframe
         if(nMPId==-1)
         {
-            pKF->ReplaceMapPointMatch(mit->second, pMP);
-            pMP->AddObservation(pKF,mit->second);
+            if(pMP->AddObservation(pKF,it->nLeft))
+            {
 #ifndef MONO
-            pMP->AddObservation(pKF,mit->second, false);
+                pMP->AddObservation(pKF,it->nLeft, false);
 #endif
+            }
+            else
+                pKF->EraseMapPointMatch(it->nLeft, this);
         }
         else
         {
-            assert(nMPId!= (int) mit->second);
-            pKF->EraseMapPointMatch(mit->second);
+            assert(nMPId!= it->nLeft);
+            pKF->EraseMapPointMatch(it->nLeft, this);
         }
     }
     pMP->ComputeDistinctiveDescriptors();
@@ -186,27 +310,22 @@ void MapPoint::Replace(MapPoint* pMP)
 
 bool MapPoint::isBad()
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    boost::mutex::scoped_lock lock2(mMutexPos);
-    return mbBad;
+    return mbBad.load(std::memory_order_acquire);
 }
 
 void MapPoint::IncreaseVisible()
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    mnVisible++;
+    mnVisible.fetch_add(1, std::memory_order_relaxed);
 }
 
 void MapPoint::IncreaseFound()
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    mnFound++;
+    mnFound.fetch_add(1, std::memory_order_relaxed);
 }
 
 float MapPoint::GetFoundRatio()
 {
-    boost::mutex::scoped_lock lock(mMutexFeatures);
-    return static_cast<float>(mnFound)/mnVisible;
+    return static_cast<float>(mnFound.load(std::memory_order_relaxed))/mnVisible.load(std::memory_order_relaxed);
 }
 // choose the distinctive descriptor from those of this MapPoint's observations
 void MapPoint::ComputeDistinctiveDescriptors()
@@ -217,29 +336,29 @@ void MapPoint::ComputeDistinctiveDescriptors()
     // Retrieve all observed descriptors
     vector<cv::Mat> vDescriptors;
 
-    map<KeyFrame*,size_t> observations, right_observations;
+    MapPointObservations observations;
 	{
         boost::mutex::scoped_lock lock1(mMutexFeatures);
     
         observations=mObservations;
-		right_observations=mRightObservations;
     }
    
-    vDescriptors.reserve(observations.size()+right_observations.size());
+    vDescriptors.reserve(2*observations.size());
 
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    // left descriptors first, then right ones
+    for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
     {
-        KeyFrame* pKF = mit->first;
-//        assert(pF->mvpMapPoints[mit->second]);
-        if(!pKF->isBad())
-            vDescriptors.push_back(pKF->GetDescriptor(mit->second));
+        KeyFrame* pKF = it->pKF;
+//        assert(pF->mvpMapPoints[it->nLeft]);
+        if(it->nLeft>=0 && !pKF->isBad())
+            vDescriptors.push_back(pKF->GetDescriptor(it->nLeft));
     }
-    for(map<KeyFrame*,size_t>::iterator mit=right_observations.begin(), mend=right_observations.end(); mit!=mend; mit++)
+    for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
     {
-        KeyFrame* pKF = mit->first;
+        KeyFrame* pKF = it->pKF;
 
-        if(!pKF->isBad())
-            vDescriptors.push_back(pKF->GetDescriptor(mit->second, false));
+        if(it->nRight>=0 && !pKF->isBad())
+            vDescriptors.push_back(pKF->GetDescriptor(it->nRight, false));
     }
   	assert(!vDescriptors.empty());
     // Compute distances between them
@@ -291,39 +410,29 @@ void MapPoint::SetDescriptor(const cv::Mat & descrip)
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF, bool left)
 {
     boost::mutex::scoped_lock lock(mMutexFeatures);
-    if(left){
-    if(mObservations.count(pKF))
-        return mObservations[pKF];
-    else
+    const MapPointObservation* pObservation = FindObservation(pKF);
+    if(!pObservation)
         return -1;
-    }
-    else{
-        if(mRightObservations.count(pKF))
-            return mRightObservations[pKF];
-        else
-            return -1;        
-    }
+    return left ? pObservation->nLeft : pObservation->nRight;
 }
 
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 {
     boost::mutex::scoped_lock lock(mMutexFeatures);
-    return (mObservations.count(pKF));
+    const MapPointObservation* pObservation = FindObservation(pKF);
+    return pObservation && pObservation->nLeft>=0;
 }
 
 int MapPoint::IdInKeyFrame(KeyFrame *pKF)
 {
     boost::mutex::scoped_lock lock(mMutexFeatures);
-    map<KeyFrame*, size_t>::const_iterator it= mObservations.find(pKF);
-    if(it==mObservations.end())
-        return -1;
-    else
-        return it->second;
+    const MapPointObservation* pObservation = FindObservation(pKF);
+    return pObservation ? pObservation->nLeft : -1;
 }
 
 void MapPoint::UpdateNormalAndDepth()
 {
-    map<KeyFrame*,size_t> observations;
+    MapPointObservations observations;
    
     KeyFrame* pRefKF;
     Eigen::Vector3d Pos;
@@ -340,11 +449,13 @@ void MapPoint::UpdateNormalAndDepth()
 
     Eigen::Vector3d normal(0,0,0);
     int n=0;
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(),
-        mend=observations.end(); mit!=mend; ++mit)
+    int nRefIndex=-1;
+    for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
     {
-        KeyFrame* pKF = mit->first;
-        if(pKF->isBad())
+        KeyFrame* pKF = it->pKF;
+        if(pKF==pRefKF)
+            nRefIndex = it->nLeft;
+        if(it->nLeft<0 || pKF->isBad())
             continue;
         Eigen::Vector3d Owi = pKF->GetCameraCenter();
         Eigen::Vector3d normali = Pos - Owi;
@@ -364,7 +475,7 @@ void MapPoint::UpdateNormalAndDepth()
         return;
     }
 
-    const int level = pRefKF->GetKeyPointScaleLevel(observations[pRefKF]);
+    const int level = nRefIndex>=0? pRefKF->GetKeyPointScaleLevel(nRefIndex): 0;
     const float levelScaleFactor =  pRefKF->GetScaleFactor(level);
 
     {
@@ -386,6 +497,15 @@ float MapPoint::GetMaxDistanceInvariance()
     boost::mutex::scoped_lock lock(mMutexPos);
     return mfMaxDistance;
 }
+
+void MapPoint::GetGeometry(Eigen::Vector3d &pos, Eigen::Vector3d &normal, float &minDistance, float &maxDistance)
+{
+    boost::mutex::scoped_lock lock(mMutexPos);
+    pos = mWorldPos;
+    normal = mNormalVector;
+    minDistance = mfMinDistance;
+    maxDistance = mfMaxDistance;
+}
 void MapPoint::SetFirstEstimate()
 {
     if(!mbFixedLinearizationPoint){
@@ -396,7 +516,6 @@ void MapPoint::SetFirstEstimate()
 void MapPoint::Release()
 {
     mObservations.clear();
-    mRightObservations.clear();
 //    mNormalVector.release();
 //    mDescriptor.release();
 }
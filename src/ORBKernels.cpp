@@ -0,0 +1,266 @@
+#include "ORBKernels.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ORBKERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM
+{
+namespace ORBKernels
+{
+
+static const int HALF_PATCH_SIZE = 15;
+static const int NUM_POINTS = 512;
+
+// rounds half to even like cvRound
+static inline int Round(float value)
+{
+#ifdef ORBKERNELS_X86
+    return _mm_cvtss_si32(_mm_set_ss(value));
+#else
+    return (int)lrintf(value);
+#endif
+}
+
+static void ICMomentsScalar(const unsigned char* center, int step, const int* u_max, int &m_01, int &m_10)
+{
+    m_01 = 0;
+    m_10 = 0;
+
+    // Treat the center line differently, v=0
+    for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
+        m_10 += u * center[u];
+
+    // Go line by line in the circular patch
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
+    {
+        // Proceed over the two lines
+        int v_sum = 0;
+        int d = u_max[v];
+        for (int u = -d; u <= d; ++u)
+        {
+            int val_plus = center[u + v*step], val_minus = center[u - v*step];
+            v_sum += (val_plus - val_minus);
+            m_10 += u * (val_plus + val_minus);
+        }
+        m_01 += v * v_sum;
+    }
+}
+
+static void DescriptorScalar(const unsigned char* center, int step, float a, float b, const int* pattern, unsigned char* desc)
+{
+    #define GET_VALUE(idx) \
+        center[Round(pattern[2*(idx)]*b + pattern[2*(idx)+1]*a)*step + \
+               Round(pattern[2*(idx)]*a - pattern[2*(idx)+1]*b)]
+
+    for (int i = 0; i < 32; ++i, pattern += 32)
+    {
+        int t0, t1, val;
+        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
+        val = t0 < t1;
+        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
+        val |= (t0 < t1) << 1;
+        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
+        val |= (t0 < t1) << 2;
+        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
+        val |= (t0 < t1) << 3;
+        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
+        val |= (t0 < t1) << 4;
+        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
+        val |= (t0 < t1) << 5;
+        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
+        val |= (t0 < t1) << 6;
+        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
+        val |= (t0 < t1) << 7;
+
+        desc[i] = (unsigned char)val;
+    }
+
+    #undef GET_VALUE
+}
+
+#ifdef ORBKERNELS_X86
+
+// A row of the patch is loaded as u in [-15, 0] and [0, 15], widened to 4 x 8 int16 lanes.
+// Lanes out of the row half width are masked, u = 0 is only counted in the first half
+__attribute__((target("sse2")))
+static void ICMomentsSSE2(const unsigned char* center, int step, const int* u_max, int &m_01, int &m_10)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vU[4] = {_mm_setr_epi16(-15,-14,-13,-12,-11,-10,-9,-8), _mm_setr_epi16(-7,-6,-5,-4,-3,-2,-1,0),
+                           _mm_setr_epi16(0,1,2,3,4,5,6,7), _mm_setr_epi16(8,9,10,11,12,13,14,15)};
+    const __m128i vAbsU[4] = {_mm_setr_epi16(15,14,13,12,11,10,9,8), _mm_setr_epi16(7,6,5,4,3,2,1,0),
+                              _mm_setr_epi16(HALF_PATCH_SIZE+1,1,2,3,4,5,6,7), _mm_setr_epi16(8,9,10,11,12,13,14,15)};
+
+    __m128i acc10 = _mm_setzero_si128(), acc01 = _mm_setzero_si128();
+    for (int v = 0; v <= HALF_PATCH_SIZE; ++v)
+    {
+        const __m128i vD = _mm_set1_epi16((short)(u_max[v]+1));
+        const __m128i vV = _mm_set1_epi16((short)v);
+        const unsigned char* plus = center + v*step;
+        const unsigned char* minus = center - v*step;
+        const __m128i plusLow = _mm_loadu_si128((const __m128i*)(plus-HALF_PATCH_SIZE));
+        const __m128i plusHigh = _mm_loadu_si128((const __m128i*)plus);
+        const __m128i vPlus[4] = {_mm_unpacklo_epi8(plusLow, zero), _mm_unpackhi_epi8(plusLow, zero),
+                                  _mm_unpacklo_epi8(plusHigh, zero), _mm_unpackhi_epi8(plusHigh, zero)};
+        if (v == 0)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                const __m128i mask = _mm_cmplt_epi16(vAbsU[k], vD);
+                acc10 = _mm_add_epi32(acc10, _mm_madd_epi16(_mm_and_si128(vPlus[k], mask), vU[k]));
+            }
+            continue;
+        }
+        const __m128i minusLow = _mm_loadu_si128((const __m128i*)(minus-HALF_PATCH_SIZE));
+        const __m128i minusHigh = _mm_loadu_si128((const __m128i*)minus);
+        const __m128i vMinus[4] = {_mm_unpacklo_epi8(minusLow, zero), _mm_unpackhi_epi8(minusLow, zero),
+                                   _mm_unpacklo_epi8(minusHigh, zero), _mm_unpackhi_epi8(minusHigh, zero)};
+        for (int k = 0; k < 4; ++k)
+        {
+            const __m128i mask = _mm_cmplt_epi16(vAbsU[k], vD);
+            const __m128i sum = _mm_and_si128(_mm_add_epi16(vPlus[k], vMinus[k]), mask);
+            const __m128i diff = _mm_and_si128(_mm_sub_epi16(vPlus[k], vMinus[k]), mask);
+            acc10 = _mm_add_epi32(acc10, _mm_madd_epi16(sum, vU[k]));
+            acc01 = _mm_add_epi32(acc01, _mm_madd_epi16(diff, vV));
+        }
+    }
+
+    int v10[4], v01[4];
+    _mm_storeu_si128((__m128i*)v10, acc10);
+    _mm_storeu_si128((__m128i*)v01, acc01);
+    m_10 = v10[0] + v10[1] + v10[2] + v10[3];
+    m_01 = v01[0] + v01[1] + v01[2] + v01[3];
+}
+
+// The points are rotated and rounded 8 at a time, their offsets y*step+x come from a multiply-add
+// of interleaved 16 bit coordinates. The pixels of the first and the second point of each pair are
+// gathered into two arrays and compared 16 pairs at a time
+__attribute__((target("sse2")))
+static void DescriptorSSE2(const unsigned char* center, int step, float a, float b, const int* pattern, unsigned char* desc)
+{
+    // offsets only fit the 16 bit multiply-add for rows shorter than 32768 bytes
+    if (step >= 32768)
+    {
+        DescriptorScalar(center, step, a, b, pattern, desc);
+        return;
+    }
+
+    int vOffsets[NUM_POINTS];
+    const __m128 vA = _mm_set1_ps(a), vB = _mm_set1_ps(b);
+    const __m128i vStep = _mm_set1_epi32((step & 0xffff) | (1 << 16));
+    for (int i = 0; i < NUM_POINTS; i += 8)
+    {
+        __m128i vXY[2];
+        for (int h = 0; h < 2; ++h)
+        {
+            const __m128 p01 = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(pattern+2*i+8*h)));
+            const __m128 p23 = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(pattern+2*i+8*h+4)));
+            const __m128 x = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2,0,2,0));
+            const __m128 y = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3,1,3,1));
+            const __m128i ry = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(x, vB), _mm_mul_ps(y, vA)));
+            const __m128i rx = _mm_cvtps_epi32(_mm_sub_ps(_mm_mul_ps(x, vA), _mm_mul_ps(y, vB)));
+            vXY[h] = _mm_packs_epi32(ry, rx); // y0..y3, x0..x3
+        }
+        const __m128i y16 = _mm_unpacklo_epi64(vXY[0], vXY[1]);
+        const __m128i x16 = _mm_unpackhi_epi64(vXY[0], vXY[1]);
+        _mm_storeu_si128((__m128i*)(vOffsets+i), _mm_madd_epi16(_mm_unpacklo_epi16(y16, x16), vStep));
+        _mm_storeu_si128((__m128i*)(vOffsets+i+4), _mm_madd_epi16(_mm_unpackhi_epi16(y16, x16), vStep));
+    }
+
+    unsigned char vFirst[NUM_POINTS/2], vSecond[NUM_POINTS/2];
+    for (int j = 0; j < NUM_POINTS/2; ++j)
+    {
+        vFirst[j] = center[vOffsets[2*j]];
+        vSecond[j] = center[vOffsets[2*j+1]];
+    }
+
+    // unsigned comparison as signed on values shifted by 128
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    for (int j = 0; j < NUM_POINTS/2; j += 16)
+    {
+        const __m128i t0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(vFirst+j)), bias);
+        const __m128i t1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(vSecond+j)), bias);
+        const int mask = _mm_movemask_epi8(_mm_cmplt_epi8(t0, t1));
+        desc[j/8] = (unsigned char)(mask & 0xff);
+        desc[j/8+1] = (unsigned char)(mask >> 8);
+    }
+}
+
+#endif
+
+struct KernelTable
+{
+    void (*moments)(const unsigned char*, int, const int*, int&, int&);
+    void (*descriptor)(const unsigned char*, int, float, float, const int*, unsigned char*);
+};
+
+static const KernelTable gKernels[] = {
+    {ICMomentsScalar, DescriptorScalar},
+#ifdef ORBKERNELS_X86
+    {ICMomentsSSE2, DescriptorSSE2},
+#endif
+};
+
+bool IsSupported(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case SCALAR:
+        return true;
+#ifdef ORBKERNELS_X86
+    case SSE2:
+        return __builtin_cpu_supports("sse2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static Kernel SelectBestKernel()
+{
+#ifdef ORBKERNELS_X86
+    // this runs during static initialization, possibly before libgcc has probed the cpu
+    __builtin_cpu_init();
+#endif
+    return IsSupported(SSE2)? SSE2: SCALAR;
+}
+
+static Kernel gKernel = SelectBestKernel();
+static KernelTable gActive = gKernels[gKernel];
+
+void ICMoments(const unsigned char* center, int step, const int* u_max, int &m_01, int &m_10)
+{
+    gActive.moments(center, step, u_max, m_01, m_10);
+}
+
+void Descriptor(const unsigned char* center, int step, float a, float b, const int* pattern, unsigned char* desc)
+{
+    gActive.descriptor(center, step, a, b, pattern, desc);
+}
+
+bool SetKernel(Kernel kernel)
+{
+    if(!IsSupported(kernel))
+        return false;
+    gKernel = kernel;
+    gActive = gKernels[kernel];
+    return true;
+}
+
+Kernel GetKernel()
+{
+    return gKernel;
+}
+
+const char* GetKernelName(Kernel kernel)
+{
+    static const char* names[] = {"scalar", "sse2"};
+    return names[kernel];
+}
+
+}
+} //namespace ORB_SLAM
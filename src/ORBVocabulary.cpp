@@ -0,0 +1,226 @@
+#include "ORBVocabulary.h"
+#include "HammingDistance.h"
+#include "ThreadPool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+namespace ORB_SLAM
+{
+
+ORBVocabulary::ORBVocabulary(int k, int L, DBoW2::WeightingType weighting, DBoW2::ScoringType scoring):
+    Base(k, L, weighting, scoring), mnMaxChildren(0)
+{
+}
+
+void ORBVocabulary::create(const std::vector<std::vector<DBoW2::FORB::TDescriptor> > &training_features)
+{
+    Base::create(training_features);
+    Flatten();
+}
+
+void ORBVocabulary::load(const cv::FileStorage &fs, const std::string &name)
+{
+    Base::load(fs, name);
+    Flatten();
+}
+
+bool ORBVocabulary::loadFromTextFile(const std::string &filename)
+{
+    const bool bLoaded = Base::loadFromTextFile(filename);
+    Flatten();
+    return bLoaded;
+}
+
+bool ORBVocabulary::loadFromBinaryFile(const std::string &filename)
+{
+    const bool bLoaded = Base::loadFromBinaryFile(filename);
+    Flatten();
+    return bLoaded;
+}
+
+void ORBVocabulary::Flatten()
+{
+    mvFlatNodes.clear();
+    mvFlatChildren.clear();
+    mpChildDescriptors.reset();
+    mnMaxChildren = 0;
+    if(m_nodes.empty() || m_nodes[0].isLeaf())
+        return;
+
+    // number the internal nodes breadth first, so that the nodes of the first levels, visited by every
+    // descriptor, are next to each other
+    std::vector<DBoW2::NodeId> vInternal(1, 0);
+    std::vector<int32_t> vFlatIndex(m_nodes.size(), -1);
+    vFlatIndex[0] = 0;
+    for(size_t i=0; i<vInternal.size(); ++i)
+    {
+        const std::vector<DBoW2::NodeId> &vChildren = m_nodes[vInternal[i]].children;
+        for(size_t j=0; j<vChildren.size(); ++j)
+        {
+            if(!m_nodes[vChildren[j]].isLeaf())
+            {
+                vFlatIndex[vChildren[j]] = vInternal.size();
+                vInternal.push_back(vChildren[j]);
+            }
+        }
+    }
+
+    // the children of a node start at a cache line, the slot after an odd number of children is padding
+    const size_t nSlotsPerLine = 64/DESCRIPTOR_BYTES;
+    size_t nSlots = 0;
+    std::vector<FlatNode> vFlatNodes(vInternal.size());
+    for(size_t i=0; i<vInternal.size(); ++i)
+    {
+        const size_t nChildren = m_nodes[vInternal[i]].children.size();
+        vFlatNodes[i].nFirstChild = nSlots;
+        vFlatNodes[i].nChildren = nChildren;
+        nSlots += (nChildren+nSlotsPerLine-1)/nSlotsPerLine*nSlotsPerLine;
+        mnMaxChildren = std::max(mnMaxChildren, nChildren);
+    }
+
+    void* pDescriptors = NULL;
+    if(posix_memalign(&pDescriptors, 64, nSlots*DESCRIPTOR_BYTES) != 0)
+        throw std::bad_alloc();
+    boost::shared_ptr<unsigned char> pChildDescriptors(static_cast<unsigned char*>(pDescriptors), free);
+    memset(pDescriptors, 0, nSlots*DESCRIPTOR_BYTES);
+
+    FlatChild padding = {0, -1};
+    std::vector<FlatChild> vFlatChildren(nSlots, padding);
+    for(size_t i=0; i<vInternal.size(); ++i)
+    {
+        const std::vector<DBoW2::NodeId> &vChildren = m_nodes[vInternal[i]].children;
+        for(size_t j=0; j<vChildren.size(); ++j)
+        {
+            const cv::Mat &descriptor = m_nodes[vChildren[j]].descriptor;
+            if(descriptor.type()!=CV_8U || descriptor.total()!=DESCRIPTOR_BYTES || !descriptor.isContinuous())
+            {
+                mnMaxChildren = 0;
+                return;
+            }
+            const size_t nSlot = vFlatNodes[i].nFirstChild + j;
+            vFlatChildren[nSlot].nodeId = vChildren[j];
+            vFlatChildren[nSlot].nFlatNode = vFlatIndex[vChildren[j]];
+            memcpy(pChildDescriptors.get() + nSlot*DESCRIPTOR_BYTES, descriptor.data, DESCRIPTOR_BYTES);
+        }
+    }
+
+    mvFlatNodes.swap(vFlatNodes);
+    mvFlatChildren.swap(vFlatChildren);
+    mpChildDescriptors = pChildDescriptors;
+}
+
+void ORBVocabulary::TransformFeature(const unsigned char* pDescriptor, DBoW2::WordId &wordId, DBoW2::WordValue &weight,
+                                     DBoW2::NodeId &nodeId, int levelsup, int* vDists) const
+{
+    // level at which the node must be stored in nodeId
+    const int nidLevel = m_L - levelsup;
+    nodeId = 0; // root
+
+    const unsigned char* pChildDescriptors = mpChildDescriptors.get();
+    DBoW2::NodeId finalId = 0;
+    int32_t nFlatNode = 0;
+    int nLevel = 0;
+    do
+    {
+        ++nLevel;
+        const FlatNode &node = mvFlatNodes[nFlatNode];
+        HammingDistance::Distances(pDescriptor, pChildDescriptors + node.nFirstChild*DESCRIPTOR_BYTES, DESCRIPTOR_BYTES,
+                                   node.nChildren, vDists);
+
+        // the first of the closest children, as DBoW2
+        uint32_t nBest = 0;
+        for(uint32_t j=1; j<node.nChildren; ++j)
+            if(vDists[j]<vDists[nBest])
+                nBest = j;
+
+        const FlatChild &child = mvFlatChildren[node.nFirstChild+nBest];
+        finalId = child.nodeId;
+        if(nLevel == nidLevel)
+            nodeId = finalId;
+        nFlatNode = child.nFlatNode;
+    }
+    while(nFlatNode >= 0);
+
+    wordId = m_nodes[finalId].word_id;
+    weight = m_nodes[finalId].weight;
+}
+
+void ORBVocabulary::transform(const cv::Mat &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup,
+                              ThreadPool* pThreadPool) const
+{
+    if(mvFlatNodes.empty() || descriptors.cols*descriptors.elemSize()!=DESCRIPTOR_BYTES)
+    {
+        std::vector<cv::Mat> vDesc;
+        vDesc.reserve(descriptors.rows);
+        for(int j=0; j<descriptors.rows; j++)
+            vDesc.push_back(descriptors.row(j));
+        Base::transform(vDesc, v, fv, levelsup);
+        return;
+    }
+
+    v.clear();
+    fv.clear();
+    if(empty())
+        return;
+
+    // words of the features in chunks, each chunk writes its own slots
+    const size_t N = descriptors.rows;
+    std::vector<DBoW2::WordId> vWordIds(N);
+    std::vector<DBoW2::WordValue> vWeights(N);
+    std::vector<DBoW2::NodeId> vNodeIds(N);
+    const size_t nChunkSize = 64;
+    const size_t nChunks = (N+nChunkSize-1)/nChunkSize;
+    auto transformChunk = [&](size_t c)
+    {
+        std::vector<int> vDists(mnMaxChildren);
+        for(size_t i=c*nChunkSize, iend=std::min(N, (c+1)*nChunkSize); i<iend; ++i)
+            TransformFeature(descriptors.ptr<unsigned char>(i), vWordIds[i], vWeights[i], vNodeIds[i], levelsup, &vDists[0]);
+    };
+    if(pThreadPool && nChunks>1)
+        pThreadPool->ParallelFor(nChunks, transformChunk);
+    else
+        for(size_t c=0; c<nChunks; ++c)
+            transformChunk(c);
+
+    // accumulate in the order of the features, as Base::transform
+    DBoW2::LNorm norm;
+    const bool must = m_scoring_object->mustNormalize(norm);
+    if(m_weighting == DBoW2::TF || m_weighting == DBoW2::TF_IDF)
+    {
+        for(size_t i=0; i<N; ++i)
+        {
+            if(vWeights[i] > 0) // not stopped
+            {
+                v.addWeight(vWordIds[i], vWeights[i]);
+                fv.addFeature(vNodeIds[i], i);
+            }
+        }
+
+        if(!v.empty() && !must)
+        {
+            // unnecessary when normalizing
+            const double nd = v.size();
+            for(DBoW2::BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+                vit->second /= nd;
+        }
+    }
+    else // IDF || BINARY
+    {
+        for(size_t i=0; i<N; ++i)
+        {
+            if(vWeights[i] > 0) // not stopped
+            {
+                v.addIfNotExist(vWordIds[i], vWeights[i]);
+                fv.addFeature(vNodeIds[i], i);
+            }
+        }
+    }
+
+    if(must)
+        v.normalize(norm);
+}
+
+} //namespace ORB_SLAM
@@ -60,8 +60,13 @@
 #include <vector>
 
 #include "ORBextractor.h"
+#include "ThreadPool.h"
+#include "ORBKernels.h"
+#include "ImagePyramid.h"
 
 #include <vikit/vision.h> //for shitomasiscore
+#include <vikit/pinhole_camera.h>
+#include <vikit/timer.h>
 //#include <ros/ros.h>
 
 
@@ -128,25 +133,7 @@ static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
 
     const uchar* center = &image.at<uchar> (cvRound(pt.y), cvRound(pt.x));
 
-    // Treat the center line differently, v=0
-    for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
-        m_10 += u * center[u];
-
-    // Go line by line in the circuI853lar patch
-    int step = (int)image.step1();
-    for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
-    {
-        // Proceed over the two lines
-        int v_sum = 0;
-        int d = u_max[v];
-        for (int u = -d; u <= d; ++u)
-        {
-            int val_plus = center[u + v*step], val_minus = center[u - v*step];
-            v_sum += (val_plus - val_minus);
-            m_10 += u * (val_plus + val_minus);
-        }
-        m_01 += v * v_sum;
-    }
+    ORBKernels::ICMoments(center, (int)image.step1(), &u_max[0], m_01, m_10);
 
     return fastAtan2((float)m_01, (float)m_10);
 }
@@ -163,35 +150,8 @@ void computeOrbDescriptor(const KeyPoint& kpt,
     const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
     const int step = (int)img.step;
 
-    #define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
-
-
-    for (int i = 0; i < 32; ++i, pattern += 16)
-    {
-        int t0, t1, val;
-        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-        val = t0 < t1;
-        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-        val |= (t0 < t1) << 1;
-        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-        val |= (t0 < t1) << 2;
-        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-        val |= (t0 < t1) << 3;
-        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-        val |= (t0 < t1) << 4;
-        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-        val |= (t0 < t1) << 5;
-        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-        val |= (t0 < t1) << 6;
-        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-        val |= (t0 < t1) << 7;
-
-        desc[i] = (uchar)val;
-    }
-
-    #undef GET_VALUE
+    // cv::Point is two ints, the pattern is read as x, y interleaved
+    ORBKernels::Descriptor(center, step, a, b, (const int*)pattern, desc);
 }
 
 
@@ -458,7 +418,7 @@ static int bit_pattern_31_[256*4] =
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels, int _scoreType,
          int _fastTh, const float sigmaLevel0):
     nlevels(_nlevels), nfeatures(_nfeatures), scaleFactor(_scaleFactor),
-    scoreType(_scoreType), fastTh(_fastTh)
+    scoreType(_scoreType), fastTh(_fastTh), mpThreadPool(NULL)
 {
     //Scale Levels Info
     mvScaleFactor.resize(nlevels);
@@ -770,189 +730,218 @@ void ORBextractor::MakeKeyPoints_Rest(std::vector<cv::KeyPoint> & vKeys,
 void ORBextractor::ComputeKeyPoints(vector<vector<KeyPoint> >& allKeypoints, bool bGAFD)
 {
     allKeypoints.resize(nlevels);
+    mvLevelTimes.resize(nlevels, 0.0);
 
+    // each level only writes its own keypoints and timing slot
+    ParallelFor(nlevels, [&](size_t level)
+    {
+        vk::Timer timer;
+        ComputeKeyPointsLevel(level, allKeypoints[level], bGAFD);
+        mvLevelTimes[level] += timer.stop();
+    });
+}
+
+void ORBextractor::ComputeKeyPointsLevel(const int level, vector<KeyPoint>& keypoints, bool bGAFD)
+{
     float imageRatio = (float)mvImagePyramid[0].cols/mvImagePyramid[0].rows;
     //HUAI: I suspect it should be rows/cols, but tows/cols gives worse result in a few tests
 
-    for (int level = 0; level < nlevels; ++level)
-    {
-        const int nDesiredFeatures = mnFeaturesPerLevel[level];
+    const int nDesiredFeatures = mnFeaturesPerLevel[level];
 
-        const int levelCols = sqrt((float)nDesiredFeatures/(5*imageRatio));
-        const int levelRows = imageRatio*levelCols;
+    const int levelCols = sqrt((float)nDesiredFeatures/(5*imageRatio));
+    const int levelRows = imageRatio*levelCols;
 
-        const int minBorderX = EDGE_THRESHOLD;
-        const int minBorderY = minBorderX;
-        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD;
-        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD;
+    const int minBorderX = EDGE_THRESHOLD;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD;
 
-        const int W = maxBorderX - minBorderX;
-        const int H = maxBorderY - minBorderY;
-        const int cellW = ceil((float)W/levelCols);
-        const int cellH = ceil((float)H/levelRows);
+    const int W = maxBorderX - minBorderX;
+    const int H = maxBorderY - minBorderY;
+    const int cellW = ceil((float)W/levelCols);
+    const int cellH = ceil((float)H/levelRows);
 
-        const int nCells = levelRows*levelCols;
-        const int nfeaturesCell = ceil((float)nDesiredFeatures/nCells);
+    const int nCells = levelRows*levelCols;
+    const int nfeaturesCell = ceil((float)nDesiredFeatures/nCells);
 
-        vector<vector<vector<KeyPoint> > > cellKeyPoints(levelRows, vector<vector<KeyPoint> >(levelCols));
+    vector<vector<vector<KeyPoint> > > cellKeyPoints(levelRows, vector<vector<KeyPoint> >(levelCols));
 
-        vector<vector<int> > nToRetain(levelRows,vector<int>(levelCols));
-        vector<vector<int> > nTotal(levelRows,vector<int>(levelCols));
-        vector<vector<bool> > bNoMore(levelRows,vector<bool>(levelCols,false));
-        vector<int> iniXCol(levelCols);
-        vector<int> iniYRow(levelRows);
-        int nNoMore = 0;
-        int nToDistribute = 0;
+    vector<vector<int> > nToRetain(levelRows,vector<int>(levelCols));
+    vector<vector<int> > nTotal(levelRows,vector<int>(levelCols));
+    vector<vector<bool> > bNoMore(levelRows,vector<bool>(levelCols,false));
+    vector<int> iniXCol(levelCols);
+    vector<int> iniYRow(levelRows);
+    int nNoMore = 0;
+    int nToDistribute = 0;
 
+    // Lay out the cell windows first, hX and hY carry over from the last column and row
+    // exactly as the serial detection did, so that cells can then be detected in any order
+    vector<Rect_<float> > cellRects(nCells);
+    vector<bool> cellValid(nCells, false);
 
-        float hY = cellH + 6;
-        float hX = cellW + 6;
+    float hY = cellH + 6;
+    float hX = cellW + 6;
 
-        for(int i=0; i<levelRows; i++)
+    for(int i=0; i<levelRows; i++)
+    {
+        const float iniY = minBorderY + i*cellH - 3;
+        iniYRow[i] = iniY;
+
+        if(i == levelRows-1)
         {
-            const float iniY = minBorderY + i*cellH - 3;
-            iniYRow[i] = iniY;
+            hY = maxBorderY+3-iniY;
+            if(hY<=0)
+                continue;
+        }
 
-            if(i == levelRows-1)
+        for(int j=0; j<levelCols; j++)
+        {
+            float iniX;
+
+            if(i==0)
             {
-                hY = maxBorderY+3-iniY;
-                if(hY<=0)
-                    continue;
+                iniX = minBorderX + j*cellW - 3;
+                iniXCol[j] = iniX;
             }
-
-            for(int j=0; j<levelCols; j++)
+            else
             {
-                float iniX;
+                iniX = iniXCol[j];
+            }
 
-                if(i==0)
-                {
-                    iniX = minBorderX + j*cellW - 3;
-                    iniXCol[j] = iniX;
-                }
-                else
-                {
-                    iniX = iniXCol[j];
-                }
 
+            if(j == levelCols-1)
+            {
+                hX = maxBorderX+3-iniX;
+                if(hX<=0)
+                    continue;
+            }
 
-                if(j == levelCols-1)
-                {
-                    hX = maxBorderX+3-iniX;
-                    if(hX<=0)
-                        continue;
-                }
+            cellRects[i*levelCols+j] = Rect_<float>(iniX, iniY, hX, hY);
+            cellValid[i*levelCols+j] = true;
+        }
+    }
 
+    ParallelFor(nCells, [&](size_t c)
+    {
+        if(!cellValid[c])
+            return;
+        const Rect_<float>& r = cellRects[c];
+        vector<KeyPoint>& keysCell = cellKeyPoints[c/levelCols][c%levelCols];
 
-                Mat cellImage = mvImagePyramid[level].rowRange(iniY,iniY+hY).colRange(iniX,iniX+hX);
+        Mat cellImage = mvImagePyramid[level].rowRange(r.y,r.y+r.height).colRange(r.x,r.x+r.width);
 
-//                Mat cellMask;
-//                if(!mvMaskPyramid[level].empty())
-//                    cellMask = cv::Mat(mvMaskPyramid[level],Rect(iniX,iniY,hX,hY));
+//        Mat cellMask;
+//        if(!mvMaskPyramid[level].empty())
+//            cellMask = cv::Mat(mvMaskPyramid[level],Rect(iniX,iniY,hX,hY));
 
-                cellKeyPoints[i][j].reserve(nfeaturesCell*5);
+        keysCell.reserve(nfeaturesCell*5);
 
-                FAST(cellImage,cellKeyPoints[i][j],fastTh,true);
+        FAST(cellImage,keysCell,fastTh,true);
 
-                if(cellKeyPoints[i][j].size()<=3)
-                {
-                    cellKeyPoints[i][j].clear();
+        if(keysCell.size()<=3)
+        {
+            keysCell.clear();
 
-                    FAST(cellImage,cellKeyPoints[i][j],7,true);
-                }
+            FAST(cellImage,keysCell,7,true);
+        }
 
-                if( scoreType == ORB::HARRIS_SCORE )
-                {
-                    // Compute the Harris cornerness
-                    HarrisResponses(cellImage,cellKeyPoints[i][j], 7, HARRIS_K);
-                }
+        if( scoreType == ORB::HARRIS_SCORE )
+        {
+            // Compute the Harris cornerness
+            HarrisResponses(cellImage,keysCell, 7, HARRIS_K);
+        }
+    });
 
-                const int nKeys = cellKeyPoints[i][j].size();
-                nTotal[i][j] = nKeys;
+    for(int i=0; i<levelRows; i++)
+    {
+        for(int j=0; j<levelCols; j++)
+        {
+            if(!cellValid[i*levelCols+j])
+                continue;
 
-                if(nKeys>nfeaturesCell)
-                {
-                    nToRetain[i][j] = nfeaturesCell;
-                    bNoMore[i][j] = false;
-                }
-                else
-                {
-                    nToRetain[i][j] = nKeys;
-                    nToDistribute += nfeaturesCell-nKeys;
-                    bNoMore[i][j] = true;
-                    nNoMore++;
-                }
+            const int nKeys = cellKeyPoints[i][j].size();
+            nTotal[i][j] = nKeys;
 
+            if(nKeys>nfeaturesCell)
+            {
+                nToRetain[i][j] = nfeaturesCell;
+                bNoMore[i][j] = false;
+            }
+            else
+            {
+                nToRetain[i][j] = nKeys;
+                nToDistribute += nfeaturesCell-nKeys;
+                bNoMore[i][j] = true;
+                nNoMore++;
             }
         }
+    }
 
 
-        // Retain by score
+    // Retain by score
 
-        while(nToDistribute>0 && nNoMore<nCells)
-        {
-            int nNewFeaturesCell = nfeaturesCell + ceil((float)nToDistribute/(nCells-nNoMore));
-            nToDistribute = 0;
+    while(nToDistribute>0 && nNoMore<nCells)
+    {
+        int nNewFeaturesCell = nfeaturesCell + ceil((float)nToDistribute/(nCells-nNoMore));
+        nToDistribute = 0;
 
-            for(int i=0; i<levelRows; i++)
+        for(int i=0; i<levelRows; i++)
+        {
+            for(int j=0; j<levelCols; j++)
             {
-                for(int j=0; j<levelCols; j++)
+                if(!bNoMore[i][j])
                 {
-                    if(!bNoMore[i][j])
+                    if(nTotal[i][j]>nNewFeaturesCell)
                     {
-                        if(nTotal[i][j]>nNewFeaturesCell)
-                        {
-                            nToRetain[i][j] = nNewFeaturesCell;
-                            bNoMore[i][j] = false;
-                        }
-                        else
-                        {
-                            nToRetain[i][j] = nTotal[i][j];
-                            nToDistribute += nNewFeaturesCell-nTotal[i][j];
-                            bNoMore[i][j] = true;
-                            nNoMore++;
-                        }
+                        nToRetain[i][j] = nNewFeaturesCell;
+                        bNoMore[i][j] = false;
+                    }
+                    else
+                    {
+                        nToRetain[i][j] = nTotal[i][j];
+                        nToDistribute += nNewFeaturesCell-nTotal[i][j];
+                        bNoMore[i][j] = true;
+                        nNoMore++;
                     }
                 }
             }
         }
+    }
 
-        vector<KeyPoint> & keypoints = allKeypoints[level];
-        keypoints.reserve(nDesiredFeatures*2);
+    keypoints.clear();
+    keypoints.reserve(nDesiredFeatures*2);
 
-        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+    const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
 
-        // Retain by score and transform coordinates
-        for(int i=0; i<levelRows; i++)
+    // Retain by score and transform coordinates
+    for(int i=0; i<levelRows; i++)
+    {
+        for(int j=0; j<levelCols; j++)
         {
-            for(int j=0; j<levelCols; j++)
-            {
-                vector<KeyPoint> &keysCell = cellKeyPoints[i][j];
-                KeyPointsFilter::retainBest(keysCell,nToRetain[i][j]);
-                if((int)keysCell.size()>nToRetain[i][j])
-                    keysCell.resize(nToRetain[i][j]);
+            vector<KeyPoint> &keysCell = cellKeyPoints[i][j];
+            KeyPointsFilter::retainBest(keysCell,nToRetain[i][j]);
+            if((int)keysCell.size()>nToRetain[i][j])
+                keysCell.resize(nToRetain[i][j]);
 
-                for(size_t k=0, kend=keysCell.size(); k<kend; k++)
-                {
-                    keysCell[k].pt.x+=iniXCol[j];
-                    keysCell[k].pt.y+=iniYRow[i];
-                    keysCell[k].octave=level;
-                    keysCell[k].size = scaledPatchSize;
-                    keypoints.push_back(keysCell[k]);
-                }
+            for(size_t k=0, kend=keysCell.size(); k<kend; k++)
+            {
+                keysCell[k].pt.x+=iniXCol[j];
+                keysCell[k].pt.y+=iniYRow[i];
+                keysCell[k].octave=level;
+                keysCell[k].size = scaledPatchSize;
+                keypoints.push_back(keysCell[k]);
             }
         }
-        if((int)keypoints.size()>nDesiredFeatures)
-        {
-            KeyPointsFilter::retainBest(keypoints,nDesiredFeatures);
-            keypoints.resize(nDesiredFeatures);
-        }
+    }
+    if((int)keypoints.size()>nDesiredFeatures)
+    {
+        KeyPointsFilter::retainBest(keypoints,nDesiredFeatures);
+        keypoints.resize(nDesiredFeatures);
     }
 
     // and compute orientations
-    if(!bGAFD){
-        for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
-    }
+    if(!bGAFD)
+        computeOrientation(mvImagePyramid[level], keypoints, umax);
 }
 
 void computeDescriptors(const Mat& image, const vector<KeyPoint>& keypoints, Mat& descriptors,
@@ -964,6 +953,33 @@ void computeDescriptors(const Mat& image, const vector<KeyPoint>& keypoints, Mat
         computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
 }
 
+// number of keypoints described by one task
+static const int DESCRIPTOR_CHUNK = 64;
+
+void ORBextractor::ComputeDescriptors(const Mat& image, const vector<KeyPoint>& keypoints, Mat& descriptors)
+{
+    descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
+
+    const size_t nChunks = (keypoints.size() + DESCRIPTOR_CHUNK - 1)/DESCRIPTOR_CHUNK;
+    ParallelFor(nChunks, [&](size_t c)
+    {
+        const size_t iend = std::min(keypoints.size(), (c+1)*DESCRIPTOR_CHUNK);
+        for (size_t i = c*DESCRIPTOR_CHUNK; i < iend; i++)
+            computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+    });
+}
+
+void ORBextractor::ParallelFor(size_t n, const boost::function<void (size_t)>& task)
+{
+    if(mpThreadPool)
+    {
+        mpThreadPool->ParallelFor(n, task);
+        return;
+    }
+    for(size_t i=0; i<n; ++i)
+        task(i);
+}
+
 void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
                       OutputArray _descriptors)
 { 
@@ -995,7 +1011,21 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     _keypoints.clear();
     _keypoints.reserve(nkeypoints);
 
-    int offset = 0;
+    vector<int> vOffsets(nlevels+1, 0);
+    for (int level = 0; level < nlevels; ++level)
+        vOffsets[level+1] = vOffsets[level] + (int)allKeypoints[level].size();
+
+    // Compute the descriptors, each level fills its own rows
+    ParallelFor(nlevels, [&](size_t level)
+    {
+        if(allKeypoints[level].empty())
+            return;
+        vk::Timer timer;
+        Mat desc = descriptors.rowRange(vOffsets[level], vOffsets[level+1]);
+        ComputeDescriptors(mvBlurredImagePyramid[level], allKeypoints[level], desc);
+        mvLevelTimes[level] += timer.stop();
+    });
+
     for (int level = 0; level < nlevels; ++level)
     {
         vector<KeyPoint>& keypoints = allKeypoints[level];
@@ -1004,15 +1034,6 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
         if(nkeypointsLevel==0)
             continue;
 
-        // preprocess the resized image
-        Mat& workingMat = mvBlurredImagePyramid[level];
-
-        // Compute the descriptors
-        Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-        computeDescriptors(workingMat, keypoints, desc, pattern);
-
-        offset += nkeypointsLevel;
-
         // Scale keypoint coordinates
         if (level != 0)
         {
@@ -1025,69 +1046,27 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
         _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
     }
 }
-// input original keypoints in image vKeys, output undistorted keypoints vKeysUn
-void UndistortKeyPoints(const std::vector<cv::KeyPoint>& vKeys, std::vector<cv::KeyPoint>& vKeysUn,
-                               const cv::Mat & K, const cv::Mat & distCoef)
-{
-    if(distCoef.at<float>(0)==0.0)
-    {
-        vKeysUn=vKeys;
-        return;
-    }
-
-    // Fill matrix with points
-    cv::Mat mat(vKeys.size(),2,CV_32F);
-    for(unsigned int i=0; i<vKeys.size(); i++)
-    {
-        mat.at<float>(i,0)=vKeys[i].pt.x;
-        mat.at<float>(i,1)=vKeys[i].pt.y;
-    }
-
-    // Undistort points
-    mat=mat.reshape(2);
-
-    cv::undistortPoints(mat,mat,K,distCoef,cv::Mat(),K);
-    mat=mat.reshape(1);
-    // Fill undistorted keypoint vector
-    vKeysUn.resize(vKeys.size());
-    for(unsigned int i=0; i<vKeys.size(); i++)
-    {
-        cv::KeyPoint kp = vKeys[i];
-        kp.pt.x=mat.at<float>(i,0);
-        kp.pt.y=mat.at<float>(i,1);
-        vKeysUn[i]=kp;
-    }
-}
-
 //assign gravity aligned orientation (GAO) angle to both keys and undistorted keys
 // This function works for points close to image border
 //input: vKeysUn stores already undistorted keypoints
 // output: vKeys and vKeyUn stores GAO
 void computeKeyPointGAO(std::vector< cv::KeyPoint>& vKeys, std::vector< cv::KeyPoint>& vKeysUn,
-                        const cv::Mat& K, const cv::Mat& distCoef, Eigen::Vector3d ginc){
+                        const vk::PinholeCamera& cam, Eigen::Vector3d ginc){
 
     ginc.normalize();
-    cv::Mat norm_point(1,3,CV_32F), distort_point(1,2, CV_32F);
-    float fx=K.at<float>(0,0), cx=K.at<float>(0,2),
-            fy=K.at<float>(1,1), cy=K.at<float>(1,2);
-    float factor=max(fx*ginc(0)+ cx*ginc(2), fy*ginc(1)+ cy*ginc(2));
-    cv::Mat rvec=cv::Mat::zeros(3,1, CV_32F);//dummy
-    cv::Mat tvec=cv::Mat::zeros(3,1, CV_32F);
+    const double fx=cam.fx(), cx=cam.cx(), fy=cam.fy(), cy=cam.cy();
+    const double factor=max(fx*ginc(0)+ cx*ginc(2), fy*ginc(1)+ cy*ginc(2));
+    const Eigen::Vector3d temp=ginc*2/factor; // how many pixel from p we expect p' to move
     int jade=0;
     for (vector<cv::KeyPoint>::iterator keypoint = vKeys.begin(),
          keypointEnd = vKeys.end(); keypoint != keypointEnd; ++keypoint, ++jade)
     {
-        norm_point.at<float>(0)=( vKeysUn[jade].pt.x- cx)/ fx;
-        norm_point.at<float>(1)=( vKeysUn[jade].pt.y- cy)/ fy;
-        norm_point.at<float>(2)=1;
-        Eigen::Vector3d temp=ginc*2/factor; // how many pixel from p we expect p' to move
-        norm_point.at<float>(0)+=temp[0];
-        norm_point.at<float>(1)+=temp[1];
-        norm_point.at<float>(2)+=temp[2];
-        cv::projectPoints(norm_point, rvec, tvec, K, distCoef, distort_point);
-        //cout<<"Distorted :"<< distort_point<<endl;
-        keypoint->angle = atan2(distort_point.at<float>(1)-keypoint->pt.y,
-                                distort_point.at<float>(0)-keypoint->pt.x);
+        Eigen::Vector3d norm_point(( vKeysUn[jade].pt.x- cx)/ fx, ( vKeysUn[jade].pt.y- cy)/ fy, 1);
+        norm_point+=temp;
+        // project with distortion as cv::projectPoints, without its matrices per keypoint
+        const Eigen::Vector2d distort_point=cam.world2cam(norm_point);
+        keypoint->angle = atan2(distort_point[1]-keypoint->pt.y,
+                                distort_point[0]-keypoint->pt.x);
         vKeysUn[jade].angle = keypoint->angle;
 //        cout<<"GAO angle:"<< keypoint->angle<<endl;
     }
@@ -1096,7 +1075,7 @@ void computeKeyPointGAO(std::vector< cv::KeyPoint>& vKeys, std::vector< cv::KeyP
 void ORBextractor::operator()(InputArray _image,cv::InputArray mask,
   std::vector<cv::KeyPoint>& _keypoints,  cv::OutputArray _descriptors,
   std::vector<cv::KeyPoint>& _keypointsUn,
-  const cv::Mat & K, const cv::Mat & distCoef, const Eigen::Vector3d& ginc)
+  const vk::PinholeCamera& cam, const Eigen::Vector3d& ginc)
 {
     if(_image.empty())
         return;
@@ -1138,8 +1117,8 @@ void ORBextractor::operator()(InputArray _image,cv::InputArray mask,
 
     //for all keypoints, undistort and compute orientation
 
-    UndistortKeyPoints( _keypoints, _keypointsUn, K, distCoef);
-    computeKeyPointGAO(_keypoints, _keypointsUn, K, distCoef, ginc);
+    cam.undistortKeyPoints(_keypoints, _keypointsUn);
+    computeKeyPointGAO(_keypoints, _keypointsUn, cam, ginc);
     offset = 0;
     for (int level = 0; level < nlevels; ++level)
     {
@@ -1165,23 +1144,20 @@ void ORBextractor::operator()(InputArray _image,cv::InputArray mask,
         descriptors = _descriptors.getMat();
     }
 
-    offset = 0;
+    vector<int> vOffsets(nlevels+1, 0);
     for (int level = 0; level < nlevels; ++level)
-    {
-        vector<KeyPoint>& keypoints = allKeypoints[level];
-        int nkeypointsLevel = (int)keypoints.size();
-
-        if(nkeypointsLevel==0)
-            continue;
+        vOffsets[level+1] = vOffsets[level] + (int)allKeypoints[level].size();
 
-        // preprocess the resized image
-        Mat& workingMat = mvImagePyramid[level];   
-        // Compute the descriptors
-        Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-        computeDescriptors(workingMat, keypoints, desc, pattern);
-
-        offset += nkeypointsLevel;   
-    }
+    // Compute the descriptors on the unblurred levels, each level fills its own rows
+    ParallelFor(nlevels, [&](size_t level)
+    {
+        if(allKeypoints[level].empty())
+            return;
+        vk::Timer timer;
+        Mat desc = descriptors.rowRange(vOffsets[level], vOffsets[level+1]);
+        ComputeDescriptors(mvImagePyramid[level], allKeypoints[level], desc);
+        mvLevelTimes[level] += timer.stop();
+    });
 }
 // bGAFD if true gravity aligned feature direction provided, this function only works for one pyramid level
 void ORBextractor::operator()( InputArray _image, vector<KeyPoint>& _keypoints,
@@ -1189,18 +1165,18 @@ void ORBextractor::operator()( InputArray _image, vector<KeyPoint>& _keypoints,
 {
     if(_image.empty())
         return;
-    if(!bGAFD){// compute orientation
-        for (vector<KeyPoint>::iterator keypoint = _keypoints.begin(),
-             keypointEnd = _keypoints.end(); keypoint != keypointEnd; ++keypoint)
-        {
-            Mat image = _image.getMat();
-            keypoint->angle = IC_Angle(image, keypoint->pt, umax);
-        }
-    }
     Mat image = _image.getMat();
     assert(image.type() == CV_8UC1 );
-    // Pre-compute the scale pyramids
-    ComputePyramid(image);
+    ImagePyramid pyramid = CreatePyramid(image);
+    (*this)(pyramid, _keypoints, _descriptors, bGAFD);
+}
+// only the blurred level 0 is needed, the other levels of the pyramid are left for its other consumers
+void ORBextractor::operator()(ImagePyramid& pyramid, vector<KeyPoint>& _keypoints,
+                              OutputArray _descriptors, bool bGAFD)
+{
+    if(pyramid.empty())
+        return;
+    const Mat& image = pyramid.GetImage();
     Mat descriptors;
     int nkeypoints = _keypoints.size();
     if( nkeypoints == 0 )
@@ -1211,17 +1187,30 @@ void ORBextractor::operator()( InputArray _image, vector<KeyPoint>& _keypoints,
         descriptors = _descriptors.getMat();
     }
     // preprocess the resized image
-    Mat& workingMat = mvBlurredImagePyramid[0];
+    mvLevelTimes.assign(nlevels, 0.0);
+    vk::Timer timer;
+    const Mat& workingMat = pyramid.GetBlurredLevel(0);
 
-    // Compute the descriptors
+    // Compute the orientations and descriptors in chunks of keypoints
     descriptors = Mat::zeros((int)_keypoints.size(), 32, CV_8UC1);
-    for (size_t i = 0; i < _keypoints.size(); i++){
-        if(_keypoints[i].size==0){ //FAQ: is it possible some keypoints in libviso2 do not have ORB descriptor?
-            cerr<<"Some keypoint has zero size in ORB extractor!"<<endl;
-            continue;
+    vector<int> vnZeroSize((_keypoints.size() + DESCRIPTOR_CHUNK - 1)/DESCRIPTOR_CHUNK, 0);
+    ParallelFor(vnZeroSize.size(), [&](size_t c)
+    {
+        const size_t iend = std::min(_keypoints.size(), (c+1)*DESCRIPTOR_CHUNK);
+        for (size_t i = c*DESCRIPTOR_CHUNK; i < iend; i++){
+            if(!bGAFD)// compute orientation
+                _keypoints[i].angle = IC_Angle(image, _keypoints[i].pt, umax);
+            if(_keypoints[i].size==0){ //FAQ: is it possible some keypoints in libviso2 do not have ORB descriptor?
+                ++vnZeroSize[c];
+                continue;
+            }
+            computeOrbDescriptor(_keypoints[i], workingMat, &pattern[0], descriptors.ptr((int)i));
         }
-        computeOrbDescriptor(_keypoints[i], workingMat, &pattern[0], descriptors.ptr((int)i));
-    }
+    });
+    mvLevelTimes[0] += timer.stop();
+    for (size_t c = 0; c < vnZeroSize.size(); ++c)
+        for (int i = 0; i < vnZeroSize[c]; ++i)
+            cerr<<"Some keypoint has zero size in ORB extractor!"<<endl;
 }
 void ORBextractor::ClonePyramid(std::vector<cv::Mat> & vImagePyramid)
 {
@@ -1234,53 +1223,33 @@ void ORBextractor::ClonePyramid(std::vector<cv::Mat> & vImagePyramid)
 
 void ORBextractor::ComputePyramid(cv::Mat image)
 {
+    ImagePyramid pyramid = CreatePyramid(image);
+    ComputePyramid(pyramid);
+}
+
+void ORBextractor::ComputePyramid(ImagePyramid& pyramid)
+{
+    // every level is resized from the previous one, so only blurring runs in parallel
+    pyramid.GetLevel(nlevels-1);
     mvImagePyramid.resize(nlevels);
     mvBlurredImagePyramid.resize(nlevels);
     for (int level = 0; level < nlevels; ++level)
-    {
-        float scale = mvInvScaleFactor[level];
-        Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
-        Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-        Mat temp(wholeSize, image.type());
-        mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
+        mvImagePyramid[level] = pyramid.GetLevel(level);
 
-//        Mat masktemp;
-//        if( !Mask.empty() )
-//        {
-//            masktemp = Mat(wholeSize, Mask.type());
-//            mvMaskPyramid[level] = masktemp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
-//        }
-
-        // Compute the resized image
-        if( level != 0 )
-        {
-            resize(mvImagePyramid[level-1], mvImagePyramid[level], sz, 0, 0, INTER_LINEAR);
-//            if (!Mask.empty())
-//            {
-//                resize(mvMaskPyramid[level-1], mvMaskPyramid[level], sz, 0, 0, INTER_NEAREST);
-//            }
-
-            copyMakeBorder(mvImagePyramid[level], temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-                           BORDER_REFLECT_101+BORDER_ISOLATED);
-//            if (!Mask.empty())
-//                copyMakeBorder(mvMaskPyramid[level], masktemp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-//                               BORDER_CONSTANT+BORDER_ISOLATED);
-        }
-        else
-        {
-            copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-                           BORDER_REFLECT_101);
-//            if( !Mask.empty() )
-//                copyMakeBorder(Mask, masktemp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-//                               BORDER_CONSTANT+BORDER_ISOLATED);
-        }
-        // preprocess the resized image
-        mvBlurredImagePyramid[level] = mvImagePyramid[level].clone();
-        GaussianBlur(mvBlurredImagePyramid[level], mvBlurredImagePyramid[level],
-                     Size(7, 7), 2, 2, BORDER_REFLECT_101);
+    mvLevelTimes.assign(nlevels, 0.0);
+    ParallelFor(nlevels, [&](size_t level)
+    {
+        vk::Timer timer;
+        mvBlurredImagePyramid[level] = pyramid.GetBlurredLevel(level);
+        mvLevelTimes[level] += timer.stop();
+    });
+}
 
-    }  
+ImagePyramid ORBextractor::CreatePyramid(const cv::Mat& image) const
+{
+    return ImagePyramid(image, mvInvScaleFactor, EDGE_THRESHOLD);
 }
+
 void ORBextractor::ComputePyramid(const cv::Mat & image,   std::vector<cv::Mat>& vImagePyramid )
 {
     vImagePyramid.resize(nlevels);
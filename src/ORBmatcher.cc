@@ -52,6 +52,8 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
 
     const bool bFactor = th!=1.0;
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
     {
         MapPoint* pMP = vpMapPoints[iMP];
@@ -72,6 +74,13 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
         vector<size_t> vNearIndices =
                 F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.GetScaleFactor(nPredictedLevel),nPredictedLevel-1,nPredictedLevel);
 
+        // Only keypoints without a MapPoint are candidates, and only their distances are computed
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vNearIndices.size(); k<kend; k++)
+            if(!F.mvpMapPoints[vNearIndices[k]])
+                vNearIndices[nCandidates++]=vNearIndices[k];
+        vNearIndices.resize(nCandidates);
+
         if(vNearIndices.empty())
             continue;
 
@@ -83,17 +92,14 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
         int bestLevel2 = -1;
         int bestIdx =-1 ;
 
+        DescriptorDistances(MPdescriptor, F.mDescriptors, vNearIndices, vDists, vpRows);
+
         // Get best and second matches with near keypoints
-        for(vector<size_t>::iterator vit=vNearIndices.begin(), vend=vNearIndices.end(); vit!=vend; vit++)
+        for(size_t k=0, kend=vNearIndices.size(); k<kend; k++)
         {
-            size_t idx = *vit;
-
-            if(F.mvpMapPoints[idx])
-                continue;
-
-            cv::Mat d=F.mDescriptors.row(idx);
+            size_t idx = vNearIndices[k];
 
-            const int dist = DescriptorDistance(MPdescriptor,d);
+            const int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -197,6 +203,8 @@ int ORBmatcher::SearchByProjectionStereo(Frame &F, const vector<MapPoint*> &vpMa
 
     const bool bFactor = th!=1.0;
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
     {
         MapPoint* pMP = vpMapPoints[iMP];
@@ -217,6 +225,13 @@ int ORBmatcher::SearchByProjectionStereo(Frame &F, const vector<MapPoint*> &vpMa
         vector<size_t> vNearIndices =
                 F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.GetScaleFactor(nPredictedLevel),nPredictedLevel-1,nPredictedLevel);
 
+        // Only keypoints without a MapPoint are candidates, and only their distances are computed
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vNearIndices.size(); k<kend; k++)
+            if(!F.mvpMapPoints[vNearIndices[k]])
+                vNearIndices[nCandidates++]=vNearIndices[k];
+        vNearIndices.resize(nCandidates);
+
         if(vNearIndices.empty())
             continue;
 
@@ -228,17 +243,14 @@ int ORBmatcher::SearchByProjectionStereo(Frame &F, const vector<MapPoint*> &vpMa
         int bestLevel2 = -1;
         int bestIdx =-1 ;
 
+        DescriptorDistances(MPdescriptor, F.mDescriptors, vNearIndices, vDists, vpRows);
+
         // Get best and second matches with near keypoints for the left image
-        for(vector<size_t>::iterator vit=vNearIndices.begin(), vend=vNearIndices.end(); vit!=vend; vit++)
+        for(size_t k=0, kend=vNearIndices.size(); k<kend; k++)
         {
-            size_t idx = *vit;
-
-            if(F.mvpMapPoints[idx])
-                continue;
-
-            cv::Mat d=F.mDescriptors.row(idx);
+            size_t idx = vNearIndices[k];
 
-            const int dist = DescriptorDistance(MPdescriptor,d);
+            const int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -262,15 +274,12 @@ int ORBmatcher::SearchByProjectionStereo(Frame &F, const vector<MapPoint*> &vpMa
 
         // Get best and second matches with near keypoints for the right image,
         // here we assume features in the right image is already matched to the left image
-        for(vector<size_t>::iterator vit=vNearIndices.begin(), vend=vNearIndices.end(); vit!=vend; vit++)
+        DescriptorDistances(MPdescriptor, F.mRightDescriptors, vNearIndices, vDists, vpRows);
+        for(size_t k=0, kend=vNearIndices.size(); k<kend; k++)
         {
-            size_t idx = *vit;
-            if(F.mvpMapPoints[idx])
-                continue;
-
-            cv::Mat d=F.mRightDescriptors.row(idx);
+            size_t idx = vNearIndices[k];
 
-            const int dist = DescriptorDistance(MPdescriptor,d);
+            const int dist = vDists[k];
 
             if(dist<bestRightDist)
             {
@@ -350,6 +359,10 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     DBoW2::FeatureVector::iterator KFend = vFeatVecKF.end();
     DBoW2::FeatureVector::iterator Fend = F.mFeatVec.end();
 
+    vector<unsigned int> vCandidatesF; // the ORB of the same node in the frame not matched yet
+    vector<int> vDists; // their distances
+    vector<const unsigned char*> vpRows; // their rows
+
     while(KFit != KFend && Fit != Fend)
     {
         if(KFit->first == Fit->first)
@@ -375,16 +388,19 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 int bestIdxF =-1 ;
                 int bestDist2=INT_MAX;
 
+                // Only keypoints not matched yet are candidates
+                vCandidatesF.clear();
                 for(size_t iF=0, iendF=vIndicesF.size(); iF<iendF; iF++)
-                {
-                    const unsigned int realIdxF = vIndicesF[iF];
+                    if(!vpMapPointMatches[vIndicesF[iF]])
+                        vCandidatesF.push_back(vIndicesF[iF]);
 
-                    if(vpMapPointMatches[realIdxF])
-                        continue;
+                DescriptorDistances(dKF, F.mDescriptors, vCandidatesF, vDists, vpRows);
 
-                    cv::Mat dF = F.mDescriptors.row(realIdxF).clone();
+                for(size_t iF=0, iendF=vCandidatesF.size(); iF<iendF; iF++)
+                {
+                    const unsigned int realIdxF = vCandidatesF[iF];
 
-                    const int dist =  DescriptorDistance(dKF,dF);
+                    const int dist = vDists[iF];
 
                     if(dist<bestDist1)
                     {
@@ -595,6 +611,8 @@ int ORBmatcher::WindowSearch(Frame &F1, Frame &F2, int windowSize, vector<MapPoi
     const bool bMinLevel = minScaleLevel>0;
     const bool bMaxLevel= maxScaleLevel<INT_MAX;
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t i1=0, iend1=F1.mvpMapPoints.size(); i1<iend1; i1++)
     {
         MapPoint* pMP1 = F1.mvpMapPoints[i1];
@@ -617,6 +635,13 @@ int ORBmatcher::WindowSearch(Frame &F1, Frame &F2, int windowSize, vector<MapPoi
 
         vector<size_t> vIndices2 = F2.GetFeaturesInArea(kp1.pt.x,kp1.pt.y, windowSize, level1, level1);
 
+        // Only keypoints not matched yet are candidates
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+            if(!vpMapPointMatches2[vIndices2[k]])
+                vIndices2[nCandidates++]=vIndices2[k];
+        vIndices2.resize(nCandidates);
+
         if(vIndices2.empty())
             continue;
 
@@ -626,16 +651,13 @@ int ORBmatcher::WindowSearch(Frame &F1, Frame &F2, int windowSize, vector<MapPoi
         int bestDist2 = INT_MAX;
         int bestIdx2 = -1;
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
-        {
-            size_t i2 = *vit;
-
-            if(vpMapPointMatches2[i2])
-                continue;
+        DescriptorDistances(d1, F2.mDescriptors, vIndices2, vDists, vpRows);
 
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+        for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+        {
+            size_t i2 = vIndices2[k];
 
-            int dist = DescriptorDistance(d1,d2);
+            int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -701,6 +723,8 @@ int ORBmatcher::SearchByProjection(Frame &F1, Frame &F2, int windowSize, vector<
     const Eigen::Matrix3d Rc2w = F2.mTcw.rotationMatrix();
     const Eigen::Vector3d tc2w = F2.mTcw.translation();
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t i1=0, iend1=F1.mvpMapPoints.size(); i1<iend1; i1++)
     {
         MapPoint* pMP1 = F1.mvpMapPoints[i1];
@@ -725,6 +749,13 @@ int ORBmatcher::SearchByProjection(Frame &F1, Frame &F2, int windowSize, vector<
 
         vector<size_t> vIndices2 = F2.GetFeaturesInArea(u2,v2, windowSize, level1, level1);
 
+        // Only keypoints not matched yet are candidates
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+            if(!vpMapPointMatches2[vIndices2[k]])
+                vIndices2[nCandidates++]=vIndices2[k];
+        vIndices2.resize(nCandidates);
+
         if(vIndices2.empty())
             continue;
 
@@ -735,16 +766,13 @@ int ORBmatcher::SearchByProjection(Frame &F1, Frame &F2, int windowSize, vector<
         int bestIdx2 = -1;
 
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
-        {
-            size_t i2 = *vit;
+        DescriptorDistances(d1, F2.mDescriptors, vIndices2, vDists, vpRows);
 
-            if(vpMapPointMatches2[i2])
-                continue;
-
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+        for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+        {
+            size_t i2 = vIndices2[k];
 
-            int dist = DescriptorDistance(d1,d2);
+            int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -784,6 +812,8 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2,
     vector<int> vMatchedDistance(F2.mvKeysUn.size(),INT_MAX);
     vector<int> vnMatches21(F2.mvKeysUn.size(),-1);
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t i1=0, iend1=F1.mvKeysUn.size(); i1<iend1; i1++)
     {
         cv::KeyPoint kp1 = F1.mvKeysUn[i1];
@@ -802,13 +832,13 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2,
         int bestDist2 = INT_MAX;
         int bestIdx2 = -1;
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
-        {
-            size_t i2 = *vit;
+        DescriptorDistances(d1, F2.mDescriptors, vIndices2, vDists, vpRows);
 
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+        for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+        {
+            size_t i2 = vIndices2[k];
 
-            int dist = DescriptorDistance(d1,d2);
+            int dist = vDists[k];
 
             if(vMatchedDistance[i2]<=dist)
                 continue;
@@ -917,6 +947,10 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     DBoW2::FeatureVector::iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::iterator f2end = vFeatVec2.end();
 
+    vector<size_t> vCandidates2; // the ORB of the same node in KF2 that can still be matched
+    vector<int> vDists; // their distances
+    vector<const unsigned char*> vpRows; // their rows
+
     while(f1it != f1end && f2it != f2end)
         {
             if(f1it->first == f2it->first)
@@ -937,21 +971,23 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                     int bestIdx2 =-1 ;
                     int bestDist2=INT_MAX;
 
+                    // Only keypoints of good MapPoints not matched yet are candidates
+                    vCandidates2.clear();
                     for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                     {
                         size_t idx2 = f2it->second[i2];
-
                         MapPoint* pMP2 = vpMapPoints2[idx2];
+                        if(!vbMatched2[idx2] && pMP2 && !pMP2->isBad())
+                            vCandidates2.push_back(idx2);
+                    }
 
-                        if(vbMatched2[idx2] || !pMP2)
-                            continue;
-
-                        if(pMP2->isBad())
-                            continue;
+                    DescriptorDistances(d1, Descriptors2, vCandidates2, vDists, vpRows);
 
-                        cv::Mat d2 = Descriptors2.row(idx2);
+                    for(size_t i2=0, iend2=vCandidates2.size(); i2<iend2; i2++)
+                    {
+                        size_t idx2 = vCandidates2[i2];
 
-                        int dist = DescriptorDistance(d1,d2);
+                        int dist = vDists[i2];
 
                         if(dist<bestDist1)
                         {
@@ -1172,6 +1208,10 @@ vector<cv::KeyPoint> &vMatchedKeys1, vector<cv::KeyPoint> &vMatchedKeys2, vector
     DBoW2::FeatureVector::iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::iterator f2end = vFeatVec2.end();
 
+    vector<size_t> vCandidates2; // the ORB of the same node in KF2 that can still be matched
+    vector<int> vDists; // their distances
+    vector<const unsigned char*> vpRows; // their rows
+
     while(f1it!=f1end && f2it!=f2end)
     {
         if(f1it->first == f2it->first)
@@ -1192,19 +1232,22 @@ vector<cv::KeyPoint> &vMatchedKeys1, vector<cv::KeyPoint> &vMatchedKeys2, vector
 
                 vector<pair<int,size_t> > vDistIndex;
 
+                // Only keypoints without a MapPoint and not matched yet are candidates
+                vCandidates2.clear();
                 for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                 {
                     size_t idx2 = f2it->second[i2];
+                    if(!vbMatched2[idx2] && !vpMapPoints2[idx2])
+                        vCandidates2.push_back(idx2);
+                }
 
-                    MapPoint* pMP2 = vpMapPoints2[idx2];
-
-                    // If we have already matched or there is a MapPoint skip
-                    if(vbMatched2[idx2] || pMP2)
-                        continue;
+                DescriptorDistances(d1, Descriptors2, vCandidates2, vDists, vpRows);
 
-                    cv::Mat d2 = Descriptors2.row(idx2);
+                for(size_t i2=0, iend2=vCandidates2.size(); i2<iend2; i2++)
+                {
+                    size_t idx2 = vCandidates2[i2];
 
-                    const int dist = DescriptorDistance(d1,d2);
+                    const int dist = vDists[i2];
 
                     if(dist>TH_LOW)
                         continue;
@@ -1305,6 +1348,14 @@ vector<cv::KeyPoint> &vMatchedKeys1, vector<cv::KeyPoint> &vMatchedKeys2, vector
 }
 
 int ORBmatcher::Fuse(KeyFrame *pKF, vector<MapPoint *> &vpMapPoints, float th)
+{
+    vector<pair<MapPoint*, size_t> > vFusions;
+    SearchForFusion(pKF, vpMapPoints, vFusions, th);
+    return ApplyFusions(pKF, vFusions);
+}
+
+int ORBmatcher::SearchForFusion(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                                vector<pair<MapPoint*, size_t> > &vFusions, float th) const
 {
     Eigen::Matrix3d Rcw = pKF->GetRotation();
     Eigen::Vector3d tcw = pKF->GetTranslation();
@@ -1319,7 +1370,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, vector<MapPoint *> &vpMapPoints, float th)
 
     Eigen::Vector3d Ow = pKF->GetCameraCenter();
 
-    int nFused=0;
+    int nFound=0;
 
     for(size_t i=0; i<vpMapPoints.size(); i++)
     {
@@ -1403,27 +1454,44 @@ int ORBmatcher::Fuse(KeyFrame *pKF, vector<MapPoint *> &vpMapPoints, float th)
             }
         }
 
+        if(bestDist<=TH_LOW)
+        {
+            vFusions.push_back(make_pair(pMP, (size_t)bestIdx));
+            nFound++;
+        }
+    }
+
+    return nFound;
+}
+
+int ORBmatcher::ApplyFusions(KeyFrame *pKF, const vector<pair<MapPoint*, size_t> > &vFusions)
+{
+    int nFused=0;
+
+    for(size_t i=0; i<vFusions.size(); i++)
+    {
+        MapPoint* pMP = vFusions[i].first;
+        const size_t bestIdx = vFusions[i].second;
+
+        // this point may be bad already, or have been fused into pKF by an earlier fusion
+        if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
+            continue;
+
         // If there is already a MapPoint replace otherwise add new measurement
-        if(bestDist<=TH_LOW && !(pMP->isBad())) // this point may be bad already
+        MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
+        if(pMPinKF)
         {
-            MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
-            if(pMPinKF)
-            {
-                if(!pMPinKF->isBad())
-                    pMP->Replace(pMPinKF);                
-            }
-            else
-            {
-          
-                pMP->AddObservation(pKF,bestIdx);
+            if(!pMPinKF->isBad())
+                pMP->Replace(pMPinKF);
+        }
+        else
+        {
+            pMP->AddObservation(pKF,bestIdx);
 #ifndef MONO
-                pMP->AddObservation(pKF,bestIdx, false);
+            pMP->AddObservation(pKF,bestIdx, false);
 #endif
-                pKF->AddMapPoint(pMP,bestIdx);
-
-            }
-            nFused++;
         }
+        nFused++;
     }
 
     return nFused;
@@ -1548,12 +1616,10 @@ int ORBmatcher::Fuse(KeyFrame *pKF, g2o::Sim3 Scw, const vector<MapPoint *> &vpP
             }
             else
             {
-            
                 pMP->AddObservation(pKF,bestIdx);
 #ifndef MONO
                 pMP->AddObservation(pKF,bestIdx, false);
 #endif
-                pKF->AddMapPoint(pMP,bestIdx);
 
             }
             nFused++;
@@ -1589,12 +1655,16 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     vector<float> vfScaleFactors1 = pKF1->GetScaleFactors();
 
     vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
+    vector<cv::KeyPoint> vKeysUn1 = pKF1->GetKeyPointsUn();
+    cv::Mat Descriptors1 = pKF1->GetDescriptors();
     const int N1 = vpMapPoints1.size();
 
     const int nMaxLevel2 = pKF2->GetScaleLevels()-1;
     vector<float> vfScaleFactors2 = pKF2->GetScaleFactors();
 
     vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
+    vector<cv::KeyPoint> vKeysUn2 = pKF2->GetKeyPointsUn();
+    cv::Mat Descriptors2 = pKF2->GetDescriptors();
     const int N2 = vpMapPoints2.size();
 
     vector<bool> vbAlreadyMatched1(N1,false);
@@ -1615,6 +1685,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     vector<int> vnMatch1(N1,-1);
     vector<int> vnMatch2(N2,-1);
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
+
     // Transform from KF1 to KF2 and search
     for(int i1=0; i1<N1; i1++)
     {
@@ -1664,6 +1737,16 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         vector<size_t> vIndices = pKF2->GetFeaturesInArea(u,v,radius);
 
+        // Only keypoints at the predicted octave or the one below are candidates
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vIndices.size(); k<kend; k++)
+        {
+            const int octave = vKeysUn2[vIndices[k]].octave;
+            if(octave>=nPredictedLevel-1 && octave<=nPredictedLevel)
+                vIndices[nCandidates++]=vIndices[k];
+        }
+        vIndices.resize(nCandidates);
+
         if(vIndices.empty())
             continue;
 
@@ -1672,18 +1755,12 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
-        for(vector<size_t>::iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+        DescriptorDistances(dMP, Descriptors2, vIndices, vDists, vpRows);
+        for(size_t k=0, kend=vIndices.size(); k<kend; k++)
         {
-            size_t idx = *vit;
+            size_t idx = vIndices[k];
 
-            cv::KeyPoint kp = pKF2->GetKeyPointUn(idx);
-
-            if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
-                continue;
-
-            cv::Mat dKF = pKF2->GetDescriptor(idx);
-
-            int dist = DescriptorDistance(dMP,dKF);
+            int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -1747,6 +1824,16 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         vector<size_t> vIndices = pKF1->GetFeaturesInArea(u,v,radius);
 
+        // Only keypoints at the predicted octave or the one below are candidates
+        size_t nCandidates=0;
+        for(size_t k=0, kend=vIndices.size(); k<kend; k++)
+        {
+            const int octave = vKeysUn1[vIndices[k]].octave;
+            if(octave>=nPredictedLevel-1 && octave<=nPredictedLevel)
+                vIndices[nCandidates++]=vIndices[k];
+        }
+        vIndices.resize(nCandidates);
+
         if(vIndices.empty())
             continue;
 
@@ -1755,18 +1842,12 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
-        for(vector<size_t>::iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+        DescriptorDistances(dMP, Descriptors1, vIndices, vDists, vpRows);
+        for(size_t k=0, kend=vIndices.size(); k<kend; k++)
         {
-            size_t idx = *vit;
+            size_t idx = vIndices[k];
 
-            cv::KeyPoint kp = pKF1->GetKeyPointUn(idx);
-
-            if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
-                continue;
-
-            cv::Mat dKF = pKF1->GetDescriptor(idx);
-
-            int dist = DescriptorDistance(dMP,dKF);
+            int dist = vDists[k];
 
             if(dist<bestDist)
             {
@@ -1815,6 +1896,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     const Eigen::Matrix3d Rcw = CurrentFrame.mTcw.rotationMatrix();
     const Eigen::Vector3d tcw = CurrentFrame.mTcw.translation();
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t i=0, iend=LastFrame.mvpMapPoints.size(); i<iend; i++)
     {
         MapPoint* pMP = LastFrame.mvpMapPoints[i];
@@ -1846,6 +1929,13 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
 
                 vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nPredictedOctave-1, nPredictedOctave+1);
 
+                // Only keypoints without a MapPoint are candidates
+                size_t nCandidates=0;
+                for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+                    if(!CurrentFrame.mvpMapPoints[vIndices2[k]])
+                        vIndices2[nCandidates++]=vIndices2[k];
+                vIndices2.resize(nCandidates);
+
                 if(vIndices2.empty())
                     continue;
 
@@ -1854,15 +1944,13 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 int bestDist = INT_MAX;
                 int bestIdx2 = -1;
 
-                for(vector<size_t>::iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
-                {
-                    size_t i2 = *vit;
-                    if(CurrentFrame.mvpMapPoints[i2])
-                        continue;
+                DescriptorDistances(dMP, CurrentFrame.mDescriptors, vIndices2, vDists, vpRows);
 
-                    cv::Mat d = CurrentFrame.mDescriptors.row(i2);
+                for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+                {
+                    size_t i2 = vIndices2[k];
 
-                    int dist = DescriptorDistance(dMP,d);
+                    int dist = vDists[k];
 
                     if(dist<bestDist)
                     {
@@ -1933,6 +2021,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
     vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
+    vector<int> vDists; // distances to the candidates of each point, reused for all the points
+    vector<const unsigned char*> vpRows; // their rows
     for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
     {
         MapPoint* pMP = vpMPs[i];
@@ -1971,6 +2061,13 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
                 vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1);
 
+                // Only keypoints without a MapPoint are candidates
+                size_t nCandidates=0;
+                for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+                    if(!CurrentFrame.mvpMapPoints[vIndices2[k]])
+                        vIndices2[nCandidates++]=vIndices2[k];
+                vIndices2.resize(nCandidates);
+
                 if(vIndices2.empty())
                     continue;
 
@@ -1979,15 +2076,13 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                 int bestDist = INT_MAX;
                 int bestIdx2 = -1;
 
-                for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
-                {
-                    size_t i2 = *vit;
-                    if(CurrentFrame.mvpMapPoints[i2])
-                        continue;
+                DescriptorDistances(dMP, CurrentFrame.mDescriptors, vIndices2, vDists, vpRows);
 
-                    cv::Mat d = CurrentFrame.mDescriptors.row(i2);
+                for(size_t k=0, kend=vIndices2.size(); k<kend; k++)
+                {
+                    size_t i2 = vIndices2[k];
 
-                    int dist = DescriptorDistance(dMP,d);
+                    int dist = vDists[k];
 
                     if(dist<bestDist)
                     {
@@ -2087,24 +2182,17 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 }
 
 
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// Dispatched to the fastest popcount kernel supported by the CPU, see HammingDistance.cpp
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
 {
-    const int *pa = a.ptr<int32_t>();
-    const int *pb = b.ptr<int32_t>();
-
-    int dist=0;
-
-    for(int i=0; i<8; i++, pa++, pb++)
-    {
-        unsigned  int v = *pa ^ *pb;
-        v = v - ((v >> 1) & 0x55555555);
-        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-    }
+    return HammingDistance::Distance(a.ptr<unsigned char>(), b.ptr<unsigned char>());
+}
 
-    return dist;
+void ORBmatcher::DescriptorDistances(const cv::Mat &a, const cv::Mat &B, std::vector<int> &vDists)
+{
+    vDists.resize(B.rows);
+    if(!vDists.empty())
+        HammingDistance::Distances(a.ptr<unsigned char>(), B.ptr<unsigned char>(), B.step[0], B.rows, &vDists[0]);
 }
 
 } //namespace ORB_SLAM
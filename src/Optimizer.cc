@@ -100,16 +100,17 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        MapPointObservations observations;
+        pMP->GetObservations(observations);
 
         //SET EDGES
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
         {
-            KeyFrame* pKF = mit->first;
-            if(pKF->isBad())
+            KeyFrame* pKF = it->pKF;
+            if(it->nLeft<0 || pKF->isBad())
                 continue;
             Eigen::Matrix<double,2,1> obs;
-            cv::KeyPoint kpUn = pKF->GetKeyPointUn(mit->second);
+            cv::KeyPoint kpUn = pKF->GetKeyPointUn(it->nLeft);
             obs << kpUn.pt.x, kpUn.pt.y;
 
             vio::EdgeSE3ProjectXYZ* e = new vio::EdgeSE3ProjectXYZ();
@@ -336,10 +337,13 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag)
     list<KeyFrame*> lFixedCameras;
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,size_t> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        MapPointObservations observations;
+        (*lit)->GetObservations(observations);
+        for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
         {
-            KeyFrame* pKFi = mit->first;
+            if(it->nLeft<0)
+                continue;
+            KeyFrame* pKFi = it->pKF;
 
             if(pKFi->mnBALocalForKF!=pKF->mnFrameId && pKFi->mnBAFixedForKF!=pKF->mnFrameId)
             {                
@@ -422,17 +426,18 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag)
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        MapPointObservations observations;
+        pMP->GetObservations(observations);
 
         //SET EDGES
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPointObservations::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
         {
-            KeyFrame* pKFi = mit->first;
+            KeyFrame* pKFi = it->pKF;
 
-            if(!pKFi->isBad())
+            if(it->nLeft>=0 && !pKFi->isBad())
             {
                 Eigen::Matrix<double,2,1> obs;
-                cv::KeyPoint kpUn = pKFi->GetKeyPointUn(mit->second);
+                cv::KeyPoint kpUn = pKFi->GetKeyPointUn(it->nLeft);
                 obs << kpUn.pt.x, kpUn.pt.y;
 
                 vio::EdgeSE3ProjectXYZ* e = new vio::EdgeSE3ProjectXYZ();
@@ -478,7 +483,6 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag)
         if(e->chi2()>5.991 || !e->isDepthPositive())
         {
             KeyFrame* pKFi = vpEdgeKF[i];
-            pKFi->EraseMapPointMatch(pMP);
             pMP->EraseObservation(pKFi);
 
             optimizer.removeEdge(e);
@@ -531,7 +535,6 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag)
         if(e->chi2()>5.991 || !e->isDepthPositive())
         {
             KeyFrame* pKF = vpEdgeKF[i];
-            pKF->EraseMapPointMatch(pMP->GetIndexInKeyFrame(pKF));
             pMP->EraseObservation(pKF);
         }
     }
@@ -1531,16 +1534,22 @@ int Optimizer::LocalOptimize(vk::PinholeCamera * cam,
         // Create point vertex
         MapPoint* pMP = *it_pt;
         if(pMP->isBad()) { (*it_pt)=NULL; continue;}
-        std::map<KeyFrame*, size_t> obs_copy= pMP->GetObservations();
-        if(obs_copy.size()<2) { (*it_pt)=NULL; continue;}
+        MapPointObservations obs_copy;
+        pMP->GetObservations(obs_copy);
+        int nLeftObs=0;
+        for(MapPointObservations::const_iterator it_obs=obs_copy.begin(); it_obs!=obs_copy.end(); ++it_obs)
+            if(it_obs->nLeft>=0)
+                ++nLeftObs;
+        if(nLeftObs<2) { (*it_pt)=NULL; continue;}
         vio::G2oVertexPointXYZ*v_pt= addPointToG2o(pMP, pMP->mnId + nOffset, false, &optimizer);
         pMP->v_pt_= v_pt;
         ++n_mps;
         // Add edges
-        std::map<KeyFrame*, size_t>::const_iterator mit_obs=obs_copy.begin();
-        while(mit_obs!=obs_copy.end())
+        for(MapPointObservations::const_iterator mit_obs=obs_copy.begin(); mit_obs!=obs_copy.end(); ++mit_obs)
         {
-            KeyFrame * pKF= mit_obs->first;
+            if(mit_obs->nLeft<0)
+                continue;
+            KeyFrame * pKF= mit_obs->pKF;
             if(pKF->v_kf_ == NULL)
             {
                 // frame does not have a vertex yet -> it belongs to the neib kfs and
@@ -1561,23 +1570,22 @@ int Optimizer::LocalOptimize(vk::PinholeCamera * cam,
             }
             // create edge
             Eigen::Matrix<double,2,1> obs;
-            cv::KeyPoint kpUn = pKF->mvKeysUn[mit_obs->second];
+            cv::KeyPoint kpUn = pKF->GetKeyPointUn(mit_obs->nLeft);
             obs << kpUn.pt.x, kpUn.pt.y;
             const float invSigma2 = pKF->GetInvSigma2(kpUn.octave);
             Eigen::Matrix2d infoMat=Eigen::Matrix2d::Identity()*invSigma2;
             vio::G2oEdgeProjectXYZ2UV* porter=addObsToG2o(obs, infoMat,
                                                      v_pt, pKF->v_kf_, true, delta, &optimizer);
-            edges.push_back(EdgeContainerSE3d(porter, pKF, mit_obs->second));
+            edges.push_back(EdgeContainerSE3d(porter, pKF, mit_obs->nLeft));
 
 #ifndef MONO
             // set right edge
-            kpUn = pKF->mvRightKeysUn[mit_obs->second];
+            kpUn = pKF->GetKeyPointUn(mit_obs->nLeft, false);
             obs << kpUn.pt.x, kpUn.pt.y;
             assert(kpUn.octave==0);
             porter=addObsToG2o(obs, infoMat, v_pt, pKF->v_kf_, true, delta, &optimizer, pTl2r );
-            edges.push_back(EdgeContainerSE3d(porter, pKF,  mit_obs->second));
+            edges.push_back(EdgeContainerSE3d(porter, pKF,  mit_obs->nLeft));
 #endif
-            ++mit_obs;
         }
     }
     pMap->mPointPoseConsistencyMutex.unlock();
@@ -1639,7 +1647,7 @@ int Optimizer::LocalOptimize(vk::PinholeCamera * cam,
                     KeyFrame * larry= (KeyFrame*)((*it_win)->next_frame);
                     if(larry->isBad()){
                         SLAM_DEBUG_STREAM("Bad keyframe in temporal window mnId,N, mbNotErase, keys size:"
-                                          <<larry->mnId<<" "<<larry->N<<" "<<larry->GetNotErase()<<" "<< larry->mvKeysUn.size());
+                                          <<larry->mnId<<" "<<larry->N<<" "<<larry->GetNotErase()<<" "<< larry->GetKeyPointsUn().size());
 
                         assert(false);
                     }
@@ -1852,10 +1860,7 @@ int Optimizer::LocalOptimize(vk::PinholeCamera * cam,
                 continue;
             }
             if(pFi->isKeyFrame())
-            {
-                pFi->EraseMapPointMatch(it->id_);
                 pMP->EraseObservation((KeyFrame*)pFi);
-            }
             else{
                 pFi->EraseMapPointMatch(it->id_);
                 if(pFi==pCurrentFrame){
@@ -1894,10 +1899,7 @@ int Optimizer::LocalOptimize(vk::PinholeCamera * cam,
                 continue;
             }
             if(pFi->isKeyFrame())
-            {
-                pFi->EraseMapPointMatch(it->id_);
                 pMP->EraseObservation((KeyFrame*)pFi);
-            }
             else{
                 pFi->EraseMapPointMatch(it->id_);
                 if(pFi==pCurrentFrame)
@@ -0,0 +1,134 @@
+#include "StereoPipeline.h"
+#include "StereoImageLoader.h"
+
+#include <vikit/timer.h>
+
+namespace ORB_SLAM
+{
+
+StereoPipeline::StereoPipeline(StereoImageLoader* pLoader, Tracking* pTracker, int nStartIndex, int nFinishIndex,
+                               size_t nQueueSize):
+    mpLoader(pLoader), mpTracker(pTracker), mnStartIndex(nStartIndex), mnFinishIndex(nFinishIndex),
+    mbCreateFrames(pTracker->CanCreateStereoFrameAhead()),
+    mLoaded(nQueueSize), mMatched(nQueueSize), mReady(nQueueSize),
+    mvStageTimes(3, 0.0), mvStageCounts(3, 0)
+{
+    mvThreads.push_back(new boost::thread(&StereoPipeline::Load, this));
+    mvThreads.push_back(new boost::thread(&StereoPipeline::ExtractFeatures, this));
+    if(mbCreateFrames)
+        mvThreads.push_back(new boost::thread(&StereoPipeline::CreateFrames, this));
+}
+
+StereoPipeline::~StereoPipeline()
+{
+    Stop();
+}
+
+StereoPipelineFrame* StereoPipeline::Next()
+{
+    StereoPipelineFrame* pFrame = NULL;
+    if(!(mbCreateFrames? mReady: mMatched).Pop(pFrame))
+        return NULL;
+    return pFrame;
+}
+
+void StereoPipeline::Stop()
+{
+    BoundedQueue<StereoPipelineFrame*>* queues[] = {&mLoaded, &mMatched, &mReady};
+    for(size_t i=0; i<3; ++i)
+        queues[i]->Close();
+    for(size_t i=0; i<mvThreads.size(); ++i)
+    {
+        mvThreads[i]->join();
+        delete mvThreads[i];
+    }
+    mvThreads.clear();
+    for(size_t i=0; i<3; ++i)
+    {
+        std::deque<StereoPipelineFrame*> remaining = queues[i]->Drain();
+        for(size_t j=0; j<remaining.size(); ++j)
+            delete remaining[j];
+    }
+}
+
+std::vector<double> StereoPipeline::GetStageTimes() const
+{
+    boost::mutex::scoped_lock lock(mMutexTimes);
+    std::vector<double> vTimes(mvStageTimes.size(), 0.0);
+    for(size_t i=0; i<vTimes.size(); ++i)
+        if(mvStageCounts[i])
+            vTimes[i] = mvStageTimes[i]/mvStageCounts[i];
+    return vTimes;
+}
+
+void StereoPipeline::AddStageTime(size_t stage, double seconds)
+{
+    boost::mutex::scoped_lock lock(mMutexTimes);
+    mvStageTimes[stage] += seconds;
+    ++mvStageCounts[stage];
+}
+
+void StereoPipeline::Load()
+{
+    for(int nImageIndex = mnStartIndex; nImageIndex<=mnFinishIndex; ++nImageIndex)
+    {
+        vk::Timer timer;
+        StereoPipelineFrame* pFrame = new StereoPipelineFrame();
+        pFrame->nImageIndex = nImageIndex;
+        mpLoader->GetTimeAndRectifiedStereoImages(pFrame->time_frame, pFrame->left_img, pFrame->right_img, nImageIndex);
+        AddStageTime(0, timer.stop());
+
+        // a frame without time ends the sequence, it is passed on so that the consumer can report it
+        const bool bLast = pFrame->time_frame == -1.0;
+        if(!mLoaded.Push(pFrame))
+        {
+            delete pFrame;
+            return;
+        }
+        if(bLast)
+            break;
+    }
+    mLoaded.Close();
+}
+
+void StereoPipeline::ExtractFeatures()
+{
+    StereoPipelineFrame* pFrame = NULL;
+    while(mLoaded.Pop(pFrame))
+    {
+        if(pFrame->time_frame != -1.0)
+        {
+            vk::Timer timer;
+            mpTracker->ExtractStereoFeatures(pFrame->left_img, pFrame->right_img, pFrame->features);
+            AddStageTime(1, timer.stop());
+        }
+        if(!mMatched.Push(pFrame))
+        {
+            delete pFrame;
+            return;
+        }
+    }
+    mMatched.Close();
+}
+
+void StereoPipeline::CreateFrames()
+{
+    StereoPipelineFrame* pFrame = NULL;
+    while(mMatched.Pop(pFrame))
+    {
+        if(pFrame->time_frame != -1.0)
+        {
+            vk::Timer timer;
+            mpTracker->CreateStereoFrame(pFrame->left_img, pFrame->right_img, pFrame->time_frame, pFrame->features);
+            AddStageTime(2, timer.stop());
+        }
+        if(!mReady.Push(pFrame))
+        {
+            delete pFrame;
+            return;
+        }
+    }
+    mReady.Close();
+}
+
+} //namespace ORB_SLAM
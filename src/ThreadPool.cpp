@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+
+namespace ORB_SLAM
+{
+
+struct ThreadPool::Job
+{
+    Job(size_t n, const boost::function<void (size_t)>& task): mnTotal(n), mTask(task), mnNext(0), mnDone(0) {}
+
+    const size_t mnTotal;
+    const boost::function<void (size_t)> mTask;
+    std::atomic<size_t> mnNext; // next iteration to be claimed
+    std::atomic<size_t> mnDone; // number of finished iterations
+
+    boost::mutex mMutexDone;
+    boost::condition_variable mCondDone;
+};
+
+ThreadPool::ThreadPool(size_t nWorkers): mbStop(false)
+{
+    mvWorkers.reserve(nWorkers);
+    for(size_t i=0; i<nWorkers; ++i)
+        mvWorkers.push_back(new boost::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutexJobs);
+        mbStop = true;
+    }
+    mCondJobs.notify_all();
+    for(size_t i=0; i<mvWorkers.size(); ++i)
+    {
+        mvWorkers[i]->join();
+        delete mvWorkers[i];
+    }
+    mvWorkers.clear();
+}
+
+void ThreadPool::RunJob(Job* pJob)
+{
+    size_t i;
+    while((i = pJob->mnNext++) < pJob->mnTotal)
+    {
+        pJob->mTask(i);
+        if(++pJob->mnDone == pJob->mnTotal)
+        {
+            boost::mutex::scoped_lock lock(pJob->mMutexDone);
+            pJob->mCondDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while(true)
+    {
+        boost::shared_ptr<Job> pJob;
+        {
+            boost::mutex::scoped_lock lock(mMutexJobs);
+            while(!mbStop && mlJobs.empty())
+                mCondJobs.wait(lock);
+            if(mlJobs.empty())
+                return;
+            pJob = mlJobs.front();
+        }
+
+        RunJob(pJob.get());
+
+        // all iterations are claimed, no other worker needs to see this job
+        boost::mutex::scoped_lock lock(mMutexJobs);
+        if(!mlJobs.empty() && mlJobs.front()==pJob)
+            mlJobs.pop_front();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t n, const boost::function<void (size_t)>& task)
+{
+    if(n==0)
+        return;
+    if(mvWorkers.empty() || n==1)
+    {
+        for(size_t i=0; i<n; ++i)
+            task(i);
+        return;
+    }
+
+    boost::shared_ptr<Job> pJob(new Job(n, task));
+    {
+        boost::mutex::scoped_lock lock(mMutexJobs);
+        mlJobs.push_back(pJob);
+    }
+    mCondJobs.notify_all();
+
+    RunJob(pJob.get());
+
+    {
+        boost::mutex::scoped_lock lock(pJob->mMutexDone);
+        while(pJob->mnDone < pJob->mnTotal)
+            pJob->mCondDone.wait(lock);
+    }
+
+    boost::mutex::scoped_lock lock(mMutexJobs);
+    for(std::deque<boost::shared_ptr<Job> >::iterator it=mlJobs.begin(); it!=mlJobs.end(); ++it)
+    {
+        if(*it==pJob)
+        {
+            mlJobs.erase(it);
+            break;
+        }
+    }
+}
+
+} //namespace ORB_SLAM
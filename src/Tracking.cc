@@ -39,14 +39,18 @@
 #include"Initializer.h"
 
 #include"Optimizer.h"
+#include"ThreadPool.h"
 #include"PnPsolver.h"
 
 #include <vikit/pinhole_camera.h>
+#include <vikit/timer.h>
 
 #include<iostream>
 #include<fstream>
 #include <queue>
 #include <utility>
+#include <atomic>
+#include <memory>
 
 using namespace std;
 using namespace Sophus;
@@ -59,19 +63,19 @@ namespace ORB_SLAM
 vk::PerformanceMonitor* g_permon = NULL;
 #endif
 
-//remove matches that have u1c falls outside of [xl, xr)
-std::vector<p_match> cropMatches(const std::vector<p_match> &pMatches, float xl, float xr)
+//remove matches that have u1c falls outside of [xl, xr), without copying the others
+void cropMatches(std::vector<p_match> &pMatches, float xl, float xr)
 {
-    std::vector<p_match> resMatches;
-    resMatches.reserve(pMatches.size());
-    for(auto it= pMatches.begin(), ite= pMatches.end(); it!=ite; ++it)
+    size_t nKept = 0;
+    for(size_t i=0; i<pMatches.size(); ++i)
     {
-        if(it->u1c<xl || it->u1c>=xr)
+        if(pMatches[i].u1c<xl || pMatches[i].u1c>=xr)
             continue;
-        else
-            resMatches.push_back(*it);
+        if(nKept!=i)
+            pMatches[nKept] = pMatches[i];
+        ++nKept;
     }
-    return resMatches;
+    pMatches.resize(nKept);
 }
 
 static bool to_bool(std::string str) {
@@ -104,7 +108,9 @@ Tracking::Tracking(ORBVocabulary* pVoc, FramePublisher*pFramePublisher, /*MapPub
     mbUseIMUData(false), mnFrameIdOfSecondKF(0), mnFeatures(mfsSettings["ORBextractor.nFeatures"]),
     mMotionModel(Eigen::Vector3d(0,0,0),Eigen::Quaterniond(1,0,0,0)),
     mpImuProcessor(NULL),
-    mfTrackedFeatureRatio(0.6), mnMinTrackedFeatures(200)
+    mfTrackedFeatureRatio(0.6), mnMinTrackedFeatures(200),
+    mbMotionPriorMatching(false), mdPriorRotationStd(0.5*M_PI/180), mdPriorTranslationStd(0.05),
+    mPredTcpCov(Eigen::Matrix<double, 6, 6>::Zero())
 {
 #ifdef SLAM_TRACE
     // Initialize Performance Monitor
@@ -251,6 +257,21 @@ Tracking::Tracking(ORBVocabulary* pVoc, FramePublisher*pFramePublisher, /*MapPub
     param.calib.cv = mfsSettings["Camera.cy"]; // principal point (v-coordinate) in pixels
     param.base     = -mTl2r.translation()[0]; // baseline in meters
     param.inlier_threshold =sqrt(5.991);
+
+    // motion prior guided matching, off by default as noisy priors may hurt matching, see ExtractStereoFeatures
+    int nMotionPriorMatching = 0;
+    if(mfsSettings["Tracking.motion_prior_matching"].isInt())
+        nMotionPriorMatching = mfsSettings["Tracking.motion_prior_matching"];
+    mbMotionPriorMatching = nMotionPriorMatching!=0;
+    if(mfsSettings["Tracking.motion_prior_rotation_std"].isReal())
+        mdPriorRotationStd = (double)mfsSettings["Tracking.motion_prior_rotation_std"]*M_PI/180;
+    if(mfsSettings["Tracking.motion_prior_translation_std"].isReal())
+        mdPriorTranslationStd = mfsSettings["Tracking.motion_prior_translation_std"];
+    if(mfsSettings["Tracking.motion_prior_sigma"].isReal())
+        param.match.prior_sigma = mfsSettings["Tracking.motion_prior_sigma"];
+    if(mfsSettings["Tracking.motion_prior_min_radius"].isInt())
+        param.match.prior_min_radius = mfsSettings["Tracking.motion_prior_min_radius"];
+    cout << "- Motion prior matching: " << mbMotionPriorMatching << endl;
     mVisoStereo.setParameters(param);
     cout<<"Refinement viso2: "<<param.match.refinement<<endl;
     mPose=libviso2::Matrix::eye(4);
@@ -286,11 +307,44 @@ Tracking::Tracking(ORBVocabulary* pVoc, FramePublisher*pFramePublisher, /*MapPub
     // Initialization uses only points from the finest scale level
     mpIniORBextractor = new ORBextractor(mnFeatures*2,1.2,8,Score,fastTh, sigmaLevel0);
 
+    // threads extracting pyramid levels, grid cells and descriptors, computing the libviso2 features of the left
+    // and right images, evaluating relocalisation candidates and scoring keyframe database queries, 0 does all serially
+    int nExtractorThreads = 0;
+    if(mfsSettings["ORBextractor.nThreads"].isInt())
+        nExtractorThreads = mfsSettings["ORBextractor.nThreads"];
+    mpThreadPool = new ThreadPool(std::max(nExtractorThreads, 0));
+    mpKeyFrameDB = NULL;
+    if(nExtractorThreads>0){
+        mpORBextractor->SetThreadPool(mpThreadPool);
+        mpIniORBextractor->SetThreadPool(mpThreadPool);
+        ThreadPool* pThreadPool = mpThreadPool;
+        mVisoStereo.matcher->setParallelFor([pThreadPool](size_t n, const std::function<void (size_t)>& task)
+        {
+            pThreadPool->ParallelFor(n, task);
+        });
+    }
+    cout << "- Extractor Threads: " << nExtractorThreads << endl;
+
     if(mfsSettings["Tracking.tracked_feature_ratio"].isReal())
         mfTrackedFeatureRatio = mfsSettings["Tracking.tracked_feature_ratio"];
     if(mfsSettings["Tracking.min_tracked_features"].isInt())
         mnMinTrackedFeatures = mfsSettings["Tracking.min_tracked_features"];
 
+    // bounded memory map, 0 keeps all keyframes in memory
+    int nMaxResidentKeyFrames = 0;
+    if(mfsSettings["Map.max_resident_keyframes"].isInt())
+        nMaxResidentKeyFrames = mfsSettings["Map.max_resident_keyframes"];
+    if(nMaxResidentKeyFrames>0)
+    {
+        string strOffloadPrefix = "/tmp/orbslam_keyframes_";
+        if(mfsSettings["Map.offload_file_prefix"].isString())
+            strOffloadPrefix = (string)mfsSettings["Map.offload_file_prefix"];
+        int nOffloadIdleKeyFrames = 20;
+        if(mfsSettings["Map.offload_idle_keyframes"].isInt())
+            nOffloadIdleKeyFrames = mfsSettings["Map.offload_idle_keyframes"];
+        mpMap->SetMemoryBudget(nMaxResidentKeyFrames, strOffloadPrefix, nOffloadIdleKeyFrames);
+    }
+
     string dataset=mfsSettings["dataset"];
     if (dataset.compare("KITTIOdoSeq")==0)
         experimDataset =KITTIOdoSeq;
@@ -352,6 +406,12 @@ Tracking::~Tracking()
         delete mpLastFrame;
         mpLastFrame=NULL;
     }
+    mpORBextractor->SetThreadPool(NULL);
+    mpIniORBextractor->SetThreadPool(NULL);
+    mVisoStereo.matcher->setParallelFor(libviso2::Matcher::ParallelFor());
+    if(mpKeyFrameDB)
+        mpKeyFrameDB->SetThreadPool(NULL);
+    delete mpThreadPool;
 }
 void Tracking::SetLocalMapper(LocalMapping *pLocalMapper)
 {
@@ -366,6 +426,8 @@ void Tracking::SetLoopClosing(LoopClosing *pLoopClosing)
 void Tracking::SetKeyFrameDatabase(KeyFrameDatabase *pKFDB)
 {
     mpKeyFrameDB = pKFDB;
+    if(mpThreadPool->GetNumWorkers()>0)
+        mpKeyFrameDB->SetThreadPool(mpThreadPool);
 }
 
 
@@ -411,12 +473,12 @@ void Tracking::CreateNewMapPoints(const std::vector<p_match>& vQuadMatches)
         if(mpLastKeyFrame->mvpMapPoints[qMatch.i1p]!=NULL ||
                 pCurrFrame->mvpMapPoints[qMatch.i1c]!=NULL)
             continue;
-        cv::KeyPoint kpUn=mpLastKeyFrame->mvKeysUn[qMatch.i1p];
+        cv::KeyPoint kpUn=mpLastKeyFrame->GetKeyPointUn(qMatch.i1p);
         int posX, posY;
         if(pFG->IsPointEligible(kpUn, posX, posY))
         {
-            const cv::KeyPoint &kp1 = mpLastKeyFrame->mvKeysUn[qMatch.i1p];
-            const cv::KeyPoint &kp2 = mpLastKeyFrame->mvRightKeysUn[qMatch.i1p];
+            const cv::KeyPoint &kp1 = kpUn;
+            const cv::KeyPoint kp2 = mpLastKeyFrame->GetKeyPointUn(qMatch.i1p, false);
             const cv::KeyPoint &kp3 = pCurrFrame->mvKeysUn[qMatch.i1c];
             const cv::KeyPoint &kp4 = pCurrFrame->mvRightKeysUn[qMatch.i1c];
             // Check parallax between left and right rays
@@ -710,10 +772,8 @@ void Tracking::CreateNewMapPoints(KeyFrame* pKF2, KeyFrame* pCurrentKeyFrame)
             // Triangulation is succesful
             MapPoint* pMP = new MapPoint(x3Dt,pCurrentKeyFrame, idx1, mpMap);
 
-            pMP->AddObservation(pKF2, idx2);
-
             pCurrentKeyFrame->AddMapPoint(pMP,idx1);
-            pKF2->AddMapPoint(pMP,idx2);
+            pMP->AddObservation(pKF2, idx2);
             //Fill Current Frame structure
             mpCurrentFrame->mvpMapPoints[idx1] = pMP;
 
@@ -736,6 +796,8 @@ void  Tracking::ProcessFrameMono(cv::Mat &im, double timeStampSec,
                                  const RawImuMeasurementVector& imu_measurements,
                                  const Sophus::SE3d *pred_Tr_delta, const Eigen::Matrix<double, 9,1> sb)
 {
+    // keyframes read while tracking this frame must not be offloaded, see Map::EnforceMemoryBudget()
+    boost::shared_lock<boost::shared_mutex> residencyLock(mpMap->mMutexResidency);
     Sophus::SE3d Tcp =(pred_Tr_delta==NULL? Sophus::SE3d(): (*pred_Tr_delta)); // current frame from previous frame
 
     // compute gravity direction in current camera frame
@@ -881,7 +943,8 @@ void  Tracking::ProcessFrameMono(cv::Mat &im, double timeStampSec,
 
             if(bNeedMorePoints){
                 mpLastFrame->PartialRelease();
-                KeyFrame* pKF = new KeyFrame(*mpCurrentFrame,mpMap,mpKeyFrameDB);
+                // the current frame is deleted and replaced by the keyframe below, so it is moved
+                KeyFrame* pKF = new KeyFrame(std::move(*mpCurrentFrame),mpMap,mpKeyFrameDB);
                 pKF->SetNotErase(DoubleWindowKF);//because we want to ensure that keyframes in temporal window are not bad
                 pKF->ComputeBoW();
                 mnLastKeyFrameId = pKF->mnId;
@@ -990,6 +1053,8 @@ void  Tracking::ProcessFrameQCV(cv::Mat &im, cv::Mat &right_img, double timeStam
                              const RawImuMeasurementVector& imu_measurements,
                              const Sophus::SE3d *pred_Tr_delta, Eigen::Matrix<double, 9,1> sb)
 {
+    // keyframes read while tracking this frame must not be offloaded, see Map::EnforceMemoryBudget()
+    boost::shared_lock<boost::shared_mutex> residencyLock(mpMap->mMutexResidency);
     Sophus::SE3d Tcp =pred_Tr_delta==NULL? Sophus::SE3d(): (*pred_Tr_delta); // current frame from previous frame
 
     // get external visual odometry of qcv
@@ -1025,10 +1090,13 @@ void  Tracking::ProcessFrameQCV(cv::Mat &im, cv::Mat &right_img, double timeStam
 
     double lastFrameTime = mpLastFrame==NULL? -1:mpLastFrame->mTimeStamp;
     //compute ORB descriptors of vStereoMatches
-    mpCurrentFrame=new Frame(im, timeStampSec, mStereoSFM.getNumDenseFeatures(),
-                                   right_img, mStereoSFM.getNumDenseFeatures(),
+    ImagePyramid leftPyramid = mpORBextractor->CreatePyramid(im);
+    ImagePyramid rightPyramid = mpORBextractor->CreatePyramid(right_img);
+    mpCurrentFrame=new Frame(leftPyramid, timeStampSec, mStereoSFM.getNumDenseFeatures(),
+                                   rightPyramid, mStereoSFM.getNumDenseFeatures(),
                                    vStereoMatches, mpORBextractor, mpORBVocabulary, cam_, right_cam_,
                                    mTl2r, ginc, sb);
+    mpCurrentFrame->AssignNextId();
 
     // also test whether a quad match satisfy stereo matches
     if(mpLastFrame!=NULL)
@@ -1138,13 +1206,13 @@ void  Tracking::ProcessFrameQCV(cv::Mat &im, cv::Mat &right_img, double timeStam
                     mpLocalMapper->InsertKeyFrame(mpLastKeyFrame);
                     pLastFrame= mpLastKeyFrame;
                 }
-                else
-                    pLastFrame= new Frame(*mpLastFrame);
+                else // mpLastFrame is deleted below, only its id is read after the move
+                    pLastFrame= new Frame(std::move(*mpLastFrame));
             }
             else{
                 assert(mpLastFrame->mnId> mnFrameIdOfSecondKF);//because we added second frame as keyframe
                 mpLastFrame->PartialRelease();
-                KeyFrame* pKF = new KeyFrame(*mpLastFrame,mpMap,mpKeyFrameDB);
+                KeyFrame* pKF = new KeyFrame(std::move(*mpLastFrame),mpMap,mpKeyFrameDB);
                 pKF->SetNotErase(DoubleWindowKF);//because we want to ensure that keyframes in temporal window are not bad
                 mnLastKeyFrameId = mpLastFrame->mnId;
                 mpLastKeyFrame = pKF;
@@ -1257,32 +1325,111 @@ void  Tracking::ProcessFrameQCV(cv::Mat &im, cv::Mat &right_img, double timeStam
 // New map points are created using quad matches between the previous frame k-1 and current frame k
 // Therefore, the last frame cannot be a keyframe and used in local mapping until the current frame is processed
 
-void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSec,
-                             const RawImuMeasurementVector& imu_measurements,
-                             const Sophus::SE3d *pred_Tr_delta,Eigen::Matrix<double, 9,1> sb)
+// libviso2 quad matching, bucketing and stereo matching of a stereo pair.
+// It only touches the libviso2 matcher, so it can run ahead of tracking in another thread
+void Tracking::ExtractStereoFeatures(cv::Mat &im, cv::Mat &right_img, StereoFeatures& features,
+                                     const Sophus::SE3d *pred_Tr_delta, const Eigen::Matrix<double, 6, 6> *pred_cov)
 {
-    Sophus::SE3d Tcp =pred_Tr_delta==NULL? Sophus::SE3d(): (*pred_Tr_delta); // current frame from previous frame
-
-    // compute visual odometry with libviso2
     int32_t dims[] = {im.cols,im.rows,im.cols};
-    SLAM_START_TIMER("extract_quadmatches");
-    // push back images, compute features
-    mVisoStereo.matcher->pushBack(im.data,right_img.data,dims,false);
-
-    // match features
-    mVisoStereo.Tr_valid=false; //do we use stereo or IMU prior information for tracking?
+    // push back images, compute features, at half resolution on the level of the pyramids shared with ORB
+    features.leftPyramid = mpORBextractor->CreatePyramid(im);
+    features.rightPyramid = mpORBextractor->CreatePyramid(right_img);
+    libviso2::VisualOdometryStereo::parameters param=mVisoStereo.getParameters();
+    if(param.match.half_resolution)
+    {
+        const cv::Mat& leftHalf = features.leftPyramid.GetHalfLevel(1);
+        const cv::Mat& rightHalf = features.rightPyramid.GetHalfLevel(1);
+        mVisoStereo.matcher->pushBack(im.data,right_img.data,dims,false,
+                                      leftHalf.data,rightHalf.data,(int32_t)leftHalf.step);
+    }
+    else
+        mVisoStereo.matcher->pushBack(im.data,right_img.data,dims,false);
+    const libviso2::Matcher::timing &pushBackTiming = mVisoStereo.matcher->getTiming();
+    SLAM_DEBUG_STREAM("libviso2 pushBack ms left/right copy "<<pushBackTiming.copy[0]<<"/"<<pushBackTiming.copy[1]
+                      <<" filter "<<pushBackTiming.filter[0]<<"/"<<pushBackTiming.filter[1]
+                      <<" nms "<<pushBackTiming.nms[0]<<"/"<<pushBackTiming.nms[1]
+                      <<" descriptor "<<pushBackTiming.descriptor[0]<<"/"<<pushBackTiming.descriptor[1]
+                      <<" total "<<pushBackTiming.total);
+
+    // match features without prior motion
     // CAUTION: Prior motion from IMU noisy data and stereo prior often leads to worse results.
     //I believe the reason is prior motion is not necessary in feature matching. E.g.,qcv stereoSFM did not use such motion prior to aid feature matching
     // but when features are matched to points in local map, Stereo PTAM used a prior motion.
     // On the other hand, prior motion should be helpful in initializing pose optimization
-    if (mVisoStereo.Tr_valid) mVisoStereo.matcher->matchFeatures(2,&mVisoStereo.Tr_delta);
-    else          mVisoStereo.matcher->matchFeatures(2);
+    // Quad matching, bucketing and stereo matching in one pass that shares the index of the current features,
+    // stereo matching can be done before motion estimation as the latter does not use the matcher.
+    // With Tracking.motion_prior_matching, the caller passes the prediction and its covariance, then the previous
+    // to current image searches are restricted to windows of a few standard deviations around the predicted positions
+    const bool bPrior = pred_Tr_delta!=NULL && pred_cov!=NULL;
+    libviso2::Matrix Tr_delta, Tr_delta_cov(6,6);
+    if(bPrior)
+    {
+        Tr_delta = Converter::toViso2Matrix(*pred_Tr_delta);
+        for(int i=0; i<6; ++i)
+            for(int j=0; j<6; ++j)
+                Tr_delta_cov.val[i][j] = (*pred_cov)(i,j);
+    }
+    vk::Timer timer;
+    mVisoStereo.matcher->matchQuadAndStereo(features.vQuadMatches, features.vBucketedMatches, features.vStereoMatches,
+                                            param.bucket.max_features, param.bucket.bucket_width, param.bucket.bucket_height,
+                                            bPrior? &Tr_delta: NULL, bPrior? &Tr_delta_cov: NULL);
+    if(!features.vQuadMatches.empty())
+    {
+        ++mMatchingStats.nFrames;
+        mMatchingStats.dMatchingTime += timer.stop();
+        mMatchingStats.nQuadMatches += features.vQuadMatches.size();
+        mMatchingStats.nComparisons += mVisoStereo.matcher->getNumComparisons();
+    }
+    cropMatches(features.vQuadMatches, Config::cropROIXL(), Config::cropROIXR());
+    cropMatches(features.vBucketedMatches, Config::cropROIXL(), Config::cropROIXR());
+    cropMatches(features.vStereoMatches, Config::cropROIXL(), Config::cropROIXR());
+    //    cout<<"stereo matches in image:"<< vStereoMatches.size() <<endl;
+    // mVisoStereo.matcher->refineFeatures(vStereoMatches);
+    features.nLeftFeatures = mVisoStereo.matcher->getNumDenseFeatures(true);
+    features.nRightFeatures = mVisoStereo.matcher->getNumDenseFeatures(false);
+}
 
-    vector<p_match> vQuadMatches = cropMatches( mVisoStereo.matcher->getMatches(), Config::cropROIXL(), Config::cropROIXR());
-    libviso2::VisualOdometryStereo::parameters param=mVisoStereo.getParameters();
-    mVisoStereo.matcher->bucketFeatures(param.bucket.max_features, param.bucket.bucket_width,param.bucket.bucket_height);
-    vector<p_match> p_matched = cropMatches(mVisoStereo.matcher->getMatches(), Config::cropROIXL(), Config::cropROIXR());
-    SLAM_STOP_TIMER("extract_quadmatches");
+// Compute ORB descriptors of the stereo matches ahead of tracking, only valid if CanCreateStereoFrameAhead(),
+// the speed and biases are set once the frame is tracked
+void Tracking::CreateStereoFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSec, StereoFeatures& features)
+{
+    assert(CanCreateStereoFrameAhead());
+    if(features.leftPyramid.empty())
+    {
+        features.leftPyramid = mpORBextractor->CreatePyramid(im);
+        features.rightPyramid = mpORBextractor->CreatePyramid(right_img);
+    }
+    features.pFrame = new Frame(features.leftPyramid, timeStampSec, features.nLeftFeatures,
+                                features.rightPyramid, features.nRightFeatures,
+                                features.vStereoMatches, mpORBextractor, mpORBVocabulary, cam_, right_cam_,
+                                mTl2r, Eigen::Vector3d::Zero(), Eigen::Matrix<double, 9,1>::Zero());
+    features.leftPyramid.Release();
+    features.rightPyramid.Release();
+}
+
+void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSec,
+                             const RawImuMeasurementVector& imu_measurements,
+                             const Sophus::SE3d *pred_Tr_delta,Eigen::Matrix<double, 9,1> sb,
+                             StereoFeatures* pFeatures)
+{
+    // keyframes read while tracking this frame must not be offloaded, see Map::EnforceMemoryBudget()
+    boost::shared_lock<boost::shared_mutex> residencyLock(mpMap->mMutexResidency);
+    Sophus::SE3d Tcp =pred_Tr_delta==NULL? Sophus::SE3d(): (*pred_Tr_delta); // current frame from previous frame
+
+    // compute visual odometry with libviso2
+    StereoFeatures features;
+    if(pFeatures==NULL)
+    {
+        // the prior is only available here, the pipelined front-end extracts features ahead of tracking
+        const bool bPrior = mbMotionPriorMatching && pred_Tr_delta!=NULL;
+        SLAM_START_TIMER("extract_quadmatches");
+        ExtractStereoFeatures(im, right_img, features, bPrior? pred_Tr_delta: NULL, bPrior? &mPredTcpCov: NULL);
+        SLAM_STOP_TIMER("extract_quadmatches");
+        pFeatures = &features;
+    }
+    vector<p_match>& vQuadMatches = pFeatures->vQuadMatches;
+    const vector<p_match>& p_matched = pFeatures->vBucketedMatches;
+    mVisoStereo.Tr_valid=false; //do we use stereo or IMU prior information for tracking?
 
     SLAM_START_TIMER("track_previous_frame");
     vector<double> tr_delta = mVisoStereo.transformationMatrixToVector (Converter::toViso2Matrix(Tcp));
@@ -1290,6 +1437,7 @@ void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSe
     switch (approach){
     case RANSAC_Geiger:
         tr_delta= mVisoStereo.estimateMotion(p_matched, tr_delta);
+        mMatchingStats.nInliers += mVisoStereo.getNumberOfInliers();
         // on failure
         if (tr_delta.size()!=6)
             mVisoStereo.Tr_valid=false;
@@ -1342,13 +1490,6 @@ void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSe
         }
     }
     SLAM_STOP_TIMER("track_previous_frame");
-    //stereo matching
-    SLAM_START_TIMER("stereo_matching");
-    mVisoStereo.matcher->matchFeatures(1);
-    vector<p_match> vStereoMatches = cropMatches(mVisoStereo.matcher->getMatches(), Config::cropROIXL(), Config::cropROIXR());
-    //    cout<<"stereo matches in image:"<< vStereoMatches.size() <<endl;
-    // mVisoStereo.matcher->refineFeatures(vStereoMatches);
-    SLAM_STOP_TIMER("stereo_matching");
     // compute gravity direction in current camera frame
     Eigen::Vector3d ginc=ginw;
     if(mpLastFrame!=NULL && (ginw.norm()>1e-6)){
@@ -1358,11 +1499,29 @@ void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSe
     SLAM_START_TIMER("create_frame");
 
     double lastFrameTime = mpLastFrame==NULL? -1:mpLastFrame->mTimeStamp;
-    //compute ORB descriptors of vStereoMatches
-    mpCurrentFrame=new Frame(im, timeStampSec, mVisoStereo.matcher->getNumDenseFeatures(true),
-                                   right_img, mVisoStereo.matcher->getNumDenseFeatures(false),
-                                   vStereoMatches, mpORBextractor, mpORBVocabulary, cam_, right_cam_,
+    if(pFeatures->pFrame)
+    {// ORB descriptors are already computed ahead, ginc is zero in this case
+        mpCurrentFrame = pFeatures->pFrame;
+        pFeatures->pFrame = NULL;
+        mpCurrentFrame->speed_bias = sb;
+    }
+    else
+    {
+        //compute ORB descriptors of vStereoMatches
+        if(pFeatures->leftPyramid.empty())
+        {
+            pFeatures->leftPyramid = mpORBextractor->CreatePyramid(im);
+            pFeatures->rightPyramid = mpORBextractor->CreatePyramid(right_img);
+        }
+        mpCurrentFrame=new Frame(pFeatures->leftPyramid, timeStampSec, pFeatures->nLeftFeatures,
+                                   pFeatures->rightPyramid, pFeatures->nRightFeatures,
+                                   pFeatures->vStereoMatches, mpORBextractor, mpORBVocabulary, cam_, right_cam_,
                                    mTl2r, ginc, sb);
+        pFeatures->leftPyramid.Release();
+        pFeatures->rightPyramid.Release();
+    }
+    // frames created ahead by the stereo pipeline are numbered here, in tracking order
+    mpCurrentFrame->AssignNextId();
 
     // also test whether a quad match satisfy stereo matches
     if(mpLastFrame!=NULL)
@@ -1455,13 +1614,13 @@ void  Tracking::ProcessFrame(cv::Mat &im, cv::Mat &right_img, double timeStampSe
                     mpLocalMapper->InsertKeyFrame(mpLastKeyFrame);
                     pLastFrame= mpLastKeyFrame;
                 }
-                else
-                    pLastFrame= new Frame(*mpLastFrame);
+                else // mpLastFrame is deleted below, only its id is read after the move
+                    pLastFrame= new Frame(std::move(*mpLastFrame));
             }
             else{
                 assert(mpLastFrame->mnId>mnFrameIdOfSecondKF);//because we added second frame as keyframe
                 mpLastFrame->PartialRelease();
-                KeyFrame* pKF = new KeyFrame(*mpLastFrame,mpMap,mpKeyFrameDB);
+                KeyFrame* pKF = new KeyFrame(std::move(*mpLastFrame),mpMap,mpKeyFrameDB);
                 pKF->SetNotErase(DoubleWindowKF);//because we want to ensure that keyframes in temporal window are not bad
                 mnLastKeyFrameId = mpLastFrame->mnId;
                 mpLastKeyFrame = pKF;
@@ -1684,12 +1843,12 @@ void Tracking::CreateInitialMapStereo(const Sophus::SE3d &Tcw, const std::vector
     for(auto itQM= vQuadMatches.begin(), itQMend= vQuadMatches.end(); itQM!=itQMend; ++itQM){
         const p_match& pQM= *itQM;
         // Create MapPoints and asscoiate to keyframes
-        cv::KeyPoint kpUn=pKFcur->mvKeysUn[pQM.i1c];
+        cv::KeyPoint kpUn=pKFcur->GetKeyPointUn(pQM.i1c);
         int posX, posY;
         if(fg.IsPointEligible(kpUn, posX, posY))
         {// Triangulate each match
-            const cv::KeyPoint &kp1 = pKFcur->mvKeysUn[pQM.i1c];
-            const cv::KeyPoint &kp2 = pKFcur->mvRightKeysUn[pQM.i1c];
+            const cv::KeyPoint &kp1 = kpUn;
+            const cv::KeyPoint kp2 = pKFcur->GetKeyPointUn(pQM.i1c, false);
             const cv::KeyPoint &kp3 = pPrevFrame->mvKeysUn[pQM.i1p];
             const cv::KeyPoint &kp4 = pPrevFrame->mvRightKeysUn[pQM.i1p];
 #if 1
@@ -1806,12 +1965,10 @@ void Tracking::CreateInitialMapStereo(const Sophus::SE3d &Tcw, const std::vector
             // Triangulation is succesful
             MapPoint* pMP = new MapPoint(x3Dt,pKFcur, pQM.i1c, mpMap);
 
+            pKFcur->AddMapPoint(pMP,pQM.i1c);
             pMP->AddObservation(pPrevFrame,pQM.i1p);
             pMP->AddObservation(pPrevFrame,pQM.i2p, false);
 
-            pKFcur->AddMapPoint(pMP,pQM.i1c);
-            pPrevFrame->AddMapPoint(pMP,pQM.i1p);
-
             pMP->ComputeDistinctiveDescriptors();
             pMP->UpdateNormalAndDepth();
 
@@ -1887,7 +2044,7 @@ void Tracking::CreateInitialMap(Eigen::Matrix3d Rcw, Eigen::Vector3d tcw, double
         if(mvIniMatches[i]<0)
             continue;
         // Create MapPoints and asscoiate to keyframes
-        cv::KeyPoint kpUn=pKFcur->mvKeysUn[mvIniMatches[i]];
+        cv::KeyPoint kpUn=pKFcur->GetKeyPointUn(mvIniMatches[i]);
         int posX, posY;
         if(fg.IsPointEligible(kpUn, posX, posY))
         {
@@ -1895,7 +2052,6 @@ void Tracking::CreateInitialMap(Eigen::Matrix3d Rcw, Eigen::Vector3d tcw, double
             Eigen::Vector3d worldPos; worldPos<<mvIniP3D[i].x, mvIniP3D[i].y, mvIniP3D[i].z;
             MapPoint* pMP = new MapPoint(worldPos,pKFcur,mvIniMatches[i], mpMap);
 
-            pKFini->AddMapPoint(pMP,i);
             pKFcur->AddMapPoint(pMP,mvIniMatches[i]);
 
             pMP->AddObservation(pKFini,i);
@@ -2333,9 +2489,9 @@ int Tracking::SearchReferencePointsInFrustum()
 
     mpCurrentFrame->UpdatePoseMatrices();// because in isInFrustum mRcw and mtcw is used
 
-    int nToMatch=0;
-
-    // Project points in frame and check its visibility
+    // Project points in frame and check its visibility, all at once on a snapshot of the points
+    vector<MapPoint*> vpCandidates;
+    vpCandidates.reserve(mvpLocalMapPoints.size());
     for(vector<MapPoint*>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
     {
         MapPoint* pMP = *vit;
@@ -2343,12 +2499,15 @@ int Tracking::SearchReferencePointsInFrustum()
             continue;
         if(pMP->isBad())
             continue;
-        // Project (this fills MapPoint variables for matching)
-        if(mpCurrentFrame->isInFrustum(pMP,0.5))
-        {
-            pMP->IncreaseVisible();
-            nToMatch++;
-        }
+        vpCandidates.push_back(pMP);
+    }
+    mLocalPointsBatch.Assign(vpCandidates);
+    // this fills MapPoint variables for matching
+    int nToMatch = mpCurrentFrame->isInFrustum(mLocalPointsBatch,0.5);
+    for(size_t i=0; i<vpCandidates.size(); i++)
+    {
+        if(mLocalPointsBatch.vbInView[i])
+            vpCandidates[i]->IncreaseVisible();
     }
 
 
@@ -2397,8 +2556,9 @@ int Tracking::SearchReferencePointsInFrustumStereo()
 
     mpCurrentFrame->UpdatePoseMatrices();// because in isInFrustum mRcw and mtcw is used
 
-    int nToMatch=0;
-    // Project points in frame and check its visibility
+    // Project points in frame and check its visibility, all at once on a snapshot of the points
+    vector<MapPoint*> vpCandidates;
+    vpCandidates.reserve(mvpLocalMapPoints.size());
     for(vector<MapPoint*>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; ++vit)
     {
         MapPoint* pMP = *vit;
@@ -2406,12 +2566,15 @@ int Tracking::SearchReferencePointsInFrustumStereo()
             continue;
         if(pMP->isBad())
             continue;
-        // Project (this fills MapPoint variables for matching)
-        if(mpCurrentFrame->isInFrustumStereo(pMP,0.5))
-        {
-            pMP->IncreaseVisible();
-            nToMatch++;
-        }
+        vpCandidates.push_back(pMP);
+    }
+    mLocalPointsBatch.Assign(vpCandidates);
+    // this fills MapPoint variables for matching
+    int nToMatch = mpCurrentFrame->isInFrustumStereo(mLocalPointsBatch,0.5);
+    for(size_t i=0; i<vpCandidates.size(); i++)
+    {
+        if(mLocalPointsBatch.vbInView[i])
+            vpCandidates[i]->IncreaseVisible();
     }
 
     if(nToMatch>0)
@@ -2474,9 +2637,11 @@ void Tracking::UpdateReferenceKeyFrames()
             MapPoint* pMP = mpCurrentFrame->mvpMapPoints[i];
             if(!pMP->isBad())
             {
-                map<KeyFrame*,size_t> observations = pMP->GetObservations();
-                for(map<KeyFrame*,size_t>::iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
-                    keyframeCounter[it->first]++;
+                pMP->VisitObservations([&](const MapPointObservation& obs)
+                {
+                    if(obs.nLeft>=0)
+                        keyframeCounter[obs.pKF]++;
+                });
             }
             else
             {
@@ -2567,9 +2732,11 @@ void Tracking::UpdateReferenceKeyFramesAndPoints()
         {
             if(!pMP->isBad())
             {
-                map<KeyFrame*,size_t> observations = pMP->GetObservations();
-                for(map<KeyFrame*,size_t>::iterator it=observations.begin(), itend=observations.end(); it!=itend; ++it)
-                    ++frameCounter[it->first];
+                pMP->VisitObservations([&](const MapPointObservation& obs)
+                {
+                    if(obs.nLeft>=0)
+                        ++frameCounter[obs.pKF];
+                });
             }
             else
                 (*it)=NULL;
@@ -2754,6 +2921,7 @@ bool Tracking::Relocalisation()
 
     // We perform first an ORB matching with each candidate
     // If enough matches are found we setup a PnP solver
+    // The candidates are independent, so they are matched in parallel on the thread pool
     ORBmatcher matcher(0.75,true);
 
     std::vector<std::shared_ptr<PnPsolver> > vpPnPsolvers;
@@ -2762,139 +2930,178 @@ bool Tracking::Relocalisation()
     vector<vector<MapPoint*> > vvpMapPointMatches;
     vvpMapPointMatches.resize(nKFs);
 
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nKFs);
-
-    int nCandidates=0;
-
-    for(size_t i=0; i<vpCandidateKFs.size(); i++)
+    mpThreadPool->ParallelFor(nKFs, [&](size_t i)
     {
         KeyFrame* pKF = vpCandidateKFs[i];
         if(pKF->isBad())
-            vbDiscarded[i] = true;
-        else
-        {
-            int nmatches = matcher.SearchByBoW(pKF,*mpCurrentFrame,vvpMapPointMatches[i]);
-            if(nmatches<15)
-            {
-                vbDiscarded[i] = true;
-                continue;
-            }
-            else
-            {
-                PnPsolver* pSolver = new PnPsolver(*mpCurrentFrame,vvpMapPointMatches[i]);
-                pSolver->SetRansacParameters(0.99,10,300,4,0.5,5.991);
-                vpPnPsolvers[i].reset(pSolver);
-                nCandidates++;
-            }
-        }
-    }
+            return;
+        int nmatches = matcher.SearchByBoW(pKF,*mpCurrentFrame,vvpMapPointMatches[i]);
+        if(nmatches<15)
+            return;
+        PnPsolver* pSolver = new PnPsolver(*mpCurrentFrame,vvpMapPointMatches[i]);
+        pSolver->SetRansacParameters(0.99,10,300,4,0.5,5.991);
+        vpPnPsolvers[i].reset(pSolver);
+    });
 
-    // perform some iterations of P4P RANSAC
+    // perform some iterations of P4P RANSAC for every candidate
     // Until we found a camera pose supported by enough inliers
-    bool bMatch = false;
-    ORBmatcher matcher2(0.9,true);
+    // Each candidate refines its hypotheses on a copy of the current frame
+    std::atomic<int> nMatchKF(nKFs); // the candidate whose pose is taken, nKFs if none
+    boost::mutex mutexMatch;
+    SE3d TcwMatch;
+    vector<MapPoint*> vpMapPointsMatch;
+    vector<bool> vbOutlierMatch;
 
-    while(nCandidates>0 && !bMatch)
+    // Perform 5 Ransac Iterations on candidate i, return false when it is done
+    auto RansacStep = [&](int i, std::unique_ptr<Frame> &pFrame) -> bool
     {
-        for(size_t i=0; i<vpCandidateKFs.size(); i++)
-        {
-            if(vbDiscarded[i])
-                continue;
+        vector<bool> vbInliers;
+        int nInliers;
+        bool bNoMore;
 
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
+        cv::Mat Tcw = vpPnPsolvers[i]->iterate(5,bNoMore,vbInliers,nInliers);
 
-            std::shared_ptr<PnPsolver> pSolver = vpPnPsolvers[i];
-            cv::Mat Tcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
-
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
-            {
-                vbDiscarded[i]=true;
-                nCandidates--;
-            }
+        // If a Camera Pose is computed, optimize
+        if(!Tcw.empty())
+        {
+            if(!pFrame)
+                pFrame.reset(new Frame(*mpCurrentFrame));
+            pFrame->SetPose(Converter::toSE3d(Tcw));
+            int nGood = RefineRelocalisationPose(*pFrame, vpCandidateKFs[i], vbInliers, vvpMapPointMatches[i]);
 
-            // If a Camera Pose is computed, optimize
-            if(!Tcw.empty())
+            // If the pose is supported by enough inliers stop ransacs and continue
+            if(nGood>=30)//was 50
             {
-                mpCurrentFrame->SetPose(Converter::toSE3d(Tcw));
-
-                set<MapPoint*> sFound;
-
-                for(size_t j=0; j<vbInliers.size(); j++)
+                boost::mutex::scoped_lock lock(mutexMatch);
+                if(i<nMatchKF.load())
                 {
-                    if(vbInliers[j])
-                    {
-                        mpCurrentFrame->mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
-                    }
-                    else
-                        mpCurrentFrame->mvpMapPoints[j]=NULL;
+                    TcwMatch = pFrame->mTcw;
+                    vpMapPointsMatch = pFrame->mvpMapPoints;
+                    vbOutlierMatch = pFrame->mvbOutlier;
+                    nMatchKF = i;
                 }
+                return false;
+            }
+        }
+        // If Ransac reachs max. iterations discard keyframe
+        return !bNoMore;
+    };
 
-                int nGood = Optimizer::PoseOptimization(mpCurrentFrame, mpMap);
-
-                if(nGood<10)
+    if(mpThreadPool->GetNumWorkers()==0)
+    {
+        // round robin over the candidates, the first pose supported by enough inliers is taken
+        vector<bool> vbDiscarded(nKFs,false);
+        int nCandidates=0;
+        for(int i=0; i<nKFs; i++)
+        {
+            vbDiscarded[i] = !vpPnPsolvers[i];
+            if(!vbDiscarded[i])
+                nCandidates++;
+        }
+        std::unique_ptr<Frame> pFrame;
+        while(nCandidates>0 && nMatchKF.load()==nKFs)
+        {
+            for(int i=0; i<nKFs && nMatchKF.load()==nKFs; i++)
+            {
+                if(vbDiscarded[i])
                     continue;
-
-                for(size_t io =0, ioend=mpCurrentFrame->mvbOutlier.size(); io<ioend; io++)
-                    if(mpCurrentFrame->mvbOutlier[io])
-                        mpCurrentFrame->mvpMapPoints[io]=NULL;
-
-                // If few inliers, search by projection in a coarse window and optimize again
-                if(nGood<50)
+                if(!RansacStep(i, pFrame))
                 {
-                    int nadditional =matcher2.SearchByProjection(*mpCurrentFrame,vpCandidateKFs[i],sFound,10,100);
-
-                    if(nadditional+nGood>=50)
-                    {
-                        nGood = Optimizer::PoseOptimization(mpCurrentFrame, mpMap);
-
-                        // If many inliers but still not enough, search by projection again in a narrower window
-                        // the camera has been already optimized with many points
-                        if(nGood>30 && nGood<50)
-                        {
-                            sFound.clear();
-                            for(size_t ip =0, ipend=mpCurrentFrame->mvpMapPoints.size(); ip<ipend; ip++)
-                                if(mpCurrentFrame->mvpMapPoints[ip])
-                                    sFound.insert(mpCurrentFrame->mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(*mpCurrentFrame,vpCandidateKFs[i],sFound,3,64);
-
-                            // Final optimization
-                            if(nGood+nadditional>=50)
-                            {
-                                nGood = Optimizer::PoseOptimization(mpCurrentFrame, mpMap);
-
-                                for(size_t io =0; io<mpCurrentFrame->mvbOutlier.size(); io++)
-                                    if(mpCurrentFrame->mvbOutlier[io])
-                                        mpCurrentFrame->mvpMapPoints[io]=NULL;
-                            }
-                        }
-                    }
-                }
-                // If the pose is supported by enough inliers stop ransacs and continue
-                if(nGood>=30)//was 50
-                {
-                    bMatch = true;
-                    break;
+                    vbDiscarded[i]=true;
+                    nCandidates--;
                 }
             }
         }
     }
+    else
+    {
+        // A candidate stops once a lower-indexed one has found a pose, so the pose of the lowest-indexed
+        // candidate that finds one is taken, whatever the order in which the threads run
+        mpThreadPool->ParallelFor(nKFs, [&](size_t i)
+        {
+            if(!vpPnPsolvers[i])
+                return;
+            std::unique_ptr<Frame> pFrame;
+            while((int)i<nMatchKF.load() && RansacStep(i, pFrame))
+                ;
+        });
+    }
 
-    if(!bMatch)
+    if(nMatchKF==nKFs)
     {
         return false;
     }
     else
     {
+        mpCurrentFrame->SetPose(TcwMatch);
+        mpCurrentFrame->mvpMapPoints = vpMapPointsMatch;
+        mpCurrentFrame->mvbOutlier = vbOutlierMatch;
         mnLastRelocFrameId = mpCurrentFrame->mnId;
         return true;
     }
 }
+
+// Optimize the pose of F estimated by PnP with the inlier matches to pKF,
+// and search more matches in pKF by projection if they are few. Return the number of inliers
+int Tracking::RefineRelocalisationPose(Frame &F, KeyFrame* pKF, const vector<bool> &vbInliers,
+                                       const vector<MapPoint*> &vpMapPointMatches)
+{
+    ORBmatcher matcher2(0.9,true);
+    set<MapPoint*> sFound;
+
+    for(size_t j=0; j<vbInliers.size(); j++)
+    {
+        if(vbInliers[j])
+        {
+            F.mvpMapPoints[j]=vpMapPointMatches[j];
+            sFound.insert(vpMapPointMatches[j]);
+        }
+        else
+            F.mvpMapPoints[j]=NULL;
+    }
+
+    int nGood = Optimizer::PoseOptimization(&F, mpMap);
+
+    if(nGood<10)
+        return nGood;
+
+    for(size_t io =0, ioend=F.mvbOutlier.size(); io<ioend; io++)
+        if(F.mvbOutlier[io])
+            F.mvpMapPoints[io]=NULL;
+
+    // If few inliers, search by projection in a coarse window and optimize again
+    if(nGood<50)
+    {
+        int nadditional =matcher2.SearchByProjection(F,pKF,sFound,10,100);
+
+        if(nadditional+nGood>=50)
+        {
+            nGood = Optimizer::PoseOptimization(&F, mpMap);
+
+            // If many inliers but still not enough, search by projection again in a narrower window
+            // the camera has been already optimized with many points
+            if(nGood>30 && nGood<50)
+            {
+                sFound.clear();
+                for(size_t ip =0, ipend=F.mvpMapPoints.size(); ip<ipend; ip++)
+                    if(F.mvpMapPoints[ip])
+                        sFound.insert(F.mvpMapPoints[ip]);
+                nadditional =matcher2.SearchByProjection(F,pKF,sFound,3,64);
+
+                // Final optimization
+                if(nGood+nadditional>=50)
+                {
+                    nGood = Optimizer::PoseOptimization(&F, mpMap);
+
+                    for(size_t io =0; io<F.mvbOutlier.size(); io++)
+                        if(F.mvbOutlier[io])
+                            F.mvpMapPoints[io]=NULL;
+                }
+            }
+        }
+    }
+    return nGood;
+}
 // forced and/or requested relocalization is only done by loop closing
 void Tracking::ForceRelocalisation(const g2o::Sim3 Sneww2oldw)
 {
@@ -3078,8 +3285,17 @@ bool Tracking::ProcessAMonocularFrame(cv::Mat &left_img, double time_frame,
     return true;
 }
 
+// covariance of a predicted motion whose rotation and translation errors are isotropic
+static Eigen::Matrix<double, 6, 6> IsotropicMotionCovariance(double rotationStd, double translationStd)
+{
+    Eigen::Matrix<double, 6, 6> cov = Eigen::Matrix<double, 6, 6>::Zero();
+    cov.topLeftCorner<3,3>() = Eigen::Matrix3d::Identity()*rotationStd*rotationStd;
+    cov.bottomRightCorner<3,3>() = Eigen::Matrix3d::Identity()*translationStd*translationStd;
+    return cov;
+}
+
 bool Tracking::ProcessAStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double time_frame,
-                                   const RawImuMeasurementVector & imuMeas){
+                                   const RawImuMeasurementVector & imuMeas, StereoFeatures* pFeatures){
     if(left_img.cols != cam_->width() || left_img.rows!= cam_->height())
     {
         cerr<<"Incompatible image size, check setting file Camera.width .height fields!"<<endl;
@@ -3091,10 +3307,21 @@ bool Tracking::ProcessAStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double
         if(!mpImuProcessor->bStatesInitialized){
             mpImuProcessor->initStates(initTws, initVwsBaBg, time_frame);
             ProcessFrame(left_img, right_img, time_frame, RawImuMeasurementVector(),
-                             NULL, initVwsBaBg);
+                             NULL, initVwsBaBg, pFeatures);
         }
         else{
+            const Eigen::Matrix<double, 15, 15> P0 = mpImuProcessor->P_;
             predTcp=mpImuProcessor->propagate(time_frame, imuMeas);
+            if(mpImuProcessor->bPredictCov){
+                // the growth of the position and attitude covariance over the propagation, its largest
+                // eigenvalues bound the uncertainty of the relative motion whatever the frame
+                const Eigen::Matrix<double, 15, 15> dP = mpImuProcessor->P_ - P0;
+                double dTransVar = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(dP.block<3,3>(0,0)).eigenvalues().maxCoeff();
+                double dRotVar = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(dP.block<3,3>(6,6)).eigenvalues().maxCoeff();
+                mPredTcpCov = IsotropicMotionCovariance(sqrt(std::max(dRotVar, 0.0)), sqrt(std::max(dTransVar, 0.0)));
+            }
+            else
+                mPredTcpCov = IsotropicMotionCovariance(mdPriorRotationStd, mdPriorTranslationStd);
 
             Eigen::Matrix<double, 9, 1> velAndBiases = mpImuProcessor->speed_bias_1;
             if(experimDataset == DiLiLi)
@@ -3102,7 +3329,7 @@ bool Tracking::ProcessAStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double
                 velAndBiases.head<3>() = mVelByStereoOdometry;
 
             ProcessFrame(left_img, right_img, time_frame,
-                         imuMeas, &predTcp, velAndBiases);
+                         imuMeas, &predTcp, velAndBiases, pFeatures);
         }
         if(mState == WORKING){
             mpImuProcessor->resetStates((imu_.T_imu_from_cam*mpLastFrame->mTcw).inverse(), mpLastFrame->speed_bias);
@@ -3116,15 +3343,17 @@ bool Tracking::ProcessAStereoFrame(cv::Mat &left_img, cv::Mat &right_img, double
         Eigen::Quaterniond quat;
         mMotionModel.PredictNextCameraMotion(trans,quat);
         predTcp= SE3d(quat,trans);
+        mPredTcpCov = IsotropicMotionCovariance(mdPriorRotationStd, mdPriorTranslationStd);
         ProcessFrame(left_img, right_img, time_frame, RawImuMeasurementVector(),
-                     &predTcp);
+                     &predTcp, Eigen::Matrix<double, 9, 1>::Zero(), pFeatures);
         if(mState == WORKING){
             SE3d Twc= mpLastFrame->mTcw.inverse();
             mMotionModel.UpdateCameraPose(Twc.translation(), Twc.unit_quaternion());
         }
     }
     else{
-        ProcessFrame(left_img, right_img, time_frame);
+        ProcessFrame(left_img, right_img, time_frame, RawImuMeasurementVector(),
+                     NULL, Eigen::Matrix<double, 9, 1>::Zero(), pFeatures);
     }
     return true;
 }
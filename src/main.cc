@@ -42,6 +42,7 @@
 #include "ORBVocabulary.h"
 #include "Converter.h"
 #include "StereoImageLoader.h"
+#include "StereoPipeline.h"
 
 #include "vio/utils.h"
 #include "vikit/pinhole_camera.h"
@@ -119,7 +120,7 @@ int main(int argc, char **argv)
 
     if(argc < 2)
     {
-        cerr << "Usage:"<< argv[0]<<" <path_to_settings.yaml> [folder of /Vocabulary/ORBvoc.txt/yaml and /data]" << endl;
+        cerr << "Usage:"<< argv[0]<<" <path_to_settings.yaml> [folder of /Vocabulary/ORBvoc.txt/yaml/bin and /data]" << endl;
 #ifdef SLAM_USE_ROS
         ros::shutdown();
 #endif
@@ -165,7 +166,7 @@ int main(int argc, char **argv)
         if(!fsVoc.isOpened())
         {
             cerr << "Wrong path to vocabulary. Path must be absolute or relative to ORB_SLAM package directory." << endl;
-            cerr << "Falied to open at: " << strVocFile << endl;
+            cerr << "Failed to open at: " << strVocFile << endl;
 #ifdef SLAM_USE_ROS
             ros::shutdown();
 #endif
@@ -180,7 +181,20 @@ int main(int argc, char **argv)
         if(!bVocLoad)
         {
             cerr << "Wrong path to vocabulary. Path must be absolute or relative to ORB_SLAM package directory." << endl;
-            cerr << "Falied to open at: " << strVocFile << endl;
+            cerr << "Failed to open at: " << strVocFile << endl;
+#ifdef SLAM_USE_ROS
+            ros::shutdown();
+#endif
+            return 1;
+        }
+    }else if(extension == "bin" || extension == "BIN"){
+        // Binary vocabulary written by tools/bin_vocabulary, it is memory
+        // mapped so loading takes a fraction of a second.
+        bool bVocLoad = Vocabulary.loadFromBinaryFile(strVocFile);
+        if(!bVocLoad)
+        {
+            cerr << "Wrong path to vocabulary. Path must be absolute or relative to ORB_SLAM package directory." << endl;
+            cerr << "Failed to open at: " << strVocFile << endl;
 #ifdef SLAM_USE_ROS
             ros::shutdown();
 #endif
@@ -188,7 +202,7 @@ int main(int argc, char **argv)
         }
     }else {
         cerr << "Wrong path to vocabulary. Path must be absolute or relative to ORB_SLAM package directory." << endl;
-        cerr << "Falied to open at: " << strVocFile << endl;
+        cerr << "Failed to open at: " << strVocFile << endl;
 #ifdef SLAM_USE_ROS
         ros::shutdown();
 #endif
@@ -230,7 +244,10 @@ int main(int argc, char **argv)
     Tracker.SetKeyFrameDatabase(&Database);
 
     //Initialize the Local Mapping Thread and launch
-    ORB_SLAM::LocalMapping LocalMapper(&World);
+    int nMapperThreads = 0;
+    if(fsSettings["LocalMapping.nThreads"].isInt())
+        nMapperThreads = fsSettings["LocalMapping.nThreads"];
+    ORB_SLAM::LocalMapping LocalMapper(&World, nMapperThreads);
     boost::thread localMappingThread(&ORB_SLAM::LocalMapping::Run,&LocalMapper);
 
     //Initialize the Loop Closing Thread and launch
@@ -374,6 +391,30 @@ int main(int argc, char **argv)
         string time_filename = slamhome + (std::string)fsSettings["time_file"]; //timestamps for frames
 
         StereoImageLoader sil(time_filename, experim, dir, strSettingsFile);
+
+        // optionally overlap image loading, libviso2 matching and ORB extraction with tracking,
+        // pipeline_queue_size is the number of frames buffered between stages, 0 (default) processes frames one by one
+        int nQueueSize = 0;
+        if(fsSettings["pipeline_queue_size"].isInt())
+            nQueueSize = fsSettings["pipeline_queue_size"];
+#ifdef MONO
+        nQueueSize = 0;
+#endif
+        // the motion prior is predicted from the tracking of the previous frame, after the pipeline has
+        // already matched the next frames without it
+        int nMotionPriorMatching = 0;
+        if(fsSettings["Tracking.motion_prior_matching"].isInt())
+            nMotionPriorMatching = fsSettings["Tracking.motion_prior_matching"];
+        if(nMotionPriorMatching && nQueueSize > 0)
+        {
+            cerr << "Tracking.motion_prior_matching requires pipeline_queue_size 0, processing frames one by one"
+                 << " instead of pipeline_queue_size " << nQueueSize << endl;
+            nQueueSize = 0;
+        }
+        ORB_SLAM::StereoPipeline* pPipeline = NULL;
+        if(nQueueSize > 0)
+            pPipeline = new ORB_SLAM::StereoPipeline(&sil, &Tracker, numImages, totalImages, nQueueSize);
+        ORB_SLAM::StereoPipelineFrame* pPipelineFrame = NULL;
 #ifdef SLAM_USE_ROS
         ros::Rate r(mFps);
         while(ros::ok()&& numImages<=totalImages)
@@ -381,7 +422,20 @@ int main(int argc, char **argv)
         while(numImages<=totalImages)
 #endif
         {
-            sil.GetTimeAndRectifiedStereoImages(time_frame, left_img, right_img, numImages);
+            ORB_SLAM::StereoFeatures* pFeatures = NULL;
+            if(pPipeline){
+                delete pPipelineFrame;
+                pPipelineFrame = pPipeline->Next();
+                if(pPipelineFrame == NULL)
+                    break;
+                assert(pPipelineFrame->nImageIndex == numImages);
+                time_frame = pPipelineFrame->time_frame;
+                left_img = pPipelineFrame->left_img;
+                right_img = pPipelineFrame->right_img;
+                pFeatures = &pPipelineFrame->features;
+            }
+            else
+                sil.GetTimeAndRectifiedStereoImages(time_frame, left_img, right_img, numImages);
 
             if(time_frame == -1.0){
                 std::cout <<"Unable to grab time for image "<< numImages<< std::endl;
@@ -405,7 +459,7 @@ int main(int argc, char **argv)
 #ifdef MONO
             Tracker.ProcessAMonocularFrame(left_img, time_frame, imuMeas);
 #else
-            Tracker.ProcessAStereoFrame(left_img, right_img, time_frame, imuMeas);
+            Tracker.ProcessAStereoFrame(left_img, right_img, time_frame, imuMeas, pFeatures);
 #endif
             SLAM_STOP_TIMER("tot_time");
 
@@ -430,6 +484,13 @@ int main(int argc, char **argv)
             r.sleep();
 #endif
         }
+        delete pPipelineFrame;
+        if(pPipeline){
+            std::vector<double> vStageTimes = pPipeline->GetStageTimes();
+            cout<<"Pipeline stage time per frame: loading "<<vStageTimes[0]<<", libviso2 matching "<<vStageTimes[1]
+               <<", ORB descriptors "<<vStageTimes[2]<<endl;
+            delete pPipeline;
+        }
 #ifdef SLAM_OUTPUT_VISO2
         viso2_stream.close();
 #endif
@@ -442,6 +503,27 @@ int main(int argc, char **argv)
     double calc_time =  timer.stop();
     double time_per_frame=calc_time/(numImages-nStartId+1);
     cout<<"Calc_time:"<<calc_time<<";"<<"time per frame:"<<time_per_frame<<endl; //do not use ROS_INFO because ros::shutdown may be already invoked
+    double avg_wait, max_wait;
+    LocalMapper.GetQueueWaitTimes(avg_wait, max_wait);
+    cout<<"Local mapping queue wait average:"<<avg_wait<<";max:"<<max_wait<<endl;
+    LoopCloser.GetQueueWaitTimes(avg_wait, max_wait);
+    cout<<"Loop closing queue wait average:"<<avg_wait<<";max:"<<max_wait<<endl;
+    const ORB_SLAM::LocalMappingStats mappingStats = LocalMapper.GetStats();
+    if(mappingStats.nKeyFrames)
+        cout<<"Local mapping time per keyframe: processing:"<<mappingStats.dProcessTime/mappingStats.nKeyFrames
+            <<";point culling:"<<mappingStats.dCullingTime/mappingStats.nKeyFrames
+            <<";triangulation:"<<mappingStats.dTriangulationTime/mappingStats.nKeyFrames
+            <<";fusion:"<<mappingStats.dFusionTime/mappingStats.nKeyFrames
+            <<";keyframe culling:"<<mappingStats.dKeyFrameCullingTime/mappingStats.nKeyFrames
+            <<";new points:"<<(double)mappingStats.nNewMapPoints/mappingStats.nKeyFrames
+            <<";fusions:"<<(double)mappingStats.nFusions/mappingStats.nKeyFrames<<endl;
+    cout<<"Keyframes in map:"<<World.KeyFramesInMap()<<";resident:"<<World.ResidentKeyFramesInMap()<<endl;
+    const ORB_SLAM::MatchingStats& matchingStats = Tracker.GetMatchingStats();
+    if(matchingStats.nFrames)
+        cout<<"Quad matching time per frame:"<<matchingStats.dMatchingTime/matchingStats.nFrames
+            <<";quad matches:"<<(double)matchingStats.nQuadMatches/matchingStats.nFrames
+            <<";inliers:"<<(double)matchingStats.nInliers/matchingStats.nFrames
+            <<";comparisons:"<<(double)matchingStats.nComparisons/matchingStats.nFrames<<endl;
 
     vector<ORB_SLAM::KeyFrame*> vpKFs = World.GetAllKeyFrames();
     sort(vpKFs.begin(),vpKFs.end(),ORB_SLAM::KeyFrame::lId);
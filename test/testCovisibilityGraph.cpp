@@ -0,0 +1,241 @@
+// Checks the covisibility graph kept by map points against KeyFrame::CountConnections() under random
+// observation insertions and erasures, map points set bad and replaced. After each keyframe updates its
+// connections, its weights and ordered covisibles must be those counted from scratch, and every keyframe
+// must hold exactly the good map points observing it in the left image. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vikit/pinhole_camera.h>
+
+#include "ORBextractor.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Map.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+// with bRareLast, the last keyframe shares few map points, so that none of its weights reaches the threshold
+KeyFrame* RandomKeyFrame(const vector<KeyFrame*>& vpKFs, bool bRareLast)
+{
+    if(!bRareLast || rand()%20==0)
+        return vpKFs[rand()%vpKFs.size()];
+    return vpKFs[rand()%(vpKFs.size()-1)];
+}
+
+MapPoint* RandomGoodPoint(const vector<MapPoint*>& vpMPs)
+{
+    for(int nTry=0; nTry<20 && !vpMPs.empty(); ++nTry)
+    {
+        MapPoint* pMP = vpMPs[rand()%vpMPs.size()];
+        if(!pMP->isBad())
+            return pMP;
+    }
+    return NULL;
+}
+
+// new map points at the next n features of pKF1 and pKF2
+void SharePoints(KeyFrame* pKF1, KeyFrame* pKF2, int n, size_t &idx, vector<MapPoint*>& vpMPs, Map& map)
+{
+    for(int i=0; i<n; ++i, ++idx)
+    {
+        MapPoint* pMP = new MapPoint(Eigen::Vector3d(0, 0, 5), pKF1, idx, &map);
+        pKF1->AddMapPoint(pMP, idx);
+        pMP->AddObservation(pKF2, idx);
+        vpMPs.push_back(pMP);
+    }
+}
+
+// a keyframe holds a good map point at idx exactly when the point observes it at idx in the left image
+bool HoldsObservedPoints(const vector<KeyFrame*>& vpKFs, const vector<MapPoint*>& vpMPs)
+{
+    for(size_t k=0; k<vpKFs.size(); ++k)
+    {
+        vector<MapPoint*> vpMatches = vpKFs[k]->GetMapPointMatches();
+        for(size_t i=0; i<vpMatches.size(); ++i)
+            if(vpMatches[i] && !vpMatches[i]->isBad() && vpMatches[i]->GetIndexInKeyFrame(vpKFs[k])!=(int)i)
+                return false;
+    }
+    for(size_t j=0; j<vpMPs.size(); ++j)
+    {
+        if(vpMPs[j]->isBad())
+            continue;
+        MapPointObservations observations;
+        vpMPs[j]->GetObservations(observations);
+        for(MapPointObservations::const_iterator it=observations.begin(); it!=observations.end(); ++it)
+            if(it->nLeft>=0 && it->pKF->GetMapPoint(it->nLeft)!=vpMPs[j])
+                return false;
+    }
+    return true;
+}
+
+// the weights and the ordered covisibles of pKF after it updates its connections, against a recount
+bool SameConnections(KeyFrame* pKF, const vector<KeyFrame*>& vpKFs, Map& map)
+{
+    const int th = 15;
+    pKF->UpdateConnections();
+    std::map<KeyFrame*,int> KFcounter;
+    pKF->CountConnections(KFcounter);
+
+    vector<pair<KeyFrame*,int> > vWeights;
+    map.GetCovisibilityGraph().GetWeights(pKF, vWeights);
+    bool bSame = std::map<KeyFrame*,int>(vWeights.begin(), vWeights.end())==KFcounter;
+    for(size_t k=0; k<vpKFs.size(); ++k)
+        if(vpKFs[k]!=pKF)
+            bSame = bSame && pKF->GetWeight(vpKFs[k])==(KFcounter.count(vpKFs[k]) ? KFcounter[vpKFs[k]] : 0);
+
+    // the keyframes over the threshold, or the one with the maximum count if none is
+    vector<pair<int,KeyFrame*> > vExpected;
+    pair<int,KeyFrame*> max(0, (KeyFrame*)NULL);
+    for(std::map<KeyFrame*,int>::iterator mit=KFcounter.begin(); mit!=KFcounter.end(); ++mit)
+    {
+        if(mit->second>=th)
+            vExpected.push_back(make_pair(mit->second, mit->first));
+        if(mit->second>max.first)
+            max = make_pair(mit->second, mit->first);
+    }
+    if(vExpected.empty() && max.second)
+        vExpected.push_back(max);
+
+    vector<KeyFrame*> vpCovisibles = pKF->GetVectorCovisibleKeyFrames();
+    vector<pair<int,KeyFrame*> > vOrdered;
+    for(size_t i=0; i<vpCovisibles.size(); ++i)
+    {
+        vOrdered.push_back(make_pair(pKF->GetWeight(vpCovisibles[i]), vpCovisibles[i]));
+        bSame = bSame && (i==0 || vOrdered[i].first<=vOrdered[i-1].first);
+    }
+    sort(vOrdered.begin(), vOrdered.end());
+    sort(vExpected.begin(), vExpected.end());
+    return bSame && vOrdered==vExpected;
+}
+
+int main()
+{
+    srand(0);
+    cv::Mat image(480, 752, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(500, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+
+    // a keyframe without a map is destroyed without touching a covisibility graph
+    delete new KeyFrame(frame, NULL, NULL);
+
+    // the map points are not added to the map, which would delete them
+    Map map;
+    vector<KeyFrame*> vpKFs;
+    for(int k=0; k<12; ++k)
+        vpKFs.push_back(new KeyFrame(frame, &map, NULL));
+
+    vector<MapPoint*> vpMPs;
+    bool bPassed = frame.N > 0;
+    int nRefused = 0;
+    // the last keyframe first shares few map points, then as many as the others, and in the end map points are
+    // only erased, so that weights cross the threshold both ways and drop to zero
+    for(int nOp=0; nOp<3000 && bPassed; ++nOp)
+    {
+        const bool bRareLast = nOp<1000;
+        const int op = nOp<2000 ? rand()%20 : 14+rand()%6;
+        if(op<10)
+        {
+            // a new point seen by its reference keyframe and a few others
+            KeyFrame* pRefKF = RandomKeyFrame(vpKFs, bRareLast);
+            const size_t idx = rand()%frame.N;
+            if(pRefKF->GetMapPoint(idx))
+                continue;
+            MapPoint* pMP = new MapPoint(Eigen::Vector3d(0, 0, 5), pRefKF, idx, &map);
+            pRefKF->AddMapPoint(pMP, idx);
+            vpMPs.push_back(pMP);
+            for(int n=rand()%4+1; n>0; --n)
+            {
+                KeyFrame* pKF = RandomKeyFrame(vpKFs, bRareLast);
+                if(pKF!=pRefKF && !pMP->IsInKeyFrame(pKF))
+                    pMP->AddObservation(pKF, rand()%frame.N);
+            }
+        }
+        else if(op<14)
+        {
+            // a new or moved observation, refused where the keyframe holds another good point
+            MapPoint* pMP = RandomGoodPoint(vpMPs);
+            KeyFrame* pKF = RandomKeyFrame(vpKFs, bRareLast);
+            const size_t idx = rand()%frame.N;
+            if(!pMP)
+                continue;
+            MapPoint* pHeld = pKF->GetMapPoint(idx);
+            const bool bAdded = pMP->AddObservation(pKF, idx);
+            if(pHeld && pHeld!=pMP && !pHeld->isBad())
+            {
+                bPassed = !bAdded && pKF->GetMapPoint(idx)==pHeld;
+                ++nRefused;
+            }
+            else
+                bPassed = bAdded && pKF->GetMapPoint(idx)==pMP && pMP->GetIndexInKeyFrame(pKF)==(int)idx;
+        }
+        else if(op<17)
+        {
+            MapPoint* pMP = RandomGoodPoint(vpMPs);
+            if(!pMP)
+                continue;
+            MapPointObservations observations;
+            pMP->GetObservations(observations);
+            pMP->EraseObservation(observations[rand()%observations.size()].pKF);
+        }
+        else if(op<18)
+        {
+            MapPoint* pMP = RandomGoodPoint(vpMPs);
+            if(pMP)
+                pMP->SetBadFlag();
+        }
+        else
+        {
+            MapPoint* pMP1 = RandomGoodPoint(vpMPs);
+            MapPoint* pMP2 = RandomGoodPoint(vpMPs);
+            if(pMP1 && pMP2)
+                pMP1->Replace(pMP2);
+        }
+
+        bPassed = bPassed && HoldsObservedPoints(vpKFs, vpMPs);
+        if(nOp%50==49)
+        {
+            // a few keyframes, and the last one, update from the changes since their last update
+            for(int n=0; n<4; ++n)
+                bPassed = bPassed && SameConnections(vpKFs[rand()%vpKFs.size()], vpKFs, map);
+            bPassed = bPassed && SameConnections(vpKFs.back(), vpKFs, map);
+        }
+    }
+    for(size_t k=0; k<vpKFs.size(); ++k)
+        bPassed = bPassed && SameConnections(vpKFs[k], vpKFs, map);
+
+    // a keyframe without weights over the threshold connects to the one sharing the most, which it drops
+    // once another one shares enough
+    vector<KeyFrame*> vpTrio;
+    for(int k=0; k<3; ++k)
+        vpTrio.push_back(new KeyFrame(frame, &map, NULL));
+    size_t idx = 0;
+    SharePoints(vpTrio[0], vpTrio[1], 3, idx, vpMPs, map);
+    SharePoints(vpTrio[0], vpTrio[2], 2, idx, vpMPs, map);
+    bPassed = bPassed && SameConnections(vpTrio[0], vpTrio, map) &&
+              vpTrio[0]->GetVectorCovisibleKeyFrames()==vector<KeyFrame*>(1, vpTrio[1]);
+    SharePoints(vpTrio[0], vpTrio[2], 15, idx, vpMPs, map);
+    bPassed = bPassed && SameConnections(vpTrio[0], vpTrio, map) &&
+              vpTrio[0]->GetVectorCovisibleKeyFrames()==vector<KeyFrame*>(1, vpTrio[2]);
+    vpKFs.insert(vpKFs.end(), vpTrio.begin(), vpTrio.end());
+
+    cout << vpMPs.size() << " map points in " << vpKFs.size() << " keyframes, " << nRefused
+         << " observations refused: " << (bPassed ? "passed" : "FAILED") << endl;
+
+    for(size_t j=0; j<vpMPs.size(); ++j)
+        delete vpMPs[j];
+    for(size_t k=0; k<vpKFs.size(); ++k)
+        delete vpKFs[k];
+    return bPassed ? 0 : 1;
+}
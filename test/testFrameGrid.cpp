@@ -0,0 +1,65 @@
+// FrameGrid on a 4x3 grid of 10 pixel cells: which keypoints fall in the grid and which ones
+// GetFeaturesInArea returns, with and without a level range. Returns non-zero on a failure.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "FrameGrid.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+bool Check(const vector<size_t>& vIndices, const vector<size_t>& vExpected, const string& name)
+{
+    const bool bSame = vIndices==vExpected;
+    if(!bSame)
+        cout << name << ": " << vIndices.size() << " indices, expected " << vExpected.size() << endl;
+    return bSame;
+}
+
+vector<size_t> Indices(size_t a, size_t b=-1, size_t c=-1)
+{
+    vector<size_t> v;
+    if(a != (size_t)-1) v.push_back(a);
+    if(b != (size_t)-1) v.push_back(b);
+    if(c != (size_t)-1) v.push_back(c);
+    return v;
+}
+
+int main()
+{
+    // cells are rounded, so (12, 12) is in cell (1, 1). Keypoints 3 and 4 are out of the grid
+    vector<cv::KeyPoint> vKeysUn;
+    const float vXYOctave[][3] = {{12, 12, 0}, {3, 4, 1}, {13, 14, 2}, {38, 25, 0}, {-8, 5, 0}, {11, 13, 1}};
+    for(size_t i=0; i<sizeof(vXYOctave)/sizeof(vXYOctave[0]); ++i)
+        vKeysUn.push_back(cv::KeyPoint(vXYOctave[i][0], vXYOctave[i][1], 31, -1, 0, (int)vXYOctave[i][2]));
+
+    FrameGrid grid(4, 3);
+    grid.Build(vKeysUn, 0, 0, 0.1f, 0.1f);
+
+    bool bPassed = true;
+    int posX, posY;
+    bPassed = grid.PosInGrid(vKeysUn[0], posX, posY) && posX==1 && posY==1 && bPassed;
+    bPassed = !grid.PosInGrid(vKeysUn[3], posX, posY) && !grid.PosInGrid(vKeysUn[4], posX, posY) && bPassed;
+    bPassed = grid.size()==4 && bPassed;
+
+    // within a cell the keypoints keep their order in the frame
+    bPassed = Check(grid.GetFeaturesInArea(12, 12, 2), Indices(0, 2, 5), "all levels") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(12, 12, 2, 1, 1), Indices(5), "level 1") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(12, 12, 2, 0, 1), Indices(0, 5), "levels 0 to 1") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(12, 12, 1), Indices(0, 5), "radius 1") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(3, 4, 1), Indices(1), "corner") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(38, 25, 3), Indices(-1), "out of the grid") && bPassed;
+    bPassed = Check(grid.GetFeaturesInArea(100, 100, 5), Indices(-1), "far away") && bPassed;
+
+    FrameGrid copy(grid);
+    bPassed = Check(copy.GetFeaturesInArea(12, 12, 2), Indices(0, 2, 5), "copy") && bPassed;
+    grid.Clear();
+    bPassed = Check(grid.GetFeaturesInArea(12, 12, 2), Indices(-1), "cleared") && bPassed;
+
+    cout << "FrameGrid: " << (bPassed ? "passed" : "FAILED") << endl;
+    return bPassed ? 0 : 1;
+}
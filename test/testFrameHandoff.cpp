@@ -0,0 +1,59 @@
+// Handoff of a tracked frame into the temporal window: the copy constructor of Frame clones the descriptors,
+// the move constructor takes them and the other features over and leaves the source without features.
+// Both give the features and the grid of the tracked frame. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <utility>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vikit/pinhole_camera.h>
+
+#include "Frame.h"
+#include "ORBextractor.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+bool SameFeatures(const Frame& a, const Frame& b)
+{
+    bool bSame = a.N==b.N && a.mvKeys.size()==b.mvKeys.size() && a.mvKeysUn.size()==b.mvKeysUn.size() &&
+            a.mDescriptors.size()==b.mDescriptors.size() && a.mvpMapPoints==b.mvpMapPoints;
+    for(size_t i=0; i<a.mvKeys.size() && bSame; ++i)
+        bSame = a.mvKeys[i].pt==b.mvKeys[i].pt && a.mvKeysUn[i].pt==b.mvKeysUn[i].pt;
+    bSame = bSame && (a.mDescriptors.empty() || cv::countNonZero(a.mDescriptors!=b.mDescriptors)==0);
+
+    // the grid finds the same keypoints around the first one
+    if(bSame && !a.mvKeysUn.empty())
+    {
+        const cv::Point2f& pt = a.mvKeysUn[0].pt;
+        bSame = a.GetFeaturesInArea(pt.x, pt.y, 20)==b.GetFeaturesInArea(pt.x, pt.y, 20);
+    }
+    return bSame;
+}
+
+int main()
+{
+    cv::Mat image(480, 752, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(1000, 1.2f, 8);
+    Frame tracked(image, 0.0, &extractor, NULL, &cam);
+    bool bPassed = tracked.N > 0;
+
+    Frame copied(tracked);
+    bPassed = bPassed && SameFeatures(copied, tracked) && copied.mDescriptors.data!=tracked.mDescriptors.data;
+
+    Frame source(tracked);
+    const uchar* pDescriptors = source.mDescriptors.data;
+    Frame moved(std::move(source));
+    bPassed = bPassed && SameFeatures(moved, tracked) && moved.mDescriptors.data==pDescriptors;
+    bPassed = bPassed && source.N==0 && source.mvKeys.empty() && source.mDescriptors.empty();
+
+    cout << "Frame handoff of " << tracked.N << " keypoints: " << (bPassed ? "passed" : "FAILED") << endl;
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Frustum culling of a few points placed by hand in front of, behind, beside and too close to a stereo
+// camera at the origin, with every kernel supported by this CPU. The points are repeated so that the
+// vector kernels also leave a remainder to the scalar code. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include "FrustumCulling.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+struct Expected
+{
+    bool bInView;
+    float u, v;
+    int nLevel;
+};
+
+void AddPoint(float x, float y, float z, float nx, float ny, float nz, float minDistance, float maxDistance,
+              FrustumCulling::Batch &batch)
+{
+    batch.vpMapPoints.push_back(NULL);
+    batch.vX.push_back(x); batch.vY.push_back(y); batch.vZ.push_back(z);
+    batch.vNx.push_back(nx); batch.vNy.push_back(ny); batch.vNz.push_back(nz);
+    batch.vMinDistance.push_back(minDistance);
+    batch.vMaxDistance.push_back(maxDistance);
+}
+
+bool CheckBatch(const FrustumCulling::Batch &batch, size_t nInView, const vector<Expected> &vExpected,
+                size_t nExpectedInView)
+{
+    bool bSame = nInView==nExpectedInView;
+    for(size_t i=0; i<batch.size(); ++i)
+    {
+        const Expected &e = vExpected[i%vExpected.size()];
+        if(batch.vbInView[i] != e.bInView)
+            bSame = false;
+        else if(e.bInView && (fabs(batch.vProjX[i]-e.u)>1e-3 || fabs(batch.vProjY[i]-e.v)>1e-3 ||
+                              batch.vnScaleLevel[i]!=e.nLevel || fabs(batch.vViewCos[i]-1.0f)>1e-5))
+            bSame = false;
+    }
+    return bSame;
+}
+
+int main()
+{
+    // identity pose, the right camera is 0.5 meters to the right of the left one
+    vector<float> vScaleFactors(8, 1.0f);
+    for(size_t l=1; l<vScaleFactors.size(); ++l)
+        vScaleFactors[l] = vScaleFactors[l-1]*1.2f;
+    FrustumCulling::View view = {};
+    view.Rcw[0] = view.Rcw[4] = view.Rcw[8] = 1.0f;
+    view.fx = view.fy = 500.0f;
+    view.cx = 320.0f;
+    view.cy = 240.0f;
+    view.bStereo = true;
+    view.Rlr[0] = view.Rlr[4] = view.Rlr[8] = 1.0f;
+    view.tlr[0] = -0.5f;
+    view.fxr = view.fyr = 500.0f;
+    view.cxr = 320.0f;
+    view.cyr = 240.0f;
+    view.minX = 0.0f; view.maxX = 640.0f;
+    view.minY = 0.0f; view.maxY = 480.0f;
+    view.viewingCosLimit = 0.5f;
+    view.vScaleFactors = &vScaleFactors[0];
+    view.nScaleLevels = vScaleFactors.size();
+
+    // the normals of the points in view point away from the camera, their viewing cosine is 1
+    FrustumCulling::Batch batch;
+    const float nB = sqrtf(1.0f+0.25f+25.0f), nE = sqrtf(5.0f);
+    for(int r=0; r<3; ++r)
+    {
+        AddPoint(0, 0, 10, 0, 0, 1, 5, 20, batch);               // straight ahead, ratio 2
+        AddPoint(1, 0.5f, 5, 1/nB, 0.5f/nB, 5/nB, 2, 10, batch); // ratio 2.56
+        AddPoint(0, 0, -10, 0, 0, -1, 5, 20, batch);             // behind
+        AddPoint(10, 0, 10, 0, 0, 1, 5, 20, batch);              // out of the left image
+        AddPoint(-1, 0, 2, -1/nE, 0, 2/nE, 1, 5, batch);         // out of the right image only, ratio 2.24
+        AddPoint(0, 0, 10, 0, 0, 1, 5, 8, batch);                // too far
+        AddPoint(0, 0, 10, 1, 0, 0, 5, 20, batch);               // seen from the side
+    }
+    batch.vbInView.resize(batch.size());
+    batch.vProjX.resize(batch.size());
+    batch.vProjY.resize(batch.size());
+    batch.vnScaleLevel.resize(batch.size());
+    batch.vViewCos.resize(batch.size());
+
+    const Expected vStereo[] = {{true, 320, 240, 4}, {true, 420, 290, 6}, {false, 0, 0, 0}, {false, 0, 0, 0},
+                                {false, 0, 0, 0}, {false, 0, 0, 0}, {false, 0, 0, 0}};
+    vector<Expected> vExpectedStereo(vStereo, vStereo+7);
+    vector<Expected> vExpectedMono = vExpectedStereo;
+    Expected inLeftImage = {true, 70, 240, 5};
+    vExpectedMono[4] = inLeftImage;
+
+    FrustumCulling::Kernel bestKernel = FrustumCulling::GetKernel();
+    bool bPassed = true;
+    for(int k=FrustumCulling::SCALAR; k<=FrustumCulling::AVX; ++k)
+    {
+        FrustumCulling::Kernel kernel = (FrustumCulling::Kernel)k;
+        if(!FrustumCulling::SetKernel(kernel))
+            continue;
+
+        view.bStereo = true;
+        bool bSame = CheckBatch(batch, FrustumCulling::Cull(view, batch), vExpectedStereo, 6);
+        view.bStereo = false;
+        bSame = CheckBatch(batch, FrustumCulling::Cull(view, batch), vExpectedMono, 9) && bSame;
+
+        cout << FrustumCulling::GetKernelName(kernel) << ": " << (bSame ? "passed" : "FAILED") << endl;
+        bPassed = bPassed && bSame;
+    }
+    FrustumCulling::SetKernel(bestKernel);
+
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// Hamming distances with every kernel supported by this CPU on descriptors of known distances:
+// descriptor i has its first i bits set, so descriptors i and j are |i-j| bits apart.
+// Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+
+#include "HammingDistance.h"
+#include "ORBmatcher.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+int main()
+{
+    cv::Mat descriptors = cv::Mat::zeros(257, 32, CV_8U);
+    for(int i=0; i<descriptors.rows; ++i)
+        for(int b=0; b<i; ++b)
+            descriptors.at<unsigned char>(i, b/8) |= 1 << (b%8);
+
+    // every third descriptor, for the indexed batch
+    vector<int> vCandidates;
+    for(int i=0; i<descriptors.rows; i+=3)
+        vCandidates.push_back(i);
+    vector<const unsigned char*> vpCandidates;
+    for(size_t i=0; i<vCandidates.size(); ++i)
+        vpCandidates.push_back(descriptors.ptr(vCandidates[i]));
+
+    const int vQueries[] = {0, 1, 100, 255, 256};
+    HammingDistance::Kernel bestKernel = HammingDistance::GetKernel();
+    bool bPassed = true;
+    for(int k=HammingDistance::SCALAR; k<=HammingDistance::AVX2; ++k)
+    {
+        HammingDistance::Kernel kernel = (HammingDistance::Kernel)k;
+        if(!HammingDistance::SetKernel(kernel))
+            continue;
+
+        bool bSame = true;
+        vector<int> vDists, vSubDists(vCandidates.size()), vMatcherSubDists;
+        vector<const unsigned char*> vpRows;
+        for(size_t q=0; q<sizeof(vQueries)/sizeof(vQueries[0]); ++q)
+        {
+            const int a = vQueries[q];
+            const cv::Mat query = descriptors.row(a);
+
+            ORBmatcher::DescriptorDistances(query, descriptors, vDists);
+            for(int i=0; i<descriptors.rows; ++i)
+                bSame = bSame && vDists[i]==abs(a-i) && HammingDistance::Distance(query.data, descriptors.ptr(i))==abs(a-i)
+                        && ORBmatcher::DescriptorDistance(query, descriptors.row(i))==abs(a-i);
+
+            HammingDistance::Distances(query.data, &vpCandidates[0], vpCandidates.size(), &vSubDists[0]);
+            ORBmatcher::DescriptorDistances(query, descriptors, vCandidates, vMatcherSubDists, vpRows);
+            for(size_t i=0; i<vCandidates.size(); ++i)
+                bSame = bSame && vSubDists[i]==abs(a-vCandidates[i]) && vMatcherSubDists[i]==abs(a-vCandidates[i]);
+        }
+
+        // an odd number of rows, so that the kernels have a remainder
+        HammingDistance::Distances(descriptors.ptr(0), descriptors.ptr(0), descriptors.step, 101, &vDists[0]);
+        for(int i=0; i<101; ++i)
+            bSame = bSame && vDists[i]==i;
+
+        cout << HammingDistance::GetKernelName(kernel) << ": " << (bSame ? "passed" : "FAILED") << endl;
+        bPassed = bPassed && bSame;
+    }
+    HammingDistance::SetKernel(bestKernel);
+    return bPassed ? 0 : 1;
+}
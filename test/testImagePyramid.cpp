@@ -0,0 +1,81 @@
+// Sizes, values and memory of the levels of ImagePyramid on small images: the halving levels of a
+// ramp, which have known means and padding, and the ORB levels with their reflected border.
+// Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "ImagePyramid.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+bool CheckHalfLevels()
+{
+    // pixel (x, y) is x+40y, the 2x2 means of level 1 are 2u+80v+20.5 and of level 2 4u+61
+    cv::Mat image(6, 37, CV_8U);
+    for(int y=0; y<image.rows; ++y)
+        for(int x=0; x<image.cols; ++x)
+            image.at<uchar>(y, x) = (uchar)(x+40*y);
+    vector<float> vInvScaleFactors(1, 1.0f);
+    ImagePyramid pyramid(image, vInvScaleFactors, 19);
+
+    bool bSame = pyramid.GetHalfLevel(0).data==image.data;
+    const cv::Mat& half = pyramid.GetHalfLevel(1);
+    bSame = bSame && half.cols==18 && half.rows==3 && half.step[0]==32 && pyramid.GetMemoryBytes()==96;
+    for(int v=0; v<half.rows && bSame; ++v)
+        for(int u=0; u<32; ++u)
+            bSame = bSame && half.ptr<uchar>(v)[u]==(u<18 ? 2*u+80*v+20 : 0);
+
+    const cv::Mat& quarter = pyramid.GetHalfLevel(2);
+    bSame = bSame && quarter.cols==9 && quarter.rows==1 && quarter.step[0]==16;
+    for(int u=0; u<9 && bSame; ++u)
+        bSame = quarter.at<uchar>(0, u)==4*u+61;
+
+    cout << "halving levels: " << (bSame ? "passed" : "FAILED") << endl;
+    return bSame;
+}
+
+bool CheckORBLevels()
+{
+    cv::Mat image(50, 100, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    vector<float> vInvScaleFactors;
+    vInvScaleFactors.push_back(1.0f);
+    vInvScaleFactors.push_back(1.0f/1.2f);
+    vInvScaleFactors.push_back(1.0f/1.44f);
+    const int nBorder = 19;
+    ImagePyramid pyramid(image, vInvScaleFactors, nBorder);
+
+    // nothing is computed before it is asked for
+    bool bSame = pyramid.GetMemoryBytes()==0;
+
+    // the last level computes the others, each in a bordered image
+    const cv::Mat& level2 = pyramid.GetLevel(2);
+    const cv::Mat& level1 = pyramid.GetLevel(1);
+    const cv::Mat& level0 = pyramid.GetLevel(0);
+    bSame = bSame && level1.cols==83 && level1.rows==42 && level2.cols==69 && level2.rows==35;
+    bSame = bSame && pyramid.GetMemoryBytes()==(size_t)(88*138 + 80*121 + 73*107);
+
+    // level 0 is the image, reflected at its border without repeating the edge pixels
+    bSame = bSame && level0.size()==image.size() && cv::countNonZero(level0!=image)==0;
+    for(int y=0; y<image.rows && bSame; ++y)
+        bSame = level0.ptr<uchar>(y)[-1]==image.at<uchar>(y, 1) &&
+                level0.ptr<uchar>(y)[image.cols]==image.at<uchar>(y, image.cols-2);
+    bSame = bSame && level0.data[-nBorder*(int)level0.step[0]]==image.at<uchar>(nBorder, 0);
+
+    bSame = bSame && pyramid.GetBlurredLevel(1).size()==level1.size();
+
+    cout << "ORB levels: " << (bSame ? "passed" : "FAILED") << endl;
+    return bSame;
+}
+
+int main()
+{
+    bool bPassed = CheckHalfLevels();
+    bPassed = CheckORBLevels() && bPassed;
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+// Checks the relocalisation candidates of the keyframe database on keyframes with known words.
+// Keyframe i has the 10 words from 1000+10*i, the keyframes 100 to 199 also share the word 500.
+// The queries run one after another to check that each one starts from clean scratch arrays,
+// and on a thread pool once there are enough keyframes to score. Returns non-zero on a failure.
+// Usage: test_keyFrameDatabase <ORBvoc.txt|ORBvoc.bin>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vikit/pinhole_camera.h>
+
+#include "ORBVocabulary.h"
+#include "ORBextractor.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "Map.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+const DBoW2::WordId nSharedWord = 500;
+
+// the first nWords words of keyframe i
+void AddWords(size_t i, size_t nWords, DBoW2::BowVector& bowVec)
+{
+    for(size_t w=0; w<nWords; ++w)
+        bowVec.addWeight(1000+10*i+w, 1.0);
+}
+
+bool Check(const vector<KeyFrame*>& vpCandidates, const vector<KeyFrame*>& vpExpected, const string& name)
+{
+    const bool bSame = vpCandidates==vpExpected;
+    cout << name << ": " << vpCandidates.size() << " candidates, "
+         << (bSame ? "as expected" : "DIFFERENT from the expected ones") << endl;
+    return bSame;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <ORBvoc.txt|ORBvoc.bin>" << endl;
+        return 1;
+    }
+    string strVocFile = argv[1];
+
+    ORBVocabulary voc;
+    bool bLoaded = strVocFile.substr(strVocFile.find_last_of('.')+1) == "bin" ?
+                voc.loadFromBinaryFile(strVocFile) : voc.loadFromTextFile(strVocFile);
+    if(!bLoaded)
+    {
+        cerr << "Failed to open at: " << strVocFile << endl;
+        return 1;
+    }
+
+    // keyframes are copies of a frame with few features, only their bag of words vectors matter
+    cv::Mat image(480, 752, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(50, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+
+    Map map;
+    KeyFrameDatabase database(voc);
+    ThreadPool pool(4);
+    vector<KeyFrame*> vpKFs;
+    for(size_t i=0; i<200; ++i)
+    {
+        KeyFrame* pKF = new KeyFrame(frame, &map, &database);
+        pKF->mBowVec.clear();
+        AddWords(i, 10, pKF->mBowVec);
+        if(i >= 100)
+            pKF->mBowVec.addWeight(nSharedWord, 1.0);
+        pKF->mBowVec.normalize(DBoW2::L1);
+        database.add(pKF);
+        vpKFs.push_back(pKF);
+    }
+
+    bool bPassed = true;
+    Frame query(frame);
+
+    // the words of one keyframe give that keyframe
+    query.mBowVec.clear();
+    AddWords(42, 10, query.mBowVec);
+    query.mBowVec.normalize(DBoW2::L1);
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vector<KeyFrame*>(1, vpKFs[42]),
+                    "words of keyframe 42") && bPassed;
+
+    // half of the words of two keyframes give both, as they score the same
+    query.mBowVec.clear();
+    AddWords(17, 5, query.mBowVec);
+    AddWords(90, 5, query.mBowVec);
+    query.mBowVec.normalize(DBoW2::L1);
+    vector<KeyFrame*> vpExpected;
+    vpExpected.push_back(vpKFs[17]);
+    vpExpected.push_back(vpKFs[90]);
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vpExpected, "words of keyframes 17 and 90")
+              && bPassed;
+
+    // an erased keyframe is not found, its neighbour still is
+    database.erase(vpKFs[42]);
+    query.mBowVec.clear();
+    AddWords(42, 10, query.mBowVec);
+    query.mBowVec.normalize(DBoW2::L1);
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vector<KeyFrame*>(),
+                    "words of erased keyframe 42") && bPassed;
+    query.mBowVec.clear();
+    AddWords(43, 10, query.mBowVec);
+    query.mBowVec.normalize(DBoW2::L1);
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vector<KeyFrame*>(1, vpKFs[43]),
+                    "words of keyframe 43") && bPassed;
+
+    // the shared word gives the 100 keyframes having it, in the order they were added, serially and on the pool
+    query.mBowVec.clear();
+    query.mBowVec.addWeight(nSharedWord, 1.0);
+    vpExpected.assign(vpKFs.begin()+100, vpKFs.end());
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vpExpected, "shared word") && bPassed;
+    database.SetThreadPool(&pool);
+    bPassed = Check(database.DetectRelocalisationCandidates(&query), vpExpected, "shared word on the pool")
+              && bPassed;
+    database.SetThreadPool(NULL);
+
+    for(size_t i=0; i<vpKFs.size(); ++i)
+        delete vpKFs[i];
+    return bPassed ? 0 : 1;
+}
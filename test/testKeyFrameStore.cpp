@@ -0,0 +1,113 @@
+// Offloads keyframes to a KeyFrameStore and reads their features back through the KeyFrame accessors. The
+// keypoints, descriptors, feature vector and grid must be those before offloading, also after a keyframe is
+// offloaded a second time, and a keyframe whose record is lost must throw when it is made resident. Prints the
+// bytes written per offloaded keyframe and what stays in memory. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vikit/pinhole_camera.h>
+
+#include "ORBextractor.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameStore.h"
+#include "Map.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+bool SameKeyPoint(const cv::KeyPoint &a, const cv::KeyPoint &b)
+{
+    return a.pt==b.pt && a.size==b.size && a.angle==b.angle && a.response==b.response && a.octave==b.octave;
+}
+
+// the features of pKF read through its accessors, against those of the frame it was created from
+bool SameFeatures(KeyFrame* pKF, const Frame &frame)
+{
+    bool bSame = pKF->GetKeyPointsUn().size()==frame.mvKeysUn.size();
+    for(size_t i=0; i<frame.mvKeysUn.size() && bSame; ++i)
+    {
+        bSame = SameKeyPoint(pKF->GetKeyPointUn(i), frame.mvKeysUn[i]) &&
+                cv::countNonZero(pKF->GetDescriptor(i)!=frame.mDescriptors.row(i))==0 &&
+                pKF->GetKeyPointScaleLevel(i)==frame.mvKeysUn[i].octave;
+        if(i<frame.mvRightKeysUn.size())
+            bSame = bSame && SameKeyPoint(pKF->GetKeyPointUn(i, false), frame.mvRightKeysUn[i]);
+        if((int)i<frame.mRightDescriptors.rows)
+            bSame = bSame && cv::countNonZero(pKF->GetDescriptor(i, false)!=frame.mRightDescriptors.row(i))==0;
+    }
+    bSame = bSame && pKF->GetFeatureVector()==frame.mFeatVec;
+    // the rebuilt grid finds the same keypoints around every tenth one
+    for(size_t i=0; i<frame.mvKeysUn.size() && bSame; i+=10)
+    {
+        const cv::Point2f &pt = frame.mvKeysUn[i].pt;
+        bSame = pKF->GetFeaturesInArea(pt.x, pt.y, 20)==frame.GetFeaturesInArea(pt.x, pt.y, 20);
+    }
+    return bSame && !pKF->IsOffloaded();
+}
+
+int main()
+{
+    cv::Mat image(480, 752, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(1000, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+    // a feature vector and a bag of words with one word per feature, as no vocabulary is loaded
+    for(int i=0; i<frame.N; ++i)
+    {
+        frame.mFeatVec[i%64].push_back(i);
+        frame.mBowVec[i] = 1.0/frame.N;
+    }
+
+    Map map;
+    KeyFrameStore store("/tmp/test_keyframe_store_");
+    bool bPassed = frame.N>0 && store.IsOpen();
+    vector<KeyFrame*> vpKFs;
+    for(int k=0; k<3 && bPassed; ++k)
+    {
+        vpKFs.push_back(new KeyFrame(frame, &map, NULL));
+        vpKFs.back()->Offload(&store);
+        bPassed = vpKFs.back()->IsOffloaded();
+    }
+    const size_t nRecordBytes = vpKFs.empty() ? 0 : store.size()/vpKFs.size();
+
+    // reloaded in another order than offloaded, and the second offload frees the features without a new record
+    for(int k=(int)vpKFs.size()-1; k>=0 && bPassed; --k)
+        bPassed = SameFeatures(vpKFs[k], frame);
+    if(bPassed)
+    {
+        vpKFs[0]->Offload(&store);
+        bPassed = vpKFs[0]->IsOffloaded() && store.size()==nRecordBytes*vpKFs.size() && SameFeatures(vpKFs[0], frame);
+    }
+
+    // the features of an offloaded keyframe exist only in the store
+    if(bPassed)
+    {
+        vpKFs[1]->Offload(&store);
+        store.Clear();
+        bool bThrown = false;
+        try
+        {
+            vpKFs[1]->GetKeyPointUn(0);
+        }
+        catch(const std::runtime_error &)
+        {
+            bThrown = true;
+        }
+        bPassed = bThrown;
+    }
+
+    cout << "Keyframe store of " << frame.N << " keypoints, " << nRecordBytes << " bytes offloaded per keyframe, "
+         << frame.mBowVec.size() << " words and " << frame.mvpMapPoints.size()
+         << " map point slots resident: " << (bPassed ? "passed" : "FAILED") << endl;
+
+    for(size_t k=0; k<vpKFs.size(); ++k)
+        delete vpKFs[k];
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// ORB orientation moments and descriptor bits with every kernel supported by this CPU on flat and
+// ramp patches, where both are known, then the keypoints and descriptors of ORBextractor with each
+// kernel against those of the scalar code. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ORBKernels.h"
+#include "ORBextractor.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+// 41x41 patch around (20, 20) of value 100 plus dx times the column offset plus dy times the row offset
+cv::Mat Ramp(int dx, int dy)
+{
+    cv::Mat patch(41, 41, CV_8U);
+    for(int y=0; y<patch.rows; ++y)
+        for(int x=0; x<patch.cols; ++x)
+            patch.at<uchar>(y, x) = (uchar)(100 + dx*(x-20) + dy*(y-20));
+    return patch;
+}
+
+bool CheckPatch(const cv::Mat& patch, const vector<int>& u_max, const vector<int>& vPattern, float a, float b,
+                int expected_m_01, int expected_m_10, unsigned char expectedByte)
+{
+    const unsigned char* center = patch.ptr<uchar>(20) + 20;
+    int m_01, m_10;
+    ORBKernels::ICMoments(center, (int)patch.step[0], &u_max[0], m_01, m_10);
+    unsigned char desc[32];
+    ORBKernels::Descriptor(center, (int)patch.step[0], a, b, &vPattern[0], desc);
+
+    bool bSame = m_01==expected_m_01 && m_10==expected_m_10;
+    for(int i=0; i<32; ++i)
+        bSame = bSame && desc[i]==expectedByte;
+    return bSame;
+}
+
+bool SameExtraction(const vector<cv::KeyPoint>& vKeys, const cv::Mat& descriptors,
+                    const vector<cv::KeyPoint>& vRefKeys, const cv::Mat& refDescriptors)
+{
+    bool bSame = vKeys.size()==vRefKeys.size() && descriptors.rows==refDescriptors.rows;
+    for(size_t i=0; i<vKeys.size() && bSame; ++i)
+        bSame = vKeys[i].pt==vRefKeys[i].pt && vKeys[i].angle==vRefKeys[i].angle &&
+                vKeys[i].octave==vRefKeys[i].octave;
+    return bSame && (descriptors.empty() || cv::countNonZero(descriptors!=refDescriptors)==0);
+}
+
+int main()
+{
+    // a square patch, so that each of its 31 rows of a horizontal ramp adds 2*(1+4+...+225) to m_10
+    vector<int> u_max(16, 15);
+    const int nRampMoment = 31*2480;
+
+    // pairs alternate between a left to right and a right to left comparison of the neighbours of the center,
+    // every byte of a descriptor along an increasing ramp is 01010101
+    vector<int> vPattern;
+    for(int p=0; p<256; ++p)
+    {
+        const int s = p%2==0 ? 1 : -1;
+        vPattern.push_back(-s); vPattern.push_back(0);
+        vPattern.push_back(s); vPattern.push_back(0);
+    }
+
+    cv::Mat image(480, 752, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+    ORBextractor extractor(1000, 1.2f, 8);
+
+    ORBKernels::Kernel bestKernel = ORBKernels::GetKernel();
+    ORBKernels::SetKernel(ORBKernels::SCALAR);
+    vector<cv::KeyPoint> vRefKeys;
+    cv::Mat refDescriptors;
+    extractor(image, cv::Mat(), vRefKeys, refDescriptors);
+    // descriptors for given keypoints, as computed for the libviso2 matches
+    vector<cv::KeyPoint> vRefGivenKeys = vRefKeys;
+    cv::Mat refGivenDescriptors;
+    extractor(image, vRefGivenKeys, refGivenDescriptors);
+
+    bool bPassed = true;
+    for(int k=ORBKernels::SCALAR; k<=ORBKernels::SSE2; ++k)
+    {
+        ORBKernels::Kernel kernel = (ORBKernels::Kernel)k;
+        if(!ORBKernels::SetKernel(kernel))
+            continue;
+
+        // at 90 degrees the pattern samples above and below the center
+        bool bSame = CheckPatch(Ramp(0, 0), u_max, vPattern, 1, 0, 0, 0, 0x00);
+        bSame = CheckPatch(Ramp(1, 0), u_max, vPattern, 1, 0, 0, nRampMoment, 0x55) && bSame;
+        bSame = CheckPatch(Ramp(0, 1), u_max, vPattern, 0, 1, nRampMoment, 0, 0x55) && bSame;
+        bSame = CheckPatch(Ramp(-1, 0), u_max, vPattern, 1, 0, 0, -nRampMoment, 0xaa) && bSame;
+
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        extractor(image, cv::Mat(), vKeys, descriptors);
+        bSame = SameExtraction(vKeys, descriptors, vRefKeys, refDescriptors) && bSame;
+        vector<cv::KeyPoint> vGivenKeys = vRefKeys;
+        extractor(image, vGivenKeys, descriptors);
+        bSame = SameExtraction(vGivenKeys, descriptors, vRefGivenKeys, refGivenDescriptors) && bSame;
+
+        cout << ORBKernels::GetKernelName(kernel) << ": " << (bSame ? "passed" : "FAILED") << endl;
+        bPassed = bPassed && bSame;
+    }
+    ORBKernels::SetKernel(bestKernel);
+    return bPassed ? 0 : 1;
+}
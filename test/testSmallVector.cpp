@@ -0,0 +1,94 @@
+// SmallVector<int, 8>: where the elements are stored around the inline capacity, erase, copies and
+// self insertion, then random insertions and erasures against std::vector. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+#include "SmallVector.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+typedef SmallVector<int, 8> IntVector;
+
+bool IsInline(const IntVector& v)
+{
+    const char* p = (const char*)v.begin();
+    return p >= (const char*)&v && p < (const char*)(&v+1);
+}
+
+bool Equals(const IntVector& v, const int* pExpected, size_t n)
+{
+    bool bSame = v.size()==n && (size_t)(v.end()-v.begin())==n;
+    for(size_t i=0; i<n && bSame; ++i)
+        bSame = v[i]==pExpected[i];
+    return bSame;
+}
+
+int main()
+{
+    const int vValues[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+    IntVector small;
+    bool bPassed = small.empty() && IsInline(small);
+    for(int i=0; i<8; ++i)
+        small.push_back(i);
+    bPassed = bPassed && IsInline(small) && Equals(small, vValues, 8);
+
+    // the ninth element moves them all to the heap, even when it is one of them
+    small.push_back(small[0]);
+    small[8] = 8;
+    small.push_back(9);
+    bPassed = bPassed && !IsInline(small) && Equals(small, vValues, 10);
+
+    // erase keeps the order and returns the next element
+    const int vErased[] = {0, 2, 3, 4, 5, 6, 7, 8};
+    IntVector::iterator it = small.erase(small.begin()+1);
+    bPassed = bPassed && *it==2;
+    it = small.erase(small.end()-1);
+    bPassed = bPassed && it==small.end() && Equals(small, vErased, 8);
+
+    // a short copy stays inline, a long one goes to the heap, and assignment replaces the elements
+    IntVector copy(small);
+    bPassed = bPassed && IsInline(copy) && Equals(copy, vErased, 8);
+    copy.push_back(9);
+    copy.push_back(10);
+    IntVector longCopy(copy);
+    bPassed = bPassed && !IsInline(longCopy) && longCopy.size()==10 && longCopy[9]==10;
+    longCopy = small;
+    bPassed = bPassed && Equals(longCopy, vErased, 8);
+    small.clear();
+    bPassed = bPassed && small.empty() && Equals(longCopy, vErased, 8);
+    cout << "SmallVector: " << (bPassed ? "passed" : "FAILED") << endl;
+
+    bool bSame = true;
+    srand(0);
+    vector<int> reference;
+    for(int i=0; i<10000 && bSame; ++i)
+    {
+        if(reference.empty() || rand()%3 != 0 || reference.size() < 4)
+        {
+            small.push_back(i);
+            reference.push_back(i);
+        }
+        else
+        {
+            const size_t k = rand()%reference.size();
+            small.erase(small.begin()+k);
+            reference.erase(reference.begin()+k);
+        }
+        if(reference.size() > 20)
+        {
+            small.clear();
+            reference.clear();
+        }
+        IntVector randomCopy(small);
+        bSame = randomCopy.size()==reference.size();
+        for(size_t k=0; k<reference.size() && bSame; ++k)
+            bSame = randomCopy[k]==reference[k] && small[k]==reference[k];
+    }
+    cout << "SmallVector against std::vector: " << (bSame ? "same" : "DIFFERENT") << endl;
+
+    return bPassed && bSame ? 0 : 1;
+}
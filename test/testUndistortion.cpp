@@ -0,0 +1,66 @@
+// Undistortion of keypoints by vk::PinholeCamera: unchanged without distortion, and with the distortion
+// of the EuRoC left camera, close to cv::undistortPoints all over the image and mapped back to the
+// distorted positions by world2cam. Returns non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vikit/pinhole_camera.h>
+
+using namespace std;
+
+int main()
+{
+    const double fx = 458.654, fy = 457.296, cx = 367.215, cy = 248.375;
+    const double k1 = -0.28340811, k2 = 0.07395907, p1 = 0.00019359, p2 = 1.76187114e-05;
+
+    // keypoints every 25.3 pixels over the image, and a few out of it
+    vector<cv::KeyPoint> vKeys;
+    for(float v=0.5f; v<480; v+=25.3f)
+        for(float u=0.5f; u<752; u+=25.3f)
+            vKeys.push_back(cv::KeyPoint(u, v, 31, 45, 0, (int)vKeys.size()%8));
+    vKeys.push_back(cv::KeyPoint(-3, 100, 31, 45, 0, 1));
+    vKeys.push_back(cv::KeyPoint(760, 470, 31, 45, 0, 2));
+
+    vector<cv::KeyPoint> vKeysUn;
+    vk::PinholeCamera pinhole(752, 480, fx, fy, cx, cy);
+    pinhole.undistortKeyPoints(vKeys, vKeysUn);
+    bool bPassed = vKeysUn.size()==vKeys.size();
+    for(size_t i=0; i<vKeys.size() && bPassed; ++i)
+        bPassed = vKeysUn[i].pt==vKeys[i].pt && vKeysUn[i].octave==vKeys[i].octave;
+    cout << "without distortion: " << (bPassed ? "passed" : "FAILED") << endl;
+
+    vk::PinholeCamera cam(752, 480, fx, fy, cx, cy, k1, k2, p1, p2);
+    cam.undistortKeyPoints(vKeys, vKeysUn);
+
+    cv::Mat K = (cv::Mat_<double>(3,3) << fx, 0, cx, 0, fy, cy, 0, 0, 1);
+    cv::Mat distCoef = (cv::Mat_<double>(4,1) << k1, k2, p1, p2);
+    cv::Mat points(vKeys.size(), 1, CV_32FC2);
+    for(size_t i=0; i<vKeys.size(); ++i)
+        points.at<cv::Point2f>(i) = vKeys[i].pt;
+    cv::undistortPoints(points, points, K, distCoef, cv::Mat(), K);
+
+    // the lookup table interpolates cv::undistortPoints, whose iterations are only accurate to about a
+    // tenth of a pixel in the corners, so the round trip is checked at that tolerance
+    bool bSame = vKeysUn.size()==vKeys.size();
+    float maxLutError = 0, maxRoundTripError = 0;
+    for(size_t i=0; i<vKeysUn.size() && bSame; ++i)
+    {
+        const cv::Point2f& un = vKeysUn[i].pt;
+        const cv::Point2f lutError = un - points.at<cv::Point2f>(i);
+        maxLutError = max(maxLutError, max(fabsf(lutError.x), fabsf(lutError.y)));
+        const Eigen::Vector2d px = cam.world2cam(Eigen::Vector2d((un.x-cx)/fx, (un.y-cy)/fy));
+        maxRoundTripError = max(maxRoundTripError, (float)max(fabs(px[0]-vKeys[i].pt.x), fabs(px[1]-vKeys[i].pt.y)));
+        bSame = vKeysUn[i].octave==vKeys[i].octave && vKeysUn[i].angle==vKeys[i].angle &&
+                vKeysUn[i].size==vKeys[i].size;
+    }
+    bSame = bSame && maxLutError<0.01f && maxRoundTripError<0.1f;
+    cout << "with distortion: " << (bSame ? "passed" : "FAILED") << ", up to " << maxLutError
+         << " pixels from cv::undistortPoints, " << maxRoundTripError << " pixels from the distorted keypoints"
+         << endl;
+
+    return bPassed && bSame ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+// Checks that the ORB vocabulary loaded from the text (.txt), memory mapped binary (.bin) and
+// cv::FileStorage (.yml) files assigns the same words to a set of random descriptors, and that
+// truncated or corrupted copies of the binary file are rejected. Returns non-zero on a failure.
+// Usage: test_vocabularyLoading <ORBvoc.txt> [ORBvoc.yml] [ORBvoc.bin]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "ORBVocabulary.h"
+
+using namespace std;
+
+bool CompareWords(const ORB_SLAM::ORBVocabulary& ref, const ORB_SLAM::ORBVocabulary& voc,
+                  const std::vector<cv::Mat>& vDesc, const std::string& name)
+{
+    DBoW2::BowVector bowRef, bow;
+    DBoW2::FeatureVector featRef, feat;
+    ref.transform(vDesc, bowRef, featRef, 4);
+    voc.transform(vDesc, bow, feat, 4);
+    bool bSame = bowRef.size() == bow.size() && featRef.size() == feat.size();
+    for(DBoW2::BowVector::const_iterator it = bowRef.begin(), jt = bow.begin();
+        bSame && it != bowRef.end(); ++it, ++jt)
+        bSame = it->first == jt->first && std::fabs(it->second - jt->second) < 1e-9;
+    std::cout << name << (bSame ? " gives the same" : " gives DIFFERENT")
+              << " BoW vectors as the text vocabulary" << std::endl;
+    return bSame;
+}
+
+// loads a modified copy of a binary vocabulary, which must fail
+bool CheckRejected(const std::string& strData, const std::string& name)
+{
+    char path[] = "/tmp/vocabularyXXXXXX";
+    const int fd = mkstemp(path);
+    if(fd < 0)
+    {
+        cerr << "Unable to create a temporary file" << endl;
+        return false;
+    }
+    close(fd);
+    {
+        ofstream f(path, ios_base::out | ios_base::binary);
+        f.write(strData.data(), strData.size());
+    }
+
+    ORB_SLAM::ORBVocabulary voc;
+    const bool bRejected = !voc.loadFromBinaryFile(path);
+    unlink(path);
+    std::cout << name << (bRejected ? " is rejected" : " is ACCEPTED") << std::endl;
+    return bRejected;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <ORBvoc.txt> [ORBvoc.yml] [ORBvoc.bin]" << endl;
+        return 1;
+    }
+    string strTxtFile = argv[1];
+    string strBase = strTxtFile.substr(0, strTxtFile.find_last_of('.'));
+    string strYmlFile = argc > 2 ? string(argv[2]) : strBase + ".yml";
+    string strBinFile = argc > 3 ? string(argv[3]) : strBase + ".bin";
+
+    cv::RNG rng(7);
+    std::vector<cv::Mat> vDesc(1000);
+    for(size_t i = 0; i < vDesc.size(); ++i)
+    {
+        vDesc[i].create(1, 32, CV_8U);
+        rng.fill(vDesc[i], cv::RNG::UNIFORM, 0, 256);
+    }
+
+    ORB_SLAM::ORBVocabulary txtVoc;
+    if(!txtVoc.loadFromTextFile(strTxtFile))
+    {
+        cerr << "Failed to open at: " << strTxtFile << endl;
+        return 1;
+    }
+
+    bool bAllSame = true;
+    ORB_SLAM::ORBVocabulary binVoc;
+    if(binVoc.loadFromBinaryFile(strBinFile))
+    {
+        bAllSame = CompareWords(txtVoc, binVoc, vDesc, "binary") && bAllSame;
+
+        ifstream f(strBinFile.c_str(), ios_base::in | ios_base::binary);
+        stringstream ss;
+        ss << f.rdbuf();
+        const string strData = ss.str();
+        bAllSame = CheckRejected(strData.substr(0, strData.size()/2), "binary cut in half") && bAllSame;
+
+        // the first child of the root refers to one past the last node. The header has 8 magic bytes,
+        // 9 fields of 4 bytes and 8 reserved bytes, then come the node weights, parents, word ids and
+        // child offsets
+        uint32_t nNodes;
+        memcpy(&nNodes, strData.data()+32, sizeof(nNodes));
+        string strCorrupted = strData;
+        const size_t nChildIds = 52 + (sizeof(double) + 2*sizeof(uint32_t))*nNodes + sizeof(uint32_t)*(nNodes+1);
+        if(nChildIds + sizeof(uint32_t) <= strCorrupted.size())
+            memcpy(&strCorrupted[nChildIds], &nNodes, sizeof(nNodes));
+        bAllSame = CheckRejected(strCorrupted, "binary with a child out of the tree") && bAllSame;
+    }
+    else
+        cout << "Skip binary vocabulary, unable to open " << strBinFile << endl;
+
+    cv::FileStorage fsVoc(strYmlFile.c_str(), cv::FileStorage::READ);
+    if(fsVoc.isOpened())
+    {
+        ORB_SLAM::ORBVocabulary ymlVoc;
+        ymlVoc.load(fsVoc);
+        bAllSame = CompareWords(txtVoc, ymlVoc, vDesc, "yml") && bAllSame;
+    }
+    else
+        cout << "Skip yml vocabulary, unable to open " << strYmlFile << endl;
+    return bAllSame ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Checks that the flattened tree of ORBVocabulary gives the same bow and feature vectors as the DBoW2
+// descent, serially and on a thread pool, on frames of random descriptors, and that these vectors are
+// consistent: no feature is in two nodes and the bow vector is L1 normalized. Returns non-zero on a failure.
+// Usage: test_vocabularyTransform <ORBvoc.txt|ORBvoc.bin>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include <opencv2/core/core.hpp>
+
+#include "ORBVocabulary.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+// featVec has features of the frame, none twice, and the weights of bowVec add up to 1.
+// Features of stopped words are in neither
+bool IsConsistent(const DBoW2::BowVector& bowVec, const DBoW2::FeatureVector& featVec, int nFeatures)
+{
+    vector<int> vCount(nFeatures, 0);
+    for(DBoW2::FeatureVector::const_iterator it=featVec.begin(); it!=featVec.end(); ++it)
+        for(size_t i=0; i<it->second.size(); ++i)
+        {
+            if(it->second[i] >= (unsigned int)nFeatures)
+                return false;
+            ++vCount[it->second[i]];
+        }
+    int nTotal = 0;
+    bool bConsistent = true;
+    for(int i=0; i<nFeatures; ++i)
+    {
+        bConsistent = bConsistent && vCount[i]<=1;
+        nTotal += vCount[i];
+    }
+
+    double sum = 0;
+    for(DBoW2::BowVector::const_iterator it=bowVec.begin(); it!=bowVec.end(); ++it)
+        sum += it->second;
+    return bConsistent && nTotal>0 && fabs(sum-1.0) < 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <ORBvoc.txt|ORBvoc.bin>" << endl;
+        return 1;
+    }
+    string strVocFile = argv[1];
+
+    ORBVocabulary voc;
+    bool bLoaded = strVocFile.substr(strVocFile.find_last_of('.')+1) == "bin" ?
+                voc.loadFromBinaryFile(strVocFile) : voc.loadFromTextFile(strVocFile);
+    if(!bLoaded)
+    {
+        cerr << "Failed to open at: " << strVocFile << endl;
+        return 1;
+    }
+
+    // an empty frame, a frame smaller than a task of the pool and full frames
+    const int vnFeatures[] = {0, 7, 500, 1000, 2000};
+    ThreadPool pool(4);
+    cv::RNG rng(3);
+    bool bSame = true;
+    for(size_t f=0; f<sizeof(vnFeatures)/sizeof(vnFeatures[0]); ++f)
+    {
+        cv::Mat descriptors(vnFeatures[f], 32, CV_8U);
+        rng.fill(descriptors, cv::RNG::UNIFORM, 0, 256);
+        vector<cv::Mat> vDesc;
+        vDesc.reserve(descriptors.rows);
+        for(int j=0; j<descriptors.rows; ++j)
+            vDesc.push_back(descriptors.row(j));
+
+        DBoW2::BowVector bowVec[3];
+        DBoW2::FeatureVector featVec[3];
+        voc.transform(vDesc, bowVec[0], featVec[0], 4);
+        voc.transform(descriptors, bowVec[1], featVec[1], 4);
+        voc.transform(descriptors, bowVec[2], featVec[2], 4, &pool);
+
+        bool bFrame = bowVec[0]==bowVec[1] && bowVec[0]==bowVec[2] &&
+                      featVec[0]==featVec[1] && featVec[0]==featVec[2];
+        bFrame = bFrame && (vnFeatures[f]==0 ? bowVec[0].empty() && featVec[0].empty() :
+                                               IsConsistent(bowVec[0], featVec[0], vnFeatures[f]));
+        cout << vnFeatures[f] << " features: " << (bFrame ? "the same" : "DIFFERENT") << " bow and feature vectors"
+             << endl;
+        bSame = bSame && bFrame;
+    }
+    return bSame ? 0 : 1;
+}
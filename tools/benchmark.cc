@@ -0,0 +1,602 @@
+/**
+* This file is part of ORB-SLAM.
+*
+* ORB-SLAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times building blocks of the front-end and back-end on synthetic data. The correctness of each of them is
+// checked by its test in test/, this only reports times. Naming a benchmark runs only that one, those that need
+// the vocabulary are skipped when no vocabulary file is given.
+// Usage: benchmark [name|all] [path_to_ORBvoc.txt/bin] [number of threads]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <viso2/matcher.h>
+#include <vikit/pinhole_camera.h>
+#include <vikit/timer.h>
+
+#include "Frame.h"
+#include "FrameGrid.h"
+#include "FrustumCulling.h"
+#include "HammingDistance.h"
+#include "ImagePyramid.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "ORBKernels.h"
+#include "ORBVocabulary.h"
+#include "ORBextractor.h"
+#include "ORBmatcher.h"
+#include "SmallVector.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace ORB_SLAM;
+
+struct BenchmarkSettings
+{
+    string strVocFile;
+    int nThreads;
+};
+
+// blurred noise gives corners all over the image
+cv::Mat NoiseImage(int rows, int cols)
+{
+    cv::Mat image(rows, cols, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5,5), 1.5);
+    return image;
+}
+
+bool LoadVocabulary(ORBVocabulary& voc, const string& strVocFile)
+{
+    return strVocFile.substr(strVocFile.find_last_of('.')+1) == "bin" ?
+                voc.loadFromBinaryFile(strVocFile) : voc.loadFromTextFile(strVocFile);
+}
+
+// loaded once for all the benchmarks that use it, NULL if it can not be loaded
+ORBVocabulary* GetVocabulary(const string& strVocFile)
+{
+    static ORBVocabulary* pVocabulary = NULL;
+    static bool bLoaded = false;
+    if(!bLoaded)
+    {
+        bLoaded = true;
+        pVocabulary = new ORBVocabulary();
+        if(!LoadVocabulary(*pVocabulary, strVocFile))
+        {
+            cerr << "Failed to open at: " << strVocFile << endl;
+            delete pVocabulary;
+            pVocabulary = NULL;
+        }
+    }
+    return pVocabulary;
+}
+
+void BenchmarkHammingDistance(const BenchmarkSettings&)
+{
+    const int N = 10000, nQueries = 200;
+    cv::Mat descriptors(N, 32, CV_8U);
+    cv::RNG rng(0);
+    rng.fill(descriptors, cv::RNG::UNIFORM, 0, 256);
+
+    HammingDistance::Kernel bestKernel = HammingDistance::GetKernel();
+    vector<int> vDists(N);
+    for(int k=HammingDistance::SCALAR; k<=HammingDistance::AVX2; ++k)
+    {
+        HammingDistance::Kernel kernel = (HammingDistance::Kernel)k;
+        if(!HammingDistance::SetKernel(kernel))
+            continue;
+
+        vk::Timer timer;
+        for(int q=0; q<nQueries; ++q)
+            ORBmatcher::DescriptorDistances(descriptors.row(q), descriptors, vDists);
+        const double tBatch = timer.stop();
+        timer.start();
+        for(int q=0; q<nQueries; ++q)
+            for(int i=0; i<N; ++i)
+                vDists[i] = ORBmatcher::DescriptorDistance(descriptors.row(q), descriptors.row(i));
+        const double tSingle = timer.stop();
+
+        cout << "hamming " << HammingDistance::GetKernelName(kernel) << ": batch " << tBatch*1e9/(nQueries*N)
+             << " ns, single " << tSingle*1e9/(nQueries*N) << " ns per descriptor" << endl;
+    }
+    HammingDistance::SetKernel(bestKernel);
+}
+
+void BenchmarkORBKernels(const BenchmarkSettings&)
+{
+    cv::Mat image = NoiseImage(480, 752);
+    ORBextractor extractor(2000, 1.2f, 8);
+    const int nRuns = 20;
+
+    ORBKernels::Kernel bestKernel = ORBKernels::GetKernel();
+    for(int k=ORBKernels::SCALAR; k<=ORBKernels::SSE2; ++k)
+    {
+        ORBKernels::Kernel kernel = (ORBKernels::Kernel)k;
+        if(!ORBKernels::SetKernel(kernel))
+            continue;
+
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        vk::Timer timer;
+        for(int r=0; r<nRuns; ++r)
+            extractor(image, cv::Mat(), vKeys, descriptors);
+        cout << "orb " << ORBKernels::GetKernelName(kernel) << ": " << timer.stop()*1e3/nRuns
+             << " ms per extraction of " << vKeys.size() << " features" << endl;
+    }
+    ORBKernels::SetKernel(bestKernel);
+}
+
+// libviso2 stereo matching and the ORB descriptors of the matches of a stereo pair, with the half resolution
+// images taken from the pyramids shared with ORBextractor or built inside libviso2 next to full ORB pyramids.
+// Returns the bytes of the pyramids
+size_t ProcessPair(libviso2::Matcher& matcher, ORBextractor& extractor, cv::Mat& left, cv::Mat& right, bool bShared)
+{
+    int32_t dims[] = {left.cols, left.rows, left.cols};
+    ImagePyramid leftPyramid = extractor.CreatePyramid(left);
+    ImagePyramid rightPyramid = extractor.CreatePyramid(right);
+    size_t nLibviso2HalfBytes = 0;
+    if(bShared)
+    {
+        const cv::Mat& leftHalf = leftPyramid.GetHalfLevel(1);
+        const cv::Mat& rightHalf = rightPyramid.GetHalfLevel(1);
+        matcher.pushBack(left.data, right.data, dims, false, leftHalf.data, rightHalf.data, (int32_t)leftHalf.step);
+    }
+    else
+    {
+        extractor.ComputePyramid(leftPyramid);
+        extractor.ComputePyramid(rightPyramid);
+        matcher.pushBack(left.data, right.data, dims, false);
+        const int halfWidth = left.cols/2;
+        nLibviso2HalfBytes = 2*(halfWidth + 15-(halfWidth-1)%16)*(left.rows/2);
+    }
+    matcher.matchFeatures(1);
+    vector<p_match> vStereoMatches = matcher.getMatches();
+
+    vector<cv::KeyPoint> vLeftKeys, vRightKeys;
+    for(size_t i=0; i<vStereoMatches.size(); ++i)
+    {
+        vLeftKeys.push_back(cv::KeyPoint(vStereoMatches[i].u1c, vStereoMatches[i].v1c, 11));
+        vRightKeys.push_back(cv::KeyPoint(vStereoMatches[i].u2c, vStereoMatches[i].v2c, 11));
+    }
+    cv::Mat leftDescriptors, rightDescriptors;
+    extractor(leftPyramid, vLeftKeys, leftDescriptors);
+    extractor(rightPyramid, vRightKeys, rightDescriptors);
+    return leftPyramid.GetMemoryBytes() + rightPyramid.GetMemoryBytes() + nLibviso2HalfBytes;
+}
+
+void BenchmarkImagePyramid(const BenchmarkSettings&)
+{
+    // the right image shifted by a disparity of 8 pixels
+    cv::Mat noise = NoiseImage(376, 1249);
+    cv::Mat left = noise.colRange(8, noise.cols).clone();
+    cv::Mat right = noise.colRange(0, noise.cols-8).clone();
+    const int nRuns = 20;
+
+    // the single level of the KITTI and Tsukuba settings, and a full ORB pyramid
+    const int vnLevels[] = {1, 8};
+    libviso2::Matcher::parameters param;
+    param.half_resolution = 1;
+    const char* names[] = {"separate", "shared"};
+    for(int l=0; l<2; ++l)
+    {
+        ORBextractor extractor(1000, 1.2f, vnLevels[l]);
+        for(int s=0; s<2; ++s)
+        {
+            libviso2::Matcher matcher(param);
+            size_t nBytes = 0;
+            vk::Timer timer;
+            for(int r=0; r<nRuns; ++r)
+                nBytes = ProcessPair(matcher, extractor, left, right, s==1);
+            cout << "pyramid " << names[s] << ", " << vnLevels[l] << " ORB levels: " << timer.stop()*1e3/nRuns
+                 << " ms, " << nBytes/1024 << " KB per stereo pair" << endl;
+        }
+    }
+}
+
+void BenchmarkFrameGrid(const BenchmarkSettings&)
+{
+    cv::Mat image = NoiseImage(480, 752);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(2000, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+    const int nRuns = 100;
+
+    FrameGrid grid(64, 48);
+    const float cellWidthInv = 64.0f/image.cols, cellHeightInv = 48.0f/image.rows;
+    vk::Timer timer;
+    for(int r=0; r<nRuns; ++r)
+        grid.Build(frame.mvKeysUn, 0, 0, cellWidthInv, cellHeightInv);
+    const double tBuild = timer.stop();
+
+    timer.start();
+    for(int r=0; r<nRuns; ++r)
+        FrameGrid copy(grid);
+    const double tCopy = timer.stop();
+
+    size_t nFound = 0;
+    timer.start();
+    for(size_t i=0; i<frame.mvKeysUn.size(); ++i)
+        nFound += grid.GetFeaturesInArea(frame.mvKeysUn[i].pt.x, frame.mvKeysUn[i].pt.y, 15).size();
+    const double tSearch = timer.stop();
+
+    cout << "grid of " << grid.size() << " keypoints: build " << tBuild*1e6/nRuns << " us, copy "
+         << tCopy*1e6/nRuns << " us, search " << tSearch*1e9/max<size_t>(1, frame.mvKeysUn.size())
+         << " ns per search of " << (double)nFound/max<size_t>(1, frame.mvKeysUn.size()) << " keypoints" << endl;
+}
+
+void BenchmarkFrameHandoff(const BenchmarkSettings&)
+{
+    cv::Mat image = NoiseImage(480, 752);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(1000, 1.2f, 8);
+    Frame tracked(image, 0.0, &extractor, NULL, &cam);
+    const int nRuns = 100;
+
+    // the frame handed off is deleted afterwards, as mpLastFrame in Tracking
+    double dTime[2] = {0, 0};
+    for(int r=0; r<nRuns; ++r)
+    {
+        Frame* pCopied = new Frame(tracked);
+        Frame* pMoved = new Frame(tracked);
+        vk::Timer timer;
+        Frame* pCopy = new Frame(*pCopied);
+        dTime[0] += timer.stop();
+        timer.start();
+        Frame* pMove = new Frame(std::move(*pMoved));
+        dTime[1] += timer.stop();
+        delete pCopied;
+        delete pMoved;
+        delete pCopy;
+        delete pMove;
+    }
+    cout << "handoff of " << tracked.N << " keypoints: copy " << dTime[0]*1e6/nRuns << " us, move "
+         << dTime[1]*1e6/nRuns << " us per frame" << endl;
+}
+
+void BenchmarkFrustumCulling(const BenchmarkSettings&)
+{
+    // a keyframe at the origin observes the points, the frame has moved forward and turned a little
+    cv::Mat image = NoiseImage(376, 1241);
+    vk::PinholeCamera cam(image.cols, image.rows, 718.856, 718.856, 607.193, 185.216);
+    ORBextractor extractor(200, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+    const int nRuns = 20;
+
+    Map map;
+    KeyFrame* pKF = new KeyFrame(frame, &map, NULL);
+    pKF->SetPose(Sophus::SE3d());
+
+    // the right camera is the left one, 0.537 meters to the right
+    frame.mTl2r = Sophus::SE3d(Eigen::Matrix3d::Identity(), Eigen::Vector3d(-0.537, 0, 0));
+    Eigen::Matrix3d Rcw = Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitY()).toRotationMatrix();
+    frame.SetPose(Rcw, -Rcw*Eigen::Vector3d(0.2, 0, 1.5));
+    frame.UpdatePoseMatrices();
+
+    // points seen by the keyframe 2 to 60 meters away, some of them out of the view of the frame
+    cv::RNG rng(0);
+    vector<MapPoint*> vpMPs;
+    for(size_t i=0; i<20000; ++i)
+    {
+        const double z = rng.uniform(2.0, 60.0);
+        const Eigen::Vector3d x3D(rng.uniform(-1.0, 1.0)*z, rng.uniform(-0.4, 0.4)*z, z);
+        MapPoint* pMP = new MapPoint(x3D, pKF, i%pKF->N, &map);
+        pMP->UpdateNormalAndDepth();
+        vpMPs.push_back(pMP);
+    }
+
+    vk::Timer timer;
+    size_t nInView = 0;
+    for(int r=0; r<nRuns; ++r)
+    {
+        nInView = 0;
+        for(size_t i=0; i<vpMPs.size(); ++i)
+            nInView += frame.isInFrustumStereo(vpMPs[i], 0.5);
+    }
+    cout << "frustum culling of " << vpMPs.size() << " points, " << nInView << " in view: point by point "
+         << timer.stop()*1e3/nRuns << " ms" << endl;
+
+    FrustumCulling::Kernel bestKernel = FrustumCulling::GetKernel();
+    for(int k=FrustumCulling::SCALAR; k<=FrustumCulling::AVX; ++k)
+    {
+        FrustumCulling::Kernel kernel = (FrustumCulling::Kernel)k;
+        if(!FrustumCulling::SetKernel(kernel))
+            continue;
+
+        FrustumCulling::Batch batch;
+        double tAssign = 0, tCull = 0;
+        for(int r=0; r<nRuns; ++r)
+        {
+            timer.start();
+            batch.Assign(vpMPs);
+            tAssign += timer.stop();
+            timer.start();
+            frame.isInFrustumStereo(batch, 0.5);
+            tCull += timer.stop();
+        }
+        cout << "frustum culling " << FrustumCulling::GetKernelName(kernel) << ": snapshot " << tAssign*1e3/nRuns
+             << " ms, culling " << tCull*1e3/nRuns << " ms" << endl;
+    }
+    FrustumCulling::SetKernel(bestKernel);
+
+    for(size_t i=0; i<vpMPs.size(); ++i)
+        delete vpMPs[i];
+    delete pKF;
+}
+
+struct Observation
+{
+    void* pKF;
+    int nLeft;
+    int nRight;
+};
+
+void BenchmarkSmallVector(const BenchmarkSettings&)
+{
+    // copy and scan of the observations of map points, as made by MapPoint::GetObservations
+    const int nPoints = 100000, nObs = 6;
+    vector<map<void*, size_t> > vMaps(nPoints);
+    vector<SmallVector<Observation, 8> > vSmall(nPoints);
+    for(int i=0; i<nPoints; ++i)
+        for(int j=0; j<nObs; ++j)
+        {
+            Observation obs = {reinterpret_cast<void*>((size_t)8*(j+1)), i, i};
+            vMaps[i][obs.pKF] = i;
+            vSmall[i].push_back(obs);
+        }
+
+    size_t nSum = 0;
+    vk::Timer timer;
+    for(int i=0; i<nPoints; ++i)
+    {
+        map<void*, size_t> copy = vMaps[i];
+        for(map<void*, size_t>::const_iterator it=copy.begin(); it!=copy.end(); ++it)
+            nSum += it->second;
+    }
+    const double tMap = timer.stop();
+    timer.start();
+    for(int i=0; i<nPoints; ++i)
+    {
+        SmallVector<Observation, 8> copy(vSmall[i]);
+        for(SmallVector<Observation, 8>::const_iterator it=copy.begin(); it!=copy.end(); ++it)
+            nSum -= it->nLeft;
+    }
+    const double tSmall = timer.stop();
+
+    cout << "copy and scan of " << nObs << " observations: std::map " << tMap*1e9/nPoints << " ns, SmallVector "
+         << tSmall*1e9/nPoints << " ns per point" << (nSum==0 ? "" : " (checksum mismatch)") << endl;
+}
+
+void BenchmarkUndistortion(const BenchmarkSettings&)
+{
+    vk::PinholeCamera cam(752, 480, 458.654, 457.296, 367.215, 248.375,
+                          -0.28340811, 0.07395907, 0.00019359, 1.76187114e-05);
+    cv::Mat K = (cv::Mat_<double>(3,3) << 458.654, 0, 367.215, 0, 457.296, 248.375, 0, 0, 1);
+    cv::Mat distCoef = (cv::Mat_<double>(4,1) << -0.28340811, 0.07395907, 0.00019359, 1.76187114e-05);
+    const int nRuns = 20;
+
+    cv::RNG rng(0);
+    vector<cv::KeyPoint> vKeys(2000);
+    cv::Mat points(vKeys.size(), 1, CV_32FC2);
+    for(size_t i=0; i<vKeys.size(); ++i)
+    {
+        vKeys[i].pt = cv::Point2f(rng.uniform(0.f, 752.f), rng.uniform(0.f, 480.f));
+        points.at<cv::Point2f>(i) = vKeys[i].pt;
+    }
+
+    vector<cv::KeyPoint> vKeysUn;
+    vk::Timer timer;
+    for(int r=0; r<nRuns; ++r)
+        cam.undistortKeyPoints(vKeys, vKeysUn);
+    const double tLut = timer.stop();
+    cv::Mat undistorted;
+    timer.start();
+    for(int r=0; r<nRuns; ++r)
+        cv::undistortPoints(points, undistorted, K, distCoef, cv::Mat(), K);
+    const double tIterative = timer.stop();
+
+    cout << "undistortion of " << vKeys.size() << " keypoints: lookup table " << tLut*1e6/nRuns
+         << " us, cv::undistortPoints " << tIterative*1e6/nRuns << " us" << endl;
+}
+
+void BenchmarkVocabularyLoading(const BenchmarkSettings& settings)
+{
+    const string strBase = settings.strVocFile.substr(0, settings.strVocFile.find_last_of('.'));
+    const char* extensions[] = {"txt", "bin", "yml"};
+    for(int e=0; e<3; ++e)
+    {
+        const string strFile = strBase + "." + extensions[e];
+        ORBVocabulary voc;
+        vk::Timer timer;
+        bool bLoaded;
+        if(e == 2)
+        {
+            cv::FileStorage fsVoc(strFile.c_str(), cv::FileStorage::READ);
+            bLoaded = fsVoc.isOpened();
+            if(bLoaded)
+                voc.load(fsVoc);
+        }
+        else
+            bLoaded = LoadVocabulary(voc, strFile);
+        const double dTime = timer.stop();
+        if(bLoaded)
+            cout << extensions[e] << " vocabulary load time " << dTime << " s" << endl;
+        else
+            cout << "Skip " << extensions[e] << " vocabulary, unable to open " << strFile << endl;
+    }
+}
+
+void BenchmarkVocabularyTransform(const BenchmarkSettings& settings)
+{
+    const ORBVocabulary* pVoc = GetVocabulary(settings.strVocFile);
+    if(!pVoc)
+        return;
+    const ORBVocabulary& voc = *pVoc;
+    ThreadPool pool(settings.nThreads);
+    const int nFrames = 100, nFeatures = 1000;
+    cv::RNG rng(3);
+    double dTime[3] = {0, 0, 0};
+    for(int f=0; f<nFrames; ++f)
+    {
+        cv::Mat descriptors(nFeatures, 32, CV_8U);
+        rng.fill(descriptors, cv::RNG::UNIFORM, 0, 256);
+        vector<cv::Mat> vDesc;
+        vDesc.reserve(descriptors.rows);
+        for(int j=0; j<descriptors.rows; ++j)
+            vDesc.push_back(descriptors.row(j));
+
+        DBoW2::BowVector bowVec;
+        DBoW2::FeatureVector featVec;
+        vk::Timer timer;
+        voc.transform(vDesc, bowVec, featVec, 4);
+        dTime[0] += timer.stop();
+        timer.start();
+        voc.transform(descriptors, bowVec, featVec, 4);
+        dTime[1] += timer.stop();
+        timer.start();
+        voc.transform(descriptors, bowVec, featVec, 4, &pool);
+        dTime[2] += timer.stop();
+    }
+    cout << nFeatures << " features per frame: DBoW2 " << dTime[0]*1e3/nFrames << " ms, flattened "
+         << dTime[1]*1e3/nFrames << " ms, flattened with " << pool.GetNumWorkers() << " threads "
+         << dTime[2]*1e3/nFrames << " ms" << endl;
+}
+
+void BenchmarkKeyFrameDatabase(const BenchmarkSettings& settings)
+{
+    const ORBVocabulary* pVoc = GetVocabulary(settings.strVocFile);
+    if(!pVoc)
+        return;
+    const ORBVocabulary& voc = *pVoc;
+    ThreadPool pool(settings.nThreads);
+
+    // 2000 keyframes of 300 random words, queried with half of the words of one of them and half random ones
+    cv::Mat image = NoiseImage(480, 752);
+    vk::PinholeCamera cam(image.cols, image.rows, 458.654, 457.296, 367.215, 248.375);
+    ORBextractor extractor(50, 1.2f, 8);
+    Frame frame(image, 0.0, &extractor, NULL, &cam);
+    const int nKeyFrames = 2000, nWords = 300, nQueries = 100;
+
+    Map map;
+    KeyFrameDatabase database(voc);
+    cv::RNG rng(1);
+    vector<KeyFrame*> vpKFs;
+    for(int i=0; i<nKeyFrames; ++i)
+    {
+        KeyFrame* pKF = new KeyFrame(frame, &map, &database);
+        pKF->mBowVec.clear();
+        for(int w=0; w<nWords; ++w)
+            pKF->mBowVec.addWeight(rng.uniform(0, (int)voc.size()), 1.0);
+        pKF->mBowVec.normalize(DBoW2::L1);
+        database.add(pKF);
+        vpKFs.push_back(pKF);
+    }
+
+    vector<Frame*> vpQueries;
+    for(int q=0; q<nQueries; ++q)
+    {
+        vpQueries.push_back(new Frame(frame));
+        const DBoW2::BowVector& bowKF = vpKFs[rng.uniform(0, nKeyFrames)]->mBowVec;
+        DBoW2::BowVector& bowVec = vpQueries[q]->mBowVec;
+        bowVec.clear();
+        int w = 0;
+        for(DBoW2::BowVector::const_iterator it=bowKF.begin(); it!=bowKF.end(); ++it, ++w)
+            bowVec.addWeight(w%2==0 ? it->first : rng.uniform(0, (int)voc.size()), 1.0);
+        bowVec.normalize(DBoW2::L1);
+    }
+
+    for(int p=0; p<2; ++p)
+    {
+        database.SetThreadPool(p==1 ? &pool : NULL);
+        size_t nCandidates = 0;
+        vk::Timer timer;
+        for(int q=0; q<nQueries; ++q)
+            nCandidates += database.DetectRelocalisationCandidates(vpQueries[q]).size();
+        cout << "relocalisation query among " << nKeyFrames << " keyframes" << (p==1 ? " on the pool: " : ": ")
+             << timer.stop()*1e3/nQueries << " ms, " << (double)nCandidates/nQueries << " candidates" << endl;
+    }
+    database.SetThreadPool(NULL);
+
+    for(size_t i=0; i<vpQueries.size(); ++i)
+        delete vpQueries[i];
+    for(size_t i=0; i<vpKFs.size(); ++i)
+        delete vpKFs[i];
+}
+
+struct Benchmark
+{
+    const char* name;
+    void (*Run)(const BenchmarkSettings&);
+    bool bNeedsVocabulary;
+};
+
+const Benchmark gBenchmarks[] = {
+    {"hamming", &BenchmarkHammingDistance, false},
+    {"orb", &BenchmarkORBKernels, false},
+    {"pyramid", &BenchmarkImagePyramid, false},
+    {"grid", &BenchmarkFrameGrid, false},
+    {"handoff", &BenchmarkFrameHandoff, false},
+    {"frustum", &BenchmarkFrustumCulling, false},
+    {"smallvector", &BenchmarkSmallVector, false},
+    {"undistortion", &BenchmarkUndistortion, false},
+    {"vocload", &BenchmarkVocabularyLoading, true},
+    {"transform", &BenchmarkVocabularyTransform, true},
+    {"kfdb", &BenchmarkKeyFrameDatabase, true}};
+
+int main(int argc, char **argv)
+{
+    const string strName = argc > 1 ? string(argv[1]) : "all";
+    BenchmarkSettings settings;
+    settings.strVocFile = argc > 2 ? string(argv[2]) : "";
+    settings.nThreads = argc > 3 ? atoi(argv[3]) : 4;
+    const bool bAll = strName == "all";
+    const size_t nBenchmarks = sizeof(gBenchmarks)/sizeof(gBenchmarks[0]);
+
+    bool bFound = false;
+    for(size_t i=0; i<nBenchmarks; ++i)
+    {
+        if(!bAll && strName != gBenchmarks[i].name)
+            continue;
+        bFound = true;
+        if(gBenchmarks[i].bNeedsVocabulary && settings.strVocFile.empty())
+        {
+            cerr << "Skip " << gBenchmarks[i].name << ", no vocabulary file given" << endl;
+            if(!bAll)
+                return 1;
+            continue;
+        }
+        gBenchmarks[i].Run(settings);
+    }
+
+    if(!bFound)
+    {
+        cerr << "Unknown benchmark " << strName << ", one of";
+        for(size_t i=0; i<nBenchmarks; ++i)
+            cerr << " " << gBenchmarks[i].name;
+        cerr << " or all. Usage: " << argv[0] << " [name|all] [path_to_ORBvoc.txt/bin] [number of threads]" << endl;
+        return 1;
+    }
+    return 0;
+}
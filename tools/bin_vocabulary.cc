@@ -0,0 +1,96 @@
+/**
+* This file is part of ORB-SLAM.
+*
+* ORB-SLAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Converts an ORB vocabulary in text (.txt) or cv::FileStorage (.yml) format
+// into the binary format which main.cc memory maps at startup.
+// Usage: bin_vocabulary <path_to_ORBvoc.txt/yml> [path_to_ORBvoc.bin]
+
+#include <iostream>
+#include <string>
+
+#include <vikit/timer.h>
+
+#include "ORBVocabulary.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <path_to_ORBvoc.txt/yml> [path_to_ORBvoc.bin]" << endl;
+        return 1;
+    }
+
+    string strVocFile = argv[1];
+    size_t found = strVocFile.find_last_of('.');
+    string extension = strVocFile.substr(found+1);
+    string strBinFile = argc > 2 ? string(argv[2]) : strVocFile.substr(0, found) + ".bin";
+
+    ORB_SLAM::ORBVocabulary Vocabulary;
+    vk::Timer timer;
+    if(extension == "yml" || extension == "YML")
+    {
+        cv::FileStorage fsVoc(strVocFile.c_str(), cv::FileStorage::READ);
+        if(!fsVoc.isOpened())
+        {
+            cerr << "Failed to open at: " << strVocFile << endl;
+            return 1;
+        }
+        Vocabulary.load(fsVoc);
+    }
+    else if(extension == "txt" || extension == "TXT")
+    {
+        if(!Vocabulary.loadFromTextFile(strVocFile))
+        {
+            cerr << "Failed to open at: " << strVocFile << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cerr << "Unknown vocabulary extension " << extension << endl;
+        return 1;
+    }
+    cout << "Loaded " << Vocabulary << " in " << timer.stop() << " s" << endl;
+
+    if(!Vocabulary.saveToBinaryFile(strBinFile))
+    {
+        cerr << "Failed to write binary vocabulary to " << strBinFile << endl;
+        return 1;
+    }
+    cout << "Saved binary vocabulary to " << strBinFile << endl;
+
+    // check that the binary file reproduces the words of the source vocabulary
+    ORB_SLAM::ORBVocabulary BinVocabulary;
+    if(!BinVocabulary.loadFromBinaryFile(strBinFile) || BinVocabulary.size() != Vocabulary.size())
+    {
+        cerr << "Failed to reload binary vocabulary from " << strBinFile << endl;
+        return 1;
+    }
+    for(unsigned int i = 0; i < Vocabulary.size(); ++i)
+    {
+        if(DBoW2::FORB::distance(Vocabulary.getWord(i), BinVocabulary.getWord(i)) != 0 ||
+                Vocabulary.getWordWeight(i) != BinVocabulary.getWordWeight(i))
+        {
+            cerr << "Binary vocabulary differs from the source at word " << i << endl;
+            return 1;
+        }
+    }
+    cout << "Binary vocabulary verified." << endl;
+    return 0;
+}